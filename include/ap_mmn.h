@@ -524,6 +524,30 @@
  *                         to struct proxy_{worker,balancer} in mod_proxy.h,
  *                         and optional ssl_engine_set() to mod_ssl.h.
  * 20160315.3 (2.5.0-dev)  Add childtags to dav_error.
+ * 20160315.4 (2.5.0-dev)  Add windex to proxy_server_conf and proxy_balancer
+ *                         in mod_proxy.h, and ap_proxy_index_workers().
+ * 20160315.5 (2.5.0-dev)  Add AP_REG_JIT, AP_REG_DEFAULT,
+ *                         ap_regcomp_get_default_cflags(),
+ *                         ap_regcomp_set_default_cflags(),
+ *                         ap_regcomp_default_cflag_by_name() and
+ *                         ap_regex_init() to ap_regex.h.
+ * 20160315.6 (2.5.0-dev)  Add ap_escape_logitem_buffer() to httpd.h.
+ * 20160315.7 (2.5.0-dev)  Add AP_CLF_DATE_LEN and ap_recent_clf_date() to
+ *                         util_time.h.
+ * 20160315.8 (2.5.0-dev)  Add lingering_normal, lingering_short,
+ *                         timeouts_expired and timeouts_usecs to
+ *                         process_score.
+ * 20160315.9 (2.5.0-dev)  Add ap_vhost_find_given_conn() to http_vhost.h.
+ * 20160315.10 (2.5.0-dev) Add ap_mpm_register_output_callback() and
+ *                         hook mpm_register_output_callback.
+ * 20160315.11 (2.5.0-dev) Add ap_mpm_register_input_callback(), hook
+ *                         mpm_register_input_callback,
+ *                         ap_read_request_body() and
+ *                         ap_finish_suspended_request().
+ * 20160315.12 (2.5.0-dev) Add ap_walk_cache_child_init(), walk_cache_hits
+ *                         and walk_cache_misses to worker_score.
+ * 20160315.13 (2.5.0-dev) Add ap_htaccess_cache_child_init() and
+ *                         ap_htaccess_cache_hold().
  */
 
 #define MODULE_MAGIC_COOKIE 0x41503235UL /* "AP25" */
@@ -531,7 +555,7 @@
 #ifndef MODULE_MAGIC_NUMBER_MAJOR
 #define MODULE_MAGIC_NUMBER_MAJOR 20160315
 #endif
-#define MODULE_MAGIC_NUMBER_MINOR 3                 /* 0...n */
+#define MODULE_MAGIC_NUMBER_MINOR 13                 /* 0...n */
 
 /**
  * Determine if the server's current MODULE_MAGIC_NUMBER is at least a
@@ -203,6 +203,43 @@ typedef void (ap_mpm_callback_fn_t)(void *baton);
 
 /* only added support in the Event MPM....  check for APR_ENOTIMPL */
 AP_DECLARE(apr_status_t) ap_mpm_resume_suspended(conn_rec *c);
+/**
+ * Register a callback to continue a suspended request once the output
+ * pending for its connection has been written.
+ * @param c The connection of the request
+ * @param cbfn The callback function
+ * @param baton userdata for the callback function
+ * @return APR_SUCCESS, or APR_ENOTIMPL if no asynch support.
+ * @remark This is for a handler which should yield (see
+ * ap_filter_should_yield()) rather than block on a slow client: it
+ * registers the callback and returns SUSPENDED, then the MPM writes the
+ * output when the connection is writable (see ap_filter_output_pending()),
+ * and calls cbfn in a worker thread when there is nothing left.  The
+ * callback either finishes the request (ap_process_request_after_handler())
+ * or yields again, without calling ap_mpm_resume_suspended().
+ * @remark From another callback (e.g. a timed one), the connection must
+ * be resumed with ap_mpm_resume_suspended() after this call.
+ * @remark If the connection times out or is aborted meanwhile, it's closed
+ * and the callback is never called.
+ */
+AP_DECLARE(apr_status_t) ap_mpm_register_output_callback(conn_rec *c,
+        ap_mpm_callback_fn_t *cbfn, void *baton);
+
+/**
+ * Register a callback to continue a suspended request once there is
+ * something to read on its connection.
+ * @param c The connection of the request
+ * @param cbfn The callback function
+ * @param baton userdata for the callback function
+ * @return APR_SUCCESS, or APR_ENOTIMPL if no asynch support.
+ * @remark This is the input counterpart of ap_mpm_register_output_callback(),
+ * for a handler whose non-blocking read of the request body would block
+ * (see ap_read_request_body()), with the same rules.  The pending output
+ * is written first, and the callback is called when the connection is
+ * readable, or some data are already available in the input filters.
+ */
+AP_DECLARE(apr_status_t) ap_mpm_register_input_callback(conn_rec *c,
+        ap_mpm_callback_fn_t *cbfn, void *baton);
 /* only added support in the Event MPM....  check for APR_ENOTIMPL */
 AP_DECLARE(apr_status_t) ap_mpm_register_timed_callback(
         apr_time_t t, ap_mpm_callback_fn_t *cbfn, void *baton);
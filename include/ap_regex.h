@@ -76,6 +76,11 @@ extern "C" {
 #define AP_REG_MULTI    0x10 /**< perl's /g (needs fixing) */
 #define AP_REG_NOMEM    0x20 /**< nomem in our code */
 #define AP_REG_DOTALL   0x40 /**< perl's /s flag */
+#define AP_REG_JIT      0x80 /**< JIT compile the regex, if PCRE can */
+
+/** The default options added to the ones given to ap_regcomp(), unless
+ * changed by RegexDefaultOptions */
+#define AP_REG_DEFAULT  (AP_REG_JIT)
 
 #define AP_REG_MATCH "MATCH_" /**< suggested prefix for ap_regname */
 
@@ -95,7 +100,7 @@ enum {
 
 /* The structure representing a compiled regular expression. */
 typedef struct {
-    void *re_pcre;
+    void *re_pcre;          /* opaque, private to util_pcre.c */
     int re_nsub;
     apr_size_t re_erroffset;
 } ap_regex_t;
@@ -121,12 +126,41 @@ AP_DECLARE(const char *) ap_pcre_version_string(int which);
  * Compile a regular expression.
  * @param preg Returned compiled regex
  * @param regex The regular expression string
- * @param cflags Bitwise OR of AP_REG_* flags (ICASE and NEWLINE supported,
- *                                             other flags are ignored)
+ * @param cflags Bitwise OR of AP_REG_* flags (ICASE, NEWLINE, DOTALL and
+ *               JIT supported, other flags are ignored), the default
+ *               flags (see ap_regcomp_get_default_cflags()) are added
  * @return Zero on success or non-zero on error
  */
 AP_DECLARE(int) ap_regcomp(ap_regex_t *preg, const char *regex, int cflags);
 
+/**
+ * Get the default compile flags, added to the ones given to ap_regcomp().
+ * @return Bitwise OR of AP_REG_* flags
+ */
+AP_DECLARE(int) ap_regcomp_get_default_cflags(void);
+
+/**
+ * Set the default compile flags, added to the ones given to ap_regcomp().
+ * @param cflags Bitwise OR of AP_REG_* flags
+ */
+AP_DECLARE(void) ap_regcomp_set_default_cflags(int cflags);
+
+/**
+ * Get the AP_REG_* flag corresponding to the name of a default option
+ * (as used by RegexDefaultOptions).
+ * @param name The name (case-insensitive), e.g. "JIT"
+ * @return The flag, or 0 if unknown
+ */
+AP_DECLARE(int) ap_regcomp_default_cflag_by_name(const char *name);
+
+/**
+ * Set up the per-thread match data (ovectors and JIT stacks) reused by
+ * ap_regexec(), without which every match uses its own.
+ * @param p The pool whose lifetime bounds the per-thread data
+ * @return APR_SUCCESS, or the error which prevented the setup
+ */
+AP_DECLARE(apr_status_t) ap_regex_init(apr_pool_t *p);
+
 /**
  * Match a NUL-terminated string against a pre-compiled regex.
  * @param preg The pre-compiled regex
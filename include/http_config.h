@@ -1126,6 +1126,30 @@ AP_CORE_DECLARE(int) ap_parse_htaccess(ap_conf_vector_t **result,
                                        const char *path,
                                        const char *access_name);
 
+/**
+ * Set up the cache of the .htaccess files parsed by the previous requests
+ * (see HtaccessCacheSize)
+ * @param pchild The child pool
+ * @param max The maximum number of directories cached, 0 to disable it
+ * @param negative_ttl How long the directories without .htaccess are
+ * cached, 0 to not cache them
+ */
+AP_CORE_DECLARE(void) ap_htaccess_cache_child_init(apr_pool_t *pchild,
+                                                   int max,
+                                                   apr_interval_time_t
+                                                       negative_ttl);
+
+/**
+ * Hold a configuration returned by ap_parse_htaccess(), if it comes from
+ * the cache of the parsed .htaccess files, until the given pool is cleared
+ * @param htaccess The configuration
+ * @param p The pool, or NULL to only check where it comes from
+ * @return Whether it comes from the cache (otherwise it lives as long as
+ * the request)
+ */
+AP_CORE_DECLARE(int) ap_htaccess_cache_hold(ap_conf_vector_t *htaccess,
+                                            apr_pool_t *p);
+
 /**
  * Setup a virtual host
  * @param p The pool to allocate all memory from
@@ -49,6 +49,7 @@
 
 #include "apr_optional.h"
 #include "util_filter.h"
+#include "ap_mpm.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -240,6 +241,15 @@ AP_DECLARE(void) ap_clear_auth_internal(void);
  */
 AP_DECLARE(void) ap_setup_auth_internal(apr_pool_t *ptemp);
 
+/**
+ * Set up the cache of the directory and location walks of the previous
+ * requests, which lets new requests reuse their merged configurations
+ * (see WalkCacheSize)
+ * @param pchild The child pool
+ * @param max The maximum number of walks cached, 0 to disable it
+ */
+AP_DECLARE(void) ap_walk_cache_child_init(apr_pool_t *pchild, int max);
+
 /**
  * Register an authentication or authorization provider with the global
  * provider pool.
@@ -335,6 +345,41 @@ AP_DECLARE(void) ap_process_request(request_rec *r);
  */
 AP_DECLARE(void) ap_process_request_after_handler(request_rec *r);
 
+/**
+ * Finish a request whose handler returned SUSPENDED, like
+ * ap_process_async_request() does when a handler returns
+ * @param r The current request
+ * @param status The status the handler would have returned: OK, DONE or
+ * an HTTP error
+ * @remark As for ap_process_request_after_handler(), r must not be used
+ * after this call.
+ */
+AP_DECLARE(void) ap_finish_suspended_request(request_rec *r, int status);
+
+/**
+ * Read some of the request body without blocking, for a handler which can
+ * yield until more is available
+ * @param r The current request
+ * @param bb The brigade to fill
+ * @param readbytes The maximum number of bytes to read
+ * @param cbfn The callback function, or NULL to block
+ * @param baton userdata for the callback function
+ * @return APR_SUCCESS with some data and/or EOS in bb, APR_EAGAIN if
+ * nothing is available yet, or an error
+ * @remark On APR_EAGAIN, cbfn was registered with
+ * ap_mpm_register_input_callback(), so the handler returns SUSPENDED (or
+ * its callback returns without finishing the request) and cbfn is called
+ * when there is more to read.  If the MPM can't do that, or for a
+ * subrequest or an internally redirected request (whose SUSPENDED return
+ * ap_internal_redirect() can't handle), this function blocks like
+ * ap_get_brigade().
+ */
+AP_DECLARE(apr_status_t) ap_read_request_body(request_rec *r,
+                                              apr_bucket_brigade *bb,
+                                              apr_off_t readbytes,
+                                              ap_mpm_callback_fn_t *cbfn,
+                                              void *baton);
+
 /**
  * Process a top-level request from a client, allowing some or all of
  * the response to remain buffered in the core output filter for later,
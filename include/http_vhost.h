@@ -86,6 +86,18 @@ AP_DECLARE(int) ap_vhost_iterate_given_conn(conn_rec *conn,
                                             ap_vhost_iterate_conn_cb func_cb,
                                             void* baton);
 
+/**
+ * Find the first virtual host on this connection whose ServerName or
+ * ServerAlias matches the given host, as ap_vhost_iterate_given_conn()
+ * would with a callback comparing the names, but without walking all
+ * the name-based virtual hosts of the address when they are many.
+ * @param conn The current connection
+ * @param host The host name to look for
+ * @return The server found, or NULL if none matches
+ */
+AP_DECLARE(server_rec *) ap_vhost_find_given_conn(conn_rec *conn,
+                                                  const char *host);
+
 /**
  * given an ip address only, give our best guess as to what vhost it is
  * @param conn The current connection
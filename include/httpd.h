@@ -1824,6 +1824,18 @@ AP_DECLARE(apr_size_t) ap_escape_errorlog_item(char *dest, const char *source,
                                                apr_size_t buflen)
                        AP_FN_ATTR_NONNULL((1));
 
+/**
+ * Escape a string for logging, like ap_escape_logitem(), into a buffer
+ * @param dest The buffer to write to
+ * @param source The string to escape
+ * @param buflen The buffer size for the escaped string (including "\0"),
+ *               which is never truncated if at least 4 * strlen(source) + 1
+ * @return The len of the escaped string (always < buflen)
+ */
+AP_DECLARE(apr_size_t) ap_escape_logitem_buffer(char *dest, const char *source,
+                                                apr_size_t buflen)
+                       AP_FN_ATTR_NONNULL((1));
+
 /**
  * Construct a full hostname
  * @param p The pool to allocate from
@@ -452,6 +452,22 @@ AP_DECLARE_HOOK(apr_status_t, mpm_unregister_poll_callback,
  */
 AP_DECLARE_HOOK(apr_status_t, mpm_resume_suspended, (conn_rec*))
 
+/**
+ * Continue the suspended request once the output of its connection
+ * is written
+ * @ingroup hooks
+ */
+AP_DECLARE_HOOK(apr_status_t, mpm_register_output_callback,
+                (conn_rec *c, ap_mpm_callback_fn_t *cbfn, void *baton))
+
+/**
+ * Continue the suspended request once there is something to read on its
+ * connection
+ * @ingroup hooks
+ */
+AP_DECLARE_HOOK(apr_status_t, mpm_register_input_callback,
+                (conn_rec *c, ap_mpm_callback_fn_t *cbfn, void *baton))
+
 /**
  * Get MPM name (e.g., "prefork" or "event")
  * @ingroup hooks
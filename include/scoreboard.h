@@ -116,6 +116,9 @@ struct worker_score {
     char request[64];           /* We just want an idea... */
     char vhost[32];             /* What virtual host is being accessed? */
     char protocol[16];          /* What protocol is used on the connection? */
+    unsigned long walk_cache_hits;   /* walks reusing the merges of a
+                                      * previous request */
+    unsigned long walk_cache_misses; /* walks which couldn't */
 };
 
 typedef struct {
@@ -144,6 +147,13 @@ struct process_score {
     apr_uint32_t keep_alive;        /* async connections in keep alive */
     apr_uint32_t suspended;         /* connections suspended by some module */
     int bucket;             /* Listener bucket used by this child */
+    apr_uint32_t lingering_normal;  /* async connections in the lingering
+                                     * close queue */
+    apr_uint32_t lingering_short;   /* async connections in the short
+                                     * lingering close queue */
+    apr_uint64_t timeouts_expired;  /* async connections expired from the
+                                     * timeout queues */
+    apr_uint64_t timeouts_usecs;    /* time spent expiring them */
 };
 
 /* Scoreboard is now in 'local' memory, since it isn't updated once created,
@@ -612,7 +612,9 @@ AP_DECLARE(apr_status_t) ap_filter_reinstate_brigade(ap_filter_t *f,
  * downstream might block, and so defer the passing of brigades
  * downstream with ap_filter_setaside_brigade().
  *
- * This function can be called safely from a handler.
+ * This function can be called safely from a handler. Rather than
+ * blocking when it returns non zero, a handler can have the MPM write its
+ * output and call it back, see ap_mpm_register_output_callback().
  */
 AP_DECLARE(int) ap_filter_should_yield(ap_filter_t *f);
 
@@ -48,6 +48,9 @@ extern "C" {
 /* Use more compact ISO 8601 format */
 #define AP_CTIME_OPTION_COMPACT 0x2
 
+/* Length of a Common Log Format timestamp, including the trailing \0 */
+#define AP_CLF_DATE_LEN 29
+
 
 /**
  * convert a recent time to its human readable components in local timezone
@@ -109,6 +112,16 @@ AP_DECLARE(apr_status_t) ap_recent_ctime_ex(char *date_str, apr_time_t t,
  */
 AP_DECLARE(apr_status_t) ap_recent_rfc822_date(char *date_str, apr_time_t t);
 
+/**
+ * format a recent timestamp in the Common Log Format, in local time,
+ * e.g. "[08/Jan/2000:18:31:41 +0100]"
+ * @param date_str String to write to (must have length >= AP_CLF_DATE_LEN)
+ * @param t the time to convert
+ * @note The formatted strings of the recent seconds are cached, as well
+ *       as the ones of ap_recent_ctime_ex() and ap_recent_rfc822_date().
+ */
+AP_DECLARE(apr_status_t) ap_recent_clf_date(char *date_str, apr_time_t t);
+
 /**
  * Force an unset TZ to UTC
  * @param p the pool to use
@@ -126,6 +126,13 @@ typedef struct cache_socache_dir_conf
 static const char * const cache_socache_id = "cache-socache";
 static apr_global_mutex_t *socache_mutex = NULL;
 
+/* Whether the socache provider of 'conf' needs socache_mutex, or does its
+ * own locking.
+ */
+#define SOCACHE_NEEDS_LOCK(conf) \
+    (socache_mutex && ((conf)->provider->socache_provider->flags \
+                       & AP_SOCACHE_FLAG_NOTMPSAFE))
+
 /*
  * Local static functions
  */
@@ -466,7 +473,7 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
     sobj->buffer_len = dconf->max;
 
     /* attempt to retrieve the cached entry */
-    if (socache_mutex) {
+    if (SOCACHE_NEEDS_LOCK(conf)) {
         apr_status_t status = apr_global_mutex_lock(socache_mutex);
         if (status != APR_SUCCESS) {
             ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02350)
@@ -480,7 +487,7 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
     rc = conf->provider->socache_provider->retrieve(
             conf->provider->socache_instance, r->server, (unsigned char *) key,
             strlen(key), sobj->buffer, &buffer_len, r->pool);
-    if (socache_mutex) {
+    if (SOCACHE_NEEDS_LOCK(conf)) {
         apr_status_t status = apr_global_mutex_unlock(socache_mutex);
         if (status != APR_SUCCESS) {
             ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02351)
@@ -529,7 +536,7 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
         nkey = regen_key(r->pool, r->headers_in, varray, key);
 
         /* attempt to retrieve the cached entry */
-        if (socache_mutex) {
+        if (SOCACHE_NEEDS_LOCK(conf)) {
             apr_status_t status = apr_global_mutex_lock(socache_mutex);
             if (status != APR_SUCCESS) {
                 ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02355)
@@ -544,7 +551,7 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
                 conf->provider->socache_instance, r->server,
                 (unsigned char *) nkey, strlen(nkey), sobj->buffer,
                 &buffer_len, r->pool);
-        if (socache_mutex) {
+        if (SOCACHE_NEEDS_LOCK(conf)) {
             apr_status_t status = apr_global_mutex_unlock(socache_mutex);
             if (status != APR_SUCCESS) {
                 ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02356)
@@ -684,7 +691,7 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
     return OK;
 
 fail:
-    if (socache_mutex) {
+    if (SOCACHE_NEEDS_LOCK(conf)) {
         apr_status_t status = apr_global_mutex_lock(socache_mutex);
         if (status != APR_SUCCESS) {
             ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02366)
@@ -697,7 +704,7 @@ fail:
     conf->provider->socache_provider->remove(
             conf->provider->socache_instance, r->server,
             (unsigned char *) nkey, strlen(nkey), r->pool);
-    if (socache_mutex) {
+    if (SOCACHE_NEEDS_LOCK(conf)) {
         apr_status_t status = apr_global_mutex_unlock(socache_mutex);
         if (status != APR_SUCCESS) {
             ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02367)
@@ -728,7 +735,7 @@ static int remove_url(cache_handle_t *h, request_rec *r)
     }
 
     /* Remove the key from the cache */
-    if (socache_mutex) {
+    if (SOCACHE_NEEDS_LOCK(conf)) {
         apr_status_t status = apr_global_mutex_lock(socache_mutex);
         if (status != APR_SUCCESS) {
             ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02368)
@@ -740,7 +747,7 @@ static int remove_url(cache_handle_t *h, request_rec *r)
     }
     conf->provider->socache_provider->remove(conf->provider->socache_instance,
             r->server, (unsigned char *) sobj->key, strlen(sobj->key), r->pool);
-    if (socache_mutex) {
+    if (SOCACHE_NEEDS_LOCK(conf)) {
         apr_status_t status = apr_global_mutex_unlock(socache_mutex);
         if (status != APR_SUCCESS) {
             ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02369)
@@ -838,7 +845,7 @@ static apr_status_t store_headers(cache_handle_t *h, request_rec *r,
                 sobj->pool = NULL;
                 return rv;
             }
-            if (socache_mutex) {
+            if (SOCACHE_NEEDS_LOCK(conf)) {
                 apr_status_t status = apr_global_mutex_lock(socache_mutex);
                 if (status != APR_SUCCESS) {
                     ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02371)
@@ -853,7 +860,7 @@ static apr_status_t store_headers(cache_handle_t *h, request_rec *r,
                     (unsigned char *) obj->key, strlen(obj->key), sobj->expire,
                     (unsigned char *) sobj->buffer, (unsigned int) slider,
                     sobj->pool);
-            if (socache_mutex) {
+            if (SOCACHE_NEEDS_LOCK(conf)) {
                 apr_status_t status = apr_global_mutex_unlock(socache_mutex);
                 if (status != APR_SUCCESS) {
                     ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02372)
@@ -1089,7 +1096,7 @@ static apr_status_t commit_entity(cache_handle_t *h, request_rec *r)
     cache_socache_object_t *sobj = (cache_socache_object_t *) obj->vobj;
     apr_status_t rv;
 
-    if (socache_mutex) {
+    if (SOCACHE_NEEDS_LOCK(conf)) {
         apr_status_t status = apr_global_mutex_lock(socache_mutex);
         if (status != APR_SUCCESS) {
             ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02384)
@@ -1103,7 +1110,7 @@ static apr_status_t commit_entity(cache_handle_t *h, request_rec *r)
             conf->provider->socache_instance, r->server,
             (unsigned char *) sobj->key, strlen(sobj->key), sobj->expire,
             sobj->buffer, sobj->body_offset + sobj->body_length, sobj->pool);
-    if (socache_mutex) {
+    if (SOCACHE_NEEDS_LOCK(conf)) {
         apr_status_t status = apr_global_mutex_unlock(socache_mutex);
         if (status != APR_SUCCESS) {
             ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02385)
@@ -1132,7 +1139,7 @@ fail:
     /* For safety, remove any existing entry on failure, just in case it could not
      * be revalidated successfully.
      */
-    if (socache_mutex) {
+    if (SOCACHE_NEEDS_LOCK(conf)) {
         apr_status_t status = apr_global_mutex_lock(socache_mutex);
         if (status != APR_SUCCESS) {
             ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02388)
@@ -1144,7 +1151,7 @@ fail:
     }
     conf->provider->socache_provider->remove(conf->provider->socache_instance,
             r->server, (unsigned char *) sobj->key, strlen(sobj->key), r->pool);
-    if (socache_mutex) {
+    if (SOCACHE_NEEDS_LOCK(conf)) {
         apr_status_t status = apr_global_mutex_unlock(socache_mutex);
         if (status != APR_SUCCESS) {
             ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02389)
@@ -1371,7 +1378,7 @@ static int socache_status_hook(request_rec *r, int flags)
         ap_rputs("ModCacheSocacheStatus\n", r);
     }
 
-    if (socache_mutex) {
+    if (SOCACHE_NEEDS_LOCK(conf)) {
         status = apr_global_mutex_lock(socache_mutex);
         if (status != APR_SUCCESS) {
             ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02816)
@@ -1391,7 +1398,7 @@ static int socache_status_hook(request_rec *r, int flags)
                                                  r, flags);
     }
 
-    if (socache_mutex && status == APR_SUCCESS) {
+    if (SOCACHE_NEEDS_LOCK(conf) && status == APR_SUCCESS) {
         status = apr_global_mutex_unlock(socache_mutex);
         if (status != APR_SUCCESS) {
             ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(02817)
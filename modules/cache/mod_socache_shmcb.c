@@ -20,11 +20,13 @@
 #include "http_protocol.h"
 #include "http_config.h"
 #include "mod_status.h"
+#include "util_mutex.h"
 
 #include "apr.h"
 #include "apr_strings.h"
 #include "apr_time.h"
 #include "apr_shm.h"
+#include "apr_global_mutex.h"
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
 #include "apr_general.h"
@@ -48,6 +50,12 @@
 
 #define DEFAULT_SHMCB_SUFFIX ".cache"
 
+/* The mutex type of the "shmcb-mt" provider's locks, and their maximum
+ * number per instance (subcache N uses lock N % nlocks).
+ */
+#define SHMCB_MUTEX_TYPE "socache-shmcb"
+#define SHMCB_MAX_LOCKS 32
+
 #define ALIGNED_HEADER_SIZE APR_ALIGN_DEFAULT(sizeof(SHMCBHeader))
 #define ALIGNED_SUBCACHE_SIZE APR_ALIGN_DEFAULT(sizeof(SHMCBSubcache))
 #define ALIGNED_INDEX_SIZE APR_ALIGN_DEFAULT(sizeof(SHMCBIndex))
@@ -56,19 +64,12 @@
  * Header structure - the start of the shared-mem segment
  */
 typedef struct {
-    /* Stats for cache operations */
-    unsigned long stat_stores;
-    unsigned long stat_replaced;
-    unsigned long stat_expiries;
-    unsigned long stat_scrolled;
-    unsigned long stat_retrieves_hit;
-    unsigned long stat_retrieves_miss;
-    unsigned long stat_removes_hit;
-    unsigned long stat_removes_miss;
     /* Number of subcaches */
     unsigned int subcache_num;
     /* How many indexes each subcache's queue has */
     unsigned int index_num;
+    /* How many slots each subcache's hash table has (a power of 2) */
+    unsigned int hash_num;
     /* How large each subcache is, including the queue and data */
     unsigned int subcache_size;
     /* How far into each subcache the data area is (optimisation) */
@@ -79,13 +80,23 @@ typedef struct {
 
 /*
  * Subcache structure - the start of each subcache, followed by
- * indexes then data
+ * indexes, hash slots then data
  */
 typedef struct {
     /* The start position and length of the cyclic buffer of indexes */
     unsigned int idx_pos, idx_used;
     /* Same for the data area */
     unsigned int data_pos, data_used;
+    /* Stats for cache operations, summed up by the status (each subcache
+     * has its own, updated under its lock with "shmcb-mt") */
+    unsigned long stat_stores;
+    unsigned long stat_replaced;
+    unsigned long stat_expiries;
+    unsigned long stat_scrolled;
+    unsigned long stat_retrieves_hit;
+    unsigned long stat_retrieves_miss;
+    unsigned long stat_removes_hit;
+    unsigned long stat_removes_miss;
 } SHMCBSubcache;
 
 /*
@@ -100,6 +111,8 @@ typedef struct {
     unsigned int data_used;
     /* length of the used data which contains the id */
     unsigned int id_len;
+    /* hash of the id, see shmcb_hash() */
+    unsigned int id_hash;
     /* Used to mark explicitly-removed socache entries */
     unsigned char removed;
 } SHMCBIndex;
@@ -109,8 +122,15 @@ struct ap_socache_instance_t {
     apr_size_t shm_size;
     apr_shm_t *shm;
     SHMCBHeader *header;
+    /* "shmcb-mt": the locks striped over the subcaches */
+    int locked;
+    apr_global_mutex_t **locks;
+    unsigned int nlocks;
 };
 
+/* The "shmcb-mt" instances, for their locks' child_init */
+static apr_array_header_t *locked_instances;
+
 /* The SHM data segment is of fixed size and stores data as follows.
  *
  *   [ SHMCBHeader | Subcaches ]
@@ -123,7 +143,7 @@ struct ap_socache_instance_t {
  * SHMCBSubcache structure has a fixed size (header->subcache_size),
  * which is determined at creation time, and looks like the following:
  *
- *   [ SHMCBSubcache | Indexes | Data ]
+ *   [ SHMCBSubcache | Indexes | Hashes | Data ]
  *
  * Each subcache is prefixed by the SHMCBSubcache structure.
  *
@@ -138,6 +158,13 @@ struct ap_socache_instance_t {
  * index of the first in use, subcache->idx_used gives the number in
  * use.  Both ->idx_* values have a range of [0, header->index_num)
  *
+ * "Hashes" is an open addressed (linear probing) hash table of
+ * header->hash_num slots, at least twice as many as indexes, which
+ * refers to the in-use and not removed SHMCBIndex structures by their
+ * position + 1 (0 is an empty slot).  Since the id hash is stored in
+ * each index, lookups compare the id bytes of the matching hashes only,
+ * and deletions can move the following slots back (no tombstones).
+ *
  * Each in-use SHMCBIndex structure represents a single cached object.
  * The ID and data segment are stored consecutively in the subcache's
  * cyclic data buffer.  The "Data" segment can thus be seen to
@@ -160,10 +187,15 @@ struct ap_socache_instance_t {
                         ALIGNED_HEADER_SIZE + \
                         (num) * ((pHeader)->subcache_size))
 
+/* This macro takes a pointer to the header and an id and returns the
+ * zero-based index of the corresponding subcache. */
+#define SHMCB_SUBCACHE_NUM(pHeader, id) \
+                (*(id) & ((pHeader)->subcache_num - 1))
+
 /* This macro takes a pointer to the header and an id and returns a
  * pointer to the corresponding subcache. */
 #define SHMCB_MASK(pHeader, id) \
-                SHMCB_SUBCACHE((pHeader), *(id) & ((pHeader)->subcache_num - 1))
+                SHMCB_SUBCACHE((pHeader), SHMCB_SUBCACHE_NUM((pHeader), (id)))
 
 /* This macro takes the same params as the last, generating two outputs for use
  * in ap_log_error(...). */
@@ -177,6 +209,13 @@ struct ap_socache_instance_t {
                         ALIGNED_SUBCACHE_SIZE + \
                         (num) * ALIGNED_INDEX_SIZE)
 
+/* This macro takes a pointer to the header and a subcache and returns a
+ * pointer to the corresponding hash slots. */
+#define SHMCB_HASHES(pHeader, pSubcache) \
+                (unsigned int *)(((unsigned char *)(pSubcache)) + \
+                        ALIGNED_SUBCACHE_SIZE + \
+                        (pHeader)->index_num * ALIGNED_INDEX_SIZE)
+
 /* This macro takes a pointer to the header and a subcache and returns a
  * pointer to the corresponding data area. */
 #define SHMCB_DATA(pHeader, pSubcache) \
@@ -281,6 +320,42 @@ static apr_status_t shmcb_subcache_iterate(ap_socache_instance_t *instance,
                                            apr_pool_t *pool,
                                            apr_time_t now);
 
+/* With "shmcb-mt", lock/unlock the lock of subcache 'num' (no-ops
+ * otherwise, the consumers then serialize the accesses).
+ */
+static apr_status_t shmcb_lock(ap_socache_instance_t *ctx, server_rec *s,
+                               unsigned int num)
+{
+    apr_status_t rv;
+
+    if (!ctx->locked) {
+        return APR_SUCCESS;
+    }
+    rv = apr_global_mutex_lock(ctx->locks[num % ctx->nlocks]);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(03398)
+                     "Failed to acquire shmcb socache lock %u",
+                     num % ctx->nlocks);
+    }
+    return rv;
+}
+
+static void shmcb_unlock(ap_socache_instance_t *ctx, server_rec *s,
+                         unsigned int num)
+{
+    apr_status_t rv;
+
+    if (!ctx->locked) {
+        return;
+    }
+    rv = apr_global_mutex_unlock(ctx->locks[num % ctx->nlocks]);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(03399)
+                     "Failed to release shmcb socache lock %u",
+                     num % ctx->nlocks);
+    }
+}
+
 /*
  * High-Level "handlers" as per ssl_scache.c
  * subcache internals are deferred to shmcb_subcache_*** functions lower down
@@ -340,6 +415,22 @@ static const char *socache_shmcb_create(ap_socache_instance_t **context,
     return NULL;
 }
 
+/* "shmcb-mt" is "shmcb" with a lock per subcache (striped over at most
+ * SHMCB_MAX_LOCKS mutexes), so that the consumers need no lock of their
+ * own around the whole cache.
+ */
+static const char *socache_shmcb_mt_create(ap_socache_instance_t **context,
+                                           const char *arg,
+                                           apr_pool_t *tmp, apr_pool_t *p)
+{
+    const char *err = socache_shmcb_create(context, arg, tmp, p);
+
+    if (!err) {
+        (*context)->locked = 1;
+    }
+    return err;
+}
+
 static apr_status_t socache_shmcb_init(ap_socache_instance_t *ctx,
                                        const char *namespace,
                                        const struct ap_socache_hints *hints,
@@ -349,7 +440,7 @@ static apr_status_t socache_shmcb_init(ap_socache_instance_t *ctx,
     apr_size_t shm_segsize;
     apr_status_t rv;
     SHMCBHeader *header;
-    unsigned int num_subcache, num_idx, loop;
+    unsigned int num_subcache, num_idx, num_hash, loop;
     apr_size_t avg_obj_size, avg_id_len;
 
     /* Create shared memory segment */
@@ -421,16 +512,10 @@ static apr_status_t socache_shmcb_init(ap_socache_instance_t *ctx,
                      "shared memory segment too small");
         return APR_ENOSPC;
     }
+    for (num_hash = 1; num_hash < 2 * num_idx; num_hash <<= 1)
+        ;
     /* OK, we're sorted */
     ctx->header = header = shm_segment;
-    header->stat_stores = 0;
-    header->stat_replaced = 0;
-    header->stat_expiries = 0;
-    header->stat_scrolled = 0;
-    header->stat_retrieves_hit = 0;
-    header->stat_retrieves_miss = 0;
-    header->stat_removes_hit = 0;
-    header->stat_removes_miss = 0;
     header->subcache_num = num_subcache;
     /* Convert the subcache size (in bytes) to a value that is suitable for
      * structure alignment on the host platform, by rounding down if necessary. */
@@ -440,10 +525,18 @@ static apr_status_t socache_shmcb_init(ap_socache_instance_t *ctx,
                                 APR_ALIGN_DEFAULT(1);
     }
     header->subcache_data_offset = ALIGNED_SUBCACHE_SIZE +
-                                   num_idx * ALIGNED_INDEX_SIZE;
+                                   num_idx * ALIGNED_INDEX_SIZE +
+                                   APR_ALIGN_DEFAULT(num_hash *
+                                                     sizeof(unsigned int));
+    if (header->subcache_data_offset >= header->subcache_size) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(03402)
+                     "shared memory segment too small");
+        return APR_ENOSPC;
+    }
     header->subcache_data_size = header->subcache_size -
                                  header->subcache_data_offset;
     header->index_num = num_idx;
+    header->hash_num = num_hash;
 
     /* Output trace info */
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00824)
@@ -458,12 +551,37 @@ static apr_status_t socache_shmcb_init(ap_socache_instance_t *ctx,
                  "subcache_data_size = %u", header->subcache_data_size);
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00829)
                  "index_num = %u", header->index_num);
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03403)
+                 "hash_num = %u", header->hash_num);
     /* The header is done, make the caches empty */
     for (loop = 0; loop < header->subcache_num; loop++) {
         SHMCBSubcache *subcache = SHMCB_SUBCACHE(header, loop);
-        subcache->idx_pos = subcache->idx_used = 0;
-        subcache->data_pos = subcache->data_used = 0;
+        memset(subcache, 0, sizeof(*subcache));
+        memset(SHMCB_HASHES(header, subcache), 0,
+               header->hash_num * sizeof(unsigned int));
     }
+
+    if (ctx->locked) {
+        ctx->nlocks = header->subcache_num < SHMCB_MAX_LOCKS
+                      ? header->subcache_num : SHMCB_MAX_LOCKS;
+        ctx->locks = apr_pcalloc(p, ctx->nlocks * sizeof(*ctx->locks));
+        for (loop = 0; loop < ctx->nlocks; loop++) {
+            rv = ap_global_mutex_create(&ctx->locks[loop], NULL,
+                                        SHMCB_MUTEX_TYPE,
+                                        apr_psprintf(p, "%s-%u", namespace,
+                                                     loop),
+                                        s, p, 0);
+            if (rv != APR_SUCCESS) {
+                ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(03396)
+                             "Could not create the shmcb socache locks");
+                return rv;
+            }
+        }
+        APR_ARRAY_PUSH(locked_instances, ap_socache_instance_t *) = ctx;
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03397)
+                     "shmcb socache using %u locks", ctx->nlocks);
+    }
+
     ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(00830)
                  "Shared memory socache initialised");
     /* Success ... */
@@ -488,7 +606,9 @@ static apr_status_t socache_shmcb_store(ap_socache_instance_t *ctx,
 {
     SHMCBHeader *header = ctx->header;
     SHMCBSubcache *subcache = SHMCB_MASK(header, id);
+    unsigned int num = SHMCB_SUBCACHE_NUM(header, id);
     int tryreplace;
+    apr_status_t rv;
 
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00831)
                  "socache_shmcb_store (0x%02x -> subcache %d)",
@@ -499,19 +619,24 @@ static apr_status_t socache_shmcb_store(ap_socache_instance_t *ctx,
                 "(%u bytes)", idlen);
         return APR_EINVAL;
     }
+    if ((rv = shmcb_lock(ctx, s, num)) != APR_SUCCESS) {
+        return rv;
+    }
     tryreplace = shmcb_subcache_remove(s, header, subcache, id, idlen);
     if (shmcb_subcache_store(s, header, subcache, encoded,
                              len_encoded, id, idlen, expiry)) {
+        shmcb_unlock(ctx, s, num);
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(00833)
                      "can't store an socache entry!");
         return APR_ENOSPC;
     }
     if (tryreplace == 0) {
-        header->stat_replaced++;
+        subcache->stat_replaced++;
     }
     else {
-        header->stat_stores++;
+        subcache->stat_stores++;
     }
+    shmcb_unlock(ctx, s, num);
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00834)
                  "leaving socache_shmcb_store successfully");
     return APR_SUCCESS;
@@ -525,6 +650,8 @@ static apr_status_t socache_shmcb_retrieve(ap_socache_instance_t *ctx,
 {
     SHMCBHeader *header = ctx->header;
     SHMCBSubcache *subcache = SHMCB_MASK(header, id);
+    unsigned int num = SHMCB_SUBCACHE_NUM(header, id);
+    apr_status_t status;
     int rv;
 
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00835)
@@ -532,12 +659,16 @@ static apr_status_t socache_shmcb_retrieve(ap_socache_instance_t *ctx,
                  SHMCB_MASK_DBG(header, id));
 
     /* Get the entry corresponding to the id, if it exists. */
+    if ((status = shmcb_lock(ctx, s, num)) != APR_SUCCESS) {
+        return status;
+    }
     rv = shmcb_subcache_retrieve(s, header, subcache, id, idlen,
                                  dest, destlen);
     if (rv == 0)
-        header->stat_retrieves_hit++;
+        subcache->stat_retrieves_hit++;
     else
-        header->stat_retrieves_miss++;
+        subcache->stat_retrieves_miss++;
+    shmcb_unlock(ctx, s, num);
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00836)
                  "leaving socache_shmcb_retrieve successfully");
 
@@ -550,6 +681,7 @@ static apr_status_t socache_shmcb_remove(ap_socache_instance_t *ctx,
 {
     SHMCBHeader *header = ctx->header;
     SHMCBSubcache *subcache = SHMCB_MASK(header, id);
+    unsigned int num = SHMCB_SUBCACHE_NUM(header, id);
     apr_status_t rv;
 
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00837)
@@ -560,13 +692,17 @@ static apr_status_t socache_shmcb_remove(ap_socache_instance_t *ctx,
                 "(%u bytes)", idlen);
         return APR_EINVAL;
     }
+    if ((rv = shmcb_lock(ctx, s, num)) != APR_SUCCESS) {
+        return rv;
+    }
     if (shmcb_subcache_remove(s, header, subcache, id, idlen) == 0) {
-        header->stat_removes_hit++;
+        subcache->stat_removes_hit++;
         rv = APR_SUCCESS;
     } else {
-        header->stat_removes_miss++;
+        subcache->stat_removes_miss++;
         rv = APR_NOTFOUND;
     }
+    shmcb_unlock(ctx, s, num);
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00839)
                  "leaving socache_shmcb_remove successfully");
 
@@ -583,6 +719,7 @@ static void socache_shmcb_status(ap_socache_instance_t *ctx,
     apr_time_t now = apr_time_now();
     double expiry_total = 0;
     int index_pct, cache_pct;
+    SHMCBSubcache stats;
 
     AP_DEBUG_ASSERT(header->subcache_num > 0);
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(00840) "inside shmcb_status");
@@ -590,9 +727,21 @@ static void socache_shmcb_status(ap_socache_instance_t *ctx,
      * pointer arithmetic. The rest of our logic uses read-only header data so
      * doesn't need the lock. */
     /* Iterate over the subcaches */
+    memset(&stats, 0, sizeof(stats));
     for (loop = 0; loop < header->subcache_num; loop++) {
         SHMCBSubcache *subcache = SHMCB_SUBCACHE(header, loop);
+        if (shmcb_lock(ctx, s, loop) != APR_SUCCESS) {
+            continue;
+        }
         shmcb_subcache_expire(s, header, subcache, now);
+        stats.stat_stores += subcache->stat_stores;
+        stats.stat_replaced += subcache->stat_replaced;
+        stats.stat_expiries += subcache->stat_expiries;
+        stats.stat_scrolled += subcache->stat_scrolled;
+        stats.stat_retrieves_hit += subcache->stat_retrieves_hit;
+        stats.stat_retrieves_miss += subcache->stat_retrieves_miss;
+        stats.stat_removes_hit += subcache->stat_removes_hit;
+        stats.stat_removes_miss += subcache->stat_removes_miss;
         total += subcache->idx_used;
         cache_total += subcache->data_used;
         if (subcache->idx_used) {
@@ -606,6 +755,7 @@ static void socache_shmcb_status(ap_socache_instance_t *ctx,
             else
                 min_expiry = ((idx_expiry < min_expiry) ? idx_expiry : min_expiry);
         }
+        shmcb_unlock(ctx, s, loop);
     }
     index_pct = (100 * total) / (header->index_num *
                                  header->subcache_num);
@@ -633,19 +783,19 @@ static void socache_shmcb_status(ap_socache_instance_t *ctx,
         ap_rprintf(r, "index usage: <b>%d%%</b>, cache usage: <b>%d%%</b><br>",
                    index_pct, cache_pct);
         ap_rprintf(r, "total entries stored since starting: <b>%lu</b><br>",
-                   header->stat_stores);
+                   stats.stat_stores);
         ap_rprintf(r, "total entries replaced since starting: <b>%lu</b><br>",
-                   header->stat_replaced);
+                   stats.stat_replaced);
         ap_rprintf(r, "total entries expired since starting: <b>%lu</b><br>",
-                   header->stat_expiries);
+                   stats.stat_expiries);
         ap_rprintf(r, "total (pre-expiry) entries scrolled out of the cache: "
-                   "<b>%lu</b><br>", header->stat_scrolled);
+                   "<b>%lu</b><br>", stats.stat_scrolled);
         ap_rprintf(r, "total retrieves since starting: <b>%lu</b> hit, "
-                   "<b>%lu</b> miss<br>", header->stat_retrieves_hit,
-                   header->stat_retrieves_miss);
+                   "<b>%lu</b> miss<br>", stats.stat_retrieves_hit,
+                   stats.stat_retrieves_miss);
         ap_rprintf(r, "total removes since starting: <b>%lu</b> hit, "
-                   "<b>%lu</b> miss<br>", header->stat_removes_hit,
-                   header->stat_removes_miss);
+                   "<b>%lu</b> miss<br>", stats.stat_removes_hit,
+                   stats.stat_removes_miss);
     }
     else {
         ap_rputs("CacheType: SHMCB\n", r);
@@ -665,14 +815,14 @@ static void socache_shmcb_status(ap_socache_instance_t *ctx,
 
         ap_rprintf(r, "CacheIndexUsage: %d%%\n", index_pct);
         ap_rprintf(r, "CacheUsage: %d%%\n", cache_pct);
-        ap_rprintf(r, "CacheStoreCount: %lu\n", header->stat_stores);
-        ap_rprintf(r, "CacheReplaceCount: %lu\n", header->stat_replaced);
-        ap_rprintf(r, "CacheExpireCount: %lu\n", header->stat_expiries);
-        ap_rprintf(r, "CacheDiscardCount: %lu\n", header->stat_scrolled);
-        ap_rprintf(r, "CacheRetrieveHitCount: %lu\n", header->stat_retrieves_hit);
-        ap_rprintf(r, "CacheRetrieveMissCount: %lu\n", header->stat_retrieves_miss);
-        ap_rprintf(r, "CacheRemoveHitCount: %lu\n", header->stat_removes_hit);
-        ap_rprintf(r, "CacheRemoveMissCount: %lu\n", header->stat_removes_miss);
+        ap_rprintf(r, "CacheStoreCount: %lu\n", stats.stat_stores);
+        ap_rprintf(r, "CacheReplaceCount: %lu\n", stats.stat_replaced);
+        ap_rprintf(r, "CacheExpireCount: %lu\n", stats.stat_expiries);
+        ap_rprintf(r, "CacheDiscardCount: %lu\n", stats.stat_scrolled);
+        ap_rprintf(r, "CacheRetrieveHitCount: %lu\n", stats.stat_retrieves_hit);
+        ap_rprintf(r, "CacheRetrieveMissCount: %lu\n", stats.stat_retrieves_miss);
+        ap_rprintf(r, "CacheRemoveHitCount: %lu\n", stats.stat_removes_hit);
+        ap_rprintf(r, "CacheRemoveMissCount: %lu\n", stats.stat_removes_miss);
     }
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(00841) "leaving shmcb_status");
 }
@@ -695,8 +845,14 @@ static apr_status_t socache_shmcb_iterate(ap_socache_instance_t *instance,
     /* Iterate over the subcaches */
     for (loop = 0; loop < header->subcache_num && rv == APR_SUCCESS; loop++) {
         SHMCBSubcache *subcache = SHMCB_SUBCACHE(header, loop);
+        /* With "shmcb-mt" the iterator is called with the subcache locked,
+         * so it must not access the cache itself. */
+        if ((rv = shmcb_lock(instance, s, loop)) != APR_SUCCESS) {
+            break;
+        }
         rv = shmcb_subcache_iterate(instance, s, userctx, header, subcache,
                                     iterator, &buf, &buflen, pool, now);
+        shmcb_unlock(instance, s, loop);
     }
     return rv;
 }
@@ -705,6 +861,92 @@ static apr_status_t socache_shmcb_iterate(ap_socache_instance_t *instance,
  * Subcache-level cache operations
  */
 
+/* FNV-1a, the first byte of the id only selects the subcache */
+static unsigned int shmcb_hash(const unsigned char *id, unsigned int idlen)
+{
+    apr_uint32_t hash = 2166136261U;
+    unsigned int i;
+
+    for (i = 0; i < idlen; i++) {
+        hash ^= id[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/* Add the index at 'pos' (whose id_hash is set) to the hash slots */
+static void shmcb_hash_insert(SHMCBHeader *header, SHMCBSubcache *subcache,
+                              unsigned int pos)
+{
+    unsigned int *slots = SHMCB_HASHES(header, subcache);
+    unsigned int mask = header->hash_num - 1;
+    SHMCBIndex *idx = SHMCB_INDEX(subcache, pos);
+    unsigned int i = idx->id_hash & mask;
+
+    while (slots[i]) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = pos + 1;
+}
+
+/* Remove the index at 'pos' from the hash slots, if there, and move back
+ * the next slots of the probe sequence which can take its place.
+ */
+static void shmcb_hash_delete(SHMCBHeader *header, SHMCBSubcache *subcache,
+                              unsigned int pos)
+{
+    unsigned int *slots = SHMCB_HASHES(header, subcache);
+    unsigned int mask = header->hash_num - 1;
+    SHMCBIndex *idx = SHMCB_INDEX(subcache, pos);
+    unsigned int i = idx->id_hash & mask;
+    unsigned int j;
+
+    while (slots[i] != pos + 1) {
+        if (!slots[i]) {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    for (j = (i + 1) & mask; slots[j]; j = (j + 1) & mask) {
+        unsigned int home;
+
+        idx = SHMCB_INDEX(subcache, slots[j] - 1);
+        home = idx->id_hash & mask;
+        /* Can slot j move to i, i.e. is its home not in (i, j]? */
+        if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i] = 0;
+}
+
+/* Find the index of 'id' (not removed, but possibly expired), returns its
+ * position or -1.
+ */
+static int shmcb_hash_lookup(SHMCBHeader *header, SHMCBSubcache *subcache,
+                             const unsigned char *id, unsigned int idlen)
+{
+    unsigned int *slots = SHMCB_HASHES(header, subcache);
+    unsigned int mask = header->hash_num - 1;
+    unsigned int hash = shmcb_hash(id, idlen);
+    unsigned int i;
+
+    for (i = hash & mask; slots[i]; i = (i + 1) & mask) {
+        SHMCBIndex *idx = SHMCB_INDEX(subcache, slots[i] - 1);
+
+        if (idx->id_hash == hash
+            && idx->id_len == idlen
+            && !idx->removed
+            && shmcb_cyclic_memcmp(header->subcache_data_size,
+                                   SHMCB_DATA(header, subcache),
+                                   idx->data_pos, id, idlen) == 0) {
+            return slots[i] - 1;
+        }
+    }
+    return -1;
+}
+
 static void shmcb_subcache_expire(server_rec *s, SHMCBHeader *header,
                                   SHMCBSubcache *subcache, apr_time_t now)
 {
@@ -716,8 +958,10 @@ static void shmcb_subcache_expire(server_rec *s, SHMCBHeader *header,
         idx = SHMCB_INDEX(subcache, new_idx_pos);
         if (idx->removed)
             freed++;
-        else if (idx->expires <= now)
+        else if (idx->expires <= now) {
+            shmcb_hash_delete(header, subcache, new_idx_pos);
             expired++;
+        }
         else
             /* not removed and not expired yet, we're done iterating */
             break;
@@ -746,7 +990,7 @@ static void shmcb_subcache_expire(server_rec *s, SHMCBHeader *header,
         subcache->data_used -= diff;
         subcache->data_pos = idx->data_pos;
     }
-    header->stat_expiries += expired;
+    subcache->stat_expiries += expired;
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00843)
                  "we now have %u socache entries", subcache->idx_used);
 }
@@ -787,6 +1031,9 @@ static int shmcb_subcache_store(server_rec *s, SHMCBHeader *header,
         do {
             SHMCBIndex *idx2;
 
+            if (!idx->removed) {
+                shmcb_hash_delete(header, subcache, subcache->idx_pos);
+            }
             /* Adjust the indexes by one */
             subcache->idx_pos = SHMCB_CYCLIC_INCREMENT(subcache->idx_pos, 1,
                                                        header->index_num);
@@ -802,7 +1049,7 @@ static int shmcb_subcache_store(server_rec *s, SHMCBHeader *header,
                                                       header->subcache_data_size);
             subcache->data_pos = idx2->data_pos;
             /* Stats */
-            header->stat_scrolled++;
+            subcache->stat_scrolled++;
             /* Loop admin */
             idx = idx2;
             loop++;
@@ -842,7 +1089,9 @@ static int shmcb_subcache_store(server_rec *s, SHMCBHeader *header,
     idx->data_pos = id_offset;
     idx->data_used = total_len;
     idx->id_len = id_len;
+    idx->id_hash = shmcb_hash(id, id_len);
     idx->removed = 0;
+    shmcb_hash_insert(header, subcache, new_idx);
     subcache->idx_used++;
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00847)
                  "insert happened at idx=%d, data=(%u:%u)", new_idx,
@@ -860,61 +1109,52 @@ static int shmcb_subcache_retrieve(server_rec *s, SHMCBHeader *header,
                                    const unsigned char *id, unsigned int idlen,
                                    unsigned char *dest, unsigned int *destlen)
 {
-    unsigned int pos;
-    unsigned int loop = 0;
-    apr_time_t now = apr_time_now();
-
-    pos = subcache->idx_pos;
-
-    while (loop < subcache->idx_used) {
-        SHMCBIndex *idx = SHMCB_INDEX(subcache, pos);
+    SHMCBIndex *idx;
+    int pos;
 
-        /* Only consider 'idx' if the id matches, and the "removed"
-         * flag isn't set, and the record is not expired.
-         * Check the data length too to avoid a buffer overflow
-         * in case of corruption, which should be impossible,
-         * but it's cheap to be safe. */
-        if (!idx->removed
-            && idx->id_len == idlen
-            && (idx->data_used - idx->id_len) <= *destlen
-            && shmcb_cyclic_memcmp(header->subcache_data_size,
-                                   SHMCB_DATA(header, subcache),
-                                   idx->data_pos, id, idx->id_len) == 0) {
-            ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00849)
-                         "match at idx=%d, data=%d", pos, idx->data_pos);
-            if (idx->expires > now) {
-                unsigned int data_offset;
+    pos = shmcb_hash_lookup(header, subcache, id, idlen);
+    if (pos < 0) {
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00851)
+                     "shmcb_subcache_retrieve found no match");
+        return -1;
+    }
+    idx = SHMCB_INDEX(subcache, pos);
+
+    /* Check the data length too to avoid a buffer overflow
+     * in case of corruption, which should be impossible,
+     * but it's cheap to be safe. */
+    if ((idx->data_used - idx->id_len) > *destlen) {
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03404)
+                     "shmcb_subcache_retrieve match too large (%u > %u)",
+                     idx->data_used - idx->id_len, *destlen);
+        return -1;
+    }
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00849)
+                 "match at idx=%d, data=%d", pos, idx->data_pos);
+    if (idx->expires > apr_time_now()) {
+        unsigned int data_offset;
 
-                /* Find the offset of the data segment, after the id */
-                data_offset = SHMCB_CYCLIC_INCREMENT(idx->data_pos,
-                                                     idx->id_len,
-                                                     header->subcache_data_size);
+        /* Find the offset of the data segment, after the id */
+        data_offset = SHMCB_CYCLIC_INCREMENT(idx->data_pos,
+                                             idx->id_len,
+                                             header->subcache_data_size);
 
-                *destlen = idx->data_used - idx->id_len;
+        *destlen = idx->data_used - idx->id_len;
 
-                /* Copy out the data */
-                shmcb_cyclic_cton_memcpy(header->subcache_data_size,
-                                         dest, SHMCB_DATA(header, subcache),
-                                         data_offset, *destlen);
+        /* Copy out the data */
+        shmcb_cyclic_cton_memcpy(header->subcache_data_size,
+                                 dest, SHMCB_DATA(header, subcache),
+                                 data_offset, *destlen);
 
-                return 0;
-            }
-            else {
-                /* Already stale, quietly remove and treat as not-found */
-                idx->removed = 1;
-                header->stat_expiries++;
-                ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00850)
-                             "shmcb_subcache_retrieve discarding expired entry");
-                return -1;
-            }
-        }
-        /* Increment */
-        loop++;
-        pos = SHMCB_CYCLIC_INCREMENT(pos, 1, header->index_num);
+        return 0;
     }
 
-    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00851)
-                 "shmcb_subcache_retrieve found no match");
+    /* Already stale, quietly remove and treat as not-found */
+    shmcb_hash_delete(header, subcache, pos);
+    idx->removed = 1;
+    subcache->stat_expiries++;
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00850)
+                 "shmcb_subcache_retrieve discarding expired entry");
     return -1;
 }
 
@@ -923,34 +1163,23 @@ static int shmcb_subcache_remove(server_rec *s, SHMCBHeader *header,
                                  const unsigned char *id,
                                  unsigned int idlen)
 {
-    unsigned int pos;
-    unsigned int loop = 0;
-
-    pos = subcache->idx_pos;
-    while (loop < subcache->idx_used) {
-        SHMCBIndex *idx = SHMCB_INDEX(subcache, pos);
+    SHMCBIndex *idx;
+    int pos;
 
-        /* Only consider 'idx' if the id matches, and the "removed"
-         * flag isn't set. */
-        if (!idx->removed && idx->id_len == idlen
-            && shmcb_cyclic_memcmp(header->subcache_data_size,
-                                   SHMCB_DATA(header, subcache),
-                                   idx->data_pos, id, idx->id_len) == 0) {
-            ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00852)
-                         "possible match at idx=%d, data=%d", pos, idx->data_pos);
-
-            /* Found the matching entry, remove it quietly. */
-            idx->removed = 1;
-            ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00853)
-                         "shmcb_subcache_remove removing matching entry");
-            return 0;
-        }
-        /* Increment */
-        loop++;
-        pos = SHMCB_CYCLIC_INCREMENT(pos, 1, header->index_num);
+    pos = shmcb_hash_lookup(header, subcache, id, idlen);
+    if (pos < 0) {
+        return -1; /* failure */
     }
-
-    return -1; /* failure */
+    idx = SHMCB_INDEX(subcache, pos);
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00852)
+                 "possible match at idx=%d, data=%d", pos, idx->data_pos);
+
+    /* Found the matching entry, remove it quietly. */
+    shmcb_hash_delete(header, subcache, pos);
+    idx->removed = 1;
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00853)
+                 "shmcb_subcache_remove removing matching entry");
+    return 0;
 }
 
 
@@ -1025,8 +1254,9 @@ static apr_status_t shmcb_subcache_iterate(ap_socache_instance_t *instance,
             }
             else {
                 /* Already stale, quietly remove and treat as not-found */
+                shmcb_hash_delete(header, subcache, pos);
                 idx->removed = 1;
-                header->stat_expiries++;
+                subcache->stat_expiries++;
                 ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00856)
                              "shmcb_subcache_iterate discarding expired entry");
             }
@@ -1052,17 +1282,80 @@ static const ap_socache_provider_t socache_shmcb = {
     socache_shmcb_iterate
 };
 
+static const ap_socache_provider_t socache_shmcb_mt = {
+    "shmcb-mt",
+    0,
+    socache_shmcb_mt_create,
+    socache_shmcb_init,
+    socache_shmcb_destroy,
+    socache_shmcb_store,
+    socache_shmcb_retrieve,
+    socache_shmcb_remove,
+    socache_shmcb_status,
+    socache_shmcb_iterate
+};
+
+static int socache_shmcb_pre_config(apr_pool_t *pconf, apr_pool_t *plog,
+                                    apr_pool_t *ptemp)
+{
+    apr_status_t rv;
+
+    rv = ap_mutex_register(pconf, SHMCB_MUTEX_TYPE, NULL, APR_LOCK_DEFAULT, 0);
+    if (rv != APR_SUCCESS) {
+        ap_log_perror(APLOG_MARK, APLOG_CRIT, rv, plog, APLOGNO(03400)
+                      "failed to register %s mutex", SHMCB_MUTEX_TYPE);
+        return 500; /* An HTTP status would be a misnomer! */
+    }
+    locked_instances = apr_array_make(pconf, 2,
+                                      sizeof(ap_socache_instance_t *));
+
+    return OK;
+}
+
+static void socache_shmcb_child_init(apr_pool_t *p, server_rec *s)
+{
+    int i;
+
+    for (i = 0; i < locked_instances->nelts; i++) {
+        ap_socache_instance_t *ctx = APR_ARRAY_IDX(locked_instances, i,
+                                                   ap_socache_instance_t *);
+        unsigned int loop;
+
+        for (loop = 0; loop < ctx->nlocks; loop++) {
+            apr_global_mutex_t *lock = ctx->locks[loop];
+            apr_status_t rv;
+
+            rv = apr_global_mutex_child_init(&ctx->locks[loop],
+                                             apr_global_mutex_lockfile(lock),
+                                             p);
+            if (rv != APR_SUCCESS) {
+                ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(03401)
+                             "failed to initialise shmcb socache lock %u "
+                             "in child process", loop);
+            }
+        }
+    }
+}
+
 static void register_hooks(apr_pool_t *p)
 {
     ap_register_provider(p, AP_SOCACHE_PROVIDER_GROUP, "shmcb",
                          AP_SOCACHE_PROVIDER_VERSION,
                          &socache_shmcb);
+    ap_register_provider(p, AP_SOCACHE_PROVIDER_GROUP, "shmcb-mt",
+                         AP_SOCACHE_PROVIDER_VERSION,
+                         &socache_shmcb_mt);
 
     /* Also register shmcb under the default provider name. */
     ap_register_provider(p, AP_SOCACHE_PROVIDER_GROUP,
                          AP_SOCACHE_DEFAULT_PROVIDER,
                          AP_SOCACHE_PROVIDER_VERSION,
                          &socache_shmcb);
+
+    ap_hook_pre_config(socache_shmcb_pre_config, NULL, NULL,
+                       APR_HOOK_MIDDLE);
+    ap_hook_child_init(socache_shmcb_child_init, NULL, NULL,
+                       APR_HOOK_MIDDLE);
 }
 
 AP_DECLARE_MODULE(socache_shmcb) = {
@@ -905,18 +905,202 @@ static int dav_method_post(request_rec *r)
 }
 
 /* handle the PUT method */
+typedef struct dav_put_ctx {
+    request_rec *r;
+    dav_resource *resource;
+    int resource_state;
+    dav_auto_version_info av_info;
+    dav_stream *stream;
+    apr_bucket_brigade *bb;
+    dav_error *err;
+} dav_put_ctx;
+
+static void dav_put_callback(void *baton);
+
+/* Complete a PUT once the body is written (or failed) */
+static int dav_put_finish(dav_put_ctx *ctx)
+{
+    request_rec *r = ctx->r;
+    dav_resource *resource = ctx->resource;
+    const dav_hooks_locks *locks_hooks = DAV_GET_HOOKS_LOCKS(r);
+    dav_error *err = ctx->err;
+    dav_error *err2;
+
+    /*
+     * Ensure that we think the resource exists now.
+     * ### eek. if an error occurred during the write and we did not commit,
+     * ### then the resource might NOT exist (e.g. dav_fs_repos.c)
+     */
+    if (err == NULL) {
+        resource->exists = 1;
+    }
+
+    /* restore modifiability of resources back to what they were */
+    err2 = dav_auto_checkin(r, resource, err != NULL /* undo if error */,
+                            0 /*unlock*/, &ctx->av_info);
+
+    /* check for errors now */
+    if (err != NULL) {
+        err = dav_join_error(err, err2); /* don't forget err2 */
+        return dav_handle_err(r, err, NULL);
+    }
+
+    if (err2 != NULL) {
+        /* just log a warning */
+        err2 = dav_push_error(r->pool, err2->status, 0,
+                              "The PUT was successful, but there "
+                              "was a problem automatically checking in "
+                              "the resource or its parent collection.",
+                              err2);
+        dav_log_err(r, err2, APLOG_WARNING);
+    }
+
+    /* ### place the Content-Type and Content-Language into the propdb */
+
+    if (locks_hooks != NULL) {
+        dav_lockdb *lockdb;
+
+        if ((err = (*locks_hooks->open_lockdb)(r, 0, 0, &lockdb)) != NULL) {
+            /* The file creation was successful, but the locking failed. */
+            err = dav_push_error(r->pool, err->status, 0,
+                                 "The file was PUT successfully, but there "
+                                 "was a problem opening the lock database "
+                                 "which prevents inheriting locks from the "
+                                 "parent resources.",
+                                 err);
+            return dav_handle_err(r, err, NULL);
+        }
+
+        /* notify lock system that we have created/replaced a resource */
+        err = dav_notify_created(r, lockdb, resource,
+                                 ctx->resource_state, 0);
+
+        (*locks_hooks->close_lockdb)(lockdb);
+
+        if (err != NULL) {
+            /* The file creation was successful, but the locking failed. */
+            err = dav_push_error(r->pool, err->status, 0,
+                                 "The file was PUT successfully, but there "
+                                 "was a problem updating its lock "
+                                 "information.",
+                                 err);
+            return dav_handle_err(r, err, NULL);
+        }
+    }
+
+    /* NOTE: WebDAV spec, S8.7.1 states properties should be unaffected */
+
+    /* return an appropriate response (HTTP_CREATED or HTTP_NO_CONTENT) */
+    return dav_created(r, NULL, "Resource",
+                       ctx->resource_state == DAV_RESOURCE_EXISTS);
+}
+
+/* Write the body of a PUT to the stream, as it comes in: this yields when
+ * the client is slow to send it, and continues from dav_put_callback().
+ */
+static int dav_put_body(dav_put_ctx *ctx)
+{
+    request_rec *r = ctx->r;
+    dav_resource *resource = ctx->resource;
+    dav_error *err2;
+    apr_bucket *b;
+    int seen_eos = 0;
+
+    do {
+        apr_status_t rc;
+
+        rc = ap_read_request_body(r, ctx->bb, DAV_READ_BLOCKSIZE,
+                                  dav_put_callback, ctx);
+
+        if (APR_STATUS_IS_EAGAIN(rc)) {
+            return SUSPENDED;
+        }
+        if (rc != APR_SUCCESS) {
+            int http_err;
+            char *msg = ap_escape_html(r->pool, r->uri);
+            if (APR_STATUS_IS_TIMEUP(rc)) {
+                http_err = HTTP_REQUEST_TIME_OUT;
+                msg = apr_psprintf(r->pool, "Timeout reading the body "
+                                   "(URI: %s)", msg);
+            }
+            else {
+                http_err = ap_map_http_request_error(rc, HTTP_BAD_REQUEST);
+                msg = apr_psprintf(r->pool,
+                        "An error occurred while reading"
+                                " the request body (URI: %s)", msg);
+            }
+            ctx->err = dav_new_error(r->pool, http_err, 0, rc, msg);
+            break;
+        }
+
+        for (b = APR_BRIGADE_FIRST(ctx->bb);
+             b != APR_BRIGADE_SENTINEL(ctx->bb);
+             b = APR_BUCKET_NEXT(b))
+        {
+            const char *data;
+            apr_size_t len;
+
+            if (APR_BUCKET_IS_EOS(b)) {
+                seen_eos = 1;
+                break;
+            }
+
+            if (APR_BUCKET_IS_METADATA(b)) {
+                continue;
+            }
+
+            if (ctx->err == NULL) {
+                /* write whatever we read, until we see an error */
+                rc = apr_bucket_read(b, &data, &len, APR_BLOCK_READ);
+                if (rc != APR_SUCCESS) {
+                   ctx->err = dav_new_error(r->pool, HTTP_BAD_REQUEST, 0, rc,
+                                            apr_psprintf(r->pool,
+                                                         "An error occurred while"
+                                                         " reading the request body"
+                                                         " from the bucket (URI: %s)",
+                                                         ap_escape_html(r->pool, r->uri)));
+                    break;
+                }
+
+                ctx->err = (*resource->hooks->write_stream)(ctx->stream,
+                                                            data, len);
+            }
+        }
+
+        apr_brigade_cleanup(ctx->bb);
+    } while (!seen_eos);
+
+    apr_brigade_destroy(ctx->bb);
+
+    err2 = (*resource->hooks->close_stream)(ctx->stream,
+                                            ctx->err == NULL /* commit */);
+    ctx->err = dav_join_error(ctx->err, err2);
+
+    return dav_put_finish(ctx);
+}
+
+static void dav_put_callback(void *baton)
+{
+    dav_put_ctx *ctx = baton;
+    int status;
+
+    status = dav_put_body(ctx);
+    if (status != SUSPENDED) {
+        ap_finish_suspended_request(ctx->r, status);
+    }
+}
+
 static int dav_method_put(request_rec *r)
 {
     dav_resource *resource;
     int resource_state;
     dav_auto_version_info av_info;
-    const dav_hooks_locks *locks_hooks = DAV_GET_HOOKS_LOCKS(r);
     const char *body;
     dav_error *err;
-    dav_error *err2;
     dav_stream_mode mode;
-    dav_stream *stream;
+    dav_stream *stream = NULL;
     dav_response *multi_response;
+    dav_put_ctx *ctx;
     int has_range;
     apr_off_t range_start;
     apr_off_t range_end;
@@ -1007,145 +1191,20 @@ static int dav_method_put(request_rec *r)
         err = (*resource->hooks->seek_stream)(stream, range_start);
     }
 
-    if (err == NULL) {
-        apr_bucket_brigade *bb;
-        apr_bucket *b;
-        int seen_eos = 0;
-
-        bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
-
-        do {
-            apr_status_t rc;
-
-            rc = ap_get_brigade(r->input_filters, bb, AP_MODE_READBYTES,
-                                APR_BLOCK_READ, DAV_READ_BLOCKSIZE);
-
-            if (rc != APR_SUCCESS) {
-                int http_err;
-                char *msg = ap_escape_html(r->pool, r->uri);
-                if (APR_STATUS_IS_TIMEUP(rc)) {
-                    http_err = HTTP_REQUEST_TIME_OUT;
-                    msg = apr_psprintf(r->pool, "Timeout reading the body "
-                                       "(URI: %s)", msg);
-                }
-                else {
-                    http_err = ap_map_http_request_error(rc, HTTP_BAD_REQUEST);
-                    msg = apr_psprintf(r->pool,
-                            "An error occurred while reading"
-                                    " the request body (URI: %s)", msg);
-                }
-                err = dav_new_error(r->pool, http_err, 0, rc, msg);
-                break;
-            }
-
-            for (b = APR_BRIGADE_FIRST(bb);
-                 b != APR_BRIGADE_SENTINEL(bb);
-                 b = APR_BUCKET_NEXT(b))
-            {
-                const char *data;
-                apr_size_t len;
+    ctx = apr_pcalloc(r->pool, sizeof(*ctx));
+    ctx->r = r;
+    ctx->resource = resource;
+    ctx->resource_state = resource_state;
+    ctx->av_info = av_info;
+    ctx->stream = stream;
+    ctx->err = err;
 
-                if (APR_BUCKET_IS_EOS(b)) {
-                    seen_eos = 1;
-                    break;
-                }
-
-                if (APR_BUCKET_IS_METADATA(b)) {
-                    continue;
-                }
-
-                if (err == NULL) {
-                    /* write whatever we read, until we see an error */
-                    rc = apr_bucket_read(b, &data, &len, APR_BLOCK_READ);
-                    if (rc != APR_SUCCESS) {
-                       err = dav_new_error(r->pool, HTTP_BAD_REQUEST, 0, rc,
-                                           apr_psprintf(r->pool,
-                                                        "An error occurred while"
-                                                        " reading the request body"
-                                                        " from the bucket (URI: %s)",
-                                                        ap_escape_html(r->pool, r->uri)));
-                        break;
-                    }
-
-                    err = (*resource->hooks->write_stream)(stream, data, len);
-                }
-            }
-
-            apr_brigade_cleanup(bb);
-        } while (!seen_eos);
-
-        apr_brigade_destroy(bb);
-
-        err2 = (*resource->hooks->close_stream)(stream,
-                                                err == NULL /* commit */);
-        err = dav_join_error(err, err2);
-    }
-
-    /*
-     * Ensure that we think the resource exists now.
-     * ### eek. if an error occurred during the write and we did not commit,
-     * ### then the resource might NOT exist (e.g. dav_fs_repos.c)
-     */
     if (err == NULL) {
-        resource->exists = 1;
-    }
-
-    /* restore modifiability of resources back to what they were */
-    err2 = dav_auto_checkin(r, resource, err != NULL /* undo if error */,
-                            0 /*unlock*/, &av_info);
-
-    /* check for errors now */
-    if (err != NULL) {
-        err = dav_join_error(err, err2); /* don't forget err2 */
-        return dav_handle_err(r, err, NULL);
-    }
-
-    if (err2 != NULL) {
-        /* just log a warning */
-        err2 = dav_push_error(r->pool, err2->status, 0,
-                              "The PUT was successful, but there "
-                              "was a problem automatically checking in "
-                              "the resource or its parent collection.",
-                              err2);
-        dav_log_err(r, err2, APLOG_WARNING);
-    }
-
-    /* ### place the Content-Type and Content-Language into the propdb */
-
-    if (locks_hooks != NULL) {
-        dav_lockdb *lockdb;
-
-        if ((err = (*locks_hooks->open_lockdb)(r, 0, 0, &lockdb)) != NULL) {
-            /* The file creation was successful, but the locking failed. */
-            err = dav_push_error(r->pool, err->status, 0,
-                                 "The file was PUT successfully, but there "
-                                 "was a problem opening the lock database "
-                                 "which prevents inheriting locks from the "
-                                 "parent resources.",
-                                 err);
-            return dav_handle_err(r, err, NULL);
-        }
-
-        /* notify lock system that we have created/replaced a resource */
-        err = dav_notify_created(r, lockdb, resource, resource_state, 0);
-
-        (*locks_hooks->close_lockdb)(lockdb);
-
-        if (err != NULL) {
-            /* The file creation was successful, but the locking failed. */
-            err = dav_push_error(r->pool, err->status, 0,
-                                 "The file was PUT successfully, but there "
-                                 "was a problem updating its lock "
-                                 "information.",
-                                 err);
-            return dav_handle_err(r, err, NULL);
-        }
+        ctx->bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+        return dav_put_body(ctx);
     }
 
-    /* NOTE: WebDAV spec, S8.7.1 states properties should be unaffected */
-
-    /* return an appropriate response (HTTP_CREATED or HTTP_NO_CONTENT) */
-    return dav_created(r, NULL, "Resource", resource_state == DAV_RESOURCE_EXISTS);
+    return dav_put_finish(ctx);
 }
 
 
@@ -189,6 +189,7 @@ static int status_handler(request_rec *r)
     int ready;
     int busy;
     unsigned long count;
+    unsigned long walk_hits, walk_misses;
     unsigned long lres, my_lres, conn_lres;
     apr_off_t bytes, my_bytes, conn_bytes;
     apr_off_t bcount, kbcount;
@@ -230,6 +231,8 @@ static int status_handler(request_rec *r)
     ready = 0;
     busy = 0;
     count = 0;
+    walk_hits = 0;
+    walk_misses = 0;
     bcount = 0;
     kbcount = 0;
     short_report = 0;
@@ -343,6 +346,8 @@ static int status_handler(request_rec *r)
             if (ap_extended_status) {
                 lres = ws_record->access_count;
                 bytes = ws_record->bytes_served;
+                walk_hits += ws_record->walk_cache_hits;
+                walk_misses += ws_record->walk_cache_misses;
 
                 if (lres != 0 || (res != SERVER_READY && res != SERVER_DEAD)) {
 #ifdef HAVE_TIMES
@@ -483,6 +488,9 @@ static int status_handler(request_rec *r)
             if (count > 0)
                 ap_rprintf(r, "BytesPerReq: %g\n",
                            KBYTE * (float) kbcount / (float) count);
+            if (walk_hits || walk_misses)
+                ap_rprintf(r, "WalkCacheHits: %lu\nWalkCacheMisses: %lu\n",
+                           walk_hits, walk_misses);
         }
         else { /* !short_report */
             ap_rprintf(r, "<dt>Total accesses: %lu - Total Traffic: ", count);
@@ -515,6 +523,13 @@ static int status_handler(request_rec *r)
             }
 
             ap_rputs("</dt>\n", r);
+
+            if (walk_hits || walk_misses) {
+                ap_rprintf(r, "<dt>Walk cache: %lu hits - %lu misses - "
+                              "%.3g%% hit rate</dt>\n",
+                           walk_hits, walk_misses,
+                           100.0 * walk_hits / (walk_hits + walk_misses));
+            }
         } /* short_report */
     } /* ap_extended_status */
 
@@ -529,7 +544,8 @@ static int status_handler(request_rec *r)
 
     if (is_async) {
         int write_completion = 0, lingering_close = 0, keep_alive = 0,
-            connections = 0;
+            connections = 0, lingering_normal = 0, lingering_short = 0;
+        apr_uint64_t timeouts_expired = 0, timeouts_usecs = 0;
         /*
          * These differ from 'busy' and 'ready' in how gracefully finishing
          * threads are counted. XXX: How to make this clear in the html?
@@ -541,10 +557,12 @@ static int status_handler(request_rec *r)
 		         "<th rowspan=\"2\">PID</th>"
                          "<th colspan=\"2\">Connections</th>\n"
                          "<th colspan=\"2\">Threads</th>"
-                         "<th colspan=\"4\">Async connections</th></tr>\n"
+                         "<th colspan=\"3\">Async connections</th>"
+                         "<th colspan=\"2\">Timeouts</th></tr>\n"
                      "<tr><th>total</th><th>accepting</th>"
                          "<th>busy</th><th>idle</th><th>writing</th>"
-                         "<th>keep-alive</th><th>closing</th></tr>\n", r);
+                         "<th>keep-alive</th><th>closing</th>"
+                         "<th>expired</th><th>ms</th></tr>\n", r);
         for (i = 0; i < server_limit; ++i) {
             ps_record = ap_get_scoreboard_process(i);
             if (ps_record->pid) {
@@ -552,37 +570,51 @@ static int status_handler(request_rec *r)
                 write_completion += ps_record->write_completion;
                 keep_alive       += ps_record->keep_alive;
                 lingering_close  += ps_record->lingering_close;
+                lingering_normal += ps_record->lingering_normal;
+                lingering_short  += ps_record->lingering_short;
+                timeouts_expired += ps_record->timeouts_expired;
+                timeouts_usecs   += ps_record->timeouts_usecs;
                 busy_workers     += thread_busy_buffer[i];
                 idle_workers     += thread_idle_buffer[i];
                 if (!short_report)
                     ap_rprintf(r, "<tr><td>%u</td><td>%" APR_PID_T_FMT "</td>"
                                       "<td>%u</td><td>%s</td><td>%u</td>"
                                       "<td>%u</td><td>%u</td><td>%u</td>"
-                                      "<td>%u</td>"
+                                      "<td>%u</td><td>%" APR_UINT64_T_FMT
+                                      "</td><td>%" APR_UINT64_T_FMT "</td>"
                                       "</tr>\n",
                                i, ps_record->pid, ps_record->connections,
                                ps_record->not_accepting ? "no" : "yes",
                                thread_busy_buffer[i], thread_idle_buffer[i],
                                ps_record->write_completion,
                                ps_record->keep_alive,
-                               ps_record->lingering_close);
+                               ps_record->lingering_close,
+                               ps_record->timeouts_expired,
+                               ps_record->timeouts_usecs / 1000);
             }
         }
         if (!short_report) {
             ap_rprintf(r, "<tr><td>Sum</td><td>%d</td><td>&nbsp;</td><td>%d</td>"
                           "<td>%d</td><td>%d</td><td>%d</td><td>%d</td>"
-                          "</tr>\n</table>\n",
+                          "<td>%" APR_UINT64_T_FMT "</td><td>%"
+                          APR_UINT64_T_FMT "</td></tr>\n</table>\n",
                           connections, busy_workers, idle_workers,
-                          write_completion, keep_alive, lingering_close);
+                          write_completion, keep_alive, lingering_close,
+                          timeouts_expired, timeouts_usecs / 1000);
 
         }
         else {
             ap_rprintf(r, "ConnsTotal: %d\n"
                           "ConnsAsyncWriting: %d\n"
                           "ConnsAsyncKeepAlive: %d\n"
-                          "ConnsAsyncClosing: %d\n",
+                          "ConnsAsyncClosing: %d\n"
+                          "ConnsAsyncLingering: %d\n"
+                          "ConnsAsyncLingeringShort: %d\n"
+                          "TimeoutsExpired: %" APR_UINT64_T_FMT "\n"
+                          "TimeoutsExpireMsecs: %" APR_UINT64_T_FMT "\n",
                        connections, write_completion, keep_alive,
-                       lingering_close);
+                       lingering_close, lingering_normal, lingering_short,
+                       timeouts_expired, timeouts_usecs / 1000);
         }
     }
 
@@ -371,6 +371,43 @@ AP_DECLARE(void) ap_process_request_after_handler(request_rec *r)
     }
 }
 
+AP_DECLARE(void) ap_finish_suspended_request(request_rec *r, int status)
+{
+    ap_die_r(status, r, HTTP_OK);
+
+    ap_process_request_after_handler(r);
+}
+
+AP_DECLARE(apr_status_t) ap_read_request_body(request_rec *r,
+                                              apr_bucket_brigade *bb,
+                                              apr_off_t readbytes,
+                                              ap_mpm_callback_fn_t *cbfn,
+                                              void *baton)
+{
+    apr_status_t rv;
+
+    if (cbfn && !r->main && !r->prev) {
+        rv = ap_get_brigade(r->input_filters, bb, AP_MODE_READBYTES,
+                            APR_NONBLOCK_READ, readbytes);
+        /* a non-blocking read which would block may also succeed with an
+         * empty brigade
+         */
+        if (rv == APR_SUCCESS && APR_BRIGADE_EMPTY(bb)) {
+            rv = APR_EAGAIN;
+        }
+        if (!APR_STATUS_IS_EAGAIN(rv)) {
+            return rv;
+        }
+        if (ap_mpm_register_input_callback(r->connection, cbfn,
+                                           baton) == APR_SUCCESS) {
+            return APR_EAGAIN;
+        }
+    }
+
+    return ap_get_brigade(r->input_filters, bb, AP_MODE_READBYTES,
+                          APR_BLOCK_READ, readbytes);
+}
+
 void ap_process_async_request(request_rec *r)
 {
     conn_rec *c = r->connection;
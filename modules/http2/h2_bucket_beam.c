@@ -647,17 +647,32 @@ static apr_status_t append_bucket(h2_bucket_beam *beam,
          * Additionally, we allow callbacks to prevent beaming file
          * handles across. The use case for this is to limit the number 
          * of open file handles and rather use a less efficient beam
-         * transport. */
-        apr_file_t *fd = ((apr_bucket_file *)bred->data)->fd;
+         * transport. 
+         * Handles opened for use by several threads (APR_FOPEN_XTHREAD),
+         * like the ones of mod_file_cache or the shared ones we get from
+         * the share callback, outlive the red side and are beamed as is. */
+        apr_bucket_file *f = (apr_bucket_file *)bred->data;
+        apr_file_t *fd = f->fd, *shared;
         int can_beam = 1;
-        if (beam->last_beamed != fd && beam->can_beam_fn) {
-            can_beam = beam->can_beam_fn(beam->can_beam_ctx, beam, fd);
+        if (apr_file_flags_get(fd) & APR_FOPEN_XTHREAD) {
+            status = APR_SUCCESS;
         }
-        if (can_beam) {
-            beam->last_beamed = fd;
-            status = apr_bucket_setaside(bred, pool);
+        else {
+            if (beam->last_beamed != fd && beam->can_beam_fn) {
+                can_beam = beam->can_beam_fn(beam->can_beam_ctx, beam, fd);
+            }
+            if (can_beam) {
+                beam->last_beamed = fd;
+                status = apr_bucket_setaside(bred, pool);
+            }
+            else if (beam->share_file_fn 
+                     && (shared = beam->share_file_fn(beam->share_file_ctx, 
+                                                      beam, fd))) {
+                f->fd = shared;
+                status = APR_SUCCESS;
+            }
+            /* else: enter ENOTIMPL case below */
         }
-        /* else: enter ENOTIMPL case below */
     }
     
     if (status == APR_ENOTIMPL) {
@@ -784,10 +799,13 @@ transfer:
             else if (APR_BUCKET_IS_FILE(bred)) {
                 /* This is set aside into the target brigade pool so that 
                  * any read operation messes with that pool and not 
-                 * the red one. */
+                 * the red one. Shared handles are not ours to set aside,
+                 * reading those reopens the file in the target pool. */
                 apr_bucket_file *f = (apr_bucket_file *)bred->data;
                 apr_file_t *fd = f->fd;
-                int setaside = (f->readpool != bb->p);
+                int setaside = (f->readpool != bb->p
+                                && !(apr_file_flags_get(fd) 
+                                     & APR_FOPEN_XTHREAD));
                 
                 if (setaside) {
                     status = apr_file_setaside(&fd, fd, bb->p);
@@ -921,6 +939,18 @@ void h2_beam_on_file_beam(h2_bucket_beam *beam,
     }
 }
 
+void h2_beam_on_file_share(h2_bucket_beam *beam, 
+                           h2_beam_share_file_callback *cb, void *ctx)
+{
+    h2_beam_lock bl;
+    
+    if (enter_yellow(beam, &bl) == APR_SUCCESS) {
+        beam->share_file_fn = cb;
+        beam->share_file_ctx = ctx;
+        leave_yellow(beam, &bl);
+    }
+}
+
 
 apr_off_t h2_beam_get_buffered(h2_bucket_beam *beam)
 {
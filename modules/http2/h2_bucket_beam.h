@@ -163,6 +163,10 @@ typedef struct {
 typedef int h2_beam_can_beam_callback(void *ctx, h2_bucket_beam *beam,
                                       apr_file_t *file);
 
+typedef apr_file_t *h2_beam_share_file_callback(void *ctx, 
+                                                h2_bucket_beam *beam,
+                                                apr_file_t *file);
+
 struct h2_bucket_beam {
     int id;
     const char *tag;
@@ -199,6 +203,8 @@ struct h2_bucket_beam {
     void *produced_ctx;
     h2_beam_can_beam_callback *can_beam_fn;
     void *can_beam_ctx;
+    h2_beam_share_file_callback *share_file_fn;
+    void *share_file_ctx;
 };
 
 /**
@@ -342,6 +348,19 @@ void h2_beam_on_produced(h2_bucket_beam *beam,
 void h2_beam_on_file_beam(h2_bucket_beam *beam, 
                           h2_beam_can_beam_callback *cb, void *ctx);
 
+/**
+ * Register a callback to be invoked on the red side when a file handle
+ * may not be beamed (see h2_beam_on_file_beam()). The callback may return
+ * another handle on the same file, opened with APR_FOPEN_XTHREAD, that 
+ * stays valid for the lifetime of the red pool. The file is then beamed 
+ * with that handle instead of being read into memory.
+ * @param beam the beam to set the callback on
+ * @param cb   the callback or NULL
+ * @param ctx  the context to use in callback invocation
+ */
+void h2_beam_on_file_share(h2_bucket_beam *beam, 
+                           h2_beam_share_file_callback *cb, void *ctx);
+
 /**
  * Get the amount of bytes currently buffered in the beam (unread).
  */
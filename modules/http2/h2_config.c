@@ -35,6 +35,7 @@
 #include "h2_config.h"
 #include "h2_h2.h"
 #include "h2_private.h"
+#include "h2_push.h"
 
 #define DEF_VAL     (-1)
 
@@ -61,7 +62,7 @@ static h2_config defconf = {
     1,                      /* HTTP/2 server push enabled */
     NULL,                   /* map of content-type to priorities */
     256,                    /* push diary size */
-    
+    0,                      /* max session workers, 0 for H2MaxWorkers */
 };
 
 void h2_config_init(apr_pool_t *pool)
@@ -95,6 +96,7 @@ static void *h2_config_create(apr_pool_t *pool,
     conf->h2_push              = DEF_VAL;
     conf->priorities           = NULL;
     conf->push_diary_size      = DEF_VAL;
+    conf->max_session_workers  = DEF_VAL;
     
     return conf;
 }
@@ -141,6 +143,7 @@ void *h2_config_merge(apr_pool_t *pool, void *basev, void *addv)
         n->priorities       = add->priorities? add->priorities : base->priorities;
     }
     n->push_diary_size      = H2_CONFIG_GET(add, base, push_diary_size);
+    n->max_session_workers  = H2_CONFIG_GET(add, base, max_session_workers);
     
     return n;
 }
@@ -185,6 +188,8 @@ apr_int64_t h2_config_geti64(const h2_config *conf, h2_config_var_t var)
             return H2_CONFIG_GET(conf, &defconf, h2_push);
         case H2_CONF_PUSH_DIARY_SIZE:
             return H2_CONFIG_GET(conf, &defconf, push_diary_size);
+        case H2_CONF_MAX_SESSION_WORKERS:
+            return H2_CONFIG_GET(conf, &defconf, max_session_workers);
         default:
             return DEF_VAL;
     }
@@ -257,6 +262,18 @@ static const char *h2_conf_set_max_workers(cmd_parms *parms,
     return NULL;
 }
 
+static const char *h2_conf_set_max_session_workers(cmd_parms *parms,
+                                                   void *arg, const char *value)
+{
+    h2_config *cfg = (h2_config *)h2_config_sget(parms->server);
+    cfg->max_session_workers = (int)apr_atoi64(value);
+    (void)arg;
+    if (cfg->max_session_workers < 0) {
+        return "value must be >= 0";
+    }
+    return NULL;
+}
+
 static const char *h2_conf_set_max_worker_idle_secs(cmd_parms *parms,
                                                     void *arg, const char *value)
 {
@@ -500,6 +517,14 @@ static const char *h2_conf_set_push_diary_size(cmd_parms *parms,
     return NULL;
 }
 
+static const char *h2_conf_set_push_diary_cache(cmd_parms *parms,
+                                                void *arg, const char *value,
+                                                const char *cookie)
+{
+    (void)arg;
+    return h2_push_diary_cache_config(parms, value, cookie);
+}
+
 #define AP_END_CMD     AP_INIT_TAKE1(NULL, NULL, NULL, RSRC_CONF, NULL)
 
 const command_rec h2_cmds[] = {
@@ -511,6 +536,8 @@ const command_rec h2_cmds[] = {
                   RSRC_CONF, "minimum number of worker threads per child"),
     AP_INIT_TAKE1("H2MaxWorkers", h2_conf_set_max_workers, NULL,
                   RSRC_CONF, "maximum number of worker threads per child"),
+    AP_INIT_TAKE1("H2MaxSessionWorkers", h2_conf_set_max_session_workers, NULL,
+                  RSRC_CONF, "maximum number of workers processing the streams of a session"),
     AP_INIT_TAKE1("H2MaxWorkerIdleSeconds", h2_conf_set_max_worker_idle_secs, NULL,
                   RSRC_CONF, "maximum number of idle seconds before a worker shuts down"),
     AP_INIT_TAKE1("H2StreamMaxMemSize", h2_conf_set_stream_max_mem_size, NULL,
@@ -539,6 +566,9 @@ const command_rec h2_cmds[] = {
                   RSRC_CONF, "define priority of PUSHed resources per content type"),
     AP_INIT_TAKE1("H2PushDiarySize", h2_conf_set_push_diary_size, NULL,
                   RSRC_CONF, "size of push diary"),
+    AP_INIT_TAKE12("H2PushDiaryCache", h2_conf_set_push_diary_cache, NULL,
+                  RSRC_CONF, "socache provider for push diaries and the cookie "
+                  "identifying a client"),
     AP_END_CMD
 };
 
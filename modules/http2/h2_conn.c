@@ -35,6 +35,7 @@
 #include "h2_stream.h"
 #include "h2_h2.h"
 #include "h2_task.h"
+#include "h2_util.h"
 #include "h2_worker.h"
 #include "h2_workers.h"
 #include "h2_conn.h"
@@ -116,6 +117,7 @@ apr_status_t h2_conn_child_init(apr_pool_t *pool, server_rec *s)
     }
 
     h2_config_init(pool);
+    h2_util_nv_cache_init(pool);
     
     minw = h2_config_geti(config, H2_CONF_MIN_WORKERS);
     maxw = h2_config_geti(config, H2_CONF_MAX_WORKERS);    
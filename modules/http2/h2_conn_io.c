@@ -207,7 +207,9 @@ static apr_status_t read_to_scratch(h2_conn_io *io, apr_bucket *b)
     }
     
     AP_DEBUG_ASSERT(b->length <= (io->ssize - io->slen));
-    if (APR_BUCKET_IS_FILE(b)) {
+    if (APR_BUCKET_IS_FILE(b) 
+        && !(apr_file_flags_get(((apr_bucket_file *)b->data)->fd) 
+             & APR_FOPEN_XTHREAD)) {
         apr_bucket_file *f = (apr_bucket_file *)b->data;
         apr_file_t *fd = f->fd;
         apr_off_t offset = b->start;
@@ -216,6 +218,8 @@ static apr_status_t read_to_scratch(h2_conn_io *io, apr_bucket *b)
         /* file buckets will either mmap (which we do not want) or
          * read 8000 byte chunks and split themself. However, we do
          * know *exactly* how many bytes we need where.
+         * Handles shared with other threads are not positioned by us,
+         * those are read as bucket below.
          */
         status = apr_file_seek(fd, APR_SET, &offset);
         if (status != APR_SUCCESS) {
@@ -269,6 +273,25 @@ static void check_write_size(h2_conn_io *io)
     }
 }
 
+/* Handles opened for several threads, like the ones h2_workers shares
+ * among connections, must not be set aside by the core output filter:
+ * apr_file_setaside() would take them from all the other users. */
+static int has_shared_file(apr_bucket_brigade *bb)
+{
+    apr_bucket *b;
+    
+    for (b = APR_BRIGADE_FIRST(bb); 
+         b != APR_BRIGADE_SENTINEL(bb); 
+         b = APR_BUCKET_NEXT(b)) {
+        if (APR_BUCKET_IS_FILE(b)
+            && (apr_file_flags_get(((apr_bucket_file *)b->data)->fd) 
+                & APR_FOPEN_XTHREAD)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 static apr_status_t pass_output(h2_conn_io *io, int flush, int eoc)
 {
     conn_rec *c = io->c;
@@ -277,6 +300,10 @@ static apr_status_t pass_output(h2_conn_io *io, int flush, int eoc)
     apr_status_t status;
     
     append_scratch(io);
+    if (!flush && has_shared_file(io->output)) {
+        /* write them out now, as the session does when it flushes */
+        flush = 1;
+    }
     if (flush) {
         b = apr_bucket_flush_create(c->bucket_alloc);
         APR_BRIGADE_INSERT_TAIL(io->output, b);
@@ -354,6 +381,16 @@ apr_status_t h2_conn_io_write(h2_conn_io *io, const char *data, size_t length)
             }
         }
     }
+    else if (!APR_BRIGADE_EMPTY(io->output) 
+             && APR_BUCKET_IS_FILE(APR_BRIGADE_LAST(io->output))) {
+        /* Small writes in between file data, the DATA frame headers, 
+         * get a bucket of their own size instead of a new buffer of 
+         * the brigade's. The core writes them, corked, right before
+         * it sendfiles the file range that follows. */
+        apr_bucket *b = apr_bucket_heap_create(data, length, NULL, 
+                                               io->c->bucket_alloc);
+        APR_BRIGADE_INSERT_TAIL(io->output, b);
+    }
     else {
         status = apr_brigade_write(io->output, NULL, NULL, data, length);
     }
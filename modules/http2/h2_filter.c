@@ -216,6 +216,7 @@ static apr_status_t h2_status_stream_filter(h2_stream *stream)
     conn_rec *c = session->c;
     h2_push_diary *diary;
     apr_bucket_brigade *bb;
+    apr_uint32_t hits, misses;
     apr_status_t status;
     
     if (!stream->response) {
@@ -239,12 +240,25 @@ static apr_status_t h2_status_stream_filter(h2_stream *stream)
     bbout(bb, "  \"this_stream\": %d,\n", stream->id);
     bbout(bb, "  \"streams_open\": %d,\n", (int)h2_ihash_count(session->streams));
     bbout(bb, "  \"max_stream_started\": %d,\n", mplx->max_stream_started);
+    bbout(bb, "  \"session_workers_max\": %d,\n", (int)mplx->workers_max);
+    bbout(bb, "  \"tasks_started\": %d,\n", (int)mplx->tasks_started);
+    bbout(bb, "  \"queue_wait_avg_ms\": %.3f,\n", mplx->tasks_started?
+          (double)mplx->queue_wait_total / mplx->tasks_started / 1000 : 0.0);
+    bbout(bb, "  \"queue_wait_max_ms\": %.3f,\n", 
+          (double)mplx->queue_wait_max / 1000);
+    bbout(bb, "  \"this_stream_queue_wait_ms\": %.3f,\n", 
+          (double)stream->queue_wait / 1000);
     bbout(bb, "  \"requests_received\": %d,\n", session->remote.emitted_count);
     bbout(bb, "  \"responses_submitted\": %d,\n", session->responses_submitted);
     bbout(bb, "  \"streams_reset\": %d, \n", session->streams_reset);
     bbout(bb, "  \"pushes_promised\": %d,\n", session->pushes_promised);
     bbout(bb, "  \"pushes_submitted\": %d,\n", session->pushes_submitted);
     bbout(bb, "  \"pushes_reset\": %d,\n", session->pushes_reset);
+    h2_util_nv_cache_stats(&hits, &misses);
+    bbout(bb, "  \"header_cache_hits\": %lu,\n", (unsigned long)hits);
+    bbout(bb, "  \"header_cache_misses\": %lu,\n", (unsigned long)misses);
+    bbout(bb, "  \"header_cache_hit_ratio\": %.3f,\n", (hits + misses)?
+          (double)hits / ((double)hits + misses) : 0.0);
     
     diary = session->push_diary;
     if (diary) {
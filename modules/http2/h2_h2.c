@@ -460,6 +460,14 @@ int h2_h2_is_tls(conn_rec *c)
     return opt_ssl_is_https && opt_ssl_is_https(c);
 }
 
+const char *h2_h2_tls_var(conn_rec *c, apr_pool_t *pool, const char *name)
+{
+    if (opt_ssl_var_lookup && h2_h2_is_tls(c)) {
+        return opt_ssl_var_lookup(pool, c->base_server, c, NULL, (char*)name);
+    }
+    return NULL;
+}
+
 int h2_is_acceptable_connection(conn_rec *c, int require_all) 
 {
     int is_tls = h2_h2_is_tls(c);
@@ -44,6 +44,11 @@ apr_status_t h2_h2_init(apr_pool_t *pool, server_rec *s);
  */
 int h2_h2_is_tls(conn_rec *c);
 
+/* Look up a mod_ssl variable, e.g. SSL_SESSION_ID, for the connection.
+ * NULL if it is not a TLS connection.
+ */
+const char *h2_h2_tls_var(conn_rec *c, apr_pool_t *pool, const char *name);
+
 /* Register apache hooks for h2 protocol
  */
 void h2_h2_register_hooks(void);
@@ -168,6 +168,23 @@ static int can_beam_file(void *ctx, h2_bucket_beam *beam,  apr_file_t *file)
     return 0;
 }
 
+static apr_file_t *share_file(void *ctx, h2_bucket_beam *beam, 
+                              apr_file_t *file)
+{
+    h2_mplx *m = ctx;
+    apr_file_t *shared = NULL;
+    
+    /* Only worth it for files the master connection will sendfile, 
+     * reading a shared handle needs to reopen the file anyway. */
+    if (apr_file_flags_get(file) & APR_FOPEN_SENDFILE_ENABLED) {
+        shared = h2_workers_file_share(m->workers, file, beam->red_pool);
+    }
+    ap_log_cerror(APLOG_MARK, APLOG_TRACE3, 0, m->c,
+                  "h2_mplx(%ld-%d): share_file %s on %s", 
+                  m->id, beam->id, shared? "granted" : "denied", beam->tag);
+    return shared;
+}
+
 static void have_out_data_for(h2_mplx *m, int stream_id);
 static void task_destroy(h2_mplx *m, h2_task *task, int called_from_master);
 
@@ -246,6 +263,7 @@ h2_mplx *h2_mplx_create(conn_rec *c, apr_pool_t *parent,
     apr_status_t status = APR_SUCCESS;
     apr_allocator_t *allocator = NULL;
     h2_mplx *m;
+    int max_session_workers;
     AP_DEBUG_ASSERT(conf);
     
     status = apr_allocator_create(&allocator);
@@ -293,7 +311,11 @@ h2_mplx *h2_mplx_create(conn_rec *c, apr_pool_t *parent,
         m->stream_timeout = stream_timeout;
         m->workers = workers;
         m->workers_max = workers->max_workers;
-        m->workers_def_limit = 4;
+        max_session_workers = h2_config_geti(conf, H2_CONF_MAX_SESSION_WORKERS);
+        if (max_session_workers > 0 && max_session_workers < m->workers_max) {
+            m->workers_max = max_session_workers;
+        }
+        m->workers_def_limit = H2MIN(4, m->workers_max);
         m->workers_limit = m->workers_def_limit;
         m->last_limit_change = m->last_idle_block = apr_time_now();
         m->limit_change_interval = apr_time_from_msec(200);
@@ -678,6 +700,10 @@ static apr_status_t out_open(h2_mplx *m, int stream_id, h2_response *response)
         h2_beam_on_consumed(task->output.beam, stream_output_consumed, task);
         m->tx_handles_reserved -= h2_beam_get_files_beamed(task->output.beam);
         h2_beam_on_file_beam(task->output.beam, can_beam_file, m);
+        if (!h2_h2_is_tls(m->c)) {
+            /* cleartext, file buckets are sendfile'd by the core */
+            h2_beam_on_file_share(task->output.beam, share_file, m);
+        }
         h2_beam_mutex_set(task->output.beam, beam_enter, task->cond, m);
     }
     
@@ -831,6 +857,7 @@ apr_status_t h2_mplx_process(h2_mplx *m, struct h2_stream *stream,
                     do_registration = m->need_registration;
                 }
                 h2_iq_add(m->q, stream->id, cmp, ctx);
+                stream->queued_at = apr_time_now();
                 
                 ap_log_cerror(APLOG_MARK, APLOG_TRACE1, status, m->c,
                               "h2_mplx(%ld-%d): process, body=%d", 
@@ -881,6 +908,12 @@ static h2_task *pop_task(h2_mplx *m)
             stream->started = 1;
             task->worker_started = 1;
             task->started_at = apr_time_now();
+            stream->queue_wait = task->started_at - stream->queued_at;
+            ++m->tasks_started;
+            m->queue_wait_total += stream->queue_wait;
+            if (stream->queue_wait > m->queue_wait_max) {
+                m->queue_wait_max = stream->queue_wait;
+            }
             if (sid > m->max_stream_started) {
                 m->max_stream_started = sid;
             }
@@ -974,6 +1007,7 @@ static void task_done(h2_mplx *m, h2_task *task, h2_req_engine *ngn)
             h2_task_redo(task);
             h2_ihash_remove(m->redo_tasks, task->stream_id);
             h2_iq_add(m->q, task->stream_id, NULL, NULL);
+            stream->queued_at = apr_time_now();
             return;
         }
         
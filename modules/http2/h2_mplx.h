@@ -88,7 +88,11 @@ struct h2_mplx {
     apr_uint32_t workers_busy;       /* # of workers processing on this mplx */
     apr_uint32_t workers_limit;      /* current # of workers limit, dynamic */
     apr_uint32_t workers_def_limit;  /* default # of workers limit */
-    apr_uint32_t workers_max;        /* max, hard limit # of workers in a process */
+    apr_uint32_t workers_max;        /* max, hard limit # of workers for this mplx,
+                                      * H2MaxWorkers or H2MaxSessionWorkers */
+    apr_uint32_t tasks_started;      /* # of tasks started */
+    apr_interval_time_t queue_wait_total; /* sum of the streams' queue_wait */
+    apr_interval_time_t queue_wait_max;   /* max of the streams' queue_wait */
     apr_time_t last_idle_block;      /* last time, this mplx entered IDLE while
                                       * streams were ready */
     apr_time_t last_limit_change;    /* last time, worker limit changed */
@@ -27,7 +27,11 @@
 
 #include <httpd.h>
 #include <http_core.h>
+#include <http_config.h>
 #include <http_log.h>
+#include <ap_provider.h>
+#include <ap_socache.h>
+#include <util_mutex.h>
 
 #include "h2_private.h"
 #include "h2_h2.h"
@@ -480,14 +484,22 @@ apr_array_header_t *h2_push_collect(apr_pool_t *p, const h2_request *req,
  *      http://giovanni.bajo.it/post/47119962313/golomb-coded-sets-smaller-than-bloom-filters
  * - The means that the push diary might be initialized with hash values of much
  *   less than 64 bits, leading to more false positives, but smaller digest size.
+ * - Entries are found via a hash table on their value and kept in a ring,
+ *   ordered by last use. Forgotten entries are kept for reuse.
+ * - With 'H2PushDiaryCache' configured, the diary of a client is stored as
+ *   a cache digest in a socache, under a cookie value or the TLS session id,
+ *   and picked up again by the next connection of that client.
  ******************************************************************************/
  
  
 #define GCSLOG_LEVEL   APLOG_TRACE1
 
-typedef struct h2_push_diary_entry {
+typedef struct h2_push_diary_entry h2_push_diary_entry;
+
+struct h2_push_diary_entry {
+    APR_RING_ENTRY(h2_push_diary_entry) link;
     apr_uint64_t hash;
-} h2_push_diary_entry;
+};
 
 
 #ifdef H2_OPENSSL
@@ -527,16 +539,13 @@ static unsigned int val_apr_hash(const char *str)
 static void calc_apr_hash(h2_push_diary *diary, apr_uint64_t *phash, h2_push *push) 
 {
     apr_uint64_t val;
-#if APR_UINT64MAX > APR_UINT_MAX
-    val = (val_apr_hash(push->req->scheme) << 32);
-    val ^= (val_apr_hash(push->req->authority) << 16);
-    val ^= val_apr_hash(push->req->path);
-#else
-    val = val_apr_hash(push->req->scheme);
-    val ^= val_apr_hash(push->req->authority);
-    val ^= val_apr_hash(push->req->path);
-#endif
-    *phash = val;
+    
+    /* As with sha256, only the upper mask_bits are used, so these need
+     * to vary with the path. */
+    val = ((apr_uint64_t)val_apr_hash(push->req->path) << 32);
+    val ^= ((apr_uint64_t)val_apr_hash(push->req->authority) << 16);
+    val ^= val_apr_hash(push->req->scheme);
+    *phash = val >> (64 - diary->mask_bits);
 }
 
 static apr_int32_t ceil_power_of_2(apr_int32_t n)
@@ -551,6 +560,16 @@ static apr_int32_t ceil_power_of_2(apr_int32_t n)
     return ++n;
 }
 
+static unsigned int diary_entry_hash(const char *key, apr_ssize_t *klen)
+{
+    /* the keys are hash values already, use the lower bits as they come */
+    apr_uint64_t val;
+    
+    memcpy(&val, key, sizeof(val));
+    (void)klen;
+    return (unsigned int)val;
+}
+
 static h2_push_diary *diary_create(apr_pool_t *p, h2_push_digest_type dtype, 
                                    apr_size_t N)
 {
@@ -567,8 +586,10 @@ static h2_push_diary *diary_create(apr_pool_t *p, h2_push_digest_type dtype,
          * If we set the diary via a compressed golomb set, we have less
          * relevant bits and need to use a smaller mask. */
         diary->mask_bits   = 64;
-        /* grows by doubling, start with a power of 2 */
-        diary->entries     = apr_array_make(p, 16, sizeof(h2_push_diary_entry));
+        diary->pool        = p;
+        diary->entries     = apr_hash_make_custom(p, diary_entry_hash);
+        APR_RING_INIT(&diary->lru, h2_push_diary_entry, link);
+        APR_RING_INIT(&diary->spare, h2_push_diary_entry, link);
         
         switch (dtype) {
 #ifdef H2_OPENSSL
@@ -592,62 +613,68 @@ h2_push_diary *h2_push_diary_create(apr_pool_t *p, apr_size_t N)
     return diary_create(p, H2_PUSH_DIGEST_SHA256, N);
 }
 
-static int h2_push_diary_find(h2_push_diary *diary, apr_uint64_t hash)
+static h2_push_diary_entry *h2_push_diary_find(h2_push_diary *diary, 
+                                               apr_uint64_t hash)
 {
-    if (diary) {
-        h2_push_diary_entry *e;
-        int i;
+    return apr_hash_get(diary->entries, &hash, sizeof(hash));
+}
 
-        /* search from the end, where the last accessed digests are */
-        for (i = diary->entries->nelts-1; i >= 0; --i) {
-            e = &APR_ARRAY_IDX(diary->entries, i, h2_push_diary_entry);
-            if (e->hash == hash) {
-                return i;
-            }
-        }
-    }
-    return -1;
+static void move_to_last(h2_push_diary *diary, h2_push_diary_entry *e)
+{
+    APR_RING_REMOVE(e, link);
+    APR_RING_INSERT_TAIL(&diary->lru, e, h2_push_diary_entry, link);
 }
 
-static h2_push_diary_entry *move_to_last(h2_push_diary *diary, apr_size_t idx)
+static void h2_push_diary_forget(h2_push_diary *diary, h2_push_diary_entry *e)
 {
-    h2_push_diary_entry *entries = (h2_push_diary_entry*)diary->entries->elts;
-    h2_push_diary_entry e;
-    apr_size_t lastidx = diary->entries->nelts-1;
-    
-    /* move entry[idx] to the end */
-    if (idx < lastidx) {
-        e =  entries[idx];
-        memmove(entries+idx, entries+idx+1, sizeof(e) * (lastidx - idx));
-        entries[lastidx] = e;
-    }
-    return &entries[lastidx];
+    apr_hash_set(diary->entries, &e->hash, sizeof(e->hash), NULL);
+    APR_RING_REMOVE(e, link);
+    APR_RING_INSERT_TAIL(&diary->spare, e, h2_push_diary_entry, link);
 }
 
-static void h2_push_diary_append(h2_push_diary *diary, h2_push_diary_entry *e)
+static void h2_push_diary_clear(h2_push_diary *diary)
+{
+    apr_hash_clear(diary->entries);
+    APR_RING_CONCAT(&diary->spare, &diary->lru, h2_push_diary_entry, link);
+}
+
+static h2_push_diary_entry *diary_next_free(h2_push_diary *diary)
 {
     h2_push_diary_entry *ne;
     
-    if (diary->entries->nelts < diary->N) {
-        /* append a new diary entry at the end */
-        APR_ARRAY_PUSH(diary->entries, h2_push_diary_entry) = *e;
-        ne = &APR_ARRAY_IDX(diary->entries, diary->entries->nelts-1, h2_push_diary_entry);
+    if (apr_hash_count(diary->entries) >= diary->N) {
+        /* forget the least recently used one. keeps memory usage constant 
+         * once the diary is full */
+        h2_push_diary_forget(diary, APR_RING_FIRST(&diary->lru));
+    }
+    if (!APR_RING_EMPTY(&diary->spare, h2_push_diary_entry, link)) {
+        ne = APR_RING_FIRST(&diary->spare);
+        APR_RING_REMOVE(ne, link);
     }
     else {
-        /* replace content with new digest. keeps memory usage constant once diary is full */
-        ne = move_to_last(diary, 0);
-        *ne = *e;
+        ne = apr_pcalloc(diary->pool, sizeof(*ne));
     }
+    return ne;
+}
+
+static void h2_push_diary_append(h2_push_diary *diary, apr_uint64_t hash)
+{
+    h2_push_diary_entry *ne = diary_next_free(diary);
+    
+    ne->hash = hash;
+    apr_hash_set(diary->entries, &ne->hash, sizeof(ne->hash), ne);
+    APR_RING_INSERT_TAIL(&diary->lru, ne, h2_push_diary_entry, link);
     /* Intentional no APLOGNO */
-    ap_log_perror(APLOG_MARK, GCSLOG_LEVEL, 0, diary->entries->pool,
+    ap_log_perror(APLOG_MARK, GCSLOG_LEVEL, 0, diary->pool,
                   "push_diary_append: %"APR_UINT64_T_HEX_FMT, ne->hash);
 }
 
 apr_array_header_t *h2_push_diary_update(h2_session *session, apr_array_header_t *pushes)
 {
     apr_array_header_t *npushes = pushes;
-    h2_push_diary_entry e;
-    int i, idx;
+    h2_push_diary_entry *e;
+    apr_uint64_t hash;
+    int i;
     
     if (session->push_diary && pushes) {
         npushes = NULL;
@@ -656,13 +683,13 @@ apr_array_header_t *h2_push_diary_update(h2_session *session, apr_array_header_t
             h2_push *push;
             
             push = APR_ARRAY_IDX(pushes, i, h2_push*);
-            session->push_diary->dcalc(session->push_diary, &e.hash, push);
-            idx = h2_push_diary_find(session->push_diary, e.hash);
-            if (idx >= 0) {
+            session->push_diary->dcalc(session->push_diary, &hash, push);
+            e = h2_push_diary_find(session->push_diary, hash);
+            if (e) {
                 /* Intentional no APLOGNO */
                 ap_log_cerror(APLOG_MARK, GCSLOG_LEVEL, 0, session->c,
                               "push_diary_update: already there PUSH %s", push->req->path);
-                move_to_last(session->push_diary, idx);
+                move_to_last(session->push_diary, e);
             }
             else {
                 /* Intentional no APLOGNO */
@@ -672,22 +699,217 @@ apr_array_header_t *h2_push_diary_update(h2_session *session, apr_array_header_t
                     npushes = apr_array_make(pushes->pool, 5, sizeof(h2_push_diary_entry*));
                 }
                 APR_ARRAY_PUSH(npushes, h2_push*) = push;
-                h2_push_diary_append(session->push_diary, &e);
+                h2_push_diary_append(session->push_diary, hash);
             }
         }
     }
     return npushes;
 }
     
+/*******************************************************************************
+ * push diary cache, shared by all connections
+ ******************************************************************************/
+
+/* The maximum number of bits we keep per hash value in the cache. Each 
+ * value in the digest takes about 2 bits more. */
+#define H2_PUSH_DIARY_CACHE_P       (1 << 20)
+#define H2_PUSH_DIARY_CACHE_TIMEOUT apr_time_from_sec(24 * 60 * 60)
+#define H2_PUSH_DIARY_COOKIE_MAX    256
+
+static const char *const diary_cache_id = "h2-push-diary";
+static ap_socache_provider_t *diary_cache_provider;
+static ap_socache_instance_t *diary_cache;
+static apr_global_mutex_t *diary_cache_mutex;
+static const char *diary_cache_cookie;
+
+/* Drop the lowest bits of all hash values, so that they compare to values
+ * with the given number of relevant bits. Values that become equal collapse
+ * into the most recently used one. */
+static void diary_reduce(h2_push_diary *diary, unsigned int mask_bits)
+{
+    h2_push_diary_entry *e, *next, *older;
+    unsigned int shift;
+    
+    if (mask_bits >= diary->mask_bits) {
+        return;
+    }
+    shift = diary->mask_bits - mask_bits;
+    diary->mask_bits = mask_bits;
+    
+    apr_hash_clear(diary->entries);
+    for (e = APR_RING_FIRST(&diary->lru); 
+         e != APR_RING_SENTINEL(&diary->lru, h2_push_diary_entry, link);
+         e = next) {
+        next = APR_RING_NEXT(e, link);
+        e->hash >>= shift;
+        older = h2_push_diary_find(diary, e->hash);
+        if (older) {
+            h2_push_diary_forget(diary, older);
+        }
+        apr_hash_set(diary->entries, &e->hash, sizeof(e->hash), e);
+    }
+}
+
+/* Add the entries of 'from' as being used before all entries in 'diary',
+ * for as long as there is room. */
+static void diary_merge(h2_push_diary *diary, h2_push_diary *from)
+{
+    h2_push_diary_entry *e, *ne;
+    
+    diary_reduce(diary, from->mask_bits);
+    diary_reduce(from, diary->mask_bits);
+    
+    for (e = APR_RING_LAST(&from->lru); 
+         e != APR_RING_SENTINEL(&from->lru, h2_push_diary_entry, link)
+         && apr_hash_count(diary->entries) < diary->N;
+         e = APR_RING_PREV(e, link)) {
+        if (!h2_push_diary_find(diary, e->hash)) {
+            ne = diary_next_free(diary);
+            ne->hash = e->hash;
+            apr_hash_set(diary->entries, &ne->hash, sizeof(ne->hash), ne);
+            APR_RING_INSERT_HEAD(&diary->lru, ne, h2_push_diary_entry, link);
+        }
+    }
+}
+
+static const char *find_cookie(apr_pool_t *p, const char *cookies, 
+                               const char *name)
+{
+    apr_size_t nlen = strlen(name);
+    const char *s = cookies, *val, *end;
+    
+    while (s && *s) {
+        while (*s == ';' || apr_isspace(*s)) {
+            ++s;
+        }
+        if (!strncmp(s, name, nlen) && s[nlen] == '=') {
+            val = s + nlen + 1;
+            end = ap_strchr_c(val, ';');
+            if (!end) {
+                end = val + strlen(val);
+            }
+            while (end > val && apr_isspace(end[-1])) {
+                --end;
+            }
+            return apr_pstrmemdup(p, val, end - val);
+        }
+        s = ap_strchr_c(s, ';');
+    }
+    return NULL;
+}
+
+/* The key a client's diary is cached under: the value of the configured 
+ * cookie, if the request carries it, or the TLS session id. */
+static const char *diary_cache_key(h2_session *session, 
+                                   const struct h2_request *req, apr_pool_t *p)
+{
+    const char *val;
+    
+    if (diary_cache_cookie) {
+        val = apr_table_get(req->headers, "Cookie");
+        val = val? find_cookie(p, val, diary_cache_cookie) : NULL;
+        if (val && *val && strlen(val) <= H2_PUSH_DIARY_COOKIE_MAX) {
+            return apr_pstrcat(p, "cookie:", val, NULL);
+        }
+    }
+    val = h2_h2_tls_var(session->c, p, "SSL_SESSION_ID");
+    if (val && *val) {
+        return apr_pstrcat(p, "tls:", val, NULL);
+    }
+    return NULL;
+}
+
+static void diary_cache_load(h2_session *session, const struct h2_request *req, 
+                             apr_pool_t *p)
+{
+    h2_push_diary *diary = session->push_diary, *stored;
+    const char *key;
+    unsigned char *data;
+    unsigned int len;
+    apr_status_t status;
+    
+    key = diary_cache_key(session, req, p);
+    if (!key) {
+        /* nothing to identify the client by (yet) */
+        return;
+    }
+    diary->cache_key = apr_pstrdup(diary->pool, key);
+    
+    /* a digest has 2 bytes header and at most log2p + 2 bits per entry */
+    len = (unsigned int)(2 + diary->NMax * 3);
+    data = apr_palloc(p, len);
+    if (diary_cache_mutex) {
+        apr_global_mutex_lock(diary_cache_mutex);
+    }
+    status = diary_cache_provider->retrieve(diary_cache, session->s, 
+                                            (const unsigned char *)key, 
+                                            (unsigned int)strlen(key), 
+                                            data, &len, p);
+    if (diary_cache_mutex) {
+        apr_global_mutex_unlock(diary_cache_mutex);
+    }
+    
+    if (status == APR_SUCCESS) {
+        stored = diary_create(p, diary->dtype, diary->NMax);
+        status = h2_push_diary_digest_set(stored, NULL, (const char *)data, len);
+        if (status == APR_SUCCESS) {
+            diary_merge(diary, stored);
+            /* Intentional no APLOGNO */
+            ap_log_cerror(APLOG_MARK, GCSLOG_LEVEL, 0, session->c,
+                          "h2_session(%ld): push diary loaded for %s, "
+                          "%d entries", session->id, key, 
+                          (int)apr_hash_count(diary->entries));
+        }
+    }
+    if (status != APR_SUCCESS && !APR_STATUS_IS_NOTFOUND(status)) {
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, status, session->c, 
+                      APLOGNO(03412) "h2_session(%ld): loading push diary "
+                      "for %s", session->id, key);
+    }
+}
+
+static void diary_cache_store(h2_session *session, apr_pool_t *p)
+{
+    h2_push_diary *diary = session->push_diary;
+    const char *data;
+    apr_size_t len;
+    apr_status_t status;
+    
+    status = h2_push_diary_digest_get(diary, p, H2_PUSH_DIARY_CACHE_P, NULL, 
+                                      &data, &len);
+    if (status == APR_SUCCESS) {
+        if (diary_cache_mutex) {
+            apr_global_mutex_lock(diary_cache_mutex);
+        }
+        status = diary_cache_provider->store(diary_cache, session->s, 
+                                             (const unsigned char *)diary->cache_key,
+                                             (unsigned int)strlen(diary->cache_key),
+                                             apr_time_now() + H2_PUSH_DIARY_CACHE_TIMEOUT,
+                                             (unsigned char *)data, 
+                                             (unsigned int)len, p);
+        if (diary_cache_mutex) {
+            apr_global_mutex_unlock(diary_cache_mutex);
+        }
+    }
+    if (status != APR_SUCCESS) {
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, status, session->c, 
+                      APLOGNO(03413) "h2_session(%ld): storing push diary "
+                      "for %s", session->id, diary->cache_key);
+    }
+}
+
 apr_array_header_t *h2_push_collect_update(h2_stream *stream, 
                                            const struct h2_request *req, 
                                            const struct h2_response *res)
 {
     h2_session *session = stream->session;
     const char *cache_digest = apr_table_get(req->headers, "Cache-Digest");
-    apr_array_header_t *pushes;
+    apr_array_header_t *pushes, *npushes;
     apr_status_t status;
     
+    if (session->push_diary && diary_cache && !session->push_diary->cache_key) {
+        diary_cache_load(session, req, stream->pool);
+    }
     if (cache_digest && session->push_diary) {
         status = h2_push_diary_digest64_set(session->push_diary, req->authority, 
                                             cache_digest, stream->pool);
@@ -699,7 +921,11 @@ apr_array_header_t *h2_push_collect_update(h2_stream *stream,
         }
     }
     pushes = h2_push_collect(stream->pool, req, res);
-    return h2_push_diary_update(stream->session, pushes);
+    npushes = h2_push_diary_update(stream->session, pushes);
+    if (npushes && session->push_diary && session->push_diary->cache_key) {
+        diary_cache_store(session, stream->pool);
+    }
+    return npushes;
 }
 
 static apr_int32_t h2_log2inv(unsigned char log2)
@@ -821,7 +1047,7 @@ apr_status_t h2_push_diary_digest_get(h2_push_diary *diary, apr_pool_t *pool,
     apr_uint64_t *hashes;
     apr_size_t hash_count;
     
-    nelts = diary->entries->nelts;
+    nelts = apr_hash_count(diary->entries);
     
     if (nelts > APR_UINT32_MAX) {
         /* should not happen */
@@ -864,11 +1090,15 @@ apr_status_t h2_push_diary_digest_get(h2_push_diary *diary, apr_pool_t *pool,
                   
     if (!authority || !diary->authority 
         || !strcmp("*", authority) || !strcmp(diary->authority, authority)) {
-        hash_count = diary->entries->nelts;
-        hashes = apr_pcalloc(encoder.pool, hash_count);
-        for (i = 0; i < hash_count; ++i) {
-            hashes[i] = ((&APR_ARRAY_IDX(diary->entries, i, h2_push_diary_entry))->hash 
-                         >> encoder.delta_bits);
+        h2_push_diary_entry *e;
+        
+        hash_count = nelts;
+        hashes = apr_pcalloc(encoder.pool, hash_count * sizeof(apr_uint64_t));
+        i = 0;
+        for (e = APR_RING_FIRST(&diary->lru); 
+             e != APR_RING_SENTINEL(&diary->lru, h2_push_diary_entry, link);
+             e = APR_RING_NEXT(e, link)) {
+            hashes[i++] = e->hash >> encoder.delta_bits;
         }
         
         qsort(hashes, hash_count, sizeof(apr_uint64_t), cmp_puint64);
@@ -966,8 +1196,8 @@ apr_status_t h2_push_diary_digest_set(h2_push_diary *diary, const char *authorit
     gset_decoder decoder;
     unsigned char log2n, log2p;
     apr_size_t N, i;
-    apr_pool_t *pool = diary->entries->pool;
-    h2_push_diary_entry e;
+    apr_pool_t *pool = diary->pool;
+    apr_uint64_t hash;
     apr_status_t status = APR_SUCCESS;
     
     if (len < 2) {
@@ -983,12 +1213,12 @@ apr_status_t h2_push_diary_digest_set(h2_push_diary *diary, const char *authorit
     }
     
     /* whatever is in the digest, it replaces the diary entries */
-    apr_array_clear(diary->entries);
+    h2_push_diary_clear(diary);
     if (!authority || !strcmp("*", authority)) {
         diary->authority = NULL;
     }
     else if (!diary->authority || strcmp(diary->authority, authority)) {
-        diary->authority = apr_pstrdup(diary->entries->pool, authority);
+        diary->authority = apr_pstrdup(diary->pool, authority);
     }
 
     N = h2_log2inv(log2n + log2p);
@@ -1025,17 +1255,19 @@ apr_status_t h2_push_diary_digest_set(h2_push_diary *diary, const char *authorit
                   (int)decoder.log2p);
                   
     for (i = 0; i < diary->N; ++i) {
-        if (gset_decode_next(&decoder, &e.hash) != APR_SUCCESS) {
+        if (gset_decode_next(&decoder, &hash) != APR_SUCCESS) {
             /* the data may have less than N values */
             break;
         }
-        h2_push_diary_append(diary, &e);
+        if (!h2_push_diary_find(diary, hash)) {
+            h2_push_diary_append(diary, hash);
+        }
     }
     
     /* Intentional no APLOGNO */
     ap_log_perror(APLOG_MARK, GCSLOG_LEVEL, 0, pool,
                   "h2_push_diary_digest_set: diary now with %d entries, mask_bits=%d", 
-                  (int)diary->entries->nelts, diary->mask_bits);
+                  (int)apr_hash_count(diary->entries), diary->mask_bits);
     return status;
 }
 
@@ -1051,3 +1283,117 @@ apr_status_t h2_push_diary_digest64_set(h2_push_diary *diary, const char *author
     return h2_push_diary_digest_set(diary, authority, data, len);
 }
 
+const char *h2_push_diary_cache_config(cmd_parms *cmd, const char *spec, 
+                                       const char *cookie)
+{
+    const char *errmsg = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    const char *sep, *name;
+    
+    if (errmsg) {
+        return errmsg;
+    }
+    
+    /* Argument is of form 'name:args' or just 'name'. */
+    sep = ap_strchr_c(spec, ':');
+    if (sep) {
+        name = apr_pstrmemdup(cmd->pool, spec, sep - spec);
+        sep++;
+    }
+    else {
+        name = spec;
+    }
+    
+    diary_cache_provider = ap_lookup_provider(AP_SOCACHE_PROVIDER_GROUP, name,
+                                              AP_SOCACHE_PROVIDER_VERSION);
+    if (diary_cache_provider == NULL) {
+        return apr_psprintf(cmd->pool, "Unknown socache provider '%s'. Maybe "
+                            "you need to load the appropriate socache module "
+                            "(mod_socache_%s?)", name, name);
+    }
+    errmsg = diary_cache_provider->create(&diary_cache, sep, 
+                                          cmd->temp_pool, cmd->pool);
+    if (errmsg) {
+        diary_cache = NULL;
+        return errmsg;
+    }
+    diary_cache_cookie = cookie;
+    return NULL;
+}
+
+apr_status_t h2_push_diary_cache_pre_config(apr_pool_t *pconf)
+{
+    diary_cache_provider = NULL;
+    diary_cache = NULL;
+    diary_cache_mutex = NULL;
+    diary_cache_cookie = NULL;
+    return ap_mutex_register(pconf, diary_cache_id, NULL, APR_LOCK_DEFAULT, 0);
+}
+
+static apr_status_t diary_cache_remove_lock(void *data)
+{
+    (void)data;
+    if (diary_cache_mutex) {
+        apr_global_mutex_destroy(diary_cache_mutex);
+        diary_cache_mutex = NULL;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t diary_cache_destroy(void *data)
+{
+    if (diary_cache) {
+        diary_cache_provider->destroy(diary_cache, (server_rec*)data);
+        diary_cache = NULL;
+    }
+    return APR_SUCCESS;
+}
+
+apr_status_t h2_push_diary_cache_post_config(apr_pool_t *pconf, apr_pool_t *ptemp,
+                                             server_rec *s)
+{
+    /* average key and digest lengths, expiry in microseconds */
+    static struct ap_socache_hints diary_cache_hints = {
+        48, 128, H2_PUSH_DIARY_CACHE_TIMEOUT
+    };
+    apr_status_t status;
+    
+    (void)ptemp;
+    if (!diary_cache) {
+        return APR_SUCCESS;
+    }
+    
+    if (diary_cache_provider->flags & AP_SOCACHE_FLAG_NOTMPSAFE) {
+        status = ap_global_mutex_create(&diary_cache_mutex, NULL, diary_cache_id, 
+                                        NULL, s, pconf, 0);
+        if (status != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_CRIT, status, s, APLOGNO(03414)
+                         "failed to create %s mutex", diary_cache_id);
+            return status;
+        }
+        apr_pool_cleanup_register(pconf, NULL, diary_cache_remove_lock, 
+                                  apr_pool_cleanup_null);
+    }
+    
+    status = diary_cache_provider->init(diary_cache, diary_cache_id, 
+                                        &diary_cache_hints, s, pconf);
+    if (status != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_CRIT, status, s, APLOGNO(03415)
+                     "failed to initialise %s cache", diary_cache_id);
+        return status;
+    }
+    apr_pool_cleanup_register(pconf, (void*)s, diary_cache_destroy, 
+                              apr_pool_cleanup_null);
+    return APR_SUCCESS;
+}
+
+apr_status_t h2_push_diary_cache_child_init(apr_pool_t *pool, server_rec *s)
+{
+    const char *lock;
+    
+    (void)s;
+    if (!diary_cache_mutex) {
+        return APR_SUCCESS;
+    }
+    lock = apr_global_mutex_lockfile(diary_cache_mutex);
+    return apr_global_mutex_child_init(&diary_cache_mutex, lock, pool);
+}
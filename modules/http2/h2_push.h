@@ -17,6 +17,8 @@
 
 #include "h2.h"
 
+struct apr_hash_t;
+struct cmd_parms_struct;
 struct h2_request;
 struct h2_response;
 struct h2_ngheader;
@@ -36,8 +38,13 @@ typedef struct h2_push_diary h2_push_diary;
 
 typedef void h2_push_digest_calc(h2_push_diary *diary, apr_uint64_t *phash, h2_push *push);
 
+APR_RING_HEAD(h2_push_diary_ring, h2_push_diary_entry);
+
 struct h2_push_diary {
-    apr_array_header_t  *entries;
+    apr_pool_t          *pool;
+    struct apr_hash_t   *entries; /* hash value -> entry, for lookup */
+    struct h2_push_diary_ring lru;   /* entries, least recently used first */
+    struct h2_push_diary_ring spare; /* entries forgotten, for reuse */
     apr_size_t           NMax; /* Maximum for N, should size change be necessary */
     apr_size_t           N;    /* Current maximum number of entries, power of 2 */
     apr_uint64_t         mask; /* mask for relevant bits */
@@ -45,6 +52,7 @@ struct h2_push_diary {
     const char          *authority;
     h2_push_digest_type  dtype;
     h2_push_digest_calc *dcalc;
+    const char          *cache_key; /* key in the push diary cache, if known */
 };
 
 /**
@@ -113,4 +121,35 @@ apr_status_t h2_push_diary_digest_set(h2_push_diary *diary, const char *authorit
 apr_status_t h2_push_diary_digest64_set(h2_push_diary *diary, const char *authority, 
                                         const char *data64url, apr_pool_t *pool);
 
+/**
+ * Configure the cache that keeps the push diaries of clients across 
+ * connections. The diary of a connection is stored as a cache digest (see
+ * h2_push_diary_digest_get()) under the value of the given cookie or, 
+ * lacking that, under the TLS session id.
+ * 
+ * @param cmd the directive being processed
+ * @param spec the socache provider as 'name' or 'name:args'
+ * @param cookie the name of the cookie identifying a client or NULL
+ * @return NULL on success or an error message
+ */
+const char *h2_push_diary_cache_config(struct cmd_parms_struct *cmd, const char *spec, 
+                                       const char *cookie);
+
+/**
+ * Register the mutex of the push diary cache. Needs to happen in 
+ * pre_config.
+ */
+apr_status_t h2_push_diary_cache_pre_config(apr_pool_t *pconf);
+
+/**
+ * Initialize the push diary cache, if one is configured.
+ */
+apr_status_t h2_push_diary_cache_post_config(apr_pool_t *pconf, apr_pool_t *ptemp,
+                                             server_rec *s);
+
+/**
+ * Initialize the push diary cache in a child process.
+ */
+apr_status_t h2_push_diary_cache_child_init(apr_pool_t *pool, server_rec *s);
+
 #endif /* defined(__mod_h2__h2_push__) */
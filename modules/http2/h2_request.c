@@ -286,9 +286,18 @@ request_rec *h2_request_create_rec(const h2_request *req, conn_rec *c)
      * called by ap_die and by ap_send_error_response works correctly on
      * status codes that do not cause the connection to be dropped and
      * in situations where the connection should be kept alive.
+     * A body without content-length is not chunked by our H2_TO_H1
+     * filter, it ends with the stream, so H2_REQUEST_BODY reads it
+     * instead (the "Transfer-Encoding: chunked" header stays, for the
+     * modules to know that there is a body).
      */
-    ap_add_input_filter_handle(ap_http_input_filter_handle,
-                               NULL, r, r->connection);
+    if (req->chunked) {
+        ap_add_input_filter("H2_REQUEST_BODY", NULL, r, r->connection);
+    }
+    else {
+        ap_add_input_filter_handle(ap_http_input_filter_handle,
+                                   NULL, r, r->connection);
+    }
     
     if (access_status != HTTP_OK
         || (access_status = ap_run_post_read_request(r))) {
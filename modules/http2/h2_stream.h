@@ -66,6 +66,9 @@ struct h2_stream {
     
     apr_off_t input_remaining;  /* remaining bytes on input as advertised via content-length */
     apr_off_t data_frames_sent; /* # of DATA frames sent out for this stream */
+    
+    apr_time_t queued_at;       /* when queued for a worker (h2_mplx) */
+    apr_interval_time_t queue_wait; /* from queued to its task started */
 };
 
 
@@ -83,8 +83,7 @@ static void make_chunk(h2_task *task, apr_bucket_brigade *bb,
     }
 }
 
-static apr_status_t input_handle_eos(h2_task *task, request_rec *r, 
-                                     apr_bucket *b)
+static apr_status_t input_handle_eos(h2_task *task, apr_bucket *b)
 {
     apr_status_t status = APR_SUCCESS;
     apr_bucket_brigade *bb = task->input.bb;
@@ -102,15 +101,11 @@ static apr_status_t input_handle_eos(h2_task *task, request_rec *r,
         }
         APR_BRIGADE_CONCAT(bb, task->input.tmp);
     }
-    else if (r && t && !apr_is_empty_table(t)){
-        /* trailers passed in directly. */
-        apr_table_overlap(r->trailers_in, t, APR_OVERLAP_TABLES_SET);
-    }
     task->input.eos_written = 1;
     return status;
 }
 
-static apr_status_t input_append_eos(h2_task *task, request_rec *r)
+static apr_status_t input_append_eos(h2_task *task)
 {
     apr_status_t status = APR_SUCCESS;
     apr_bucket_brigade *bb = task->input.bb;
@@ -126,10 +121,6 @@ static apr_status_t input_append_eos(h2_task *task, request_rec *r)
             status = apr_brigade_puts(bb, NULL, NULL, "0\r\n\r\n");
         }
     }
-    else if (r && t && !apr_is_empty_table(t)){
-        /* trailers passed in directly. */
-        apr_table_overlap(r->trailers_in, t, APR_OVERLAP_TABLES_SET);
-    }
     APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(bb->bucket_alloc));
     task->input.eos_written = 1;
     return status;
@@ -157,7 +148,7 @@ static apr_status_t input_read(h2_task *task, ap_filter_t* f,
     
     if (!task->input.bb) {
         if (!task->input.eos_written) {
-            input_append_eos(task, f->r);
+            input_append_eos(task);
         }
         return APR_EOF;
     }
@@ -226,7 +217,7 @@ static apr_status_t input_read(h2_task *task, ap_filter_t* f,
                 }
                 if (APR_BUCKET_IS_EOS(b)) {
                     task->input.eos = 1;
-                    input_handle_eos(task, f->r, b);
+                    input_handle_eos(task, b);
                     h2_util_bb_log(f->c, task->stream_id, APLOG_TRACE2, 
                                    "input.bb after handle eos", 
                                    task->input.bb);
@@ -252,7 +243,7 @@ static apr_status_t input_read(h2_task *task, ap_filter_t* f,
     }
     
     if (!task->input.eos_written && task->input.eos) {
-        input_append_eos(task, f->r);
+        input_append_eos(task);
     }
 
     h2_util_bb_log(f->c, task->stream_id, APLOG_TRACE2, 
@@ -506,6 +497,91 @@ static apr_status_t h2_filter_read_response(ap_filter_t* filter,
     return h2_from_h1_read_response(task->output.from_h1, filter, bb);
 }
 
+typedef struct {
+    apr_off_t limit;
+    apr_off_t read;
+    unsigned int eos_sent : 1;
+} h2_body_ctx;
+
+/* The request body filter taking the place of HTTP_IN for requests
+ * without content-length which are not serialized: the body arrives from
+ * the stream as it is and ends with the stream's EOS, so there is no
+ * chunked encoding to add (by H2_TO_H1) and to parse again (by HTTP_IN),
+ * only LimitRequestBody to check, and the trailers to set on the request
+ * at the end. */
+static apr_status_t h2_filter_request_body(ap_filter_t* f,
+                                           apr_bucket_brigade* bb,
+                                           ap_input_mode_t mode,
+                                           apr_read_type_e block,
+                                           apr_off_t readbytes)
+{
+    h2_body_ctx *ctx = f->ctx;
+    apr_status_t status;
+    apr_bucket *b;
+    apr_off_t len;
+    
+    if (mode != AP_MODE_READBYTES && mode != AP_MODE_GETLINE) {
+        return ap_get_brigade(f->next, bb, mode, block, readbytes);
+    }
+    if (!ctx) {
+        f->ctx = ctx = apr_pcalloc(f->r->pool, sizeof(*ctx));
+        ctx->limit = ap_get_limit_req_body(f->r);
+    }
+    if (ctx->eos_sent) {
+        /* read again after the end, like HTTP_IN */
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(f->c->bucket_alloc));
+        return APR_SUCCESS;
+    }
+    
+    status = ap_get_brigade(f->next, bb, mode, block, readbytes);
+    if (APR_STATUS_IS_EOF(status)) {
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(f->c->bucket_alloc));
+        status = APR_SUCCESS;
+    }
+    if (status != APR_SUCCESS) {
+        return status;
+    }
+    
+    for (b = APR_BRIGADE_FIRST(bb);
+         b != APR_BRIGADE_SENTINEL(bb);
+         b = APR_BUCKET_NEXT(b)) {
+        if (APR_BUCKET_IS_EOS(b)) {
+            h2_task *task = h2_ctx_cget_task(f->c);
+            apr_table_t *t = task->request->trailers;
+            
+            if (t && !apr_is_empty_table(t)) {
+                core_server_config *conf = 
+                    ap_get_core_module_config(f->r->server->module_config);
+                
+                apr_table_overlap(f->r->trailers_in, t, 
+                                  APR_OVERLAP_TABLES_SET);
+                /* like HTTP_IN */
+                if (conf->merge_trailers == AP_MERGE_TRAILERS_ENABLE) {
+                    f->r->headers_in = apr_table_overlay(f->r->pool, 
+                                                         f->r->headers_in,
+                                                         f->r->trailers_in);
+                }
+            }
+            ctx->eos_sent = 1;
+            break;
+        }
+    }
+    
+    if (ctx->limit) {
+        apr_brigade_length(bb, 1, &len);
+        ctx->read += len;
+        if (ctx->read > ctx->limit) {
+            ap_log_rerror(APLOG_MARK, APLOG_INFO, 0, f->r, APLOGNO(03411)
+                          "h2_task(%s): request body larger than the "
+                          "configured limit of %" APR_OFF_T_FMT, 
+                          h2_ctx_cget_task(f->c)->id, ctx->limit);
+            apr_brigade_cleanup(bb);
+            return APR_ENOSPC;
+        }
+    }
+    return APR_SUCCESS;
+}
+
 /*******************************************************************************
  * task things
  ******************************************************************************/
@@ -607,6 +683,8 @@ void h2_task_register_hooks(void)
                               NULL, AP_FTYPE_PROTOCOL);
     ap_register_output_filter("H2_TRAILERS", h2_response_trailers_filter,
                               NULL, AP_FTYPE_PROTOCOL);
+    ap_register_input_filter("H2_REQUEST_BODY", h2_filter_request_body,
+                             NULL, AP_FTYPE_PROTOCOL);
 }
 
 /* post config init */
@@ -696,7 +774,9 @@ apr_status_t h2_task_do(h2_task *task, apr_thread_t *thread)
     AP_DEBUG_ASSERT(task);
     
     task->input.block = APR_BLOCK_READ;
-    task->input.chunked = task->request->chunked;
+    /* Only the HTTP/1 parsing of serialized requests needs the body of
+     * unknown length in chunks, see h2_request_create_rec(). */
+    task->input.chunked = task->request->chunked && task->ser_headers;
     task->input.eos = !task->request->body;
     if (task->input.eos && !task->input.chunked && !task->ser_headers) {
         /* We do not serialize/chunk and have eos already, no need to
@@ -717,7 +797,7 @@ apr_status_t h2_task_do(h2_task *task, apr_thread_t *thread)
             apr_brigade_puts(task->input.bb, NULL, NULL, "\r\n");
         }
         if (task->input.eos) {
-            input_append_eos(task, NULL);
+            input_append_eos(task);
         }
     }
     
@@ -14,6 +14,7 @@
  */
 
 #include <assert.h>
+#include <apr_atomic.h>
 #include <apr_strings.h>
 
 #include <httpd.h>
@@ -1186,22 +1187,250 @@ static int count_header(void *ctx, const char *key, const char *value)
     return 1;
 }
 
-#define NV_ADD_LIT_CS(nv, k, v)     add_header(nv, k, sizeof(k) - 1, v, strlen(v))
-#define NV_ADD_CS_CS(nv, k, v)      add_header(nv, k, strlen(k), v, strlen(v))
+/* The strings in the nv cache live as long as the child. With nghttp2
+ * >= 1.17.0, we can tell it to not copy them. */
+#if NGHTTP2_VERSION_NUM >= 0x011100
+#define H2_NV_NO_COPY_NAME      NGHTTP2_NV_FLAG_NO_COPY_NAME
+#define H2_NV_NO_COPY_VALUE     NGHTTP2_NV_FLAG_NO_COPY_VALUE
+#else
+#define H2_NV_NO_COPY_NAME      0
+#define H2_NV_NO_COPY_VALUE     0
+#endif
+
+#define H2_NV_CACHE_SLOTS       1024    /* power of 2 */
+#define H2_NV_CACHE_ENTRIES     512
+#define H2_NV_CACHE_PROBES      8
+#define H2_NV_CACHE_VALUE_MAX   128
+
+typedef struct {
+    const char *name;           /* lower case, as nghttp2 needs uncopied */
+    size_t len;
+    int cache_values;           /* NV_CACHE_*, if the values rarely vary */
+} nv_name;
+
+#define NV_CACHE_NONE       0
+#define NV_CACHE_ALL        1
+#define NV_CACHE_CHARSET    2   /* only values without parameters other 
+                                 * than a charset */
+
+/* The value cache is filled once and never evicts, so only the values of
+ * fields set by the configuration or the content are cached, not those 
+ * which vary per response or echo the request (like the Origin in
+ * access-control-allow-origin, or the nonces of content-security-policy):
+ * clients could fill it up with them for the lifetime of the child. 
+ * This also goes for the max-age mod_expires computes from the modification
+ * time in cache-control, and the boundary mod_byterange puts in the
+ * multipart/byteranges content-type. */
+
+/* sorted, for the binary search */
+static const nv_name NVNames[] = {
+    { ":status",                     7, NV_CACHE_ALL },
+    { "accept-ranges",              13, NV_CACHE_ALL },
+    { "access-control-allow-origin", 27, NV_CACHE_NONE },
+    { "age",                         3, NV_CACHE_NONE },
+    { "alt-svc",                     7, NV_CACHE_ALL },
+    { "cache-control",              13, NV_CACHE_NONE },
+    { "content-encoding",           16, NV_CACHE_ALL },
+    { "content-language",           16, NV_CACHE_ALL },
+    { "content-length",             14, NV_CACHE_NONE },
+    { "content-location",           16, NV_CACHE_NONE },
+    { "content-security-policy",    23, NV_CACHE_NONE },
+    { "content-type",               12, NV_CACHE_CHARSET },
+    { "date",                        4, NV_CACHE_NONE },
+    { "etag",                        4, NV_CACHE_NONE },
+    { "expires",                     7, NV_CACHE_NONE },
+    { "last-modified",              13, NV_CACHE_NONE },
+    { "link",                        4, NV_CACHE_NONE },
+    { "location",                    8, NV_CACHE_NONE },
+    { "referrer-policy",            15, NV_CACHE_ALL },
+    { "server",                      6, NV_CACHE_ALL },
+    { "set-cookie",                 10, NV_CACHE_NONE },
+    { "strict-transport-security",  25, NV_CACHE_ALL },
+    { "vary",                        4, NV_CACHE_ALL },
+    { "x-content-type-options",     22, NV_CACHE_ALL },
+    { "x-frame-options",            15, NV_CACHE_ALL },
+    { "x-xss-protection",           16, NV_CACHE_ALL },
+};
+
+typedef struct {
+    apr_uint32_t hash;
+    const nv_name *name;
+    size_t valuelen;
+    char value[H2_NV_CACHE_VALUE_MAX + 1];
+} nv_entry;
+
+/* The entries are added lock free, claiming the next free one and 
+ * putting it into an empty slot with a compare-and-swap. They are never 
+ * changed or removed, the cache just stops growing once full. */
+typedef struct {
+    nv_entry * volatile slots[H2_NV_CACHE_SLOTS];
+    nv_entry *entries;
+    volatile apr_uint32_t nentries;
+    volatile apr_uint32_t hits;
+    volatile apr_uint32_t misses;
+} nv_cache;
+
+static nv_cache *NVCache;
+
+apr_status_t h2_util_nv_cache_init(apr_pool_t *pool)
+{
+    nv_cache *cache = apr_pcalloc(pool, sizeof(*cache));
+    cache->entries = apr_pcalloc(pool, H2_NV_CACHE_ENTRIES 
+                                 * sizeof(nv_entry));
+    NVCache = cache;
+    return APR_SUCCESS;
+}
+
+void h2_util_nv_cache_stats(apr_uint32_t *phits, apr_uint32_t *pmisses)
+{
+    *phits = NVCache? apr_atomic_read32(&NVCache->hits) : 0;
+    *pmisses = NVCache? apr_atomic_read32(&NVCache->misses) : 0;
+}
+
+static const nv_name *nv_name_get(const char *key, size_t key_len)
+{
+    int lo = 0, hi = H2_ALEN(NVNames) - 1, mid, cmp;
+    
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        cmp = ap_casecmpstrn(key, NVNames[mid].name, 
+                             H2MIN(key_len, NVNames[mid].len));
+        if (!cmp) {
+            cmp = (key_len < NVNames[mid].len)? -1 :
+                  (key_len > NVNames[mid].len)? 1 : 0;
+            if (!cmp) {
+                return &NVNames[mid];
+            }
+        }
+        if (cmp < 0) {
+            hi = mid - 1;
+        }
+        else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
 
+static const nv_entry *nv_cache_get(const nv_name *name, 
+                                    const char *value, size_t val_len)
+{
+    apr_uint32_t hash, i, n;
+    const unsigned char *s = (const unsigned char *)value;
+    nv_entry * volatile *slot;
+    nv_entry *e;
+    
+    if (val_len > H2_NV_CACHE_VALUE_MAX) {
+        return NULL;
+    }
+    /* FNV-1a */
+    hash = (2166136261U ^ (apr_uint32_t)(name - NVNames)) * 16777619U;
+    for (i = 0; i < val_len; ++i) {
+        hash = (hash ^ s[i]) * 16777619U;
+    }
+    
+    for (i = 0; i < H2_NV_CACHE_PROBES; ++i) {
+        slot = &NVCache->slots[(hash + i) & (H2_NV_CACHE_SLOTS - 1)];
+        e = *slot;
+        if (!e) {
+            if (apr_atomic_read32(&NVCache->nentries) >= H2_NV_CACHE_ENTRIES
+                || (n = apr_atomic_inc32(&NVCache->nentries)) 
+                    >= H2_NV_CACHE_ENTRIES) {
+                return NULL;
+            }
+            e = &NVCache->entries[n];
+            e->hash = hash;
+            e->name = name;
+            e->valuelen = val_len;
+            memcpy(e->value, value, val_len);
+            if (!apr_atomic_casptr((volatile void **)slot, e, NULL)) {
+                return e;
+            }
+            /* another thread added one here first, our entry is lost */
+            e = *slot;
+        }
+        if (e->hash == hash && e->name == name && e->valuelen == val_len
+            && !memcmp(e->value, value, val_len)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static int nv_value_cacheable(const nv_name *name, 
+                              const char *value, size_t val_len)
+{
+    const char *end = value + val_len, *s;
+    
+    if (name->cache_values != NV_CACHE_CHARSET) {
+        return name->cache_values;
+    }
+    for (s = memchr(value, ';', val_len); s; 
+         s = memchr(s, ';', end - s)) {
+        for (++s; s < end && (*s == ' ' || *s == '\t'); ++s);
+        if (end - s < 8 || ap_casecmpstrn(s, "charset=", 8)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Returns != 0 iff the value is not from the cache */
 static int add_header(h2_ngheader *ngh, 
                       const char *key, size_t key_len,
                       const char *value, size_t val_len)
 {
     nghttp2_nv *nv = &ngh->nv[ngh->nvlen++];
+    const nv_name *name;
+    const nv_entry *e;
     
     nv->name = (uint8_t*)key;
     nv->namelen = key_len;
     nv->value = (uint8_t*)value;
     nv->valuelen = val_len;
+    
+    if (NVCache && (name = nv_name_get(key, key_len))) {
+        nv->name = (uint8_t*)name->name;
+        nv->flags |= H2_NV_NO_COPY_NAME;
+        if (nv_value_cacheable(name, value, val_len)) {
+            if ((e = nv_cache_get(name, value, val_len))) {
+                nv->value = (uint8_t*)e->value;
+                nv->flags |= H2_NV_NO_COPY_VALUE;
+                ++ngh->cache_hits;
+                return 0;
+            }
+            ++ngh->cache_misses;
+        }
+    }
     return 1;
 }
 
+static void add_status(h2_ngheader *ngh, apr_pool_t *p, int http_status)
+{
+    char buffer[16];
+    int len = apr_snprintf(buffer, sizeof(buffer), "%d", http_status);
+    
+    if (add_header(ngh, ":status", 7, buffer, len)) {
+        ngh->nv[ngh->nvlen-1].value = (uint8_t*)apr_pstrmemdup(p, buffer, 
+                                                               len);
+    }
+}
+
+static void count_cache_use(h2_ngheader *ngh)
+{
+    /* once per header set, not per field, to keep the contention on 
+     * the shared counters low */
+    if (ngh->cache_hits) {
+        apr_atomic_add32(&NVCache->hits, ngh->cache_hits);
+    }
+    if (ngh->cache_misses) {
+        apr_atomic_add32(&NVCache->misses, ngh->cache_misses);
+    }
+}
+
+#define NV_ADD_LIT_CS(nv, k, v)     add_header(nv, k, sizeof(k) - 1, v, strlen(v))
+#define NV_ADD_CS_CS(nv, k, v)      add_header(nv, k, strlen(k), v, strlen(v))
+
 static int add_table_header(void *ctx, const char *key, const char *value)
 {
     if (!h2_util_ignore_header(key)) {
@@ -1222,6 +1451,7 @@ h2_ngheader *h2_util_ngheader_make(apr_pool_t *p, apr_table_t *header)
     ngh = apr_pcalloc(p, sizeof(h2_ngheader));
     ngh->nv =  apr_pcalloc(p, n * sizeof(nghttp2_nv));
     apr_table_do(add_table_header, ngh, header, NULL);
+    count_cache_use(ngh);
 
     return ngh;
 }
@@ -1238,8 +1468,9 @@ h2_ngheader *h2_util_ngheader_make_res(apr_pool_t *p,
     
     ngh = apr_pcalloc(p, sizeof(h2_ngheader));
     ngh->nv =  apr_pcalloc(p, n * sizeof(nghttp2_nv));
-    NV_ADD_LIT_CS(ngh, ":status", apr_psprintf(p, "%d", http_status));
+    add_status(ngh, p, http_status);
     apr_table_do(add_table_header, ngh, header, NULL);
+    count_cache_use(ngh);
 
     return ngh;
 }
@@ -1267,6 +1498,7 @@ h2_ngheader *h2_util_ngheader_make_req(apr_pool_t *p,
     NV_ADD_LIT_CS(ngh, ":path", req->path);
     NV_ADD_LIT_CS(ngh, ":method", req->method);
     apr_table_do(add_table_header, ngh, req->headers, NULL);
+    count_cache_use(ngh);
 
     return ngh;
 }
@@ -271,8 +271,27 @@ int h2_util_ignore_header(const char *name);
 typedef struct h2_ngheader {
     nghttp2_nv *nv;
     apr_size_t nvlen;
+    apr_uint32_t cache_hits;
+    apr_uint32_t cache_misses;
 } h2_ngheader;
 
+/**
+ * Set up the cache for the header fields of h2_ngheader, shared by all
+ * HTTP/2 sessions of a child process. Names of well known fields and the
+ * values of the ones that rarely vary (content-type, cache-control, 
+ * server, etc.) are then kept for the lifetime of the child, so that 
+ * nghttp2 does not need to copy them for every HEADERS frame. Without
+ * the cache, all names and values are copied.
+ * @param pool the child pool
+ */
+apr_status_t h2_util_nv_cache_init(apr_pool_t *pool);
+
+/**
+ * Get the number of lookups of cacheable header values in the child 
+ * process, that were found in the cache (hits) or not (misses).
+ */
+void h2_util_nv_cache_stats(apr_uint32_t *phits, apr_uint32_t *pmisses);
+
 h2_ngheader *h2_util_ngheader_make(apr_pool_t *p, apr_table_t *header);
 h2_ngheader *h2_util_ngheader_make_res(apr_pool_t *p, 
                                        int http_status, 
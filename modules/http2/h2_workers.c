@@ -15,6 +15,7 @@
 
 #include <assert.h>
 #include <apr_atomic.h>
+#include <apr_hash.h>
 #include <apr_thread_mutex.h>
 #include <apr_thread_cond.h>
 
@@ -31,11 +32,17 @@
 #include "h2_workers.h"
 
 
-static int in_list(h2_workers *workers, h2_mplx *m)
+static h2_workers_queue *home_queue(h2_workers *workers, h2_mplx *m)
+{
+    return &workers->queues[m->id % workers->nqueues];
+}
+
+/* Called with the lock of the queue held */
+static int in_list(h2_workers_queue *q, h2_mplx *m)
 {
     h2_mplx *e;
-    for (e = H2_MPLX_LIST_FIRST(&workers->mplxs); 
-         e != H2_MPLX_LIST_SENTINEL(&workers->mplxs);
+    for (e = H2_MPLX_LIST_FIRST(&q->mplxs); 
+         e != H2_MPLX_LIST_SENTINEL(&q->mplxs);
          e = H2_MPLX_NEXT(e)) {
         if (e == m) {
             return 1;
@@ -61,7 +68,8 @@ static void cleanup_zombies(h2_workers *workers, int lock)
     }
 }
 
-static h2_task *next_task(h2_workers *workers)
+/* Called with the lock of the queue held */
+static h2_task *next_queue_task(h2_workers *workers, h2_workers_queue *q)
 {
     h2_task *task = NULL;
     h2_mplx *last = NULL;
@@ -72,23 +80,22 @@ static h2_task *next_task(h2_workers *workers)
      * task to the worker.
      * If it (currently) has no tasks, remove it so that it needs
      * to register again for scheduling.
-     * If we run out of h2_mplx in the queue, we need to wait for
-     * new mplx to arrive. Depending on how many workers do exist,
-     * we do a timed wait or block indefinitely.
      */
-    while (!task && !H2_MPLX_LIST_EMPTY(&workers->mplxs)) {
-        h2_mplx *m = H2_MPLX_LIST_FIRST(&workers->mplxs);
+    while (!task && !H2_MPLX_LIST_EMPTY(&q->mplxs)) {
+        h2_mplx *m = H2_MPLX_LIST_FIRST(&q->mplxs);
         
         if (last == m) {
             break;
         }
         H2_MPLX_REMOVE(m);
-        --workers->mplx_count;
+        --q->count;
+        apr_atomic_dec32(&workers->mplx_count);
         
         task = h2_mplx_pop_task(m, &has_more);
         if (has_more) {
-            H2_MPLX_LIST_INSERT_TAIL(&workers->mplxs, m);
-            ++workers->mplx_count;
+            H2_MPLX_LIST_INSERT_TAIL(&q->mplxs, m);
+            ++q->count;
+            apr_atomic_inc32(&workers->mplx_count);
             if (!last) {
                 last = m;
             }
@@ -97,6 +104,32 @@ static h2_task *next_task(h2_workers *workers)
     return task;
 }
 
+static h2_task *next_task(h2_workers *workers, h2_worker *worker)
+{
+    h2_task *task = NULL;
+    int i, home = worker->id % workers->nqueues;
+    
+    /* Our own queue first, then steal from the others. */
+    for (i = 0; i < workers->nqueues && !task; ++i) {
+        h2_workers_queue *q = &workers->queues[(home + i) % workers->nqueues];
+        if (q->count) {
+            apr_thread_mutex_lock(q->lock);
+            task = next_queue_task(workers, q);
+            apr_thread_mutex_unlock(q->lock);
+        }
+    }
+    return task;
+}
+
+static void signal_idle(h2_workers *workers)
+{
+    apr_thread_mutex_lock(workers->lock);
+    if (workers->idle_workers > 0) {
+        apr_thread_cond_signal(workers->mplx_added);
+    }
+    apr_thread_mutex_unlock(workers->lock);
+}
+
 /**
  * Get the next task for the given worker. Will block until a task arrives
  * or the max_wait timer expires and more than min workers exist.
@@ -108,18 +141,42 @@ static apr_status_t get_mplx_next(h2_worker *worker, void *ctx,
     apr_time_t wait_until = 0, now;
     h2_workers *workers = ctx;
     h2_task *task = NULL;
+    apr_uint32_t registered;
     
     *ptask = NULL;
     *psticky = 0;
     
+    /* Without the global lock, when there is work. */
+    if (!h2_worker_is_aborted(worker) && !workers->aborted
+        && (task = next_task(workers, worker))) {
+        *ptask = task;
+        *psticky = (workers->max_workers >= (int)workers->mplx_count);
+        if (apr_atomic_read32(&workers->mplx_count) 
+            && apr_atomic_read32(&workers->idle_workers) > 0) {
+            signal_idle(workers);
+        }
+        return APR_SUCCESS;
+    }
+    
     status = apr_thread_mutex_lock(workers->lock);
     if (status == APR_SUCCESS) {
-        ++workers->idle_workers;
+        apr_atomic_inc32(&workers->idle_workers);
         ap_log_error(APLOG_MARK, APLOG_TRACE3, 0, workers->s,
                      "h2_worker(%d): looking for work", worker->id);
         
-        while (!h2_worker_is_aborted(worker) && !workers->aborted
-               && !(task = next_task(workers))) {
+        while (!h2_worker_is_aborted(worker) && !workers->aborted) {
+            /* h2_workers_register() counts the registrations before it
+             * looks for idle workers to signal (which needs our lock), and
+             * we look at the count after being counted idle, so if nothing
+             * was registered since we started looking, we won't miss the
+             * signal. */
+            registered = apr_atomic_read32(&workers->registrations);
+            if ((task = next_task(workers, worker))) {
+                break;
+            }
+            if (registered != apr_atomic_read32(&workers->registrations)) {
+                continue;
+            }
         
             /* Need to wait for a new tasks to arrive. If we are above
              * minimum workers, we do a timed wait. When timeout occurs
@@ -136,7 +193,7 @@ static apr_status_t get_mplx_next(h2_worker *worker, void *ctx,
                              "h2_worker(%d): waiting signal, "
                              "workers=%d, idle=%d", worker->id, 
                              (int)workers->worker_count, 
-                             workers->idle_workers);
+                             (int)workers->idle_workers);
                 status = apr_thread_cond_timedwait(workers->mplx_added,
                                                    workers->lock, 
                                                    wait_until - now);
@@ -156,7 +213,7 @@ static apr_status_t get_mplx_next(h2_worker *worker, void *ctx,
                              "h2_worker(%d): waiting signal (eternal), "
                              "worker_count=%d, idle=%d", worker->id, 
                              (int)workers->worker_count,
-                             workers->idle_workers);
+                             (int)workers->idle_workers);
                 apr_thread_cond_wait(workers->mplx_added, workers->lock);
             }
         }
@@ -169,20 +226,20 @@ static apr_status_t get_mplx_next(h2_worker *worker, void *ctx,
              * If we have more idle workers than h2_mplx in our queue, then
              * we let the worker be sticky, e.g. making it poll the task's
              * h2_mplx instance for more work before asking back here.
-             * This avoids entering our global lock as long as enough idle
+             * This avoids entering our locks as long as enough idle
              * workers remain. Stickiness of a worker ends when the connection
              * has no new tasks to process, so the worker will get back here
              * eventually.
              */
             *ptask = task;
-            *psticky = (workers->max_workers >= workers->mplx_count);
+            *psticky = (workers->max_workers >= (int)workers->mplx_count);
             
             if (workers->mplx_count && workers->idle_workers > 1) {
                 apr_thread_cond_signal(workers->mplx_added);
             }
         }
         
-        --workers->idle_workers;
+        apr_atomic_dec32(&workers->idle_workers);
         apr_thread_mutex_unlock(workers->lock);
     }
     
@@ -242,6 +299,7 @@ h2_workers *h2_workers_create(server_rec *s, apr_pool_t *server_pool,
     apr_status_t status;
     h2_workers *workers;
     apr_pool_t *pool;
+    int i;
 
     AP_DEBUG_ASSERT(s);
     AP_DEBUG_ASSERT(server_pool);
@@ -275,11 +333,27 @@ h2_workers *h2_workers_create(server_rec *s, apr_pool_t *server_pool,
         
         APR_RING_INIT(&workers->workers, h2_worker, link);
         APR_RING_INIT(&workers->zombies, h2_worker, link);
-        APR_RING_INIT(&workers->mplxs, h2_mplx, link);
         
-        status = apr_thread_mutex_create(&workers->lock,
-                                         APR_THREAD_MUTEX_DEFAULT,
-                                         workers->pool);
+        workers->nqueues = (max_workers + H2_WORKERS_PER_QUEUE - 1) 
+                           / H2_WORKERS_PER_QUEUE;
+        if (workers->nqueues < 1) {
+            workers->nqueues = 1;
+        }
+        workers->queues = apr_pcalloc(workers->pool, workers->nqueues 
+                                      * sizeof(h2_workers_queue));
+        status = APR_SUCCESS;
+        for (i = 0; i < workers->nqueues && status == APR_SUCCESS; ++i) {
+            APR_RING_INIT(&workers->queues[i].mplxs, h2_mplx, link);
+            status = apr_thread_mutex_create(&workers->queues[i].lock,
+                                             APR_THREAD_MUTEX_DEFAULT,
+                                             workers->pool);
+        }
+        
+        if (status == APR_SUCCESS) {
+            status = apr_thread_mutex_create(&workers->lock,
+                                             APR_THREAD_MUTEX_DEFAULT,
+                                             workers->pool);
+        }
         if (status == APR_SUCCESS) {
             status = apr_thread_cond_create(&workers->mplx_added, workers->pool);
         }
@@ -290,6 +364,23 @@ h2_workers *h2_workers_create(server_rec *s, apr_pool_t *server_pool,
                                              workers->pool);
         }
         
+        if (status == APR_SUCCESS) {
+            /* The shared files have pools of their own, created and
+             * destroyed in various threads under the tx_lock, so their
+             * parent needs an allocator not used anywhere else. */
+            apr_allocator_t *allocator = NULL;
+            status = apr_allocator_create(&allocator);
+            if (status == APR_SUCCESS) {
+                apr_pool_create_ex(&workers->files_pool, workers->pool, 
+                                   NULL, allocator);
+                apr_allocator_owner_set(allocator, workers->files_pool);
+                apr_pool_tag(workers->files_pool, "h2_workers_files");
+                workers->files = apr_hash_make(workers->files_pool);
+                APR_RING_INIT(&workers->files_idle, h2_workers_file, link);
+                workers->max_files = max_tx_handles;
+            }
+        }
+        
         if (status == APR_SUCCESS) {
             status = h2_workers_start(workers);
         }
@@ -304,6 +395,8 @@ h2_workers *h2_workers_create(server_rec *s, apr_pool_t *server_pool,
 
 void h2_workers_destroy(h2_workers *workers)
 {
+    int i;
+    
     /* before we go, cleanup any zombie workers that may have accumulated */
     cleanup_zombies(workers, 1);
     
@@ -315,9 +408,16 @@ void h2_workers_destroy(h2_workers *workers)
         apr_thread_mutex_destroy(workers->lock);
         workers->lock = NULL;
     }
-    while (!H2_MPLX_LIST_EMPTY(&workers->mplxs)) {
-        h2_mplx *m = H2_MPLX_LIST_FIRST(&workers->mplxs);
-        H2_MPLX_REMOVE(m);
+    for (i = 0; i < workers->nqueues; ++i) {
+        h2_workers_queue *q = &workers->queues[i];
+        while (!H2_MPLX_LIST_EMPTY(&q->mplxs)) {
+            h2_mplx *m = H2_MPLX_LIST_FIRST(&q->mplxs);
+            H2_MPLX_REMOVE(m);
+        }
+        if (q->lock) {
+            apr_thread_mutex_destroy(q->lock);
+            q->lock = NULL;
+        }
     }
     while (!H2_WORKER_LIST_EMPTY(&workers->workers)) {
         h2_worker *w = H2_WORKER_LIST_FIRST(&workers->workers);
@@ -331,45 +431,56 @@ void h2_workers_destroy(h2_workers *workers)
 
 apr_status_t h2_workers_register(h2_workers *workers, struct h2_mplx *m)
 {
-    apr_status_t status = apr_thread_mutex_lock(workers->lock);
+    h2_workers_queue *q = home_queue(workers, m);
+    apr_status_t status = apr_thread_mutex_lock(q->lock);
     if (status == APR_SUCCESS) {
         ap_log_error(APLOG_MARK, APLOG_TRACE3, status, workers->s,
                      "h2_workers: register mplx(%ld), idle=%d", 
-                     m->id, workers->idle_workers);
-        if (in_list(workers, m)) {
+                     m->id, (int)workers->idle_workers);
+        if (in_list(q, m)) {
             status = APR_EAGAIN;
         }
         else {
-            H2_MPLX_LIST_INSERT_TAIL(&workers->mplxs, m);
-            ++workers->mplx_count;
+            H2_MPLX_LIST_INSERT_TAIL(&q->mplxs, m);
+            ++q->count;
+            apr_atomic_inc32(&workers->mplx_count);
             status = APR_SUCCESS;
         }
+        apr_thread_mutex_unlock(q->lock);
         
-        if (workers->idle_workers > 0) { 
-            apr_thread_cond_signal(workers->mplx_added);
+        /* see get_mplx_next() */
+        apr_atomic_inc32(&workers->registrations);
+        if (apr_atomic_read32(&workers->idle_workers) > 0) { 
+            signal_idle(workers);
         }
         else if (status == APR_SUCCESS 
                  && workers->worker_count < workers->max_workers) {
-            ap_log_error(APLOG_MARK, APLOG_TRACE3, 0, workers->s,
-                         "h2_workers: got %d worker, adding 1", 
-                         workers->worker_count);
-            add_worker(workers);
+            apr_thread_mutex_lock(workers->lock);
+            if (workers->worker_count < workers->max_workers) {
+                ap_log_error(APLOG_MARK, APLOG_TRACE3, 0, workers->s,
+                             "h2_workers: got %d worker, adding 1", 
+                             workers->worker_count);
+                add_worker(workers);
+            }
+            apr_thread_mutex_unlock(workers->lock);
         }
-        apr_thread_mutex_unlock(workers->lock);
     }
     return status;
 }
 
 apr_status_t h2_workers_unregister(h2_workers *workers, struct h2_mplx *m)
 {
-    apr_status_t status = apr_thread_mutex_lock(workers->lock);
+    h2_workers_queue *q = home_queue(workers, m);
+    apr_status_t status = apr_thread_mutex_lock(q->lock);
     if (status == APR_SUCCESS) {
         status = APR_EAGAIN;
-        if (in_list(workers, m)) {
+        if (in_list(q, m)) {
             H2_MPLX_REMOVE(m);
+            --q->count;
+            apr_atomic_dec32(&workers->mplx_count);
             status = APR_SUCCESS;
         }
-        apr_thread_mutex_unlock(workers->lock);
+        apr_thread_mutex_unlock(q->lock);
     }
     return status;
 }
@@ -414,3 +525,146 @@ void h2_workers_tx_free(h2_workers *workers, apr_size_t count)
     }
 }
 
+
+static apr_status_t file_id_get(h2_workers_file_id *id, apr_file_t *file)
+{
+    apr_int32_t wanted = APR_FINFO_IDENT|APR_FINFO_MTIME|APR_FINFO_SIZE;
+    apr_finfo_t finfo;
+    apr_status_t status;
+    
+    status = apr_file_info_get(&finfo, wanted, file);
+    if (status != APR_SUCCESS && status != APR_INCOMPLETE) {
+        return status;
+    }
+    if ((finfo.valid & wanted) != wanted) {
+        return APR_INCOMPLETE;
+    }
+    /* used as hash key, no garbage in the padding */
+    memset(id, 0, sizeof(*id));
+    id->device = finfo.device;
+    id->inode  = finfo.inode;
+    id->mtime  = finfo.mtime;
+    id->size   = finfo.size;
+    return APR_SUCCESS;
+}
+
+/* Called with the tx_lock held */
+static void file_close(h2_workers_file *wf)
+{
+    h2_workers *workers = wf->workers;
+    
+    APR_RING_REMOVE(wf, link);
+    apr_hash_set(workers->files, &wf->id, sizeof(wf->id), NULL);
+    --workers->files_open;
+    apr_pool_destroy(wf->pool);
+}
+
+static apr_status_t file_release(void *data)
+{
+    h2_workers_file *wf = data;
+    h2_workers *workers = wf->workers;
+    
+    if (apr_thread_mutex_lock(workers->tx_lock) == APR_SUCCESS) {
+        if (--wf->refs == 0) {
+            APR_RING_INSERT_TAIL(&workers->files_idle, wf, 
+                                 h2_workers_file, link);
+        }
+        apr_thread_mutex_unlock(workers->tx_lock);
+    }
+    return APR_SUCCESS;
+}
+
+/* Called with the tx_lock held */
+static h2_workers_file *file_ref(h2_workers *workers, h2_workers_file_id *id)
+{
+    h2_workers_file *wf = apr_hash_get(workers->files, id, sizeof(*id));
+    if (wf && wf->refs++ == 0) {
+        APR_RING_REMOVE(wf, link);
+    }
+    return wf;
+}
+
+apr_file_t *h2_workers_file_share(h2_workers *workers, apr_file_t *file,
+                                  apr_pool_t *pool)
+{
+    h2_workers_file_id id, opened_id;
+    h2_workers_file *wf = NULL;
+    apr_allocator_t *allocator;
+    apr_pool_t *fpool = NULL;
+    apr_file_t *fd;
+    const char *fname;
+    apr_status_t status;
+    
+    if (!workers->max_files
+        || apr_file_name_get(&fname, file) != APR_SUCCESS || !fname
+        || file_id_get(&id, file) != APR_SUCCESS) {
+        return NULL;
+    }
+    
+    if (apr_thread_mutex_lock(workers->tx_lock) != APR_SUCCESS) {
+        return NULL;
+    }
+    wf = file_ref(workers, &id);
+    if (!wf) {
+        if (workers->files_open >= workers->max_files
+            && !APR_RING_EMPTY(&workers->files_idle, h2_workers_file, link)) {
+            /* make room by closing the file unused for the longest time */
+            file_close(APR_RING_FIRST(&workers->files_idle));
+        }
+        if (workers->files_open < workers->max_files
+            && apr_allocator_create(&allocator) == APR_SUCCESS) {
+            apr_pool_create_ex(&fpool, workers->files_pool, NULL, allocator);
+            apr_allocator_owner_set(allocator, fpool);
+            ++workers->files_open;
+        }
+    }
+    apr_thread_mutex_unlock(workers->tx_lock);
+    
+    if (fpool) {
+        /* Open it without holding the lock, the new pool is ours alone 
+         * until the file is added. The file may have been replaced since
+         * the caller opened it, we only share the same one. */
+        apr_pool_tag(fpool, "h2_workers_file");
+        status = apr_file_open(&fd, fname, 
+                               (APR_FOPEN_READ|APR_FOPEN_BINARY
+                                |APR_FOPEN_XTHREAD
+                                |(apr_file_flags_get(file) 
+                                  & APR_FOPEN_SENDFILE_ENABLED)), 
+                               APR_OS_DEFAULT, fpool);
+        if (status == APR_SUCCESS
+            && file_id_get(&opened_id, fd) == APR_SUCCESS
+            && !memcmp(&id, &opened_id, sizeof(id))) {
+            wf = apr_pcalloc(fpool, sizeof(*wf));
+            APR_RING_ELEM_INIT(wf, link);
+            wf->workers = workers;
+            wf->pool = fpool;
+            wf->id = id;
+            wf->fd = fd;
+            wf->refs = 1;
+        }
+        
+        apr_thread_mutex_lock(workers->tx_lock);
+        if (wf && !apr_hash_get(workers->files, &id, sizeof(id))) {
+            apr_hash_set(workers->files, &wf->id, sizeof(wf->id), wf);
+            ap_log_error(APLOG_MARK, APLOG_TRACE2, 0, workers->s,
+                         "h2_workers: sharing file %s, %d/%d files open", 
+                         fname, (int)workers->files_open, 
+                         (int)workers->max_files);
+        }
+        else {
+            /* could not open it or another thread was faster */
+            int opened = (wf != NULL);
+            --workers->files_open;
+            apr_pool_destroy(fpool);
+            wf = opened? file_ref(workers, &id) : NULL;
+        }
+        apr_thread_mutex_unlock(workers->tx_lock);
+    }
+    
+    if (wf) {
+        apr_pool_cleanup_register(pool, wf, file_release, 
+                                  apr_pool_cleanup_null);
+        return wf->fd;
+    }
+    return NULL;
+}
@@ -21,7 +21,14 @@
  * number of workers it creates. Starts with minimum workers and adds
  * some on load, reduces the number again when idle.
  *
+ * The h2_mplx with tasks to hand out are spread over several queues,
+ * each with its own lock: a h2_mplx always registers in the same queue
+ * (by its id), and each worker looks in its own queue first (by its id)
+ * before stealing from the others, so that the workers do not all contend
+ * for a single list. The global lock is only taken to wait for work, and
+ * to add workers.
  */
+struct apr_hash_t;
 struct apr_thread_mutex_t;
 struct apr_thread_cond_t;
 struct h2_mplx;
@@ -30,6 +37,39 @@ struct h2_task;
 
 typedef struct h2_workers h2_workers;
 
+/* The number of workers per queue, the h2_workers have (max_workers /
+ * H2_WORKERS_PER_QUEUE) queues, rounded up. */
+#define H2_WORKERS_PER_QUEUE    8
+
+typedef struct h2_workers_queue h2_workers_queue;
+
+struct h2_workers_queue {
+    struct apr_thread_mutex_t *lock;
+    APR_RING_HEAD(h2_mplx_list, h2_mplx) mplxs;
+    volatile int count;         /* # of h2_mplx in the list, peeked unlocked */
+};
+
+typedef struct h2_workers_file h2_workers_file;
+
+/* A file opened for use by all master connections (see 
+ * h2_workers_file_share()). Identified by device, inode, modification
+ * time and size, so that a changed file gets opened anew. */
+typedef struct {
+    apr_dev_t device;
+    apr_ino_t inode;
+    apr_time_t mtime;
+    apr_off_t size;
+} h2_workers_file_id;
+
+struct h2_workers_file {
+    APR_RING_ENTRY(h2_workers_file) link;
+    struct h2_workers *workers;
+    apr_pool_t *pool;
+    h2_workers_file_id id;
+    apr_file_t *fd;
+    int refs;                   /* # of red pools using it, 0 when idle */
+};
+
 struct h2_workers {
     server_rec *s;
     apr_pool_t *pool;
@@ -38,7 +78,7 @@ struct h2_workers {
     int min_workers;
     int max_workers;
     int worker_count;
-    int idle_workers;
+    volatile apr_uint32_t idle_workers; /* changed with lock held, atomic */
     int max_idle_secs;
     
     apr_size_t max_tx_handles;
@@ -50,13 +90,22 @@ struct h2_workers {
     
     APR_RING_HEAD(h2_worker_list, h2_worker) workers;
     APR_RING_HEAD(h2_worker_zombies, h2_worker) zombies;
-    APR_RING_HEAD(h2_mplx_list, h2_mplx) mplxs;
-    int mplx_count;
+    h2_workers_queue *queues;
+    int nqueues;
+    volatile apr_uint32_t mplx_count;   /* in all the queues, atomic */
+    volatile apr_uint32_t registrations;/* # of h2_workers_register(), atomic */
     
     struct apr_thread_mutex_t *lock;
     struct apr_thread_cond_t *mplx_added;
 
     struct apr_thread_mutex_t *tx_lock;
+    
+    /* shared files, guarded by tx_lock */
+    apr_pool_t *files_pool;
+    struct apr_hash_t *files;
+    APR_RING_HEAD(h2_workers_file_idle, h2_workers_file) files_idle;
+    apr_size_t max_files;
+    apr_size_t files_open;
 };
 
 
@@ -117,4 +166,26 @@ apr_size_t h2_workers_tx_reserve(h2_workers *workers, apr_size_t count);
  */
 void h2_workers_tx_free(h2_workers *workers, apr_size_t count);
 
+/**
+ * Get a handle on the given file that may be used by all threads, for 
+ * transfer to a master connection after the reserved handles (see 
+ * h2_workers_tx_reserve()) ran out. Many streams serving the same static
+ * file then share one handle, instead of having its content copied.
+ *
+ * The handle is opened with APR_FOPEN_XTHREAD and stays open at least
+ * until the given pool is cleared or destroyed. Afterwards, it is kept
+ * open for reuse until the space is needed for another file. At most
+ * as many files are shared as there are handles for reservation.
+ * The handle must not be set aside into another pool (which would take
+ * it from all other users), the master connection writes it out
+ * instead (see h2_conn_io).
+ *
+ * @param workers the workers instance
+ * @param file the file to share, open on the caller's side
+ * @param pool the pool whose lifetime the handle needs to cover
+ * @return the shared handle or NULL if the file cannot be shared (now)
+ */
+apr_file_t *h2_workers_file_share(h2_workers *workers, apr_file_t *file,
+                                  apr_pool_t *pool);
+
 #endif /* defined(__mod_h2__h2_workers__) */
@@ -57,6 +57,21 @@ AP_DECLARE_MODULE(http2) = {
 
 static int h2_h2_fixups(request_rec *r);
 
+static int h2_pre_config(apr_pool_t *pconf, apr_pool_t *plog, 
+                         apr_pool_t *ptemp)
+{
+    apr_status_t status;
+    
+    (void)ptemp;
+    status = h2_push_diary_cache_pre_config(pconf);
+    if (status != APR_SUCCESS) {
+        ap_log_perror(APLOG_MARK, APLOG_CRIT, status, plog, APLOGNO(03416)
+                      "registering push diary cache mutex");
+        return !OK;
+    }
+    return OK;
+}
+
 typedef struct {
     unsigned int change_prio : 1;
     unsigned int sha256 : 1;
@@ -140,6 +155,9 @@ static int h2_post_config(apr_pool_t *p, apr_pool_t *plog,
     if (status == APR_SUCCESS) {
         status = h2_task_init(p, s);
     }
+    if (status == APR_SUCCESS) {
+        status = h2_push_diary_cache_post_config(p, ptemp, s);
+    }
     
     return status;
 }
@@ -179,7 +197,11 @@ static void h2_child_init(apr_pool_t *pool, server_rec *s)
         ap_log_error(APLOG_MARK, APLOG_ERR, status, s,
                      APLOGNO(02949) "initializing connection handling");
     }
-    
+    status = h2_push_diary_cache_child_init(pool, s);
+    if (status != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, status, s,
+                     APLOGNO(03417) "initializing push diary cache mutex");
+    }
 }
 
 /* Install this module into the apache2 infrastructure.
@@ -196,6 +218,10 @@ static void h2_hooks(apr_pool_t *pool)
 
     ap_log_perror(APLOG_MARK, APLOG_TRACE1, 0, pool, "installing hooks");
     
+    /* Run once before the configuration is read.
+     */
+    ap_hook_pre_config(h2_pre_config, NULL, NULL, APR_HOOK_MIDDLE);
+    
     /* Run once after configuration is set, but before mpm children initialize.
      */
     ap_hook_post_config(h2_post_config, mod_ssl, NULL, APR_HOOK_MIDDLE);
@@ -0,0 +1,53 @@
+#!/bin/sh
+#
+# Licensed to the Apache Software Foundation (ASF) under one or more
+# contributor license agreements.  See the NOTICE file distributed with
+# this work for additional information regarding copyright ownership.
+# The ASF licenses this file to You under the Apache License, Version 2.0
+# (the "License"); you may not use this file except in compliance with
+# the License.  You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Responses with many distinct content-types (a unique boundary each, as
+# mod_byterange sends) must not fill up the header value cache, which
+# never evicts: a new content-type is still cached after them. This is
+# seen in the header_cache_misses of the http2-status handler, which go
+# up by one (not two) for two responses with that new content-type.
+#
+NGHTTP=${NGHTTP:-nghttp}
+N=${N:-1000}
+
+misses() {
+    $NGHTTP "$URL/h2-status" \
+        | sed -n 's/.*"header_cache_misses": *\([0-9]*\).*/\1/p'
+}
+
+urls=
+i=0
+while [ $i -lt $N ] ; do
+    urls="$urls $URL/ct?multipart%2Fbyteranges%3B%20boundary%3D$i"
+    i=`expr $i + 1`
+done
+$NGHTTP -n $urls || exit 1
+
+# the other fields of these responses are cached by now
+$NGHTTP -n "$URL/ct?text%2Fplain" "$URL/h2-status" || exit 1
+before=`misses`
+$NGHTTP -n "$URL/ct?application%2Fx-h2test" || exit 1
+$NGHTTP -n "$URL/ct?application%2Fx-h2test" || exit 1
+after=`misses`
+
+if [ -n "$before" -a `expr $after - $before` = 1 ] ; then
+    echo "nv-cache $N content-types: ok"
+else
+    echo "nv-cache $N content-types: new value not cached" \
+         "($before -> $after misses)"
+    exit 1
+fi
@@ -0,0 +1,53 @@
+#!/bin/sh
+#
+# Licensed to the Apache Software Foundation (ASF) under one or more
+# contributor license agreements.  See the NOTICE file distributed with
+# this work for additional information regarding copyright ownership.
+# The ASF licenses this file to You under the Apache License, Version 2.0
+# (the "License"); you may not use this file except in compliance with
+# the License.  You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# The static files mod_http2 shares across cleartext connections (see
+# H2SessionExtraFiles) must be sent right to slow readers too, while the
+# other connections keep sending the same file. A file is downloaded with
+# N concurrent HTTP/2 connections (curl --http2-prior-knowledge), every
+# other one at RATE bytes per second, and each download is compared with
+# the file on disk.
+#
+CURL=${CURL:-curl}
+N=${N:-16}
+RATE=${RATE:-200k}
+
+i=0
+while [ $i -lt $N ] ; do
+    if [ `expr $i % 2` = 1 ] ; then
+        LIMIT="--limit-rate $RATE"
+    else
+        LIMIT=
+    fi
+    $CURL -s --http2-prior-knowledge $LIMIT -o $OUT/large.$i \
+        "$URL/large" &
+    i=`expr $i + 1`
+done
+wait
+
+rv=0
+i=0
+while [ $i -lt $N ] ; do
+    if cmp -s $OUT/htdocs/large $OUT/large.$i ; then
+        echo "slow-reader connection $i: ok"
+    else
+        echo "slow-reader connection $i: differs"
+        rv=1
+    fi
+    i=`expr $i + 1`
+done
+exit $rv
@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# Licensed to the Apache Software Foundation (ASF) under one or more
+# contributor license agreements.  See the NOTICE file distributed with
+# this work for additional information regarding copyright ownership.
+# The ASF licenses this file to You under the Apache License, Version 2.0
+# (the "License"); you may not use this file except in compliance with
+# the License.  You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# The trailers of HTTP/2 requests must reach the request (r->trailers_in),
+# with and without content-length: POST requests announcing a trailer are
+# sent with nghttp --trailer, and the trailer is looked for in the log of
+# "%{X-H2-Trailer}^ti".
+#
+NGHTTP=${NGHTTP:-nghttp}
+BODY=$OUT/trailers.body
+
+echo "trailers" > $BODY
+$NGHTTP -d $BODY -H "Trailer: X-H2-Trailer" \
+    --trailer "X-H2-Trailer: with-length" "$URL/echo" >/dev/null || exit 1
+$NGHTTP -d $BODY --no-content-length -H "Trailer: X-H2-Trailer" \
+    --trailer "X-H2-Trailer: chunked" "$URL/echo" >/dev/null || exit 1
+# the log is written when the requests are done
+sleep 1
+
+rv=0
+for t in with-length chunked ; do
+    if grep -qx "$t" $OUT/trailers_log ; then
+        echo "trailers $t: ok"
+    else
+        echo "trailers $t: missing"
+        rv=1
+    fi
+done
+exit $rv
@@ -151,6 +151,8 @@
 #include "apr_hash.h"
 #include "apr_optional.h"
 #include "apr_anylock.h"
+#include "apr_thread_proc.h"
+#include "apr_thread_cond.h"
 
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
@@ -202,9 +204,16 @@ static ap_log_writer_init *ap_log_set_writer_init(ap_log_writer_init *handle);
 static ap_log_writer *ap_log_set_writer(ap_log_writer *handle);
 static ap_log_writer *log_writer = ap_default_log_writer;
 static ap_log_writer_init *log_writer_init = ap_default_log_writer_init;
-static int buffered_logs = 0; /* default unbuffered */
+
+#define BUFFERED_LOGS_OFF       0   /* default unbuffered */
+#define BUFFERED_LOGS_SHARED    1   /* one buffer per log and child */
+#define BUFFERED_LOGS_THREAD    2   /* one buffer per log and thread */
+static int buffered_logs = BUFFERED_LOGS_OFF;
+static apr_interval_time_t buffered_logs_interval;
 static apr_array_header_t *all_buffered_logs = NULL;
 
+#define DEFAULT_BUFFERED_LOGS_INTERVAL apr_time_from_sec(1)
+
 /* POSIX.1 defines PIPE_BUF as the maximum number of bytes that is
  * guaranteed to be atomic when writing a pipe.  And PIPE_BUF >= 512
  * is guaranteed.  So we'll just guess 512 in the event the system
@@ -253,13 +262,6 @@ typedef struct {
  * set to a opaque structure (usually a fd) after it is opened.
 
  */
-typedef struct {
-    apr_file_t *handle;
-    apr_size_t outcnt;
-    char outbuf[LOG_BUFSIZE];
-    apr_anylock_t mutex;
-} buffered_log;
-
 typedef struct {
     const char *fname;
     const char *format_string;
@@ -285,12 +287,29 @@ typedef struct {
  * Note that many of these could have ap_sprintfs replaced with static buffers.
  */
 
+/*
+ * The items of the format are rendered in a single buffer, which is
+ * sized beforehand.  Constant items are merged at parse time, and
+ * the common items below are rendered in place rather than through
+ * their (allocating) handler.
+ */
+#define LOG_ITEM_GENERIC        0   /* through func */
+#define LOG_ITEM_CONSTANT       1   /* arg, arglen */
+#define LOG_ITEM_REMOTE_HOST    2   /* %h */
+#define LOG_ITEM_REQUEST_TIME   3   /* %t */
+#define LOG_ITEM_REQUEST_LINE   4   /* %r */
+#define LOG_ITEM_STATUS         5   /* %s */
+#define LOG_ITEM_CLF_BYTES      6   /* %b */
+#define LOG_ITEM_DURATION_USEC  7   /* %D */
+
 typedef struct {
     ap_log_handler_fn_t *func;
     char *arg;
     int condition_sense;
     int want_orig;
     apr_array_header_t *conditions;
+    int type;
+    apr_size_t arglen;
 } log_format_item;
 
 /*
@@ -322,6 +341,51 @@ typedef struct {
     void *log_writer;
 } default_log_writer;
 
+typedef struct {
+    default_log_writer *handle;
+    int index;                  /* in all_buffered_logs */
+    apr_size_t outcnt;
+    char outbuf[LOG_BUFSIZE];
+    apr_anylock_t mutex;
+} buffered_log;
+
+#if APR_HAS_THREADS
+/*
+ * With "BufferedLogs Thread", each thread fills its own buffer for each
+ * buffered log, so that the threads of a child don't serialize on the
+ * mutex of the shared buffer.  A thread writes its buffer out with a
+ * single write() of whole lines when the next line does not fit, so the
+ * lines of a thread stay in order and writes to pipes remain atomic.
+ * The flusher thread writes out whatever is pending every
+ * BufferedLogsFlushInterval, which is the only contention the mutex of
+ * a thread buffer ever sees.
+ */
+typedef struct {
+    apr_thread_mutex_t *mutex;
+    apr_size_t outcnt;
+    char outbuf[LOG_BUFSIZE];
+} thread_log_buf;
+
+typedef struct thread_log_bufs thread_log_bufs;
+struct thread_log_bufs {
+    thread_log_bufs *next;      /* in thread_logs.all */
+    thread_log_bufs *next_free; /* in thread_logs.free */
+    thread_log_buf *bufs;       /* indexed by buffered_log->index */
+};
+
+static struct {
+    apr_pool_t *pool;           /* own allocator, under mutex */
+    apr_threadkey_t *key;       /* thread_log_bufs of the current thread */
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t *cond;
+    apr_thread_t *flusher;
+    thread_log_bufs *all;
+    thread_log_bufs *free;      /* left over by exited threads */
+    int nlogs;
+    int stopping;
+} thread_logs;
+#endif
+
 static char *pfmt(apr_pool_t *p, int i)
 {
     if (i <= 0) {
@@ -636,13 +700,6 @@ static const char *log_request_time_custom(request_rec *r, char *a,
     return apr_pstrdup(r->pool, tstr);
 }
 
-#define DEFAULT_REQUEST_TIME_SIZE 32
-typedef struct {
-    unsigned t;
-    char timestr[DEFAULT_REQUEST_TIME_SIZE];
-    unsigned t_validate;
-} cached_request_time;
-
 #define TIME_FMT_CUSTOM          0
 #define TIME_FMT_CLF             1
 #define TIME_FMT_ABS_SEC         2
@@ -651,10 +708,6 @@ typedef struct {
 #define TIME_FMT_ABS_MSEC_FRAC   5
 #define TIME_FMT_ABS_USEC_FRAC   6
 
-#define TIME_CACHE_SIZE 4
-#define TIME_CACHE_MASK 3
-static cached_request_time request_time_cache[TIME_CACHE_SIZE];
-
 static apr_time_t get_request_end_time(request_rec *r)
 {
     log_request_state *state = (log_request_state *)ap_get_module_config(r->request_config,
@@ -765,43 +818,9 @@ static const char *log_request_time(request_rec *r, char *a)
         return log_request_time_custom(r, a, &xt);
     }
     else {                                   /* CLF format */
-        /* This code uses the same technique as ap_explode_recent_localtime():
-         * optimistic caching with logic to detect and correct race conditions.
-         * See the comments in server/util_time.c for more information.
-         */
-        cached_request_time* cached_time = apr_palloc(r->pool,
-                                                      sizeof(*cached_time));
-        unsigned t_seconds = (unsigned)apr_time_sec(request_time);
-        unsigned i = t_seconds & TIME_CACHE_MASK;
-        *cached_time = request_time_cache[i];
-        if ((t_seconds != cached_time->t) ||
-            (t_seconds != cached_time->t_validate)) {
-
-            /* Invalid or old snapshot, so compute the proper time string
-             * and store it in the cache
-             */
-            char sign;
-            int timz;
-
-            ap_explode_recent_localtime(&xt, request_time);
-            timz = xt.tm_gmtoff;
-            if (timz < 0) {
-                timz = -timz;
-                sign = '-';
-            }
-            else {
-                sign = '+';
-            }
-            cached_time->t = t_seconds;
-            apr_snprintf(cached_time->timestr, DEFAULT_REQUEST_TIME_SIZE,
-                         "[%02d/%s/%d:%02d:%02d:%02d %c%.2d%.2d]",
-                         xt.tm_mday, apr_month_snames[xt.tm_mon],
-                         xt.tm_year+1900, xt.tm_hour, xt.tm_min, xt.tm_sec,
-                         sign, timz / (60*60), (timz % (60*60)) / 60);
-            cached_time->t_validate = t_seconds;
-            request_time_cache[i] = *cached_time;
-        }
-        return cached_time->timestr;
+        char *timestr = apr_palloc(r->pool, AP_CLF_DATE_LEN);
+        ap_recent_clf_date(timestr, request_time);
+        return timestr;
     }
 }
 
@@ -921,6 +940,7 @@ static char *parse_log_misc_string(apr_pool_t *p, log_format_item *it,
     char *d;
 
     it->func = constant_item;
+    it->type = LOG_ITEM_CONSTANT;
     it->conditions = NULL;
 
     s = *sa;
@@ -992,6 +1012,7 @@ static char *parse_log_item(apr_pool_t *p, log_format_item *it, const char **sa)
     if (*s == '%') {
         it->arg = "%";
         it->func = constant_item;
+        it->type = LOG_ITEM_CONSTANT;
         *sa = ++s;
 
         return NULL;
@@ -1071,6 +1092,33 @@ static char *parse_log_item(apr_pool_t *p, log_format_item *it, const char **sa)
             if (it->want_orig == -1) {
                 it->want_orig = handler->want_orig_default;
             }
+
+            /* Handlers can be overridden by other modules, so check the
+             * functions rather than the directives.
+             */
+            it->type = LOG_ITEM_GENERIC;
+            if (it->func == log_remote_host) {
+                if (!*it->arg) {
+                    it->type = LOG_ITEM_REMOTE_HOST;
+                }
+            }
+            else if (it->func == log_request_time) {
+                if (!*it->arg) {
+                    it->type = LOG_ITEM_REQUEST_TIME;
+                }
+            }
+            else if (it->func == log_request_line) {
+                it->type = LOG_ITEM_REQUEST_LINE;
+            }
+            else if (it->func == log_status) {
+                it->type = LOG_ITEM_STATUS;
+            }
+            else if (it->func == clf_log_bytes_sent) {
+                it->type = LOG_ITEM_CLF_BYTES;
+            }
+            else if (it->func == log_request_duration_microseconds) {
+                it->type = LOG_ITEM_DURATION_USEC;
+            }
             *sa = s;
             return NULL;
         }
@@ -1079,6 +1127,33 @@ static char *parse_log_item(apr_pool_t *p, log_format_item *it, const char **sa)
     return "Ran off end of LogFormat parsing args to some directive";
 }
 
+static void compile_log_format(apr_pool_t *p, apr_array_header_t *a)
+{
+    log_format_item *items = (log_format_item *) a->elts;
+    int i, n = 0;
+
+    /* Merge adjacent constants */
+    for (i = 0; i < a->nelts; ++i) {
+        log_format_item *it = &items[i];
+
+        if (it->type != LOG_ITEM_CONSTANT) {
+            items[n++] = *it;
+            continue;
+        }
+        it->arglen = strlen(it->arg);
+        if (n && items[n - 1].type == LOG_ITEM_CONSTANT) {
+            log_format_item *prev = &items[n - 1];
+
+            prev->arg = apr_pstrcat(p, prev->arg, it->arg, NULL);
+            prev->arglen += it->arglen;
+        }
+        else {
+            items[n++] = *it;
+        }
+    }
+    a->nelts = n;
+}
+
 static apr_array_header_t *parse_log_string(apr_pool_t *p, const char *s, const char **err)
 {
     apr_array_header_t *a = apr_array_make(p, 30, sizeof(log_format_item));
@@ -1093,6 +1168,8 @@ static apr_array_header_t *parse_log_string(apr_pool_t *p, const char *s, const
 
     s = APR_EOL_STR;
     parse_log_item(p, (log_format_item *) apr_array_push(a), &s);
+
+    compile_log_format(p, a);
     return a;
 }
 
@@ -1101,13 +1178,8 @@ static apr_array_header_t *parse_log_string(apr_pool_t *p, const char *s, const
  * Actually logging.
  */
 
-static const char *process_item(request_rec *r, request_rec *orig,
-                          log_format_item *item)
+static int item_wanted(request_rec *r, log_format_item *item)
 {
-    const char *cp;
-
-    /* First, see if we need to process this thing at all... */
-
     if (item->conditions && item->conditions->nelts != 0) {
         int i;
         int *conds = (int *) item->conditions->elts;
@@ -1122,35 +1194,246 @@ static const char *process_item(request_rec *r, request_rec *orig,
 
         if ((item->condition_sense && in_list)
             || (!item->condition_sense && !in_list)) {
-            return "-";
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * How the value of an item gets into the log line, see render_log_line()
+ */
+#define LOG_RENDER_COPY     0   /* str, of length len */
+#define LOG_RENDER_ESCAPE   1   /* str escaped, len is its upper bound */
+#define LOG_RENDER_DIRECT   2   /* formatted in place, of at most len */
+
+/* Large enough for the decimal of an apr_int64_t, sign included */
+#define LOG_NUM_MAX 20
+
+#define LOG_ITEMS_ON_STACK 32
+
+typedef struct {
+    const char *str;
+    apr_size_t len;
+    int how;
+} log_item_value;
+
+static apr_size_t render_number(char *d, apr_int64_t n)
+{
+    char tmp[LOG_NUM_MAX];
+    char *t = tmp + sizeof(tmp);
+    apr_uint64_t u = (n < 0) ? -(apr_uint64_t)n : (apr_uint64_t)n;
+    apr_size_t len;
+
+    do {
+        *--t = '0' + (char)(u % 10);
+        u /= 10;
+    } while (u);
+    if (n < 0) {
+        *--t = '-';
+    }
+    len = tmp + sizeof(tmp) - t;
+    memcpy(d, t, len);
+
+    return len;
+}
+
+/*
+ * First pass: get the value of each item, or for the ones rendered in
+ * place an upper bound of their length, and return the total.
+ */
+static apr_size_t eval_log_items(request_rec *r, request_rec *orig,
+                                 log_format_item *items, int nelts,
+                                 log_item_value *vals)
+{
+    apr_size_t len = 0;
+    int i;
+
+    for (i = 0; i < nelts; ++i) {
+        log_format_item *item = &items[i];
+        log_item_value *val = &vals[i];
+        request_rec *rr = item->want_orig ? orig : r;
+
+        val->how = LOG_RENDER_COPY;
+        if (item->type == LOG_ITEM_CONSTANT) {
+            val->str = item->arg;
+            val->len = item->arglen;
+            len += val->len;
+            continue;
+        }
+        if (!item_wanted(r, item)) {
+            val->str = "-";
+            val->len = 1;
+            len += val->len;
+            continue;
+        }
+
+        switch (item->type) {
+        case LOG_ITEM_REMOTE_HOST:
+            val->str = ap_get_useragent_host(rr, REMOTE_NAME, NULL);
+            if (val->str) {
+                val->how = LOG_RENDER_ESCAPE;
+            }
+            break;
+
+        case LOG_ITEM_REQUEST_LINE:
+            if (!rr->parsed_uri.password) {
+                val->str = rr->the_request;
+                if (val->str) {
+                    val->how = LOG_RENDER_ESCAPE;
+                }
+            }
+            else {
+                /* the password is masked by the handler */
+                val->str = (*item->func)(rr, item->arg);
+            }
+            break;
+
+        case LOG_ITEM_REQUEST_TIME:
+            val->how = LOG_RENDER_DIRECT;
+            val->len = AP_CLF_DATE_LEN - 1;
+            break;
+
+        case LOG_ITEM_STATUS:
+        case LOG_ITEM_CLF_BYTES:
+        case LOG_ITEM_DURATION_USEC:
+            val->how = LOG_RENDER_DIRECT;
+            val->len = LOG_NUM_MAX;
+            break;
+
+        default:
+            val->str = (*item->func)(rr, item->arg);
+            break;
         }
+
+        switch (val->how) {
+        case LOG_RENDER_COPY:
+            if (!val->str) {
+                val->str = "-";
+            }
+            val->len = strlen(val->str);
+            break;
+        case LOG_RENDER_ESCAPE:
+            /* Each escaped character takes up to 4 bytes (\xhh) */
+            val->len = 4 * strlen(val->str);
+            break;
+        }
+        len += val->len;
     }
 
-    /* We do.  Do it... */
+    return len;
+}
 
-    cp = (*item->func) (item->want_orig ? orig : r, item->arg);
-    return cp ? cp : "-";
+/*
+ * Second pass: render the items in buf, which must be large enough for
+ * the length returned by eval_log_items() plus a trailing NUL, and
+ * return the actual length.
+ */
+static apr_size_t render_log_line(request_rec *r, request_rec *orig,
+                                  log_format_item *items, int nelts,
+                                  log_item_value *vals, char *buf)
+{
+    char *d = buf;
+    int i;
+
+    for (i = 0; i < nelts; ++i) {
+        log_format_item *item = &items[i];
+        log_item_value *val = &vals[i];
+        request_rec *rr = item->want_orig ? orig : r;
+
+        switch (val->how) {
+        case LOG_RENDER_COPY:
+            memcpy(d, val->str, val->len);
+            d += val->len;
+            break;
+
+        case LOG_RENDER_ESCAPE:
+            d += ap_escape_logitem_buffer(d, val->str, val->len + 1);
+            break;
+
+        case LOG_RENDER_DIRECT:
+            switch (item->type) {
+            case LOG_ITEM_REQUEST_TIME:
+                ap_recent_clf_date(d, rr->request_time);
+                d += AP_CLF_DATE_LEN - 1;
+                break;
+            case LOG_ITEM_STATUS:
+                if (rr->status <= 0) {
+                    *d++ = '-';
+                }
+                else {
+                    d += render_number(d, rr->status);
+                }
+                break;
+            case LOG_ITEM_CLF_BYTES:
+                if (!rr->sent_bodyct || !rr->bytes_sent) {
+                    *d++ = '-';
+                }
+                else {
+                    d += render_number(d, rr->bytes_sent);
+                }
+                break;
+            case LOG_ITEM_DURATION_USEC:
+                d += render_number(d, get_request_end_time(rr)
+                                      - rr->request_time);
+                break;
+            }
+            break;
+        }
+    }
+    *d = '\0';
+
+    return d - buf;
 }
 
 static void flush_log(buffered_log *buf)
 {
     if (buf->outcnt && buf->handle != NULL) {
         /* XXX: error handling */
-        apr_file_write_full(buf->handle, buf->outbuf, buf->outcnt, NULL);
+        apr_file_write_full(buf->handle->log_writer, buf->outbuf,
+                            buf->outcnt, NULL);
         buf->outcnt = 0;
     }
 }
 
+#if APR_HAS_THREADS
+static void flush_thread_log(buffered_log *buf, thread_log_buf *tbuf)
+{
+    if (tbuf->outcnt) {
+        /* XXX: error handling */
+        apr_file_write_full(buf->handle->log_writer, tbuf->outbuf,
+                            tbuf->outcnt, NULL);
+        tbuf->outcnt = 0;
+    }
+}
+
+static void flush_thread_logs(thread_log_bufs *tb)
+{
+    buffered_log **array = (buffered_log **)all_buffered_logs->elts;
+    int i;
+
+    for (i = 0; i < thread_logs.nlogs; i++) {
+        thread_log_buf *tbuf = &tb->bufs[i];
+
+        apr_thread_mutex_lock(tbuf->mutex);
+        flush_thread_log(array[i], tbuf);
+        apr_thread_mutex_unlock(tbuf->mutex);
+    }
+}
+#endif
+
 
 static int config_log_transaction(request_rec *r, config_log_state *cls,
                                   apr_array_header_t *default_format)
 {
     log_format_item *items;
-    const char **strs;
-    int *strl;
+    log_item_value vals_stack[LOG_ITEMS_ON_STACK], *vals;
+    const char *str;
+    char *buf;
+    int strl;
     request_rec *orig;
-    int i;
-    apr_size_t len = 0;
+    apr_size_t len;
     apr_array_header_t *format;
     char *envar;
     apr_status_t rv;
@@ -1188,8 +1471,12 @@ static int config_log_transaction(request_rec *r, config_log_state *cls,
 
     format = cls->format ? cls->format : default_format;
 
-    strs = apr_palloc(r->pool, sizeof(char *) * (format->nelts));
-    strl = apr_palloc(r->pool, sizeof(int) * (format->nelts));
+    if (format->nelts <= LOG_ITEMS_ON_STACK) {
+        vals = vals_stack;
+    }
+    else {
+        vals = apr_palloc(r->pool, sizeof(log_item_value) * format->nelts);
+    }
     items = (log_format_item *) format->elts;
 
     orig = r;
@@ -1200,19 +1487,18 @@ static int config_log_transaction(request_rec *r, config_log_state *cls,
         r = r->next;
     }
 
-    for (i = 0; i < format->nelts; ++i) {
-        strs[i] = process_item(r, orig, &items[i]);
-    }
+    len = eval_log_items(r, orig, items, format->nelts, vals);
+    buf = apr_palloc(r->pool, len + 1);
+    len = render_log_line(r, orig, items, format->nelts, vals, buf);
+    str = buf;
+    strl = (int)len;
 
-    for (i = 0; i < format->nelts; ++i) {
-        len += strl[i] = strlen(strs[i]);
-    }
     if (!log_writer) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(00645)
                 "log writer isn't correctly setup");
         return HTTP_INTERNAL_SERVER_ERROR;
     }
-    rv = log_writer(r, cls->log_writer, strs, strl, format->nelts, len);
+    rv = log_writer(r, cls->log_writer, &str, &strl, 1, len);
     if (rv != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_WARNING, rv, r, APLOGNO(00646)
                       "Error writing to %s", cls->fname);
@@ -1410,9 +1696,22 @@ static const char *set_transfer_log(cmd_parms *cmd, void *dummy,
     return add_custom_log(cmd, dummy, fn, NULL, NULL);
 }
 
-static const char *set_buffered_logs_on(cmd_parms *parms, void *dummy, int flag)
+static const char *set_buffered_logs(cmd_parms *parms, void *dummy,
+                                     const char *arg)
 {
-    buffered_logs = flag;
+    if (!strcasecmp(arg, "On")) {
+        buffered_logs = BUFFERED_LOGS_SHARED;
+    }
+    else if (!strcasecmp(arg, "Thread")) {
+        buffered_logs = BUFFERED_LOGS_THREAD;
+    }
+    else if (!strcasecmp(arg, "Off")) {
+        buffered_logs = BUFFERED_LOGS_OFF;
+    }
+    else {
+        return "BufferedLogs must be On, Off or Thread";
+    }
+
     if (buffered_logs) {
         ap_log_set_writer_init(ap_buffered_log_writer_init);
         ap_log_set_writer(ap_buffered_log_writer);
@@ -1423,6 +1722,24 @@ static const char *set_buffered_logs_on(cmd_parms *parms, void *dummy, int flag)
     }
     return NULL;
 }
+
+static const char *set_buffered_logs_interval(cmd_parms *parms, void *dummy,
+                                              const char *arg)
+{
+    apr_interval_time_t interval;
+
+    if (ap_timeout_parameter_parse(arg, &interval, "s") != APR_SUCCESS
+        || interval < 0) {
+        return "BufferedLogsFlushInterval must be a non-negative time "
+               "interval (0 to flush on buffer full only)";
+    }
+    /* 0 disables the flusher thread: the thread buffers are written out
+     * when full, or when the child exits */
+    buffered_logs_interval = interval;
+
+    return NULL;
+}
+
 static const command_rec config_log_cmds[] =
 {
 AP_INIT_TAKE23("CustomLog", add_custom_log, NULL, RSRC_CONF,
@@ -1434,8 +1751,11 @@ AP_INIT_TAKE1("TransferLog", set_transfer_log, NULL, RSRC_CONF,
      "the filename of the access log"),
 AP_INIT_TAKE12("LogFormat", log_format, NULL, RSRC_CONF,
      "a log format string (see docs) and an optional format name"),
-AP_INIT_FLAG("BufferedLogs", set_buffered_logs_on, NULL, RSRC_CONF,
-                 "Enable Buffered Logging (experimental)"),
+AP_INIT_TAKE1("BufferedLogs", set_buffered_logs, NULL, RSRC_CONF,
+              "Enable Buffered Logging (experimental), On, Off or Thread"),
+AP_INIT_TAKE1("BufferedLogsFlushInterval", set_buffered_logs_interval, NULL,
+              RSRC_CONF, "Maximum time the lines of a thread buffered log "
+              "are kept in memory, 0 to flush on buffer full only"),
     {NULL}
 };
 
@@ -1544,7 +1864,9 @@ static apr_status_t flush_all_logs(void *data)
             clsarray = (config_log_state *) log_list->elts;
             for (i = 0; i < log_list->nelts; ++i) {
                 buf = clsarray[i].log_writer;
-                flush_log(buf);
+                if (buf) {
+                    flush_log(buf);
+                }
             }
         }
     }
@@ -1575,6 +1897,195 @@ static int init_config_log(apr_pool_t *pc, apr_pool_t *p, apr_pool_t *pt, server
     return res;
 }
 
+#if APR_HAS_THREADS
+static void thread_log_bufs_release(void *data)
+{
+    thread_log_bufs *tb = data;
+
+    /* The thread is exiting, hand its buffers over to the next one */
+    flush_thread_logs(tb);
+
+    apr_thread_mutex_lock(thread_logs.mutex);
+    tb->next_free = thread_logs.free;
+    thread_logs.free = tb;
+    apr_thread_mutex_unlock(thread_logs.mutex);
+}
+
+static thread_log_bufs *thread_log_bufs_acquire(void)
+{
+    thread_log_bufs *tb;
+    int i;
+
+    apr_thread_mutex_lock(thread_logs.mutex);
+    if (thread_logs.stopping) {
+        tb = NULL;
+    }
+    else if ((tb = thread_logs.free) != NULL) {
+        thread_logs.free = tb->next_free;
+    }
+    else {
+        tb = apr_pcalloc(thread_logs.pool, sizeof(*tb));
+        tb->bufs = apr_pcalloc(thread_logs.pool,
+                               thread_logs.nlogs * sizeof(thread_log_buf));
+        for (i = 0; i < thread_logs.nlogs; i++) {
+            if (apr_thread_mutex_create(&tb->bufs[i].mutex,
+                                        APR_THREAD_MUTEX_DEFAULT,
+                                        thread_logs.pool) != APR_SUCCESS) {
+                /* keep the pool allocations, they are too small to matter */
+                tb = NULL;
+                break;
+            }
+        }
+        if (tb) {
+            tb->next = thread_logs.all;
+            thread_logs.all = tb;
+        }
+    }
+    apr_thread_mutex_unlock(thread_logs.mutex);
+
+    return tb;
+}
+
+static thread_log_buf *get_thread_log_buf(buffered_log *buf)
+{
+    thread_log_bufs *tb = NULL;
+
+    if (apr_threadkey_private_get((void **)&tb, thread_logs.key)
+            != APR_SUCCESS) {
+        return NULL;
+    }
+    if (!tb) {
+        tb = thread_log_bufs_acquire();
+        if (!tb || apr_threadkey_private_set(tb, thread_logs.key)
+                        != APR_SUCCESS) {
+            return NULL;
+        }
+    }
+
+    return &tb->bufs[buf->index];
+}
+
+static void * APR_THREAD_FUNC thread_logs_flusher(apr_thread_t *thd,
+                                                  void *data)
+{
+    apr_thread_mutex_lock(thread_logs.mutex);
+    while (!thread_logs.stopping) {
+        thread_log_bufs *tb;
+
+        apr_thread_cond_timedwait(thread_logs.cond, thread_logs.mutex,
+                                  buffered_logs_interval);
+        if (thread_logs.stopping) {
+            break;
+        }
+
+        /* Only the head of the list moves, and buffers are never freed
+         * before this thread is joined, so the list can be walked without
+         * holding the mutex (which thread_log_bufs_release() needs).
+         */
+        tb = thread_logs.all;
+        apr_thread_mutex_unlock(thread_logs.mutex);
+        for (; tb; tb = tb->next) {
+            flush_thread_logs(tb);
+        }
+        apr_thread_mutex_lock(thread_logs.mutex);
+    }
+    apr_thread_mutex_unlock(thread_logs.mutex);
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static apr_status_t thread_logs_cleanup(void *data)
+{
+    thread_log_bufs *tb;
+    apr_status_t rv;
+
+    /* No more thread_log_bufs_release() from exiting threads */
+    apr_threadkey_private_delete(thread_logs.key);
+
+    apr_thread_mutex_lock(thread_logs.mutex);
+    thread_logs.stopping = 1;
+    if (thread_logs.flusher) {
+        apr_thread_cond_signal(thread_logs.cond);
+    }
+    apr_thread_mutex_unlock(thread_logs.mutex);
+    if (thread_logs.flusher) {
+        apr_thread_join(&rv, thread_logs.flusher);
+    }
+
+    for (tb = thread_logs.all; tb; tb = tb->next) {
+        flush_thread_logs(tb);
+    }
+
+    memset(&thread_logs, 0, sizeof(thread_logs));
+    return APR_SUCCESS;
+}
+
+static void init_thread_logs(apr_pool_t *p, server_rec *s)
+{
+    apr_allocator_t *allocator;
+    apr_status_t rv;
+
+    memset(&thread_logs, 0, sizeof(thread_logs));
+    thread_logs.nlogs = all_buffered_logs->nelts;
+    if (!thread_logs.nlogs) {
+        return;
+    }
+
+    /* Per thread buffers are allocated at runtime, when the child
+     * pool can't be used without a lock.
+     */
+    rv = apr_allocator_create(&allocator);
+    if (rv == APR_SUCCESS) {
+        rv = apr_pool_create_ex(&thread_logs.pool, p, NULL, allocator);
+        if (rv == APR_SUCCESS) {
+            apr_allocator_owner_set(allocator, thread_logs.pool);
+            apr_pool_tag(thread_logs.pool, "thread_logs");
+        }
+        else {
+            apr_allocator_destroy(allocator);
+        }
+    }
+    if (rv == APR_SUCCESS) {
+        rv = apr_thread_mutex_create(&thread_logs.mutex,
+                                     APR_THREAD_MUTEX_DEFAULT,
+                                     thread_logs.pool);
+    }
+    if (rv == APR_SUCCESS) {
+        rv = apr_thread_cond_create(&thread_logs.cond, thread_logs.pool);
+    }
+    if (rv == APR_SUCCESS) {
+        rv = apr_threadkey_private_create(&thread_logs.key,
+                                          thread_log_bufs_release,
+                                          thread_logs.pool);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(03391)
+                     "could not initialize per thread buffered logs, "
+                     "falling back to shared buffers");
+        if (thread_logs.pool) {
+            apr_pool_destroy(thread_logs.pool);
+        }
+        memset(&thread_logs, 0, sizeof(thread_logs));
+        return;
+    }
+    apr_pool_cleanup_register(thread_logs.pool, NULL, thread_logs_cleanup,
+                              apr_pool_cleanup_null);
+
+    if (buffered_logs_interval > 0) {
+        rv = apr_thread_create(&thread_logs.flusher, NULL,
+                               thread_logs_flusher, NULL, thread_logs.pool);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(03392)
+                         "could not create the buffered logs flusher "
+                         "thread, logs will be flushed on buffer full "
+                         "only");
+            thread_logs.flusher = NULL;
+        }
+    }
+}
+#endif
+
 static void init_child(apr_pool_t *p, server_rec *s)
 {
     int mpm_threads;
@@ -1612,6 +2123,15 @@ static void init_child(apr_pool_t *p, server_rec *s)
                 this->mutex.type = apr_anylock_none;
             }
         }
+
+#if APR_HAS_THREADS
+        /* The thread buffers live in a subpool, so they are flushed
+         * before flush_all_logs runs at child exit.
+         */
+        if (buffered_logs == BUFFERED_LOGS_THREAD && mpm_threads > 1) {
+            init_thread_logs(p, s);
+        }
+#endif
     }
 }
 
@@ -1640,6 +2160,30 @@ static ap_log_writer *ap_log_set_writer(ap_log_writer *handle)
     return old;
 }
 
+/*
+ * We do this memcpy dance because write() is atomic for len < PIPE_BUF,
+ * while writev() need not be.  config_log_transaction() gives a single
+ * string already.
+ */
+static const char *join_log_line(request_rec *r, const char **strs,
+                                 int *strl, int nelts, apr_size_t len)
+{
+    char *str, *s;
+    int i;
+
+    if (nelts == 1) {
+        return strs[0];
+    }
+
+    str = apr_palloc(r->pool, len + 1);
+    for (i = 0, s = str; i < nelts; ++i) {
+        memcpy(s, strs[i], strl[i]);
+        s += strl[i];
+    }
+
+    return str;
+}
+
 static apr_status_t ap_default_log_writer( request_rec *r,
                            void *handle,
                            const char **strs,
@@ -1649,21 +2193,10 @@ static apr_status_t ap_default_log_writer( request_rec *r,
 
 {
     default_log_writer *log_writer = handle;
-    char *str;
-    char *s;
-    int i;
+    const char *str;
     apr_status_t rv;
 
-    /*
-     * We do this memcpy dance because write() is atomic for len < PIPE_BUF,
-     * while writev() need not be.
-     */
-    str = apr_palloc(r->pool, len + 1);
-
-    for (i = 0, s = str; i < nelts; ++i) {
-        memcpy(s, strs[i], strl[i]);
-        s += strl[i];
-    }
+    str = join_log_line(r, strs, strl, nelts, len);
 
     if (log_writer->type == LOG_WRITER_FD) {
         rv = apr_file_write_full((apr_file_t*)log_writer->log_writer, str,
@@ -1768,6 +2301,7 @@ static void *ap_buffered_log_writer_init(apr_pool_t *p, server_rec *s,
     buffered_log *b;
     b = apr_pcalloc(p, sizeof(buffered_log));
     b->handle = ap_default_log_writer_init(p, s, name);
+    b->index = all_buffered_logs->nelts;
 
     if (b->handle) {
         *(buffered_log **)apr_array_push(all_buffered_logs) = b;
@@ -1784,12 +2318,46 @@ static apr_status_t ap_buffered_log_writer(request_rec *r,
                                            apr_size_t len)
 
 {
-    char *str;
+    const char *str;
     char *s;
     int i;
     apr_status_t rv;
     buffered_log *buf = (buffered_log*)handle;
 
+    if (buf->handle->type != LOG_WRITER_FD) {
+        /* providers do their own buffering, if any */
+        return ap_default_log_writer(r, buf->handle, strs, strl, nelts, len);
+    }
+
+#if APR_HAS_THREADS
+    if (thread_logs.key) {
+        thread_log_buf *tbuf = get_thread_log_buf(buf);
+
+        if (tbuf) {
+            apr_thread_mutex_lock(tbuf->mutex);
+            if (len + tbuf->outcnt > LOG_BUFSIZE) {
+                flush_thread_log(buf, tbuf);
+            }
+            if (len >= LOG_BUFSIZE) {
+                /* Too long to be buffered */
+                str = join_log_line(r, strs, strl, nelts, len);
+                rv = apr_file_write_full(buf->handle->log_writer, str, len,
+                                         NULL);
+            }
+            else {
+                for (i = 0, s = &tbuf->outbuf[tbuf->outcnt]; i < nelts; ++i) {
+                    memcpy(s, strs[i], strl[i]);
+                    s += strl[i];
+                }
+                tbuf->outcnt += len;
+                rv = APR_SUCCESS;
+            }
+            apr_thread_mutex_unlock(tbuf->mutex);
+            return rv;
+        }
+    }
+#endif
+
     if ((rv = APR_ANYLOCK_LOCK(&buf->mutex)) != APR_SUCCESS) {
         return rv;
     }
@@ -1798,19 +2366,8 @@ static apr_status_t ap_buffered_log_writer(request_rec *r,
         flush_log(buf);
     }
     if (len >= LOG_BUFSIZE) {
-        apr_size_t w;
-
-        /*
-         * We do this memcpy dance because write() is atomic for
-         * len < PIPE_BUF, while writev() need not be.
-         */
-        str = apr_palloc(r->pool, len + 1);
-        for (i = 0, s = str; i < nelts; ++i) {
-            memcpy(s, strs[i], strl[i]);
-            s += strl[i];
-        }
-        w = len;
-        rv = apr_file_write_full(buf->handle, str, w, NULL);
+        str = join_log_line(r, strs, strl, nelts, len);
+        rv = apr_file_write_full(buf->handle->log_writer, str, len, NULL);
 
     }
     else {
@@ -1871,7 +2428,8 @@ static int log_pre_config(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp)
     /* reset to default conditions */
     ap_log_set_writer_init(ap_default_log_writer_init);
     ap_log_set_writer(ap_default_log_writer);
-    buffered_logs = 0;
+    buffered_logs = BUFFERED_LOGS_OFF;
+    buffered_logs_interval = DEFAULT_BUFFERED_LOGS_INTERVAL;
 
     return OK;
 }
@@ -55,6 +55,7 @@
 #include "apr_global_mutex.h"
 #include "apr_dbm.h"
 #include "apr_dbd.h"
+#include "apr_mmap.h"
 #include "mod_dbd.h"
 
 #if APR_HAS_THREADS
@@ -188,6 +189,7 @@ static const char* really_last_key = "rewrite_really_last";
 #define MAPTYPE_RND                 (1<<4)
 #define MAPTYPE_DBD                 (1<<5)
 #define MAPTYPE_DBD_CACHE           (1<<6)
+#define MAPTYPE_ITXT                (1<<7)
 
 #define ENGINE_DISABLED             (1<<0)
 #define ENGINE_ENABLED              (1<<1)
@@ -216,6 +218,9 @@ static const char* really_last_key = "rewrite_really_last";
 #define REWRITE_MAX_TXT_MAP_LINE 1024
 #endif
 
+/* magic/version of the on-disk index of itxt: maps, bump on layout change */
+#define REWRITE_TXTIDX_MAGIC 0x52574931UL /* "RWI1" */
+
 /* buffer length for prg rewrite maps */
 #ifndef REWRITE_PRG_MAP_BUF
 #define REWRITE_PRG_MAP_BUF 1024
@@ -355,6 +360,7 @@ typedef struct {
 typedef struct cache {
     apr_pool_t         *pool;
     apr_hash_t         *maps;
+    apr_hash_t         *indexes;  /* itxt: maps, see txtidx_map */
 #if APR_HAS_THREADS
     apr_thread_mutex_t *lock;
 #endif
@@ -369,6 +375,40 @@ typedef struct {
     apr_hash_t *entries;
 } cachedmap;
 
+/* The index of an itxt: map is a single read-only image, built from the
+ * text file and stored as <DefaultRuntimeDir>/rewritemap.<hash>.idx.
+ * Children mmap() it, so the pages are shared between all processes.
+ * Layout: header, nslots slots (open addressing, linear probing), then
+ * the NUL terminated keys, values and source path. String offsets are
+ * relative to the string area, whose first byte is a '\0' so that
+ * offset 0 can denote an empty slot.
+ */
+typedef struct {
+    apr_uint32_t magic;            /* REWRITE_TXTIDX_MAGIC                */
+    apr_uint32_t nslots;           /* number of slots, a power of two     */
+    apr_uint32_t nentries;         /* number of used slots                */
+    apr_uint32_t source;           /* offset of the txt file's path       */
+    apr_uint64_t mtime;            /* mtime of the txt file when indexed  */
+    apr_uint64_t size;             /* size of the txt file when indexed   */
+} txtidx_header;
+
+typedef struct {
+    apr_uint32_t hash;
+    apr_uint32_t key;
+    apr_uint32_t val;
+} txtidx_slot;
+
+/* per-child handle on a loaded index; the mapping lives in pool, which
+ * is cleared when the index gets replaced.
+ */
+typedef struct {
+    apr_pool_t *pool;
+    const char *base;
+    apr_size_t len;
+    apr_time_t mtime;
+    apr_off_t size;
+} txtidx_map;
+
 /* the regex structure for the
  * substitution of backreferences
  */
@@ -1103,6 +1143,7 @@ static int init_cache(apr_pool_t *p)
     }
 
     cachep->maps = apr_hash_make(cachep->pool);
+    cachep->indexes = apr_hash_make(cachep->pool);
 #if APR_HAS_THREADS
     (void)apr_thread_mutex_create(&(cachep->lock), APR_THREAD_MUTEX_DEFAULT, p);
 #endif
@@ -1111,6 +1152,379 @@ static int init_cache(apr_pool_t *p)
 }
 
 
+/*
+ * +-------------------------------------------------------+
+ * |                                                       |
+ * |                  indexed text maps
+ * |                                                       |
+ * +-------------------------------------------------------+
+ */
+
+typedef struct {
+    const char *key;
+    const char *val;
+    apr_size_t klen;
+    apr_size_t vlen;
+} txtidx_entry;
+
+static APR_INLINE apr_uint32_t txtidx_hash(const char *key, apr_size_t len)
+{
+    apr_ssize_t klen = len;
+
+    return (apr_uint32_t)apr_hashfunc_default(key, &klen);
+}
+
+static const char *txtidx_filename(apr_pool_t *p, const char *file)
+{
+    apr_ssize_t len = APR_HASH_KEY_STRING;
+
+    return ap_runtime_dir_relative(p, apr_psprintf(p, "rewritemap.%08x.idx",
+                                   apr_hashfunc_default(file, &len)));
+}
+
+/*
+ * read the text map and build the index image in memory, applying the
+ * same parsing rules as lookup_map_txtfile(): the first valid line for
+ * a key wins, lines without a value are ignored.
+ */
+static apr_status_t txtidx_build(apr_pool_t *p, const char *file,
+                                 const apr_finfo_t *st,
+                                 char **image, apr_size_t *len)
+{
+    apr_file_t *fp = NULL;
+    char line[REWRITE_MAX_TXT_MAP_LINE + 1]; /* +1 for \0 */
+    apr_array_header_t *entries;
+    txtidx_header *hdr;
+    txtidx_slot *slots;
+    char *strings, *pos;
+    apr_size_t flen, strsize;
+    apr_uint32_t nslots, mask;
+    apr_status_t rv;
+    int n;
+
+    if ((rv = apr_file_open(&fp, file, APR_READ|APR_BUFFERED, APR_OS_DEFAULT,
+                            p)) != APR_SUCCESS) {
+        return rv;
+    }
+
+    flen = strlen(file);
+    strsize = 1 + flen + 1;
+    entries = apr_array_make(p, 1024, sizeof(txtidx_entry));
+    while (apr_file_gets(line, sizeof(line), fp) == APR_SUCCESS) {
+        txtidx_entry *e;
+        char *k, *v;
+
+        /* ignore comments and lines starting with whitespaces */
+        if (*line == '#' || apr_isspace(*line)) {
+            continue;
+        }
+
+        /* the key must be followed by whitespace and a value */
+        for (k = line; *k && !apr_isspace(*k); ++k)
+            ;
+        for (v = k; apr_isspace(*v); ++v)
+            ;
+        if (k == v || !*v) {
+            continue;
+        }
+
+        e = apr_array_push(entries);
+        e->klen = k - line;
+        e->key = apr_pstrmemdup(p, line, e->klen);
+        for (k = v; *k && !apr_isspace(*k); ++k)
+            ;
+        e->vlen = k - v;
+        e->val = apr_pstrmemdup(p, v, e->vlen);
+        strsize += e->klen + 1 + e->vlen + 1;
+    }
+    apr_file_close(fp);
+
+    if (strsize > APR_UINT32_MAX) {
+        return APR_ENOSPC;
+    }
+
+    /* keep the load factor at or below 1/2 so probe chains stay short */
+    for (nslots = 16; nslots < (apr_uint32_t)entries->nelts * 2; nslots <<= 1)
+        ;
+    mask = nslots - 1;
+
+    *len = sizeof(*hdr) + nslots * sizeof(*slots) + strsize;
+    *image = apr_pcalloc(p, *len);
+    hdr = (txtidx_header *)*image;
+    slots = (txtidx_slot *)(*image + sizeof(*hdr));
+    strings = (char *)(slots + nslots);
+
+    hdr->magic = REWRITE_TXTIDX_MAGIC;
+    hdr->nslots = nslots;
+    hdr->mtime = (apr_uint64_t)st->mtime;
+    hdr->size = (apr_uint64_t)st->size;
+
+    pos = strings + 1;
+    hdr->source = (apr_uint32_t)(pos - strings);
+    memcpy(pos, file, flen + 1);
+    pos += flen + 1;
+
+    for (n = 0; n < entries->nelts; ++n) {
+        txtidx_entry *e = &APR_ARRAY_IDX(entries, n, txtidx_entry);
+        apr_uint32_t h = txtidx_hash(e->key, e->klen);
+        apr_uint32_t i;
+
+        for (i = h & mask; slots[i].key; i = (i + 1) & mask) {
+            if (slots[i].hash == h && !strcmp(strings + slots[i].key, e->key)) {
+                break;
+            }
+        }
+        if (slots[i].key) {
+            continue; /* duplicate key, the first one wins */
+        }
+
+        slots[i].hash = h;
+        slots[i].key = (apr_uint32_t)(pos - strings);
+        memcpy(pos, e->key, e->klen + 1);
+        pos += e->klen + 1;
+        slots[i].val = (apr_uint32_t)(pos - strings);
+        memcpy(pos, e->val, e->vlen + 1);
+        pos += e->vlen + 1;
+        ++hdr->nentries;
+    }
+    *len = pos - *image;
+
+    return APR_SUCCESS;
+}
+
+/*
+ * check that an index image is sane and belongs to the current state
+ * of the text map. All offsets are checked against the string area, and
+ * as the image ends with a '\0', every string read stays in it; at least
+ * one slot must be empty, so that lookups terminate.
+ */
+static int txtidx_valid(const char *base, apr_size_t len, const char *file,
+                        const apr_finfo_t *st)
+{
+    const txtidx_header *hdr = (const txtidx_header *)base;
+    const txtidx_slot *slots = (const txtidx_slot *)(base + sizeof(*hdr));
+    apr_size_t strsize;
+    apr_uint32_t i, used = 0;
+
+    if (len <= sizeof(*hdr) || base[len - 1] != '\0'
+        || hdr->magic != REWRITE_TXTIDX_MAGIC
+        || !hdr->nslots || (hdr->nslots & (hdr->nslots - 1))
+        || hdr->nslots >= (len - sizeof(*hdr)) / sizeof(txtidx_slot)) {
+        return 0;
+    }
+
+    strsize = len - sizeof(*hdr) - hdr->nslots * sizeof(txtidx_slot);
+    if (hdr->source >= strsize
+        || hdr->mtime != (apr_uint64_t)st->mtime
+        || hdr->size != (apr_uint64_t)st->size) {
+        return 0;
+    }
+
+    for (i = 0; i < hdr->nslots; ++i) {
+        if (!slots[i].key) {
+            continue;
+        }
+        if (slots[i].key >= strsize || slots[i].val >= strsize) {
+            return 0;
+        }
+        ++used;
+    }
+    if (used >= hdr->nslots) {
+        return 0;
+    }
+
+    return !strcmp(base + len - strsize + hdr->source, file);
+}
+
+static apr_status_t txtidx_load(apr_pool_t *p, const char *idxfile,
+                                const char *file, const apr_finfo_t *st,
+                                const char **base, apr_size_t *len)
+{
+    apr_file_t *fp = NULL;
+    apr_finfo_t fi;
+    apr_status_t rv;
+#if APR_HAS_MMAP
+    apr_mmap_t *mm = NULL;
+#else
+    char *buf;
+#endif
+
+    if ((rv = apr_file_open(&fp, idxfile, APR_READ|APR_BINARY,
+                            APR_OS_DEFAULT, p)) != APR_SUCCESS) {
+        return rv;
+    }
+
+    rv = apr_file_info_get(&fi, APR_FINFO_SIZE, fp);
+    if (rv == APR_SUCCESS
+        && (fi.size <= (apr_off_t)sizeof(txtidx_header)
+            || (apr_off_t)(apr_size_t)fi.size != fi.size)) {
+        rv = APR_EINVAL;
+    }
+    if (rv == APR_SUCCESS) {
+        *len = (apr_size_t)fi.size;
+#if APR_HAS_MMAP
+        rv = apr_mmap_create(&mm, fp, 0, *len, APR_MMAP_READ, p);
+        if (rv == APR_SUCCESS) {
+            *base = mm->mm;
+        }
+#else
+        buf = apr_palloc(p, *len);
+        rv = apr_file_read_full(fp, buf, *len, NULL);
+        *base = buf;
+#endif
+    }
+    apr_file_close(fp);
+
+    if (rv == APR_SUCCESS && !txtidx_valid(*base, *len, file, st)) {
+#if APR_HAS_MMAP
+        apr_mmap_delete(mm);
+#endif
+        rv = APR_EINVAL;
+    }
+
+    return rv;
+}
+
+/*
+ * write the index image to a temporary file and rename it into place,
+ * so that readers always see either the old or the new index
+ */
+static apr_status_t txtidx_write(apr_pool_t *p, const char *idxfile,
+                                 const char *image, apr_size_t len)
+{
+    apr_file_t *fp = NULL;
+    char *tmpfile = apr_pstrcat(p, idxfile, ".XXXXXX", NULL);
+    apr_status_t rv, rv2;
+
+    rv = apr_file_mktemp(&fp, tmpfile, APR_FOPEN_CREATE | APR_FOPEN_WRITE
+                                       | APR_FOPEN_EXCL | APR_FOPEN_BINARY, p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    rv = apr_file_write_full(fp, image, len, NULL);
+    rv2 = apr_file_close(fp);
+    if (rv == APR_SUCCESS) {
+        rv = rv2;
+    }
+    if (rv == APR_SUCCESS) {
+        /* children may run as another user than the one building it */
+        rv = apr_file_perms_set(tmpfile, APR_FPROT_UREAD | APR_FPROT_UWRITE
+                                         | APR_FPROT_GREAD | APR_FPROT_WREAD);
+        if (APR_STATUS_IS_ENOTIMPL(rv)) {
+            rv = APR_SUCCESS;
+        }
+    }
+    if (rv == APR_SUCCESS) {
+        rv = apr_file_rename(tmpfile, idxfile, p);
+    }
+    if (rv != APR_SUCCESS) {
+        apr_file_remove(tmpfile, p);
+    }
+
+    return rv;
+}
+
+/*
+ * Get an up to date index of the text map 'file' into pool 'p'. A valid
+ * index file is reused, otherwise it is rebuilt and replaced. If it can't
+ * be written (e.g. the runtime directory isn't writable by the children)
+ * the in-memory image is used, which is then private to this process.
+ */
+static apr_status_t txtidx_open(apr_pool_t *p, server_rec *s,
+                                const char *file, const apr_finfo_t *st,
+                                const char **base, apr_size_t *len)
+{
+    const char *idxfile = txtidx_filename(p, file);
+    char *image;
+    apr_size_t imglen;
+    apr_status_t rv;
+
+    if (txtidx_load(p, idxfile, file, st, base, len) == APR_SUCCESS) {
+        return APR_SUCCESS;
+    }
+
+    rv = txtidx_build(p, file, st, &image, &imglen);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(03386)
+                     "mod_rewrite: can't index text RewriteMap file %s", file);
+        return rv;
+    }
+
+    rv = txtidx_write(p, idxfile, image, imglen);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, APLOGNO(03387)
+                     "mod_rewrite: can't write index %s of text RewriteMap "
+                     "file %s, using a per process copy", idxfile, file);
+    }
+    else if (txtidx_load(p, idxfile, file, st, base, len) == APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03388)
+                     "mod_rewrite: indexed text RewriteMap file %s into %s "
+                     "(%u entries)", file, idxfile,
+                     ((txtidx_header *)image)->nentries);
+        return APR_SUCCESS;
+    }
+
+    *base = image;
+    *len = imglen;
+
+    return APR_SUCCESS;
+}
+
+static const char *txtidx_lookup(const txtidx_map *m, const char *key)
+{
+    const txtidx_header *hdr = (const txtidx_header *)m->base;
+    const txtidx_slot *slots = (const txtidx_slot *)(m->base + sizeof(*hdr));
+    const char *strings = (const char *)(slots + hdr->nslots);
+    apr_uint32_t mask = hdr->nslots - 1;
+    apr_uint32_t h = txtidx_hash(key, strlen(key));
+    apr_uint32_t i;
+
+    for (i = h & mask; slots[i].key; i = (i + 1) & mask) {
+        if (slots[i].hash == h && !strcmp(strings + slots[i].key, key)) {
+            return strings + slots[i].val;
+        }
+    }
+
+    return NULL;
+}
+
+/* build the indexes in the parent, so that the children find them ready */
+static void txtidx_prebuild(server_rec *s, apr_pool_t *ptemp)
+{
+    apr_hash_t *done = apr_hash_make(ptemp);
+
+    for (; s; s = s->next) {
+        rewrite_server_conf *conf;
+        apr_hash_index_t *hi;
+
+        conf = ap_get_module_config(s->module_config, &rewrite_module);
+        if (conf->state == ENGINE_DISABLED) {
+            continue;
+        }
+
+        for (hi = apr_hash_first(ptemp, conf->rewritemaps); hi;
+             hi = apr_hash_next(hi)) {
+            rewritemap_entry *map = apr_hash_this_val(hi);
+            apr_finfo_t st;
+            const char *base;
+            apr_size_t len;
+
+            if (map->type != MAPTYPE_ITXT
+                || apr_hash_get(done, map->datafile, APR_HASH_KEY_STRING)) {
+                continue;
+            }
+            apr_hash_set(done, map->datafile, APR_HASH_KEY_STRING, map);
+
+            if (apr_stat(&st, map->checkfile, APR_FINFO_MIN,
+                         ptemp) == APR_SUCCESS) {
+                txtidx_open(ptemp, s, map->datafile, &st, &base, &len);
+            }
+        }
+    }
+}
+
+
 /*
  * +-------------------------------------------------------+
  * |                                                       |
@@ -1345,6 +1759,64 @@ static char *lookup_map_txtfile(request_rec *r, const char *file, char *key)
     return value;
 }
 
+static char *lookup_map_txtidx(request_rec *r, rewritemap_entry *s,
+                               const apr_finfo_t *st, char *key)
+{
+    txtidx_map *m;
+    const char *value = NULL;
+    int indexed = 0;
+
+    if (!cachep) {
+        return lookup_map_txtfile(r, s->datafile, key);
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(cachep->lock);
+#endif
+    m = apr_hash_get(cachep->indexes, s->cachename, APR_HASH_KEY_STRING);
+    if (!m) {
+        m = apr_pcalloc(cachep->pool, sizeof(*m));
+        apr_hash_set(cachep->indexes, s->cachename, APR_HASH_KEY_STRING, m);
+    }
+
+    /* (re)load the index if the map changed since we last looked */
+    if (!m->base || m->mtime != st->mtime || m->size != st->size) {
+        m->base = NULL;
+        if (m->pool) {
+            apr_pool_clear(m->pool);
+        }
+        else if (apr_pool_create(&m->pool, cachep->pool) != APR_SUCCESS) {
+            m->pool = NULL;
+        }
+
+        if (m->pool && txtidx_open(m->pool, r->server, s->datafile, st,
+                                   &m->base, &m->len) == APR_SUCCESS) {
+            m->mtime = st->mtime;
+            m->size = st->size;
+            rewritelog((r, 6, NULL, "loaded index of map file %s",
+                        s->datafile));
+        }
+    }
+
+    if (m->base) {
+        indexed = 1;
+        value = txtidx_lookup(m, key);
+        if (value) {
+            /* the index may be unmapped once we release the lock */
+            value = apr_pstrdup(r->pool, value);
+        }
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(cachep->lock);
+#endif
+
+    if (!indexed) {
+        return lookup_map_txtfile(r, s->datafile, key);
+    }
+
+    return (char *)value;
+}
+
 static char *lookup_map_dbmfile(request_rec *r, const char *file,
                                 const char *dbmtype, char *key)
 {
@@ -1662,6 +2134,30 @@ static char *lookup_map(request_rec *r, char *name, char *key)
 
         return *value ? value : NULL;
 
+    /*
+     * Indexed text file map
+     */
+    case MAPTYPE_ITXT:
+        rv = apr_stat(&st, s->checkfile, APR_FINFO_MIN, r->pool);
+        if (rv != APR_SUCCESS) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(03389)
+                          "mod_rewrite: can't access text RewriteMap file %s",
+                          s->checkfile);
+            return NULL;
+        }
+
+        value = lookup_map_txtidx(r, s, &st, key);
+        if (!value) {
+            rewritelog((r, 5, NULL, "map lookup FAILED: map=%s[itxt] key=%s",
+                        name, key));
+            return NULL;
+        }
+
+        rewritelog((r, 5, NULL, "map lookup OK: map=%s[itxt] key=%s -> val=%s",
+                    name, key, value));
+
+        return value;
+
     /*
      * DBM file map
      */
@@ -3079,6 +3575,18 @@ static const char *cmd_rewritemap(cmd_parms *cmd, void *dconf, const char *a1,
         newmap->cachename = apr_psprintf(cmd->pool, "%pp:%s",
                                          (void *)cmd->server, a1);
     }
+    else if (strncasecmp(a2, "itxt:", 5) == 0) {
+        if ((fname = ap_server_root_relative(cmd->pool, a2+5)) == NULL) {
+            return apr_pstrcat(cmd->pool, "RewriteMap: bad path to itxt map: ",
+                               a2+5, NULL);
+        }
+
+        newmap->type      = MAPTYPE_ITXT;
+        newmap->datafile  = fname;
+        newmap->checkfile = fname;
+        newmap->cachename = apr_psprintf(cmd->pool, "%pp:%s",
+                                         (void *)cmd->server, a1);
+    }
     else if (strncasecmp(a2, "rnd:", 4) == 0) {
         if ((fname = ap_server_root_relative(cmd->pool, a2+4)) == NULL) {
             return apr_pstrcat(cmd->pool, "RewriteMap: bad path to rnd map: ",
@@ -4494,14 +5002,17 @@ static int post_config(apr_pool_t *p,
                               apr_pool_cleanup_null);
 
     /* if we are not doing the initial config, step through the servers and
-     * open the RewriteMap prg:xxx programs,
+     * open the RewriteMap prg:xxx programs and index the itxt:xxx maps,
      */
     if (ap_state_query(AP_SQ_MAIN_STATE) == AP_SQ_MS_CREATE_CONFIG) {
-        for (; s; s = s->next) {
-            if (run_rewritemap_programs(s, p) != APR_SUCCESS) {
+        server_rec *sp;
+
+        for (sp = s; sp; sp = sp->next) {
+            if (run_rewritemap_programs(sp, p) != APR_SUCCESS) {
                 return HTTP_INTERNAL_SERVER_ERROR;
             }
         }
+        txtidx_prebuild(s, ptemp);
     }
 
     rewrite_ssl_lookup = APR_RETRIEVE_OPTIONAL_FN(ssl_var_lookup);
@@ -14,7 +14,7 @@ if test "$proxy_mods_enable" = "no"; then
   enable_proxy_hcheck=no
 fi
 
-proxy_objs="mod_proxy.lo proxy_util.lo"
+proxy_objs="mod_proxy.lo proxy_util.lo proxy_trie.lo"
 APACHE_MODULE(proxy, Apache proxy module, $proxy_objs, , $proxy_mods_enable)
 
 proxy_connect_objs="mod_proxy_connect.lo"
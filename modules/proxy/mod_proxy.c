@@ -1285,6 +1285,14 @@ cleanup:
         r->status = saved_status;
     }
 
+    /*
+     * A suspended request is not done yet, the scheme handler reports its
+     * status when it finishes it.
+     */
+    if (access_status == SUSPENDED) {
+        return SUSPENDED;
+    }
+
     proxy_run_request_status(&access_status, r);
     AP_PROXY_RUN_FINISHED(r, attempts, access_status);
 
@@ -2769,6 +2777,8 @@ static int proxy_post_config(apr_pool_t *pconf, apr_pool_t *plog,
                 return rc;
             }
         }
+
+        ap_proxy_index_workers(pconf, sconf);
     }
 
     return OK;
@@ -110,6 +110,10 @@ SOURCE=.\mod_proxy.c
 
 SOURCE=.\proxy_util.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\proxy_trie.c
+# End Source File
 # End Group
 # Begin Group "Header Files"
 
@@ -118,6 +122,10 @@ SOURCE=.\proxy_util.c
 
 SOURCE=.\mod_proxy.h
 # End Source File
+# Begin Source File
+
+SOURCE=.\proxy_trie.h
+# End Source File
 # End Group
 # Begin Source File
 
@@ -109,6 +109,14 @@ typedef struct proxy_balancer  proxy_balancer;
 typedef struct proxy_worker    proxy_worker;
 typedef struct proxy_conn_pool proxy_conn_pool;
 typedef struct proxy_balancer_method proxy_balancer_method;
+typedef struct proxy_worker_index proxy_worker_index;
+
+/* minimum number of workers for ap_proxy_get_worker() to use an index
+ * rather than a linear scan
+ */
+#ifndef PROXY_WORKER_INDEX_MIN
+#define PROXY_WORKER_INDEX_MIN 8
+#endif
 
 /* static information about a remote proxy */
 struct proxy_remote {
@@ -199,6 +207,7 @@ typedef struct {
     unsigned int inherit_set:1;
     unsigned int ppinherit:1;
     unsigned int ppinherit_set:1;
+    proxy_worker_index *windex; /* index of workers, built at post_config */
 } proxy_server_conf;
 
 
@@ -525,6 +534,7 @@ struct proxy_balancer {
     unsigned int growth_set:1;
     unsigned int lbmethod_set:1;
     ap_conf_vector_t *section_config; /* <Proxy>-section wherein defined */
+    proxy_worker_index *windex;  /* index of workers, built at post_config */
 };
 
 struct proxy_balancer_method {
@@ -18,6 +18,7 @@
 
 #include "mod_proxy.h"
 #include "ap_regex.h"
+#include "ap_mpm.h"
 
 module AP_MODULE_DECLARE_DATA proxy_http_module;
 
@@ -768,7 +769,13 @@ static int ap_proxy_http_prefetch(apr_pool_t *p, request_rec *r,
      */
     temp_brigade = apr_brigade_create(p, bucket_alloc);
     block = (flushall) ? APR_NONBLOCK_READ : APR_BLOCK_READ;
-    do {
+    /* (Some of) the body may have been read asynchronously already, see
+     * proxy_http_read_body().
+     */
+    apr_brigade_length(input_brigade, 1, &bytes_read);
+    while ((bytes_read < MAX_MEM_SPOOL - 80)
+           && (APR_BRIGADE_EMPTY(input_brigade)
+               || !APR_BUCKET_IS_EOS(APR_BRIGADE_LAST(input_brigade)))) {
         status = ap_get_brigade(r->input_filters, temp_brigade,
                                 AP_MODE_READBYTES, block,
                                 MAX_MEM_SPOOL - bytes_read);
@@ -811,14 +818,16 @@ static int ap_proxy_http_prefetch(apr_pool_t *p, request_rec *r,
             return HTTP_INTERNAL_SERVER_ERROR;
         }
 
+        if (block == APR_NONBLOCK_READ) {
+            break;
+        }
+
     /* Ensure we don't hit a wall where we have a buffer too small
      * for ap_get_brigade's filters to fetch us another bucket,
      * surrender once we hit 80 bytes less than MAX_MEM_SPOOL
      * (an arbitrary value.)
      */
-    } while ((bytes_read < MAX_MEM_SPOOL - 80)
-              && !APR_BUCKET_IS_EOS(APR_BRIGADE_LAST(input_brigade))
-              && block == APR_BLOCK_READ);
+    }
 
     /* Use chunked request body encoding or send a content-length body?
      *
@@ -1243,6 +1252,224 @@ static int add_trailers(void *data, const char *key, const char *val)
     return 1;
 }
 
+/*
+ * The forwarding of the response body, which yields to the MPM rather than
+ * blocking when the client is slower than the backend, and is called back
+ * once the pending output is written.
+ */
+typedef struct {
+    request_rec *r;
+    proxy_conn_rec *backend;    /* NULL once released */
+    proxy_server_conf *conf;
+    apr_bucket_brigade *bb;
+    apr_bucket_brigade *pass_bb;
+    int backend_broke;
+    int async;
+} proxy_http_resp_t;
+
+static void proxy_http_resp_callback(void *baton);
+
+/* Finish a request suspended by proxy_http_handler(), with what
+ * proxy_handler() does once it's done with the others.
+ */
+static void proxy_http_finish_suspended(request_rec *r, int status)
+{
+    proxy_run_request_status(&status, r);
+    AP_PROXY_RUN_FINISHED(r, 0, status);
+    ap_finish_suspended_request(r, status);
+}
+
+static int proxy_http_send_body(proxy_http_resp_t *resp)
+{
+    request_rec *r = resp->r;
+    conn_rec *c = r->connection;
+    proxy_conn_rec *backend = resp->backend;
+    apr_bucket_brigade *bb = resp->bb, *pass_bb = resp->pass_bb;
+    apr_read_type_e mode = APR_NONBLOCK_READ;
+    apr_bucket *e;
+    int finish = FALSE;
+
+    do {
+        apr_off_t readbytes;
+        apr_status_t rv;
+
+        /* Rather than blocking on a slow client, have the MPM write what
+         * is pending and call us back.
+         */
+        if (resp->async && ap_filter_should_yield(r->output_filters)) {
+            if (ap_mpm_register_output_callback(c, proxy_http_resp_callback,
+                                                resp) == APR_SUCCESS) {
+                return SUSPENDED;
+            }
+            resp->async = 0;
+        }
+
+        rv = ap_get_brigade(backend->r->input_filters, bb,
+                            AP_MODE_READBYTES, mode,
+                            resp->conf->io_buffer_size);
+
+        /* ap_get_brigade will return success with an empty brigade
+         * for a non-blocking read which would block: */
+        if (mode == APR_NONBLOCK_READ
+            && (APR_STATUS_IS_EAGAIN(rv)
+                || (rv == APR_SUCCESS && APR_BRIGADE_EMPTY(bb)))) {
+            /* flush to the client and switch to blocking mode */
+            e = apr_bucket_flush_create(c->bucket_alloc);
+            APR_BRIGADE_INSERT_TAIL(bb, e);
+            if (ap_pass_brigade(r->output_filters, bb)
+                || c->aborted) {
+                backend->close = 1;
+                break;
+            }
+            apr_brigade_cleanup(bb);
+            mode = APR_BLOCK_READ;
+            continue;
+        }
+        else if (rv == APR_EOF) {
+            backend->close = 1;
+            break;
+        }
+        else if (rv != APR_SUCCESS) {
+            if (rv == APR_ENOSPC) {
+                ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(02475)
+                              "Response chunk/line was too large to parse");
+            }
+            else if (rv == APR_ENOTIMPL) {
+                ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(02476)
+                              "Response Transfer-Encoding was not recognised");
+            }
+            else {
+                ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01110)
+                              "Network error reading response");
+            }
+
+            /* In this case, we are in real trouble because
+             * our backend bailed on us. Given we're half way
+             * through a response, our only option is to
+             * disconnect the client too.
+             */
+            e = ap_bucket_error_create(HTTP_GATEWAY_TIME_OUT, NULL,
+                    r->pool, c->bucket_alloc);
+            APR_BRIGADE_INSERT_TAIL(bb, e);
+            e = ap_bucket_eoc_create(c->bucket_alloc);
+            APR_BRIGADE_INSERT_TAIL(bb, e);
+            ap_pass_brigade(r->output_filters, bb);
+
+            resp->backend_broke = 1;
+            backend->close = 1;
+            break;
+        }
+        /* next time try a non-blocking read */
+        mode = APR_NONBLOCK_READ;
+
+        if (!apr_is_empty_table(backend->r->trailers_in)) {
+            apr_table_do(add_trailers, r->trailers_out,
+                    backend->r->trailers_in, NULL);
+            apr_table_clear(backend->r->trailers_in);
+        }
+
+        apr_brigade_length(bb, 0, &readbytes);
+        backend->worker->s->read += readbytes;
+#if DEBUGGING
+        {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(01111)
+                      "readbytes: %#x", readbytes);
+        }
+#endif
+        /* sanity check */
+        if (APR_BRIGADE_EMPTY(bb)) {
+            break;
+        }
+
+        /* Switch the allocator lifetime of the buckets */
+        ap_proxy_buckets_lifetime_transform(r, bb, pass_bb);
+
+        /* found the last brigade? */
+        if (APR_BUCKET_IS_EOS(APR_BRIGADE_LAST(pass_bb))) {
+
+            /* signal that we must leave */
+            finish = TRUE;
+
+            /* the brigade may contain transient buckets that contain
+             * data that lives only as long as the backend connection.
+             * Force a setaside so these transient buckets become heap
+             * buckets that live as long as the request.
+             */
+            for (e = APR_BRIGADE_FIRST(pass_bb); e
+                    != APR_BRIGADE_SENTINEL(pass_bb); e
+                    = APR_BUCKET_NEXT(e)) {
+                apr_bucket_setaside(e, r->pool);
+            }
+
+            /* finally it is safe to clean up the brigade from the
+             * connection pool, as we have forced a setaside on all
+             * buckets.
+             */
+            apr_brigade_cleanup(bb);
+
+            /* make sure we release the backend connection as soon
+             * as we know we are done, so that the backend isn't
+             * left waiting for a slow client to eventually
+             * acknowledge the data.
+             */
+            proxy_run_detach_backend(r, backend);
+            ap_proxy_release_connection(backend->worker->s->scheme,
+                    backend, r->server);
+            /* Ensure that the backend is not reused */
+            resp->backend = NULL;
+
+        }
+
+        /* try send what we read */
+        if (ap_pass_brigade(r->output_filters, pass_bb) != APR_SUCCESS
+            || c->aborted) {
+            /* Ack! Phbtt! Die! User aborted! */
+            /* Only close backend if we haven't got all from the
+             * backend. Furthermore if resp->backend is NULL it is no
+             * longer safe to fiddle around with backend as it might
+             * be already in use by another thread.
+             */
+            if (resp->backend) {
+                backend->close = 1;  /* this causes socket close below */
+            }
+            finish = TRUE;
+        }
+
+        /* make sure we always clean up after ourselves */
+        apr_brigade_cleanup(pass_bb);
+        apr_brigade_cleanup(bb);
+
+    } while (!finish);
+
+    return OK;
+}
+
+static void proxy_http_resp_callback(void *baton)
+{
+    proxy_http_resp_t *resp = baton;
+    request_rec *r = resp->r;
+    int status;
+
+    if (proxy_http_send_body(resp) == SUSPENDED) {
+        return;
+    }
+
+    /* what ap_proxy_http_process_response() and proxy_http_handler() do
+     * once the body is sent
+     */
+    apr_brigade_cleanup(resp->bb);
+    status = (r->connection->aborted || resp->backend_broke) ? DONE : OK;
+    if (resp->backend) {
+        proxy_run_detach_backend(r, resp->backend);
+        if (status != OK) {
+            resp->backend->close = 1;
+        }
+        ap_proxy_http_cleanup(resp->backend->worker->s->scheme, r,
+                              resp->backend);
+    }
+    proxy_http_finish_suspended(r, status);
+}
+
 static
 int ap_proxy_http_process_response(apr_pool_t * p, request_rec *r,
         proxy_conn_rec **backend_ptr, proxy_worker *worker,
@@ -1706,8 +1933,7 @@ int ap_proxy_http_process_response(apr_pool_t * p, request_rec *r,
              */
             if (!dconf->error_override || !ap_is_HTTP_ERROR(proxy_status)) {
                 /* read the body, pass it to the output filters */
-                apr_read_type_e mode = APR_NONBLOCK_READ;
-                int finish = FALSE;
+                proxy_http_resp_t *resp;
 
                 /* Handle the case where the error document is itself reverse
                  * proxied and was successful. We must maintain any previous
@@ -1720,146 +1946,21 @@ int ap_proxy_http_process_response(apr_pool_t * p, request_rec *r,
                     r->status_line = original_status_line;
                 }
 
-                do {
-                    apr_off_t readbytes;
-                    apr_status_t rv;
-
-                    rv = ap_get_brigade(backend->r->input_filters, bb,
-                                        AP_MODE_READBYTES, mode,
-                                        conf->io_buffer_size);
-
-                    /* ap_get_brigade will return success with an empty brigade
-                     * for a non-blocking read which would block: */
-                    if (mode == APR_NONBLOCK_READ
-                        && (APR_STATUS_IS_EAGAIN(rv)
-                            || (rv == APR_SUCCESS && APR_BRIGADE_EMPTY(bb)))) {
-                        /* flush to the client and switch to blocking mode */
-                        e = apr_bucket_flush_create(c->bucket_alloc);
-                        APR_BRIGADE_INSERT_TAIL(bb, e);
-                        if (ap_pass_brigade(r->output_filters, bb)
-                            || c->aborted) {
-                            backend->close = 1;
-                            break;
-                        }
-                        apr_brigade_cleanup(bb);
-                        mode = APR_BLOCK_READ;
-                        continue;
-                    }
-                    else if (rv == APR_EOF) {
-                        backend->close = 1;
-                        break;
-                    }
-                    else if (rv != APR_SUCCESS) {
-                        if (rv == APR_ENOSPC) {
-                            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(02475)
-                                          "Response chunk/line was too large to parse");
-                        }
-                        else if (rv == APR_ENOTIMPL) {
-                            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(02476)
-                                          "Response Transfer-Encoding was not recognised");
-                        }
-                        else {
-                            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01110)
-                                          "Network error reading response");
-                        }
-
-                        /* In this case, we are in real trouble because
-                         * our backend bailed on us. Given we're half way
-                         * through a response, our only option is to
-                         * disconnect the client too.
-                         */
-                        e = ap_bucket_error_create(HTTP_GATEWAY_TIME_OUT, NULL,
-                                r->pool, c->bucket_alloc);
-                        APR_BRIGADE_INSERT_TAIL(bb, e);
-                        e = ap_bucket_eoc_create(c->bucket_alloc);
-                        APR_BRIGADE_INSERT_TAIL(bb, e);
-                        ap_pass_brigade(r->output_filters, bb);
-
-                        backend_broke = 1;
-                        backend->close = 1;
-                        break;
-                    }
-                    /* next time try a non-blocking read */
-                    mode = APR_NONBLOCK_READ;
-
-                    if (!apr_is_empty_table(backend->r->trailers_in)) {
-                        apr_table_do(add_trailers, r->trailers_out,
-                                backend->r->trailers_in, NULL);
-                        apr_table_clear(backend->r->trailers_in);
-                    }
-
-                    apr_brigade_length(bb, 0, &readbytes);
-                    backend->worker->s->read += readbytes;
-#if DEBUGGING
-                    {
-                    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(01111)
-                                  "readbytes: %#x", readbytes);
-                    }
-#endif
-                    /* sanity check */
-                    if (APR_BRIGADE_EMPTY(bb)) {
-                        break;
-                    }
-
-                    /* Switch the allocator lifetime of the buckets */
-                    ap_proxy_buckets_lifetime_transform(r, bb, pass_bb);
-
-                    /* found the last brigade? */
-                    if (APR_BUCKET_IS_EOS(APR_BRIGADE_LAST(pass_bb))) {
-
-                        /* signal that we must leave */
-                        finish = TRUE;
-
-                        /* the brigade may contain transient buckets that contain
-                         * data that lives only as long as the backend connection.
-                         * Force a setaside so these transient buckets become heap
-                         * buckets that live as long as the request.
-                         */
-                        for (e = APR_BRIGADE_FIRST(pass_bb); e
-                                != APR_BRIGADE_SENTINEL(pass_bb); e
-                                = APR_BUCKET_NEXT(e)) {
-                            apr_bucket_setaside(e, r->pool);
-                        }
-
-                        /* finally it is safe to clean up the brigade from the
-                         * connection pool, as we have forced a setaside on all
-                         * buckets.
-                         */
-                        apr_brigade_cleanup(bb);
-
-                        /* make sure we release the backend connection as soon
-                         * as we know we are done, so that the backend isn't
-                         * left waiting for a slow client to eventually
-                         * acknowledge the data.
-                         */
-                        proxy_run_detach_backend(r, backend);
-                        ap_proxy_release_connection(backend->worker->s->scheme,
-                                backend, r->server);
-                        /* Ensure that the backend is not reused */
-                        *backend_ptr = NULL;
-
-                    }
-
-                    /* try send what we read */
-                    if (ap_pass_brigade(r->output_filters, pass_bb) != APR_SUCCESS
-                        || c->aborted) {
-                        /* Ack! Phbtt! Die! User aborted! */
-                        /* Only close backend if we haven't got all from the
-                         * backend. Furthermore if *backend_ptr is NULL it is no
-                         * longer safe to fiddle around with backend as it might
-                         * be already in use by another thread.
-                         */
-                        if (*backend_ptr) {
-                            backend->close = 1;  /* this causes socket close below */
-                        }
-                        finish = TRUE;
-                    }
-
-                    /* make sure we always clean up after ourselves */
-                    apr_brigade_cleanup(pass_bb);
-                    apr_brigade_cleanup(bb);
-
-                } while (!finish);
+                resp = apr_pcalloc(p, sizeof(*resp));
+                resp->r = r;
+                resp->backend = backend;
+                resp->conf = conf;
+                resp->bb = bb;
+                resp->pass_bb = pass_bb;
+                /* Balancer members are released by proxy_handler() when
+                 * we yield, see proxy_http_body_prefetch().
+                 */
+                resp->async = (!r->main && !r->prev && !worker->balancer);
+                if (proxy_http_send_body(resp) == SUSPENDED) {
+                    return SUSPENDED;
+                }
+                *backend_ptr = resp->backend;
+                backend_broke = resp->backend_broke;
             }
             ap_log_rerror(APLOG_MARK, APLOG_TRACE2, 0, r, "end body send");
         }
@@ -1917,6 +2018,130 @@ apr_status_t ap_proxy_http_cleanup(const char *scheme, request_rec *r,
     return OK;
 }
 
+/*
+ * The prefetch of the request body, done asynchronously (before anything
+ * else) when the client is slow to send it, so that no thread waits for it.
+ * The handler is run again with what was read once the prefetch is done.
+ */
+typedef struct {
+    request_rec *r;
+    proxy_worker *worker;
+    proxy_server_conf *conf;
+    char *url;
+    const char *proxyname;
+    apr_port_t proxyport;
+    apr_bucket_brigade *input_brigade;
+    apr_bucket_brigade *temp_brigade;
+    apr_off_t bytes_read;
+} proxy_http_body_t;
+
+static int proxy_http_handler(request_rec *r, proxy_worker *worker,
+                              proxy_server_conf *conf,
+                              char *url, const char *proxyname,
+                              apr_port_t proxyport);
+
+static void proxy_http_body_callback(void *baton);
+
+static int proxy_http_read_body(proxy_http_body_t *body)
+{
+    request_rec *r = body->r;
+    apr_status_t status;
+    apr_off_t bytes;
+
+    /* Same limits as ap_proxy_http_prefetch() */
+    while ((body->bytes_read < MAX_MEM_SPOOL - 80)
+           && (APR_BRIGADE_EMPTY(body->input_brigade)
+               || !APR_BUCKET_IS_EOS(APR_BRIGADE_LAST(body->input_brigade)))) {
+        status = ap_read_request_body(r, body->temp_brigade,
+                                      MAX_MEM_SPOOL - body->bytes_read,
+                                      proxy_http_body_callback, body);
+        if (APR_STATUS_IS_EAGAIN(status)) {
+            return SUSPENDED;
+        }
+        if (status != APR_SUCCESS) {
+            conn_rec *c = r->connection;
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(03410)
+                          "prefetch request body failed from %s (%s)",
+                          c->client_ip, c->remote_host ? c->remote_host: "");
+            return ap_map_http_request_error(status, HTTP_BAD_REQUEST);
+        }
+
+        apr_brigade_length(body->temp_brigade, 1, &bytes);
+        body->bytes_read += bytes;
+
+        /* set aside, see ap_proxy_http_prefetch() */
+        status = ap_save_brigade(NULL, &body->input_brigade,
+                                 &body->temp_brigade, r->pool);
+        if (status != APR_SUCCESS) {
+            return HTTP_INTERNAL_SERVER_ERROR;
+        }
+    }
+
+    return OK;
+}
+
+static void proxy_http_body_callback(void *baton)
+{
+    proxy_http_body_t *body = baton;
+    int status;
+
+    status = proxy_http_read_body(body);
+    if (status == OK) {
+        status = proxy_http_handler(body->r, body->worker, body->conf,
+                                    body->url, body->proxyname,
+                                    body->proxyport);
+    }
+    if (status != SUSPENDED) {
+        proxy_http_finish_suspended(body->r, status);
+    }
+}
+
+static int proxy_http_body_prefetch(request_rec *r, proxy_worker *worker,
+                                    proxy_server_conf *conf,
+                                    char *url, const char *proxyname,
+                                    apr_port_t proxyport,
+                                    proxy_http_body_t **pbody)
+{
+    proxy_http_body_t *body;
+
+    body = ap_get_module_config(r->request_config, &proxy_http_module);
+    if (body) {
+        /* run again by proxy_http_body_callback() */
+        *pbody = body;
+        return OK;
+    }
+    *pbody = NULL;
+
+    /* Leave the cases where the body is not read before connecting to
+     * the backend (or not at all) to ap_proxy_http_prefetch(), along
+     * with subrequests and internal redirects which can't be suspended.
+     * Balancer members are also left alone, since proxy_handler() would
+     * release them (ap_proxy_post_request()) before the backend is even
+     * contacted, and failover could not happen from here.
+     */
+    if (r->main || r->prev || !ap_request_has_body(r) || worker->balancer
+        || apr_table_get(r->subprocess_env, "proxy-flushall")
+        || apr_table_get(r->subprocess_env, "force-proxy-request-1.0")) {
+        return OK;
+    }
+
+    body = apr_pcalloc(r->pool, sizeof(*body));
+    body->r = r;
+    body->worker = worker;
+    body->conf = conf;
+    body->url = url;
+    body->proxyname = proxyname;
+    body->proxyport = proxyport;
+    body->input_brigade = apr_brigade_create(r->pool,
+                                             r->connection->bucket_alloc);
+    body->temp_brigade = apr_brigade_create(r->pool,
+                                            r->connection->bucket_alloc);
+    ap_set_module_config(r->request_config, &proxy_http_module, body);
+    *pbody = body;
+
+    return proxy_http_read_body(body);
+}
+
 /*
  * This handles http:// URLs, and other URLs using a remote proxy over http
  * If proxyhost is NULL, then contact the server directly, otherwise
@@ -1953,6 +2178,7 @@ static int proxy_http_handler(request_rec *r, proxy_worker *worker,
      */
     apr_pool_t *p = r->pool;
     apr_uri_t *uri;
+    proxy_http_body_t *body;
 
     /* find the scheme */
     u = strchr(url, ':');
@@ -1987,6 +2213,12 @@ static int proxy_http_handler(request_rec *r, proxy_worker *worker,
     }
     ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r, "HTTP: serving URL %s", url);
 
+    /* Wait for the body (or enough of it) before anything else, possibly
+     * yielding until the client sends it.
+     */
+    if ((status = proxy_http_body_prefetch(r, worker, conf, url, proxyname,
+                                           proxyport, &body)) != OK)
+        return status;
 
     /* create space for state information */
     if ((status = ap_proxy_acquire_connection(proxy_function, &backend,
@@ -2037,6 +2269,9 @@ static int proxy_http_handler(request_rec *r, proxy_worker *worker,
      */
     input_brigade = apr_brigade_create(p, c->bucket_alloc);
     header_brigade = apr_brigade_create(p, c->bucket_alloc);
+    if (body) {
+        APR_BRIGADE_CONCAT(input_brigade, body->input_brigade);
+    }
     if ((status = ap_proxy_http_prefetch(p, r, backend, worker, conf, uri,
                                          locurl, server_portstr,
                                          header_brigade, input_brigade,
@@ -2138,7 +2373,7 @@ static int proxy_http_handler(request_rec *r, proxy_worker *worker,
 
     /* Step Six: Clean Up */
 cleanup:
-    if (backend) {
+    if (backend && status != SUSPENDED) {
         if (status != OK)
             backend->close = 1;
         ap_proxy_http_cleanup(proxy_function, r, backend);
@@ -0,0 +1,192 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Radix tree used to find the worker whose name is the longest prefix
+ * of a URL, see ap_proxy_get_worker().
+ */
+
+#include "apr_lib.h"
+#include "apr_strings.h"
+#include "apr_tables.h"
+
+#define APR_WANT_STRFUNC
+#include "apr_want.h"
+
+#include "proxy_trie.h"
+
+typedef struct proxy_trie_node proxy_trie_node;
+
+struct proxy_trie_node {
+    const char *label;            /* edge label from the parent, not \0 terminated */
+    apr_size_t len;               /* length of label */
+    int value;                    /* value of the key ending here, or -1 */
+    apr_array_header_t *children; /* proxy_trie_node *, sorted by label[0] */
+};
+
+struct proxy_trie_t {
+    apr_pool_t *pool;
+    proxy_trie_node *root;
+};
+
+static proxy_trie_node *make_node(apr_pool_t *p, const char *label,
+                                  apr_size_t len, int value)
+{
+    proxy_trie_node *n = apr_palloc(p, sizeof(*n));
+
+    n->label = label;
+    n->len = len;
+    n->value = value;
+    n->children = apr_array_make(p, 2, sizeof(proxy_trie_node *));
+
+    return n;
+}
+
+/* Binary search of the child whose label starts with c; returns its
+ * position, or the position it would be inserted at with *found = 0.
+ */
+static int find_child(const proxy_trie_node *n, unsigned char c, int *found)
+{
+    proxy_trie_node **children = (proxy_trie_node **)n->children->elts;
+    int lo = 0, hi = n->children->nelts;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        unsigned char m = (unsigned char)children[mid]->label[0];
+
+        if (m == c) {
+            *found = 1;
+            return mid;
+        }
+        if (m < c) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    *found = 0;
+    return lo;
+}
+
+proxy_trie_t *proxy_trie_make(apr_pool_t *p)
+{
+    proxy_trie_t *t = apr_palloc(p, sizeof(*t));
+
+    t->pool = p;
+    t->root = make_node(p, "", 0, -1);
+
+    return t;
+}
+
+void proxy_trie_insert(proxy_trie_t *t, const char *key, int value)
+{
+    proxy_trie_node *n = t->root;
+    const char *k = apr_pstrdup(t->pool, key);
+
+    for (;;) {
+        proxy_trie_node **children, *child, *mid;
+        apr_size_t common;
+        int pos, found;
+
+        if (!*k) {
+            if (n->value < 0) {
+                n->value = value;
+            }
+            return;
+        }
+
+        pos = find_child(n, (unsigned char)*k, &found);
+        if (!found) {
+            /* new leaf, shift the greater children to keep them sorted */
+            apr_array_push(n->children);
+            children = (proxy_trie_node **)n->children->elts;
+            memmove(children + pos + 1, children + pos,
+                    (n->children->nelts - pos - 1) * sizeof(*children));
+            children[pos] = make_node(t->pool, k, strlen(k), value);
+            return;
+        }
+
+        children = (proxy_trie_node **)n->children->elts;
+        child = children[pos];
+        for (common = 1; common < child->len && k[common] == child->label[common];
+             ++common)
+            ;
+
+        if (common < child->len) {
+            /* split the edge, the new inner node keeps the first char so
+             * the children order is unchanged
+             */
+            mid = make_node(t->pool, child->label, common, -1);
+            child->label += common;
+            child->len -= common;
+            APR_ARRAY_PUSH(mid->children, proxy_trie_node *) = child;
+            children[pos] = mid;
+            child = mid;
+        }
+
+        n = child;
+        k += common;
+    }
+}
+
+int proxy_trie_longest_prefix(const proxy_trie_t *t, const char *str,
+                              apr_size_t fold, apr_size_t *match_len)
+{
+    const proxy_trie_node *n = t->root;
+    apr_size_t pos = 0;
+    int value = n->value;
+
+    if (value >= 0) {
+        *match_len = 0;
+    }
+
+    while (str[pos]) {
+        proxy_trie_node **children;
+        unsigned char c;
+        apr_size_t i;
+        int at, found;
+
+        c = (unsigned char)str[pos];
+        if (pos < fold) {
+            c = (unsigned char)apr_tolower(c);
+        }
+        at = find_child(n, c, &found);
+        if (!found) {
+            break;
+        }
+
+        children = (proxy_trie_node **)n->children->elts;
+        n = children[at];
+        for (i = 1; i < n->len; ++i) {
+            c = (unsigned char)str[pos + i];
+            if (pos + i < fold) {
+                c = (unsigned char)apr_tolower(c);
+            }
+            if (c != (unsigned char)n->label[i]) {
+                return value;
+            }
+        }
+        pos += n->len;
+
+        if (n->value >= 0) {
+            value = n->value;
+            *match_len = pos;
+        }
+    }
+
+    return value;
+}
@@ -0,0 +1,72 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROXY_TRIE_H_
+#define PROXY_TRIE_H_
+
+/**
+ * @file  proxy_trie.h
+ * @brief Radix tree for longest prefix matching of worker names.
+ *
+ * @defgroup MOD_PROXY_TRIE Worker name trie
+ * @ingroup MOD_PROXY_PRIVATE
+ * @{
+ */
+
+#include "apr.h"
+#include "apr_pools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct proxy_trie_t proxy_trie_t;
+
+/**
+ * Create an empty trie.
+ * @param p The pool where the trie and its keys are allocated
+ * @return The new trie
+ */
+proxy_trie_t *proxy_trie_make(apr_pool_t *p);
+
+/**
+ * Add a key to the trie. The key is copied. If the key is already
+ * present, the value of the first insertion is kept.
+ * @param t The trie
+ * @param key The key to add
+ * @param value The value associated with key, must be >= 0
+ */
+void proxy_trie_insert(proxy_trie_t *t, const char *key, int value);
+
+/**
+ * Find the longest key which is a prefix of str. This does not allocate.
+ * @param t The trie
+ * @param str The string to match
+ * @param fold The number of leading characters of str which are lowercased
+ *             before being compared
+ * @param match_len Set to the length of the matching key, if any
+ * @return The value of the matching key, or -1 if none matches
+ */
+int proxy_trie_longest_prefix(const proxy_trie_t *t, const char *str,
+                              apr_size_t fold, apr_size_t *match_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* PROXY_TRIE_H_ */
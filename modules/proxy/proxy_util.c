@@ -21,6 +21,7 @@
 #include "apr_version.h"
 #include "apr_hash.h"
 #include "proxy_util.h"
+#include "proxy_trie.h"
 #include "ajp.h"
 #include "scgi.h"
 
@@ -1505,12 +1506,16 @@ PROXY_DECLARE(char *) ap_proxy_worker_name(apr_pool_t *p,
  * Hmmm... shouldn't this really go component by component?
  *
  * Adds handling of the "\<any>" => "<any>" unescaping.
+ *
+ * The first 'fold' characters of str are lowercased before being compared.
  */
-static int ap_proxy_strcmp_ematch(const char *str, const char *expected)
+static int ap_proxy_strcmp_ematch(const char *str, const char *expected,
+                                  apr_size_t fold)
 {
     apr_size_t x, y;
 
     for (x = 0, y = 0; expected[y]; ++y, ++x) {
+        char c;
         if ((!str[x]) && (expected[y] != '$' || !apr_isdigit(expected[y + 1])))
             return -1;
         if (expected[y] == '$' && apr_isdigit(expected[y + 1])) {
@@ -1520,8 +1525,10 @@ static int ap_proxy_strcmp_ematch(const char *str, const char *expected)
                 return 0;
             while (str[x]) {
                 int ret;
-                if ((ret = ap_proxy_strcmp_ematch(&str[x++], &expected[y])) != 1)
+                if ((ret = ap_proxy_strcmp_ematch(&str[x], &expected[y],
+                                                  fold > x ? fold - x : 0)) != 1)
                     return ret;
+                ++x;
             }
             return -1;
         }
@@ -1530,13 +1537,114 @@ static int ap_proxy_strcmp_ematch(const char *str, const char *expected)
             if (!expected[++y])
                 return -2;
         }
-        if (str[x] != expected[y])
+        c = (x < fold) ? apr_tolower(str[x]) : str[x];
+        if (c != expected[y])
             return 1;
     }
     /* We got all the way through the worker path without a difference */
     return 0;
 }
 
+/*
+ * strncmp() of the worker name against the URL, with the first 'fold'
+ * characters of the URL lowercased.
+ */
+static int proxy_worker_name_cmp(const char *url, const char *name,
+                                 apr_size_t len, apr_size_t fold)
+{
+    apr_size_t i;
+
+    for (i = 0; i < len; ++i) {
+        char c = (i < fold) ? apr_tolower(url[i]) : url[i];
+        if (c != name[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Returns the length of the worker's name if it matches the URL better
+ * than a previous match of length max_match (see ap_proxy_get_worker()),
+ * 0 otherwise.
+ */
+static int proxy_worker_match(const proxy_worker *worker, const char *url,
+                              int url_length, int min_match, int max_match)
+{
+    const char *name = worker->s->name;
+    int worker_name_length = strlen(name);
+
+    if (worker_name_length <= url_length
+        && worker_name_length >= min_match
+        && worker_name_length > max_match
+        && (worker->s->is_name_matchable
+            ? ap_proxy_strcmp_ematch(url, name, min_match) == 0
+            : proxy_worker_name_cmp(url, name, worker_name_length,
+                                    min_match) == 0)) {
+        return worker_name_length;
+    }
+    return 0;
+}
+
+/*
+ * Index of the worker names of a server or balancer, built once the
+ * configuration is complete: a trie of the plain names, and the list of
+ * the (regex) matchable workers which still need to be scanned. It is
+ * only used as long as the workers array has the size it was built for,
+ * workers added at runtime (balancer-manager) fall back to the scan.
+ */
+struct proxy_worker_index {
+    int nelts;               /* size of the indexed workers array */
+    proxy_trie_t *names;     /* name => position in the array */
+    apr_array_header_t *matchable; /* of int, positions in the array */
+};
+
+static proxy_worker_index *proxy_index_workers(apr_pool_t *p,
+                                               apr_array_header_t *workers,
+                                               int is_balancer)
+{
+    proxy_worker_index *index;
+    int i;
+
+    if (workers->nelts < PROXY_WORKER_INDEX_MIN) {
+        return NULL;
+    }
+
+    index = apr_palloc(p, sizeof(*index));
+    index->nelts = workers->nelts;
+    index->names = proxy_trie_make(p);
+    index->matchable = apr_array_make(p, 1, sizeof(int));
+
+    for (i = 0; i < workers->nelts; i++) {
+        proxy_worker *worker = is_balancer
+                               ? APR_ARRAY_IDX(workers, i, proxy_worker *)
+                               : &APR_ARRAY_IDX(workers, i, proxy_worker);
+
+        if (worker->s->is_name_matchable) {
+            APR_ARRAY_PUSH(index->matchable, int) = i;
+        }
+        else {
+            proxy_trie_insert(index->names, worker->s->name, i);
+        }
+    }
+
+    return index;
+}
+
+PROXY_DECLARE(void) ap_proxy_index_workers(apr_pool_t *p,
+                                           proxy_server_conf *conf)
+{
+    proxy_balancer *balancer;
+    int i;
+
+    conf->windex = proxy_index_workers(p, conf->workers, 0);
+
+    balancer = (proxy_balancer *)conf->balancers->elts;
+    for (i = 0; i < conf->balancers->nelts; i++, balancer++) {
+        balancer->windex = proxy_index_workers(p, balancer->workers, 1);
+    }
+}
+
 PROXY_DECLARE(proxy_worker *) ap_proxy_get_worker(apr_pool_t *p,
                                                   proxy_balancer *balancer,
                                                   proxy_server_conf *conf,
@@ -1544,12 +1652,13 @@ PROXY_DECLARE(proxy_worker *) ap_proxy_get_worker(apr_pool_t *p,
 {
     proxy_worker *worker;
     proxy_worker *max_worker = NULL;
+    proxy_worker_index *index;
+    apr_array_header_t *workers;
     int max_match = 0;
     int url_length;
     int min_match;
     int worker_name_length;
     const char *c;
-    char *url_copy;
     int i;
 
     if (!url) {
@@ -1564,27 +1673,16 @@ PROXY_DECLARE(proxy_worker *) ap_proxy_get_worker(apr_pool_t *p,
     }
 
     url_length = strlen(url);
-    url_copy = apr_pstrmemdup(p, url, url_length);
 
     /*
      * We need to find the start of the path and
      * therefore we know the length of the scheme://hostname/
-     * part to we can force-lowercase everything up to
-     * the start of the path.
+     * part, which is compared case-insensitively (the worker names
+     * are lowercased up to the start of their path).
      */
     c = ap_strchr_c(c+3, '/');
-    if (c) {
-        char *pathstart;
-        pathstart = url_copy + (c - url);
-        *pathstart = '\0';
-        ap_str_tolower(url_copy);
-        min_match = strlen(url_copy);
-        *pathstart = '/';
-    }
-    else {
-        ap_str_tolower(url_copy);
-        min_match = strlen(url_copy);
-    }
+    min_match = c ? c - url : url_length;
+
     /*
      * Do a "longest match" on the worker name to find the worker that
      * fits best to the URL, but keep in mind that we must have at least
@@ -1593,34 +1691,64 @@ PROXY_DECLARE(proxy_worker *) ap_proxy_get_worker(apr_pool_t *p,
      */
 
     if (balancer) {
-        proxy_worker **workers = (proxy_worker **)balancer->workers->elts;
-        for (i = 0; i < balancer->workers->nelts; i++, workers++) {
-            worker = *workers;
-            if ( ((worker_name_length = strlen(worker->s->name)) <= url_length)
-                && (worker_name_length >= min_match)
-                && (worker_name_length > max_match)
-                && (worker->s->is_name_matchable
-                    || strncmp(url_copy, worker->s->name,
-                               worker_name_length) == 0)
-                && (!worker->s->is_name_matchable
-                    || ap_proxy_strcmp_ematch(url_copy,
-                                              worker->s->name) == 0) ) {
+        workers = balancer->workers;
+        index = balancer->windex;
+    }
+    else {
+        workers = conf->workers;
+        index = conf->windex;
+    }
+
+    if (index && index->nelts == workers->nelts) {
+        apr_size_t len;
+        int *matchable = (int *)index->matchable->elts;
+        int max_pos;
+
+        /* the longest plain name, then any longer (or equally long but
+         * defined earlier) matchable name, like the scan below would do
+         */
+        max_pos = proxy_trie_longest_prefix(index->names, url, min_match, &len);
+        if (max_pos >= 0 && len >= (apr_size_t)min_match) {
+            max_match = len;
+        }
+        else {
+            max_pos = -1;
+        }
+        for (i = 0; i < index->matchable->nelts; i++) {
+            int pos = matchable[i];
+
+            worker = balancer ? APR_ARRAY_IDX(workers, pos, proxy_worker *)
+                              : &APR_ARRAY_IDX(workers, pos, proxy_worker);
+            worker_name_length = proxy_worker_match(worker, url, url_length,
+                                                    min_match,
+                                                    pos < max_pos ? max_match - 1
+                                                                  : max_match);
+            if (worker_name_length) {
+                max_pos = pos;
+                max_match = worker_name_length;
+            }
+        }
+        if (max_pos >= 0) {
+            max_worker = balancer ? APR_ARRAY_IDX(workers, max_pos, proxy_worker *)
+                                  : &APR_ARRAY_IDX(workers, max_pos, proxy_worker);
+        }
+    }
+    else if (balancer) {
+        proxy_worker **bworkers = (proxy_worker **)workers->elts;
+        for (i = 0; i < workers->nelts; i++, bworkers++) {
+            worker = *bworkers;
+            if ((worker_name_length = proxy_worker_match(worker, url, url_length,
+                                                         min_match, max_match))) {
                 max_worker = worker;
                 max_match = worker_name_length;
             }
         }
-    } else {
-        worker = (proxy_worker *)conf->workers->elts;
-        for (i = 0; i < conf->workers->nelts; i++, worker++) {
-            if ( ((worker_name_length = strlen(worker->s->name)) <= url_length)
-                && (worker_name_length >= min_match)
-                && (worker_name_length > max_match)
-                && (worker->s->is_name_matchable
-                    || strncmp(url_copy, worker->s->name,
-                               worker_name_length) == 0)
-                && (!worker->s->is_name_matchable
-                    || ap_proxy_strcmp_ematch(url_copy,
-                                              worker->s->name) == 0) ) {
+    }
+    else {
+        worker = (proxy_worker *)workers->elts;
+        for (i = 0; i < workers->nelts; i++, worker++) {
+            if ((worker_name_length = proxy_worker_match(worker, url, url_length,
+                                                         min_match, max_match))) {
                 max_worker = worker;
                 max_match = worker_name_length;
             }
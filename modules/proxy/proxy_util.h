@@ -35,6 +35,15 @@ extern PROXY_DECLARE_DATA int proxy_lb_workers;
 extern PROXY_DECLARE_DATA const apr_strmatch_pattern *ap_proxy_strmatch_path;
 extern PROXY_DECLARE_DATA const apr_strmatch_pattern *ap_proxy_strmatch_domain;
 
+/**
+ * Index the worker names of a server and of its balancers, so that
+ * ap_proxy_get_worker() does not need to scan them.
+ * @param p     The pool where the indexes are allocated
+ * @param conf  The proxy server configuration, once complete
+ */
+PROXY_DECLARE(void) ap_proxy_index_workers(apr_pool_t *p,
+                                           proxy_server_conf *conf);
+
 /**
  * Register optional functions declared within proxy_util.c.
  */
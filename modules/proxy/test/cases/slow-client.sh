@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# Licensed to the Apache Software Foundation (ASF) under one or more
+# contributor license agreements.  See the NOTICE file distributed with
+# this work for additional information regarding copyright ownership.
+# The ASF licenses this file to You under the Apache License, Version 2.0
+# (the "License"); you may not use this file except in compliance with
+# the License.  You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Proxied downloads to slow clients must not pin the worker threads: while
+# twice as many of them as there are threads are running, a small request
+# is still answered right away. Then each download must match the file.
+#
+CURL=${CURL:-curl}
+N=${N:-16}
+RATE=${RATE:-500k}
+
+i=0
+while [ $i -lt $N ] ; do
+    $CURL -s --limit-rate $RATE -o $OUT/large.$i "$URL/proxy/large" &
+    i=`expr $i + 1`
+done
+sleep 3
+
+rv=0
+if [ "`$CURL -s -m 5 $URL/small`" = small ] ; then
+    echo "slow-client $N downloads, small request: ok"
+else
+    echo "slow-client $N downloads, small request: no answer"
+    rv=1
+fi
+wait
+
+i=0
+while [ $i -lt $N ] ; do
+    if ! cmp -s $OUT/htdocs/large $OUT/large.$i ; then
+        echo "slow-client download $i: differs"
+        rv=1
+    fi
+    i=`expr $i + 1`
+done
+exit $rv
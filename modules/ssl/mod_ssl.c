@@ -162,6 +162,13 @@ static const command_rec ssl_config_cmds[] = {
     SSL_CMD_SRV(SessionTickets, FLAG,
                 "Enable or disable TLS session tickets"
                 "(`on', `off')")
+    SSL_CMD_SRV(KernelTLS, FLAG,
+                "Let the kernel encrypt the data sent "
+                "(`on', `off')")
+    SSL_CMD_SRV(DynamicRecordSize, TAKE123,
+                "Send small TLS records first, then full ones "
+                "(`on', `off' or size in bytes [threshold in bytes "
+                "[idle timeout]])")
     SSL_CMD_SRV(InsecureRenegotiation, FLAG,
                 "Enable support for insecure renegotiation")
     SSL_CMD_ALL(UserName, TAKE1,
@@ -289,6 +296,9 @@ static const command_rec ssl_config_cmds[] = {
                 "SSL stapling option for OCSP Response Error Cache Lifetime")
     SSL_CMD_SRV(StaplingForceURL, TAKE1,
                 "SSL stapling option to Force the OCSP Stapling URL")
+    SSL_CMD_SRV(StaplingBackgroundRefresh, FLAG,
+                "SSL stapling switch to renew OCSP responses in the background "
+                "rather than in the handshakes (`on', `off')")
 #endif
 
 #ifdef HAVE_SSL_CONF_CMD
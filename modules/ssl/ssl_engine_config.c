@@ -74,6 +74,8 @@ SSLModConfigRec *ssl_config_global_create(server_rec *s)
     mc->stapling_cache_mutex   = NULL;
     mc->stapling_refresh_mutex = NULL;
 #endif
+    mc->stats                  = NULL;
+    mc->stats_slots            = 0;
 
     apr_pool_userdata_set(mc, SSL_MOD_CONFIG_KEY,
                           apr_pool_cleanup_null,
@@ -148,6 +150,7 @@ static void modssl_ctx_init(modssl_ctx_t *mctx, apr_pool_t *p)
     mctx->stapling_errcache_timeout  = UNSET;
     mctx->stapling_responder_timeout = UNSET;
     mctx->stapling_force_url         = NULL;
+    mctx->stapling_background_refresh = UNSET;
 #endif
 
 #ifdef HAVE_SRP
@@ -208,6 +211,10 @@ static SSLSrvConfigRec *ssl_config_server_new(apr_pool_t *p)
     sc->compression            = UNSET;
 #endif
     sc->session_tickets        = UNSET;
+    sc->ktls                   = UNSET;
+    sc->dyn_rec_size           = UNSET;
+    sc->dyn_rec_threshold      = 0;
+    sc->dyn_rec_idle           = 0;
 
     modssl_ctx_init_server(sc, p);
 
@@ -281,6 +288,7 @@ static void modssl_ctx_cfg_merge(apr_pool_t *p,
     cfgMergeInt(stapling_errcache_timeout);
     cfgMergeInt(stapling_responder_timeout);
     cfgMerge(stapling_force_url, NULL);
+    cfgMergeBool(stapling_background_refresh);
 #endif
 
 #ifdef HAVE_SRP
@@ -336,6 +344,17 @@ void *ssl_config_server_merge(apr_pool_t *p, void *basev, void *addv)
     cfgMergeBool(compression);
 #endif
     cfgMergeBool(session_tickets);
+    cfgMergeBool(ktls);
+    if (add->dyn_rec_size == UNSET) {
+        mrg->dyn_rec_size      = base->dyn_rec_size;
+        mrg->dyn_rec_threshold = base->dyn_rec_threshold;
+        mrg->dyn_rec_idle      = base->dyn_rec_idle;
+    }
+    else {
+        mrg->dyn_rec_size      = add->dyn_rec_size;
+        mrg->dyn_rec_threshold = add->dyn_rec_threshold;
+        mrg->dyn_rec_idle      = add->dyn_rec_idle;
+    }
 
     modssl_ctx_cfg_merge_server(p, base->server, add->server, mrg->server);
 
@@ -786,6 +805,67 @@ const char *ssl_cmd_SSLSessionTickets(cmd_parms *cmd, void *dcfg, int flag)
     return NULL;
 }
 
+const char *ssl_cmd_SSLKernelTLS(cmd_parms *cmd, void *dcfg, int flag)
+{
+    SSLSrvConfigRec *sc = mySrvConfig(cmd->server);
+#ifndef HAVE_KTLS
+    if (flag) {
+        return "SSLKernelTLS unsupported; not available with this SSL "
+               "library or system";
+    }
+#endif
+    sc->ktls = flag ? TRUE : FALSE;
+    return NULL;
+}
+
+const char *ssl_cmd_SSLDynamicRecordSize(cmd_parms *cmd, void *dcfg,
+                                         const char *arg1, const char *arg2,
+                                         const char *arg3)
+{
+    SSLSrvConfigRec *sc = mySrvConfig(cmd->server);
+    apr_int64_t n;
+    char *end;
+
+    sc->dyn_rec_size = SSL_DYN_REC_SIZE_DEFAULT;
+    sc->dyn_rec_threshold = SSL_DYN_REC_THRESHOLD_DEFAULT;
+    sc->dyn_rec_idle = SSL_DYN_REC_IDLE_DEFAULT;
+
+    if (!strcasecmp(arg1, "off")) {
+        if (arg2) {
+            return "SSLDynamicRecordSize: 'off' takes no other argument";
+        }
+        sc->dyn_rec_size = 0;
+        return NULL;
+    }
+    if (strcasecmp(arg1, "on")) {
+        n = apr_strtoi64(arg1, &end, 10);
+        if (*end || n < 256 || n >= SSL_RECORD_SIZE_MAX) {
+            return apr_psprintf(cmd->pool, "SSLDynamicRecordSize: the "
+                                "record size must be 'on', 'off' or a number "
+                                "of bytes between 256 and %d",
+                                SSL_RECORD_SIZE_MAX - 1);
+        }
+        sc->dyn_rec_size = (int)n;
+    }
+    if (arg2) {
+        n = apr_strtoi64(arg2, &end, 10);
+        if (*end || n <= 0) {
+            return "SSLDynamicRecordSize: the threshold must be a positive "
+                   "number of bytes";
+        }
+        sc->dyn_rec_threshold = (apr_size_t)n;
+    }
+    if (arg3) {
+        if (ap_timeout_parameter_parse(arg3, &sc->dyn_rec_idle,
+                                       "s") != APR_SUCCESS
+            || sc->dyn_rec_idle <= 0) {
+            return "SSLDynamicRecordSize: invalid idle timeout";
+        }
+    }
+
+    return NULL;
+}
+
 const char *ssl_cmd_SSLInsecureRenegotiation(cmd_parms *cmd, void *dcfg, int flag)
 {
 #ifdef SSL_OP_ALLOW_UNSAFE_LEGACY_RENEGOTIATION
@@ -1882,6 +1962,14 @@ const char *ssl_cmd_SSLStaplingForceURL(cmd_parms *cmd, void *dcfg,
     return NULL;
 }
 
+const char *ssl_cmd_SSLStaplingBackgroundRefresh(cmd_parms *cmd,
+                                                 void *dcfg, int flag)
+{
+    SSLSrvConfigRec *sc = mySrvConfig(cmd->server);
+    sc->server->stapling_background_refresh = flag ? TRUE : FALSE;
+    return NULL;
+}
+
 #endif /* HAVE_OCSP_STAPLING */
 
 #ifdef HAVE_SSL_CONF_CMD
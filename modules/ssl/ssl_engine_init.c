@@ -314,6 +314,7 @@ apr_status_t ssl_init_Module(apr_pool_t *p, apr_pool_t *plog,
     if ((rv = ssl_scache_init(base_server, p)) != APR_SUCCESS) {
         return rv;
     }
+    ssl_scache_stats_init(base_server, p);
 
     pphrases = apr_array_make(ptemp, 2, sizeof(char *));
 
@@ -354,6 +355,12 @@ apr_status_t ssl_init_Module(apr_pool_t *p, apr_pool_t *plog,
         return rv;
     }
 
+#ifdef HAVE_OCSP_STAPLING
+    if ((rv = ssl_stapling_refresh_init(base_server, p)) != APR_SUCCESS) {
+        return rv;
+    }
+#endif
+
     for (s = base_server; s; s = s->next) {
         SSLDirConfigRec *sdc = ap_get_module_config(s->lookup_defaults,
                                                     &ssl_module);
@@ -703,6 +710,14 @@ static apr_status_t ssl_init_ctx_protocol(server_rec *s,
     }
 #endif
 
+#ifdef HAVE_KTLS
+    /* OpenSSL installs the keys through the output BIO,
+     * see bio_filter_out_ktls_start() */
+    if (!mctx->pkp && sc->ktls == TRUE) {
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+
     SSL_CTX_set_app_data(ctx, s);
 
     /*
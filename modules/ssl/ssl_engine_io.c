@@ -32,6 +32,20 @@
 #include "mod_ssl_openssl.h"
 #include "apr_date.h"
 
+#ifdef HAVE_KTLS
+#include "apr_portable.h"
+#include "apr_support.h"
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#endif
+
 APR_IMPLEMENT_OPTIONAL_HOOK_RUN_ALL(ssl, SSL, int, proxy_post_handshake,
                                     (conn_rec *c,SSL *ssl),
                                     (c,ssl),OK,DECLINED);
@@ -109,6 +123,8 @@ typedef struct {
     ap_filter_t        *pInputFilter;
     ap_filter_t        *pOutputFilter;
     SSLConnRec         *config;
+    apr_size_t          rec_sent;   /* since the start or the last idle */
+    apr_time_t          rec_last;   /* last write */
 } ssl_filter_ctx_t;
 
 typedef struct {
@@ -116,6 +132,10 @@ typedef struct {
     conn_rec *c;
     apr_bucket_brigade *bb;    /* Brigade used as a buffer. */
     apr_status_t rc;
+#ifdef HAVE_KTLS
+    int ktls_send;             /* the kernel encrypts what we send */
+    int ktls_record_type;      /* of the next write if not app data */
+#endif
 } bio_filter_out_ctx_t;
 
 static bio_filter_out_ctx_t *bio_filter_out_ctx_new(ssl_filter_ctx_t *filter_ctx,
@@ -126,6 +146,10 @@ static bio_filter_out_ctx_t *bio_filter_out_ctx_new(ssl_filter_ctx_t *filter_ctx
     outctx->filter_ctx = filter_ctx;
     outctx->c = c;
     outctx->bb = apr_brigade_create(c->pool, c->bucket_alloc);
+#ifdef HAVE_KTLS
+    outctx->ktls_send = 0;
+    outctx->ktls_record_type = 0;
+#endif
 
     return outctx;
 }
@@ -160,6 +184,148 @@ static int bio_filter_out_flush(BIO *bio)
     return bio_filter_out_pass(outctx);
 }
 
+#ifdef HAVE_KTLS
+/* Called by OpenSSL (BIO_CTRL_SET_KTLS) when the keys for sending change,
+ * after flushing the records encrypted with the previous ones.  Install
+ * the new ones on the socket if SSLKernelTLS is enabled for the (SNI)
+ * virtual host, which lets OpenSSL and ssl_io_filter_output() send
+ * plaintext from now on.
+ *
+ * Once the kernel encrypts, this is also called for a TLS 1.3 key update
+ * (which the client can request), and OpenSSL goes on sending plaintext
+ * whatever we return.  If the kernel does not take the new keys, which
+ * older ones do not, the connection is aborted rather than have it
+ * encrypt with the old ones.
+ */
+static long bio_filter_out_ktls_start(bio_filter_out_ctx_t *outctx,
+                                      int is_tx, void *crypto_info)
+{
+    SSLConnRec *sslconn = outctx->filter_ctx->config;
+    struct tls_crypto_info *info = crypto_info;
+    apr_os_sock_t fd;
+    socklen_t len;
+
+    if (!is_tx || (!outctx->ktls_send
+                   && (sslconn->is_proxy
+                       || mySrvConfig(sslconn->server)->ktls != TRUE))) {
+        return 0;
+    }
+
+    switch (info->cipher_type) {
+    case TLS_CIPHER_AES_GCM_128:
+        len = sizeof(struct tls12_crypto_info_aes_gcm_128);
+        break;
+#ifdef TLS_CIPHER_AES_GCM_256
+    case TLS_CIPHER_AES_GCM_256:
+        len = sizeof(struct tls12_crypto_info_aes_gcm_256);
+        break;
+#endif
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case TLS_CIPHER_CHACHA20_POLY1305:
+        len = sizeof(struct tls12_crypto_info_chacha20_poly1305);
+        break;
+#endif
+    default:
+        len = 0;
+        break;
+    }
+
+    apr_os_sock_get(&fd, ap_get_conn_socket(outctx->c));
+    if (outctx->ktls_send) {
+        if (len == 0 || setsockopt(fd, SOL_TLS, TLS_TX, info, len) < 0) {
+            ap_log_cerror(APLOG_MARK, APLOG_INFO, len ? errno : 0, outctx->c,
+                          APLOGNO(03418) "kernel TLS failed to update the "
+                          "keys for sending, aborting connection");
+            outctx->c->aborted = 1;
+            outctx->rc = APR_ECONNABORTED;
+            return 0;
+        }
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE2, 0, outctx->c,
+                      "kernel TLS keys for sending updated");
+        return 1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) < 0
+        || setsockopt(fd, SOL_TLS, TLS_TX, info, len) < 0) {
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, errno, outctx->c,
+                      APLOGNO(03409) "kernel TLS not available "
+                      "(tls module not loaded?), using OpenSSL");
+        return 0;
+    }
+
+    ap_log_cerror(APLOG_MARK, APLOG_TRACE2, 0, outctx->c,
+                  "kernel TLS enabled for sending");
+    outctx->ktls_send = 1;
+    return 1;
+}
+
+/* Once the kernel encrypts, OpenSSL still writes the records other than
+ * application data (alerts, session tickets, key updates), which must be
+ * sent with their type in a control message.  They are sent after
+ * anything pending in the output filters.
+ */
+static int bio_filter_out_ktls_write(BIO *bio, bio_filter_out_ctx_t *outctx,
+                                     const char *in, int inl)
+{
+    apr_socket_t *sock = ap_get_conn_socket(outctx->c);
+    unsigned char type = (unsigned char)outctx->ktls_record_type;
+    char cbuf[CMSG_SPACE(sizeof(type))];
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    apr_os_sock_t fd;
+    apr_status_t rv;
+    ssize_t n;
+
+    outctx->ktls_record_type = 0;
+    if (bio_filter_out_flush(bio) < 0) {
+        return -1;
+    }
+
+    apr_os_sock_get(&fd, sock);
+    iov.iov_base = (void *)in;
+    iov.iov_len = inl;
+    while (iov.iov_len > 0) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cbuf;
+        msg.msg_controllen = sizeof(cbuf);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_TLS;
+        cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(type));
+        *CMSG_DATA(cmsg) = type;
+        msg.msg_controllen = cmsg->cmsg_len;
+
+        n = sendmsg(fd, &msg, 0);
+        if (n >= 0) {
+            iov.iov_base = (char *)iov.iov_base + n;
+            iov.iov_len -= n;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            rv = apr_wait_for_io_or_timeout(NULL, sock, 0);
+            if (rv == APR_SUCCESS) {
+                continue;
+            }
+        }
+        else {
+            rv = APR_FROM_OS_ERROR(errno);
+        }
+        outctx->rc = rv;
+        return -1;
+    }
+
+    return inl;
+}
+#endif /* HAVE_KTLS */
+
 static int bio_filter_create(BIO *bio)
 {
     BIO_set_shutdown(bio, 1);
@@ -216,6 +382,12 @@ static int bio_filter_out_write(BIO *bio, const char *in, int inl)
      */
     BIO_clear_retry_flags(bio);
 
+#ifdef HAVE_KTLS
+    if (outctx->ktls_record_type) {
+        return bio_filter_out_ktls_write(bio, outctx, in, inl);
+    }
+#endif
+
     /* Use a transient bucket for the output data - any downstream
      * filter must setaside if necessary. */
     e = apr_bucket_transient_create(in, inl, outctx->bb->bucket_alloc);
@@ -278,6 +450,20 @@ static long bio_filter_out_ctrl(BIO *bio, int cmd, long num, void *ptr)
       case BIO_CTRL_DUP:
         ret = 1;
         break;
+#ifdef HAVE_KTLS
+      case BIO_CTRL_SET_KTLS:
+        ret = bio_filter_out_ktls_start(outctx, (int)num, ptr);
+        break;
+      case BIO_CTRL_GET_KTLS_SEND:
+        ret = outctx->ktls_send;
+        break;
+      case BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG:
+        outctx->ktls_record_type = (int)num;
+        break;
+      case BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG:
+        outctx->ktls_record_type = 0;
+        break;
+#endif
         /* N/A */
       case BIO_C_SET_BUF_MEM:
       case BIO_C_GET_BUF_MEM_PTR:
@@ -571,6 +757,12 @@ static int bio_filter_in_gets(BIO *bio, char *buf, int size)
 static long bio_filter_in_ctrl(BIO *bio, int cmd, long num, void *ptr)
 {
     bio_filter_in_ctx_t *inctx = (bio_filter_in_ctx_t *)BIO_get_data(bio);
+#ifdef HAVE_KTLS
+    /* not for receiving (SSL_OP_ENABLE_KTLS) */
+    if (cmd == BIO_CTRL_SET_KTLS || cmd == BIO_CTRL_GET_KTLS_RECV) {
+        return 0;
+    }
+#endif
     ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, inctx->f->c,
                   "BUG: %s() should not be called", "bio_filter_in_ctrl");
     AP_DEBUG_ASSERT(0);
@@ -933,6 +1125,53 @@ static apr_status_t ssl_filter_write(ap_filter_t *f,
     return outctx->rc;
 }
 
+/* Write the data in TLS records of at most SSL_RECORD_SIZE_MAX bytes, or
+ * of the SSLDynamicRecordSize until its threshold is sent since the start
+ * of the connection or the last idle period, so that the client can
+ * decrypt the first bytes before the congestion window grows.
+ */
+static apr_status_t ssl_filter_write_records(ap_filter_t *f,
+                                             const char *data,
+                                             apr_size_t len)
+{
+    ssl_filter_ctx_t *filter_ctx = f->ctx;
+    SSLSrvConfigRec *sc = mySrvConfig(filter_ctx->config->server);
+    int dyn = sc->dyn_rec_size > 0 && !filter_ctx->config->is_proxy;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t max, n;
+
+    if (dyn) {
+        apr_time_t now = apr_time_now();
+
+        if (now - filter_ctx->rec_last > sc->dyn_rec_idle) {
+            filter_ctx->rec_sent = 0;
+        }
+        filter_ctx->rec_last = now;
+    }
+
+    while (len > 0) {
+        if (dyn && filter_ctx->rec_sent < sc->dyn_rec_threshold) {
+            max = sc->dyn_rec_size;
+        }
+        else {
+            max = SSL_RECORD_SIZE_MAX;
+        }
+        n = (len < max) ? len : max;
+
+        rv = ssl_filter_write(f, data, n);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        ssl_scache_stats_record(f->c->base_server, n);
+
+        filter_ctx->rec_sent += n;
+        data += n;
+        len -= n;
+    }
+
+    return rv;
+}
+
 /* Just use a simple request.  Any request will work for this, because
  * we use a flag in the conn_rec->conn_vector now.  The fake request just
  * gets the request back to the Apache core so that a response can be sent.
@@ -1814,6 +2053,28 @@ static apr_status_t ssl_io_filter_output(ap_filter_t *f,
                 status = APR_ECONNRESET;
             apr_brigade_cleanup(outctx->bb);
         }
+#ifdef HAVE_KTLS
+        else if (outctx->ktls_send) {
+            /* The kernel encrypts, so pass the data buckets (up to the
+             * next metadata bucket) as is: the core output filter will
+             * writev() or sendfile() them.
+             */
+            do {
+                if (bucket == flush_upto) {
+                    flush_upto = NULL;
+                }
+                APR_BUCKET_REMOVE(bucket);
+                APR_BRIGADE_INSERT_TAIL(outctx->bb, bucket);
+                bucket = APR_BRIGADE_FIRST(bb);
+            } while (bucket != APR_BRIGADE_SENTINEL(bb)
+                     && !APR_BUCKET_IS_METADATA(bucket));
+
+            status = ap_pass_brigade(f->next, outctx->bb);
+            if (status == APR_SUCCESS && f->c->aborted)
+                status = APR_ECONNRESET;
+            apr_brigade_cleanup(outctx->bb);
+        }
+#endif
         else {
             /* Filter a data bucket. */
             const char *data;
@@ -1839,7 +2100,7 @@ static apr_status_t ssl_io_filter_output(ap_filter_t *f,
                 break;
             }
 
-            status = ssl_filter_write(f, data, len);
+            status = ssl_filter_write_records(f, data, len);
             apr_bucket_delete(bucket);
         }
 
@@ -2093,6 +2354,8 @@ void ssl_io_filter_init(conn_rec *c, request_rec *r, SSL *ssl)
     filter_ctx = apr_palloc(c->pool, sizeof(ssl_filter_ctx_t));
 
     filter_ctx->config          = myConnConfig(c);
+    filter_ctx->rec_sent        = 0;
+    filter_ctx->rec_last        = 0;
 
     ap_add_output_filter(ssl_io_coalesce, NULL, r, c);
 
@@ -35,7 +35,7 @@
 
 static void ssl_configure_env(request_rec *r, SSLConnRec *sslconn);
 #ifdef HAVE_TLSEXT
-static int ssl_find_vhost(void *servername, conn_rec *c, server_rec *s);
+static BOOL ssl_set_vhost(conn_rec *c, server_rec *s);
 #endif
 
 #define SWITCH_STATUS_LINE "HTTP/1.1 101 Switching Protocols"
@@ -2101,10 +2101,19 @@ void ssl_callback_Info(const SSL *ssl, int where, int rc)
             ap_log_cerror(APLOG_MARK, APLOG_ERR, 0, c, APLOGNO(02042)
                           "rejecting client initiated renegotiation");
     }
+    /* Time the initial handshake of incoming connections. */
+    else if ((where & SSL_CB_HANDSHAKE_START) && scr->reneg_state == RENEG_INIT
+             && !scr->is_proxy && !scr->handshake_start) {
+        scr->handshake_start = apr_time_now();
+    }
     /* If the first handshake is complete, change state to reject any
      * subsequent client-initiated renegotiation. */
     else if ((where & SSL_CB_HANDSHAKE_DONE) && scr->reneg_state == RENEG_INIT) {
         scr->reneg_state = RENEG_REJECT;
+        if (scr->handshake_start) {
+            ssl_scache_stats_handshake(c->base_server, apr_time_now()
+                                       - scr->handshake_start);
+        }
     }
 
     s = mySrvFromConn(c);
@@ -2121,6 +2130,7 @@ void ssl_callback_Info(const SSL *ssl, int where, int rc)
 static apr_status_t init_vhost(conn_rec *c, SSL *ssl)
 {
     const char *servername;
+    server_rec *s;
     
     if (c) {
         SSLConnRec *sslcon = myConnConfig(c);
@@ -2132,13 +2142,21 @@ static apr_status_t init_vhost(conn_rec *c, SSL *ssl)
         
         servername = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
         if (servername) {
-            if (ap_vhost_iterate_given_conn(c, ssl_find_vhost,
-                                            (void *)servername)) {
+            s = ap_vhost_find_given_conn(c, servername);
+            if (s && ssl_set_vhost(c, s)) {
                 ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, c, APLOGNO(02043)
                               "SSL virtual host for servername %s found",
                               servername);
                 return APR_SUCCESS;
             }
+            else if (s) {
+                /* The handshake goes on as if no vhost matched */
+                ap_log_cerror(APLOG_MARK, APLOG_WARNING, 0, c, APLOGNO(03419)
+                              "Could not switch to the SSL virtual host %s "
+                              "for servername %s (using default/first "
+                              "virtual host)", s->server_hostname,
+                              servername);
+            }
             else {
                 ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, c, APLOGNO(02044)
                               "No matching SSL virtual host for servername "
@@ -2184,24 +2202,23 @@ int ssl_callback_ServerNameIndication(SSL *ssl, int *al, modssl_ctx_t *mctx)
 }
 
 /*
- * Find a (name-based) SSL virtual host where either the ServerName
- * or one of the ServerAliases matches the supplied name (to be used
- * with ap_vhost_iterate_given_conn())
+ * Switch the connection to the (name-based) SSL virtual host whose
+ * ServerName or one of the ServerAliases matched the SNI servername,
+ * as found by ap_vhost_find_given_conn(). On failure, the connection is
+ * left with the SSL_CTX it has.
  */
-static int ssl_find_vhost(void *servername, conn_rec *c, server_rec *s)
+static BOOL ssl_set_vhost(conn_rec *c, server_rec *s)
 {
     SSLSrvConfigRec *sc;
     SSL *ssl;
-    BOOL found;
     SSLConnRec *sslcon;
+    SSL_CTX *ctx;
 
-    found = ssl_util_vhost_matches(servername, s);
-
-    /* set SSL_CTX (if matched) */
+    /* set SSL_CTX */
     sslcon = myConnConfig(c);
-    if (found && (ssl = sslcon->ssl) &&
-        (sc = mySrvConfig(s))) {
-        SSL_CTX *ctx = SSL_set_SSL_CTX(ssl, sc->server->ssl_ctx);
+    if ((ssl = sslcon->ssl) &&
+        (sc = mySrvConfig(s)) && sc->server && sc->server->ssl_ctx &&
+        (ctx = SSL_set_SSL_CTX(ssl, sc->server->ssl_ctx))) {
         /*
          * SSL_set_SSL_CTX() only deals with the server cert,
          * so we need to duplicate a few additional settings
@@ -2264,10 +2281,10 @@ static int ssl_find_vhost(void *servername, conn_rec *c, server_rec *s)
             }
         }
 
-        return 1;
+        return TRUE;
     }
 
-    return 0;
+    return FALSE;
 }
 #endif /* HAVE_TLSEXT */
 
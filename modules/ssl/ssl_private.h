@@ -199,6 +199,12 @@
 
 #endif /* !defined(OPENSSL_NO_TLSEXT) && defined(SSL_set_tlsext_host_name) */
 
+/* Kernel TLS (Linux) for sending, OpenSSL >= 3.0 built with enable-ktls */
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS) \
+    && defined(BIO_CTRL_SET_KTLS) && defined(HAVE_LINUX_TLS_H)
+#define HAVE_KTLS
+#endif
+
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 #define BN_get_rfc2409_prime_768   get_rfc2409_prime_768
 #define BN_get_rfc2409_prime_1024  get_rfc2409_prime_1024
@@ -503,8 +509,43 @@ typedef struct {
     SSLDirConfigRec *dc;
     
     const char *cipher_suite; /* cipher suite used in last reneg */
+
+    apr_time_t handshake_start; /* of the initial handshake */
 } SSLConnRec;
 
+/* Histograms shown by the mod_status extension:
+ * - of the time taken by the initial handshakes of the incoming
+ *   connections, where the first bucket counts the ones shorter than
+ *   SSL_HANDSHAKE_TIME_MIN microseconds, and the next ones up to twice as
+ *   long as the previous, but the last one which counts all the longer
+ *   ones,
+ * - of the size of the TLS records of application data written, where
+ *   the first bucket counts the ones smaller than SSL_RECORD_SIZE_MIN
+ *   bytes, the next ones up to twice as large, and the last one the full
+ *   (SSL_RECORD_SIZE_MAX) records.
+ */
+#define SSL_HANDSHAKE_TIME_MIN     128
+#define SSL_HANDSHAKE_TIME_BUCKETS 16
+#define SSL_RECORD_SIZE_MIN        512
+#define SSL_RECORD_SIZE_BUCKETS    7
+#define SSL_RECORD_SIZE_MAX        SSL3_RT_MAX_PLAIN_LENGTH
+
+/* SSLDynamicRecordSize defaults: records which fit in a packet of a
+ * 1500 bytes MTU (with the IPv6, TCP with timestamps and TLS overheads)
+ * for the first 64KB sent, again after 1s idle. */
+#define SSL_DYN_REC_SIZE_DEFAULT      1369
+#define SSL_DYN_REC_THRESHOLD_DEFAULT (64 * 1024)
+#define SSL_DYN_REC_IDLE_DEFAULT      apr_time_from_sec(1)
+
+/* The counters of a child process, padded to whole cache lines so that
+ * the children do not contend for them. */
+#define SSL_STATS_COUNTERS (SSL_HANDSHAKE_TIME_BUCKETS + SSL_RECORD_SIZE_BUCKETS)
+typedef struct {
+    apr_uint32_t handshake_time[SSL_HANDSHAKE_TIME_BUCKETS];
+    apr_uint32_t record_size[SSL_RECORD_SIZE_BUCKETS];
+    char pad[64 - (SSL_STATS_COUNTERS * sizeof(apr_uint32_t)) % 64];
+} modssl_stats_t;
+
 /* BIG FAT WARNING: SSLModConfigRec has unusual memory lifetime: it is
  * allocated out of the "process" pool and only a single such
  * structure is created and used for the lifetime of the process.
@@ -566,6 +607,12 @@ typedef struct {
     apr_global_mutex_t   *stapling_cache_mutex;
     apr_global_mutex_t   *stapling_refresh_mutex;
 #endif
+
+    /* One per child process (after those of the children which do not
+     * know their scoreboard slot), in shared memory when possible, reset
+     * on restart. */
+    modssl_stats_t *stats;
+    int stats_slots;
 } SSLModConfigRec;
 
 /** Structure representing configured filenames for certs and keys for
@@ -658,6 +705,7 @@ typedef struct {
     int         stapling_errcache_timeout;
     apr_interval_time_t stapling_responder_timeout;
     const char *stapling_force_url;
+    BOOL        stapling_background_refresh;
 #endif
 
 #ifdef HAVE_SRP
@@ -707,6 +755,10 @@ struct SSLSrvConfigRec {
     BOOL             compression;
 #endif
     BOOL             session_tickets;
+    BOOL             ktls;
+    int              dyn_rec_size;      /* SSLDynamicRecordSize, 0 if off */
+    apr_size_t       dyn_rec_threshold;
+    apr_interval_time_t dyn_rec_idle;
 };
 
 /**
@@ -766,6 +818,9 @@ const char  *ssl_cmd_SSLCARevocationCheck(cmd_parms *, void *, const char *);
 const char  *ssl_cmd_SSLHonorCipherOrder(cmd_parms *cmd, void *dcfg, int flag);
 const char  *ssl_cmd_SSLCompression(cmd_parms *, void *, int flag);
 const char  *ssl_cmd_SSLSessionTickets(cmd_parms *, void *, int flag);
+const char  *ssl_cmd_SSLKernelTLS(cmd_parms *, void *, int flag);
+const char  *ssl_cmd_SSLDynamicRecordSize(cmd_parms *, void *, const char *,
+                                          const char *, const char *);
 const char  *ssl_cmd_SSLVerifyClient(cmd_parms *, void *, const char *);
 const char  *ssl_cmd_SSLVerifyDepth(cmd_parms *, void *, const char *);
 const char  *ssl_cmd_SSLSessionCache(cmd_parms *, void *, const char *);
@@ -872,6 +927,9 @@ int ssl_callback_alpn_select(SSL *ssl, const unsigned char **out,
 /**  Session Cache Support  */
 apr_status_t ssl_scache_init(server_rec *, apr_pool_t *);
 void         ssl_scache_status_register(apr_pool_t *p);
+void         ssl_scache_stats_init(server_rec *, apr_pool_t *);
+void         ssl_scache_stats_handshake(server_rec *, apr_interval_time_t);
+void         ssl_scache_stats_record(server_rec *, apr_size_t);
 void         ssl_scache_kill(server_rec *);
 BOOL         ssl_scache_store(server_rec *, IDCONST UCHAR *, int,
                               apr_time_t, SSL_SESSION *, apr_pool_t *);
@@ -891,10 +949,12 @@ const char *ssl_cmd_SSLStaplingReturnResponderErrors(cmd_parms *, void *, int);
 const char *ssl_cmd_SSLStaplingFakeTryLater(cmd_parms *, void *, int);
 const char *ssl_cmd_SSLStaplingResponderTimeout(cmd_parms *, void *, const char *);
 const char *ssl_cmd_SSLStaplingForceURL(cmd_parms *, void *, const char *);
+const char *ssl_cmd_SSLStaplingBackgroundRefresh(cmd_parms *, void *, int);
 apr_status_t modssl_init_stapling(server_rec *, apr_pool_t *, apr_pool_t *, modssl_ctx_t *);
 void         ssl_stapling_certinfo_hash_init(apr_pool_t *);
 int          ssl_stapling_init_cert(server_rec *, apr_pool_t *, apr_pool_t *,
                                     modssl_ctx_t *, X509 *);
+apr_status_t ssl_stapling_refresh_init(server_rec *, apr_pool_t *);
 #endif
 #ifdef HAVE_SRP
 int          ssl_callback_SRPServerParams(SSL *, int *, void *);
@@ -925,8 +985,6 @@ void         ssl_util_thread_setup(apr_pool_t *);
 #endif
 int          ssl_init_ssl_connection(conn_rec *c, request_rec *r);
 
-BOOL         ssl_util_vhost_matches(const char *servername, server_rec *s);
-
 /**  Pass Phrase Support  */
 apr_status_t ssl_load_encrypted_pkey(server_rec *, apr_pool_t *, int,
                                      const char *, apr_array_header_t **);
@@ -30,6 +30,10 @@
                                                  -- Unknown         */
 #include "ssl_private.h"
 #include "mod_status.h"
+#include "apr_shm.h"
+#include "apr_atomic.h"
+#include "scoreboard.h"
+#include "ap_mpm.h"
 
 /*  _________________________________________________________________
 **
@@ -194,13 +198,8 @@ void ssl_scache_remove(server_rec *s, IDCONST UCHAR *id, int idlen,
 **  SSL Extension to mod_status
 **  _________________________________________________________________
 */
-static int ssl_ext_status_hook(request_rec *r, int flags)
+static void ssl_scache_status(request_rec *r, int flags, SSLModConfigRec *mc)
 {
-    SSLModConfigRec *mc = myModConfig(r->server);
-
-    if (mc == NULL || mc->sesscache == NULL)
-        return OK;
-
     if (!(flags & AP_STATUS_SHORT)) {
         ap_rputs("<hr>\n", r);
         ap_rputs("<table cellspacing=0 cellpadding=0>\n", r);
@@ -227,13 +226,189 @@ static int ssl_ext_status_hook(request_rec *r, int flags)
         ap_rputs("</td></tr>\n", r);
         ap_rputs("</table>\n", r);
     }
+}
+
+static void ssl_stats_status(request_rec *r, int flags, SSLModConfigRec *mc)
+{
+    apr_uint32_t hcount[SSL_HANDSHAKE_TIME_BUCKETS] = { 0 };
+    apr_uint32_t rcount[SSL_RECORD_SIZE_BUCKETS] = { 0 };
+    apr_interval_time_t bound;
+    unsigned long htotal = 0, rtotal = 0;
+    modssl_stats_t *stats;
+    int i, n;
+
+    /* add up the children */
+    for (n = 0; n < mc->stats_slots; n++) {
+        stats = &mc->stats[n];
+        for (i = 0; i < SSL_HANDSHAKE_TIME_BUCKETS; i++) {
+            hcount[i] += apr_atomic_read32(&stats->handshake_time[i]);
+        }
+        for (i = 0; i < SSL_RECORD_SIZE_BUCKETS; i++) {
+            rcount[i] += apr_atomic_read32(&stats->record_size[i]);
+        }
+    }
+    for (i = 0; i < SSL_HANDSHAKE_TIME_BUCKETS; i++) {
+        htotal += hcount[i];
+    }
+    for (i = 0; i < SSL_RECORD_SIZE_BUCKETS; i++) {
+        rtotal += rcount[i];
+    }
+
+    if (!(flags & AP_STATUS_SHORT)) {
+        ap_rputs("<hr>\n", r);
+        ap_rputs("<table cellspacing=0 cellpadding=0>\n", r);
+        ap_rputs("<tr><td bgcolor=\"#000000\">\n", r);
+        ap_rputs("<b><font color=\"#ffffff\" face=\"Arial,Helvetica\">SSL/TLS Handshake Times:</font></b>\r", r);
+        ap_rputs("</td></tr>\n", r);
+        ap_rputs("<tr><td bgcolor=\"#ffffff\">\n", r);
+        ap_rprintf(r, "total handshakes since starting: <b>%lu</b><br>",
+                   htotal);
+        for (i = 0; i < SSL_HANDSHAKE_TIME_BUCKETS - 1; i++) {
+            bound = (apr_interval_time_t)SSL_HANDSHAKE_TIME_MIN << i;
+            ap_rprintf(r, "less than %.3f ms: <b>%u</b><br>",
+                       bound / 1000.0, hcount[i]);
+        }
+        ap_rprintf(r, "longer: <b>%u</b><br>", hcount[i]);
+        ap_rputs("</td></tr>\n", r);
+        ap_rputs("</table>\n", r);
+
+        ap_rputs("<hr>\n", r);
+        ap_rputs("<table cellspacing=0 cellpadding=0>\n", r);
+        ap_rputs("<tr><td bgcolor=\"#000000\">\n", r);
+        ap_rputs("<b><font color=\"#ffffff\" face=\"Arial,Helvetica\">SSL/TLS Record Sizes:</font></b>\r", r);
+        ap_rputs("</td></tr>\n", r);
+        ap_rputs("<tr><td bgcolor=\"#ffffff\">\n", r);
+        ap_rprintf(r, "total records written since starting: <b>%lu</b><br>",
+                   rtotal);
+        for (i = 0; i < SSL_RECORD_SIZE_BUCKETS - 1; i++) {
+            ap_rprintf(r, "less than %d bytes: <b>%u</b><br>",
+                       SSL_RECORD_SIZE_MIN << i, rcount[i]);
+        }
+        ap_rprintf(r, "%d bytes: <b>%u</b><br>", SSL_RECORD_SIZE_MAX,
+                   rcount[i]);
+        ap_rputs("</td></tr>\n", r);
+        ap_rputs("</table>\n", r);
+    }
+    else {
+        ap_rprintf(r, "TLSHandshakeCount: %lu\n", htotal);
+        for (i = 0; i < SSL_HANDSHAKE_TIME_BUCKETS - 1; i++) {
+            bound = (apr_interval_time_t)SSL_HANDSHAKE_TIME_MIN << i;
+            ap_rprintf(r, "TLSHandshakesUnder%" APR_TIME_T_FMT "us: %u\n",
+                       bound, hcount[i]);
+        }
+        ap_rprintf(r, "TLSHandshakesOver%" APR_TIME_T_FMT "us: %u\n",
+                   bound, hcount[i]);
+
+        ap_rprintf(r, "TLSRecordCount: %lu\n", rtotal);
+        for (i = 0; i < SSL_RECORD_SIZE_BUCKETS - 1; i++) {
+            ap_rprintf(r, "TLSRecordsUnder%dBytes: %u\n",
+                       SSL_RECORD_SIZE_MIN << i, rcount[i]);
+        }
+        ap_rprintf(r, "TLSRecordsOf%dBytes: %u\n", SSL_RECORD_SIZE_MAX,
+                   rcount[i]);
+    }
+}
+
+static int ssl_ext_status_hook(request_rec *r, int flags)
+{
+    SSLModConfigRec *mc = myModConfig(r->server);
+
+    if (mc == NULL)
+        return OK;
+
+    if (mc->sesscache != NULL) {
+        ssl_scache_status(r, flags, mc);
+    }
+    if (mc->stats != NULL) {
+        ssl_stats_status(r, flags, mc);
+    }
 
     return OK;
 }
 
+/* When anonymous shared memory is available, each child counts in the
+ * slot of its scoreboard slot (a replacing child continues with the
+ * counts of the one it replaces), and the status adds them up. Otherwise
+ * each child has its own counters (and shows them).
+ */
+void ssl_scache_stats_init(server_rec *s, apr_pool_t *p)
+{
+    SSLModConfigRec *mc = myModConfig(s);
+    apr_size_t size;
+    apr_shm_t *shm;
+    int limit = 0;
+
+    ap_mpm_query(AP_MPMQ_HARD_LIMIT_DAEMONS, &limit);
+    mc->stats_slots = 1 + (limit > 0 ? limit : 0);
+    size = mc->stats_slots * sizeof(modssl_stats_t);
+    if (apr_shm_create(&shm, size, NULL, p) == APR_SUCCESS) {
+        mc->stats = apr_shm_baseaddr_get(shm);
+        memset(mc->stats, 0, size);
+    }
+    else {
+        mc->stats_slots = 1;
+        mc->stats = apr_pcalloc(p, sizeof(modssl_stats_t));
+    }
+}
+
+/* This process' counters, found on first use (and after a restart). Those
+ * which can't find their scoreboard slot share the first counters. */
+static modssl_stats_t *my_stats_base;
+static modssl_stats_t *my_stats;
+
+static modssl_stats_t *ssl_stats_get(SSLModConfigRec *mc)
+{
+    if (my_stats_base != mc->stats) {
+        process_score *ps;
+        int i;
+
+        my_stats = mc->stats;
+        for (i = 0; i < mc->stats_slots - 1; i++) {
+            ps = ap_get_scoreboard_process(i);
+            if (ps && ps->pid == mc->pid) {
+                my_stats = &mc->stats[1 + i];
+                break;
+            }
+        }
+        my_stats_base = mc->stats;
+    }
+    return my_stats;
+}
+
+void ssl_scache_stats_handshake(server_rec *s, apr_interval_time_t t)
+{
+    SSLModConfigRec *mc = myModConfig(s);
+    int i;
+
+    if (mc->stats == NULL) {
+        return;
+    }
+    for (i = 0; i < SSL_HANDSHAKE_TIME_BUCKETS - 1; i++) {
+        if (t < ((apr_interval_time_t)SSL_HANDSHAKE_TIME_MIN << i)) {
+            break;
+        }
+    }
+    apr_atomic_inc32(&ssl_stats_get(mc)->handshake_time[i]);
+}
+
+void ssl_scache_stats_record(server_rec *s, apr_size_t len)
+{
+    SSLModConfigRec *mc = myModConfig(s);
+    int i;
+
+    if (mc->stats == NULL) {
+        return;
+    }
+    for (i = 0; i < SSL_RECORD_SIZE_BUCKETS - 1; i++) {
+        if (len < ((apr_size_t)SSL_RECORD_SIZE_MIN << i)) {
+            break;
+        }
+    }
+    apr_atomic_inc32(&ssl_stats_get(mc)->record_size[i]);
+}
+
 void ssl_scache_status_register(apr_pool_t *p)
 {
     APR_OPTIONAL_HOOK(ap, status_hook, ssl_ext_status_hook, NULL, NULL,
                       APR_HOOK_MIDDLE);
 }
-
@@ -31,6 +31,7 @@
 #include "ssl_private.h"
 #include "ap_mpm.h"
 #include "apr_thread_mutex.h"
+#include "mod_watchdog.h"
 
 #ifdef HAVE_OCSP_STAPLING
 
@@ -46,6 +47,12 @@ static int stapling_cache_mutex_off(server_rec *s);
 
 #define MAX_STAPLING_DER 10240
 
+/* The watchdog of SSLStaplingBackgroundRefresh, and how often it looks for
+ * responses to renew.
+ */
+#define SSL_STAPLING_WATCHDOG_NAME "_ssl_stapling_"
+#define SSL_STAPLING_WATCHDOG_INTERVAL AP_WD_TM_INTERVAL
+
 /* Cached info stored in the global stapling_certinfo hash. */
 typedef struct {
     /* Index in session cache (SHA-1 digest of DER encoded certificate) */
@@ -54,6 +61,12 @@ typedef struct {
     OCSP_CERTID *cid;
     /* URI of the OCSP responder */
     char *uri;
+    /* Server and context of the certificate (one with
+     * SSLStaplingBackgroundRefresh, if any), and when the background
+     * refresh may query the responder again at the earliest */
+    server_rec *s;
+    modssl_ctx_t *mctx;
+    apr_time_t retry_at;
 } certinfo;
 
 static apr_status_t ssl_stapling_certid_free(void *data)
@@ -69,9 +82,15 @@ static apr_status_t ssl_stapling_certid_free(void *data)
 
 static apr_hash_t *stapling_certinfo;
 
+/* Whether the responses of SSLStaplingBackgroundRefresh certificates are
+ * renewed by the watchdog (only), i.e. mod_watchdog is available.
+ */
+static int stapling_refresh_watchdog;
+
 void ssl_stapling_certinfo_hash_init(apr_pool_t *p)
 {
     stapling_certinfo = apr_hash_make(p);
+    stapling_refresh_watchdog = 0;
 }
 
 static X509 *stapling_get_issuer(modssl_ctx_t *mctx, X509 *x)
@@ -124,6 +143,11 @@ int ssl_stapling_init_cert(server_rec *s, apr_pool_t *p, apr_pool_t *ptemp,
 
     cinf = apr_hash_get(stapling_certinfo, idx, sizeof(idx));
     if (cinf) {
+        if (mctx->stapling_background_refresh == TRUE
+            && cinf->mctx->stapling_background_refresh != TRUE) {
+            cinf->s = s;
+            cinf->mctx = mctx;
+        }
         /* 
          * We already parsed the certificate, and no OCSP URI was found.
          * The certificate might be used for multiple vhosts, though,
@@ -168,6 +192,8 @@ int ssl_stapling_init_cert(server_rec *s, apr_pool_t *p, apr_pool_t *ptemp,
     cinf = apr_pcalloc(p, sizeof(certinfo));
     memcpy (cinf->idx, idx, sizeof(idx));
     cinf->cid = cid;
+    cinf->s = s;
+    cinf->mctx = mctx;
     /* make sure cid is also freed at pool cleanup */
     apr_pool_cleanup_register(p, cid, ssl_stapling_certid_free,
                               apr_pool_cleanup_null);
@@ -208,7 +234,9 @@ static certinfo *stapling_get_certinfo(server_rec *s, modssl_ctx_t *mctx,
  * which indicates whether the response was invalid when it was stored.
  * the purpose of this flag is to avoid repeated queries to a server
  * which has given an invalid response while allowing a response which
- * has subsequently become invalid to be retried immediately.
+ * has subsequently become invalid to be retried immediately. Then
+ * follows the time it was stored (8 bytes, most significant first), for
+ * the background refresh to know how far into its cache lifetime it is.
  *
  * The key for the cache is the hash of the certificate the response
  * is for.
@@ -218,11 +246,11 @@ static BOOL stapling_cache_response(server_rec *s, modssl_ctx_t *mctx,
                                     BOOL ok, apr_pool_t *pool)
 {
     SSLModConfigRec *mc = myModConfig(s);
-    unsigned char resp_der[MAX_STAPLING_DER]; /* includes one-byte flag + response */
+    unsigned char resp_der[MAX_STAPLING_DER]; /* includes flag, time + response */
     unsigned char *p;
-    int resp_derlen, stored_len;
+    int resp_derlen, stored_len, i;
     BOOL rv;
-    apr_time_t expiry;
+    apr_time_t now, expiry;
 
     resp_derlen = i2d_OCSP_RESPONSE(rsp, NULL);
 
@@ -232,7 +260,7 @@ static BOOL stapling_cache_response(server_rec *s, modssl_ctx_t *mctx,
         return FALSE;
     }
 
-    stored_len = resp_derlen + 1; /* response + ok flag */
+    stored_len = resp_derlen + 1 + 8; /* response + ok flag + time */
     if (stored_len > sizeof resp_der) {
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(01928)
                      "OCSP stapling response too big (%u bytes)", resp_derlen);
@@ -251,7 +279,11 @@ static BOOL stapling_cache_response(server_rec *s, modssl_ctx_t *mctx,
         expiry = apr_time_from_sec(mctx->stapling_errcache_timeout);
     }
 
-    expiry += apr_time_now();
+    now = apr_time_now();
+    expiry += now;
+    for (i = 7; i >= 0; --i) {
+        *p++ = (unsigned char)((apr_uint64_t)now >> (i * 8));
+    }
 
     i2d_OCSP_RESPONSE(rsp, &p);
 
@@ -272,8 +304,8 @@ static BOOL stapling_cache_response(server_rec *s, modssl_ctx_t *mctx,
 }
 
 static void stapling_get_cached_response(server_rec *s, OCSP_RESPONSE **prsp,
-                                         BOOL *pok, certinfo *cinf,
-                                         apr_pool_t *pool)
+                                         BOOL *pok, apr_time_t *pstored,
+                                         certinfo *cinf, apr_pool_t *pool)
 {
     SSLModConfigRec *mc = myModConfig(s);
     apr_status_t rv;
@@ -281,6 +313,8 @@ static void stapling_get_cached_response(server_rec *s, OCSP_RESPONSE **prsp,
     unsigned char resp_der[MAX_STAPLING_DER];
     const unsigned char *p;
     unsigned int resp_derlen = MAX_STAPLING_DER;
+    apr_uint64_t stored = 0;
+    int i;
 
     if (mc->stapling_cache->flags & AP_SOCACHE_FLAG_NOTMPSAFE)
         stapling_cache_mutex_on(s);
@@ -294,9 +328,9 @@ static void stapling_get_cached_response(server_rec *s, OCSP_RESPONSE **prsp,
                      "stapling_get_cached_response: cache miss");
         return;
     }
-    if (resp_derlen <= 1) {
+    if (resp_derlen <= 1 + 8) {
         /* should-not-occur; must have at least valid-when-stored flag +
-         * OCSPResponseStatus
+         * time stored + OCSPResponseStatus
          */
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(01931)
                      "stapling_get_cached_response: response length invalid??");
@@ -308,7 +342,10 @@ static void stapling_get_cached_response(server_rec *s, OCSP_RESPONSE **prsp,
     else
         *pok = FALSE;
     p++;
-    resp_derlen--;
+    for (i = 0; i < 8; ++i) {
+        stored = (stored << 8) | *p++;
+    }
+    resp_derlen -= 1 + 8;
     rsp = d2i_OCSP_RESPONSE(NULL, &p, resp_derlen);
     if (!rsp) {
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(01932)
@@ -319,6 +356,9 @@ static void stapling_get_cached_response(server_rec *s, OCSP_RESPONSE **prsp,
                  "stapling_get_cached_response: cache hit");
 
     *prsp = rsp;
+    if (pstored) {
+        *pstored = (apr_time_t)stored;
+    }
 }
 
 static int stapling_set_response(SSL *ssl, OCSP_RESPONSE *rsp)
@@ -432,11 +472,14 @@ static int stapling_check_response(server_rec *s, modssl_ctx_t *mctx,
     return rv;
 }
 
+/* Query the responder and cache its response.  'ssl' is the handshake asking
+ * for it, or NULL for the background refresh.
+ */
 static BOOL stapling_renew_response(server_rec *s, modssl_ctx_t *mctx, SSL *ssl,
-                                    certinfo *cinf, OCSP_RESPONSE **prsp,
-                                    BOOL *pok, apr_pool_t *pool)
+                                    conn_rec *conn, certinfo *cinf,
+                                    OCSP_RESPONSE **prsp, BOOL *pok,
+                                    apr_pool_t *pool)
 {
-    conn_rec *conn      = (conn_rec *)SSL_get_app_data(ssl);
     apr_pool_t *vpool;
     OCSP_REQUEST *req = NULL;
     OCSP_CERTID *id = NULL;
@@ -461,11 +504,13 @@ static BOOL stapling_renew_response(server_rec *s, modssl_ctx_t *mctx, SSL *ssl,
         goto err;
     id = NULL;
     /* Add any extensions to the request */
-    SSL_get_tlsext_status_exts(ssl, &exts);
-    for (i = 0; i < sk_X509_EXTENSION_num(exts); i++) {
-        X509_EXTENSION *ext = sk_X509_EXTENSION_value(exts, i);
-        if (!OCSP_REQUEST_add_ext(req, ext, -1))
-            goto err;
+    if (ssl) {
+        SSL_get_tlsext_status_exts(ssl, &exts);
+        for (i = 0; i < sk_X509_EXTENSION_num(exts); i++) {
+            X509_EXTENSION *ext = sk_X509_EXTENSION_value(exts, i);
+            if (!OCSP_REQUEST_add_ext(req, ext, -1))
+                goto err;
+        }
     }
 
     if (mctx->stapling_force_url)
@@ -696,7 +741,7 @@ static int get_and_check_cached_response(server_rec *s, modssl_ctx_t *mctx,
     AP_DEBUG_ASSERT(*rsp == NULL);
 
     /* Check to see if we already have a response for this certificate */
-    stapling_get_cached_response(s, rsp, &ok, cinf, p);
+    stapling_get_cached_response(s, rsp, &ok, NULL, cinf, p);
 
     if (*rsp) {
         /* see if response is acceptable */
@@ -773,6 +818,15 @@ static int stapling_cb(SSL *ssl, void *arg)
         return rv;
     }
 
+    if (rsp == NULL && mctx->stapling_background_refresh == TRUE
+        && stapling_refresh_watchdog) {
+        /* Don't block the handshake, the watchdog will renew it */
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03405)
+                     "stapling_cb: no cached response, left to the "
+                     "background refresh");
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+
     if (rsp == NULL) {
         ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(01954)
                      "stapling_cb: renewing cached response");
@@ -799,7 +853,7 @@ static int stapling_cb(SSL *ssl, void *arg)
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03238)
                          "stapling_cb: still must refresh cached response "
                          "after obtaining refresh mutex");
-            rv = stapling_renew_response(s, mctx, ssl, cinf, &rsp, &ok,
+            rv = stapling_renew_response(s, mctx, ssl, conn, cinf, &rsp, &ok,
                                          conn->pool);
             stapling_refresh_mutex_off(s);
 
@@ -864,10 +918,242 @@ apr_status_t modssl_init_stapling(server_rec *s, apr_pool_t *p,
     if (mctx->stapling_responder_timeout == UNSET) {
         mctx->stapling_responder_timeout = 10 * APR_USEC_PER_SEC;
     }
+    if (mctx->stapling_background_refresh == UNSET) {
+        mctx->stapling_background_refresh = FALSE;
+    }
     SSL_CTX_set_tlsext_status_cb(ctx, stapling_cb);
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(01960) "OCSP stapling initialized");
 
     return APR_SUCCESS;
 }
 
+/*
+ * Background refresh (SSLStaplingBackgroundRefresh): a singleton watchdog
+ * renews the responses a while before they expire from the cache, and
+ * those which are missing, so that the handshakes only read the cache.
+ */
+
+/* modssl_dispatch_ocsp_request() wants a connection (for its server
+ * config and logging), make up one for the watchdog's queries.
+ */
+static conn_rec *stapling_refresh_conn(server_rec *s, apr_pool_t *p)
+{
+    conn_rec *c = apr_pcalloc(p, sizeof(*c));
+    SSLConnRec *sslconn = apr_pcalloc(p, sizeof(*sslconn));
+
+    c->pool = p;
+    c->base_server = s;
+    c->conn_config = ap_create_conn_config(p);
+    c->notes = apr_table_make(p, 1);
+    c->bucket_alloc = apr_bucket_alloc_create(p);
+    c->local_addr = c->client_addr = s->addrs ? s->addrs->host_addr : NULL;
+    c->local_ip = c->client_ip = "-";
+    c->local_host = s->server_hostname;
+    sslconn->server = s;
+    myConnConfigSet(c, sslconn);
+
+    return c;
+}
+
+/* The time of an OCSP GeneralizedTime ("YYYYMMDDHHMMSS[.f]Z"), or 0 */
+static apr_time_t stapling_asn1_time(const ASN1_GENERALIZEDTIME *tm)
+{
+    apr_time_exp_t exp = {0};
+    apr_time_t t;
+    const unsigned char *d;
+    int i;
+
+    if (!tm || tm->type != V_ASN1_GENERALIZEDTIME || tm->length < 14) {
+        return 0;
+    }
+    d = tm->data;
+    for (i = 0; i < 14; ++i) {
+        if (!apr_isdigit(d[i])) {
+            return 0;
+        }
+    }
+#define DIGIT2NUM(x) (((x)[0] - '0') * 10 + (x)[1] - '0')
+    exp.tm_year = DIGIT2NUM(d) * 100 + DIGIT2NUM(d + 2) - 1900;
+    exp.tm_mon = DIGIT2NUM(d + 4) - 1;
+    exp.tm_mday = DIGIT2NUM(d + 6);
+    exp.tm_hour = DIGIT2NUM(d + 8);
+    exp.tm_min = DIGIT2NUM(d + 10);
+    exp.tm_sec = DIGIT2NUM(d + 12);
+#undef DIGIT2NUM
+    if (apr_time_exp_gmt_get(&t, &exp) != APR_SUCCESS) {
+        return 0;
+    }
+    return t;
+}
+
+/* When the background refresh is to renew a cached response: when 3/4 of
+ * its validity (from thisUpdate to nextUpdate) or of its cache lifetime
+ * (from when it was stored) has passed, whichever comes first, so that it
+ * never expires.  Both come with the response, so a new process does not
+ * query the responders again for responses that are still good.  A
+ * response which is not valid (anymore) is renewed right away, one which
+ * was stored as an error when it expires from the cache.
+ */
+static apr_time_t stapling_refresh_due(modssl_ctx_t *mctx, certinfo *cinf,
+                                       OCSP_RESPONSE *rsp, BOOL ok,
+                                       apr_time_t stored)
+{
+    OCSP_BASICRESP *bs;
+    ASN1_GENERALIZEDTIME *rev, *thisupd, *nextupd;
+    int status, reason;
+    apr_interval_time_t lifetime;
+    apr_time_t this_t, next_t, due = 0;
+
+    if (!ok) {
+        return APR_INT64_MAX;
+    }
+    if (OCSP_response_status(rsp) != OCSP_RESPONSE_STATUS_SUCCESSFUL
+        || (bs = OCSP_response_get1_basic(rsp)) == NULL) {
+        return 0;
+    }
+
+    if (OCSP_resp_find_status(bs, cinf->cid, &status, &reason, &rev,
+                              &thisupd, &nextupd)
+        && OCSP_check_validity(thisupd, nextupd,
+                               mctx->stapling_resptime_skew,
+                               mctx->stapling_resp_maxage)
+        && (this_t = stapling_asn1_time(thisupd)) != 0) {
+        lifetime = apr_time_from_sec(mctx->stapling_cache_timeout);
+        due = stored + lifetime - lifetime / 4;
+        next_t = stapling_asn1_time(nextupd);
+        if (next_t > this_t) {
+            lifetime = next_t - this_t;
+            if (this_t + lifetime - lifetime / 4 < due) {
+                due = this_t + lifetime - lifetime / 4;
+            }
+        }
+    }
+    else {
+        /* not the place to complain, the handshakes do */
+        ERR_clear_error();
+    }
+
+    OCSP_BASICRESP_free(bs);
+    return due;
+}
+
+static void stapling_refresh_cert(certinfo *cinf, apr_time_t now,
+                                  apr_pool_t *p)
+{
+    server_rec *s = cinf->s;
+    modssl_ctx_t *mctx = cinf->mctx;
+    OCSP_RESPONSE *rsp = NULL;
+    apr_time_t stored = 0, due;
+    BOOL ok = FALSE;
+
+    stapling_get_cached_response(s, &rsp, &ok, &stored, cinf, p);
+    if (rsp) {
+        due = stapling_refresh_due(mctx, cinf, rsp, ok, stored);
+        OCSP_RESPONSE_free(rsp);
+        rsp = NULL;
+        if (now < due) {
+            return;
+        }
+    }
+    /* A responder whose responses are due (or fail) as soon as we get
+     * them is not asked every second either.
+     */
+    if (now < cinf->retry_at) {
+        return;
+    }
+
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03406)
+                 "stapling_refresh_cert: renewing response for %s",
+                 mctx->sc->vhost_id);
+    /* Serialized with the handshakes of the vhosts which renew their
+     * responses themselves.
+     */
+    stapling_refresh_mutex_on(s);
+    stapling_renew_response(s, mctx, NULL, stapling_refresh_conn(s, p),
+                            cinf, &rsp, &ok, p);
+    stapling_refresh_mutex_off(s);
+    if (rsp) {
+        OCSP_RESPONSE_free(rsp);
+    }
+
+    cinf->retry_at = now + apr_time_from_sec(mctx->stapling_errcache_timeout);
+}
+
+static apr_status_t stapling_refresh_callback(int state, void *data,
+                                              apr_pool_t *pool)
+{
+    apr_hash_index_t *hi;
+    apr_time_t now;
+
+    /* Not on STARTING, which may happen before the child_init of the
+     * stapling mutexes.
+     */
+    if (state != AP_WATCHDOG_STATE_RUNNING) {
+        return APR_SUCCESS;
+    }
+
+    now = apr_time_now();
+    for (hi = apr_hash_first(pool, stapling_certinfo); hi;
+         hi = apr_hash_next(hi)) {
+        certinfo *cinf = apr_hash_this_val(hi);
+
+        if (cinf->mctx->stapling_background_refresh == TRUE) {
+            apr_pool_t *p;
+
+            apr_pool_create(&p, pool);
+            stapling_refresh_cert(cinf, now, p);
+            apr_pool_destroy(p);
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+apr_status_t ssl_stapling_refresh_init(server_rec *s, apr_pool_t *p)
+{
+    APR_OPTIONAL_FN_TYPE(ap_watchdog_get_instance) *wd_get_instance;
+    APR_OPTIONAL_FN_TYPE(ap_watchdog_register_callback) *wd_register_callback;
+    ap_watchdog_t *watchdog;
+    apr_hash_index_t *hi;
+    apr_status_t rv;
+    int needed = 0;
+
+    for (hi = apr_hash_first(p, stapling_certinfo); hi;
+         hi = apr_hash_next(hi)) {
+        certinfo *cinf = apr_hash_this_val(hi);
+
+        if (cinf->mctx->stapling_background_refresh == TRUE) {
+            needed = 1;
+            break;
+        }
+    }
+    if (!needed) {
+        return APR_SUCCESS;
+    }
+
+    wd_get_instance = APR_RETRIEVE_OPTIONAL_FN(ap_watchdog_get_instance);
+    wd_register_callback = APR_RETRIEVE_OPTIONAL_FN(ap_watchdog_register_callback);
+    if (!wd_get_instance || !wd_register_callback) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, APLOGNO(03407)
+                     "SSLStaplingBackgroundRefresh requires mod_watchdog, "
+                     "OCSP responses will be renewed by the handshakes");
+        return APR_SUCCESS;
+    }
+
+    rv = wd_get_instance(&watchdog, SSL_STAPLING_WATCHDOG_NAME, 0, 1, p);
+    if (rv == APR_SUCCESS) {
+        rv = wd_register_callback(watchdog, SSL_STAPLING_WATCHDOG_INTERVAL,
+                                  NULL, stapling_refresh_callback);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, rv, s, APLOGNO(03408)
+                     "SSLStaplingBackgroundRefresh: cannot start the "
+                     "watchdog (%s)", SSL_STAPLING_WATCHDOG_NAME);
+        return ssl_die(s);
+    }
+    stapling_refresh_watchdog = 1;
+
+    return APR_SUCCESS;
+}
+
 #endif
@@ -41,6 +41,7 @@ typedef struct dialup_baton_t {
     apr_file_t *fd;
     apr_bucket_brigade *bb;
     apr_bucket_brigade *tmpbb;
+    int async;
 } dialup_baton_t;
 
 static int
@@ -75,9 +76,14 @@ dialup_send_pulse(dialup_baton_t *db)
             APR_BRIGADE_CONCAT(db->tmpbb, db->bb);
         }
 
-        e = apr_bucket_flush_create(db->r->connection->bucket_alloc);
+        /* Unless the MPM writes the output for us, wait for the client
+         * to get this pulse before the next one.
+         */
+        if (!db->async) {
+            e = apr_bucket_flush_create(db->r->connection->bucket_alloc);
 
-        APR_BRIGADE_INSERT_TAIL(db->tmpbb, e);
+            APR_BRIGADE_INSERT_TAIL(db->tmpbb, e);
+        }
 
         apr_brigade_length(db->tmpbb, 1, &len);
         bytes_sent += len;
@@ -100,6 +106,16 @@ dialup_send_pulse(dialup_baton_t *db)
     }
 }
 
+static void
+dialup_callback(void *baton);
+
+static void
+dialup_output_callback(void *baton)
+{
+    /* the client got the last pulse, next one in a second */
+    ap_mpm_register_timed_callback(apr_time_from_sec(1), dialup_callback, baton);
+}
+
 static void
 dialup_callback(void *baton)
 {
@@ -112,7 +128,13 @@ dialup_callback(void *baton)
     status = dialup_send_pulse(db);
 
     if (status == SUSPENDED) {
-        ap_mpm_register_timed_callback(apr_time_from_sec(1), dialup_callback, baton);
+        if (db->async) {
+            ap_mpm_register_output_callback(c, dialup_output_callback, baton);
+        }
+        else {
+            ap_mpm_register_timed_callback(apr_time_from_sec(1),
+                                           dialup_callback, baton);
+        }
     }
     else if (status == DONE) {
         apr_thread_mutex_unlock(db->r->invoke_mtx);
@@ -214,6 +236,11 @@ dialup_handler(request_rec *r)
 
     APR_BRIGADE_INSERT_TAIL(db->bb, e);
 
+    /* Don't block on clients slower than the configured rate */
+    db->async = (ap_mpm_register_output_callback(r->connection,
+                                                 dialup_output_callback,
+                                                 db) == APR_SUCCESS);
+
     status = dialup_send_pulse(db);
     if (status != SUSPENDED && status != DONE) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(01870)
@@ -221,7 +248,10 @@ dialup_handler(request_rec *r)
         return status;
     }
 
-    ap_mpm_register_timed_callback(apr_time_from_sec(1), dialup_callback, db);
+    if (!db->async) {
+        ap_mpm_register_timed_callback(apr_time_from_sec(1), dialup_callback,
+                                       db);
+    }
 
     return SUSPENDED;
 }
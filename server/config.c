@@ -34,6 +34,10 @@
 #include "apr_portable.h"
 #include "apr_file_io.h"
 #include "apr_fnmatch.h"
+#include "apr_hash.h"
+#if APR_HAS_THREADS
+#include "apr_thread_mutex.h"
+#endif
 
 #define APR_WANT_STDIO
 #define APR_WANT_STRFUNC
@@ -2104,6 +2108,297 @@ apr_status_t ap_open_htaccess(request_rec *r, const char *dir_name,
     return ap_pcfg_openfile(conffile, r->pool, *full_name);
 }
 
+/* The parsed .htaccess files of the previous requests (HtaccessCacheSize),
+ * per child, by vhost, directory and overrides.  An entry is validated by a
+ * stat of the file it was parsed from (mtime, ctime, size, inode, device)
+ * and of the access names before it, which must still not exist, so that
+ * only the changed files are parsed again.  The directories without any
+ * .htaccess are cached for HtaccessCacheNegativeTTL seconds, if not zero.
+ *
+ * The configurations are referenced by the LRU, the (main) requests using
+ * them and the directory walks cached with them (ap_htaccess_cache_hold()),
+ * and freed with the last one.
+ */
+typedef struct htaccess_entry_t htaccess_entry_t;
+struct htaccess_entry_t {
+    htaccess_entry_t *prev, *next;  /* LRU ring, most recently used first */
+    apr_pool_t *pool;               /* of the entry and the configuration */
+    const char *key;
+    ap_conf_vector_t *htaccess;     /* NULL if none */
+    int access_idx;                 /* the access name found */
+    apr_finfo_t finfo;              /* and its stat when parsed */
+    apr_time_t expiry;              /* of an entry without .htaccess */
+    int refs;
+};
+
+typedef struct {
+    apr_pool_t *pool;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+    apr_hash_t *entries;            /* by key */
+    apr_hash_t *confs;              /* by configuration */
+    htaccess_entry_t ring;
+    int count;
+    int max;
+    apr_interval_time_t negative_ttl;
+} htaccess_cache_t;
+
+static htaccess_cache_t *htaccess_cache = NULL;
+
+#define HTACCESS_FINFO_WANTED (APR_FINFO_MTIME | APR_FINFO_CTIME \
+                               | APR_FINFO_SIZE | APR_FINFO_TYPE \
+                               | APR_FINFO_INODE | APR_FINFO_DEV)
+
+static APR_INLINE void htaccess_cache_lock(void)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(htaccess_cache->mutex);
+#endif
+}
+
+static APR_INLINE void htaccess_cache_unlock(void)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(htaccess_cache->mutex);
+#endif
+}
+
+/* Called with the mutex held */
+static void htaccess_entry_release(htaccess_entry_t *entry)
+{
+    if (--entry->refs == 0) {
+        if (entry->htaccess) {
+            apr_hash_set(htaccess_cache->confs, &entry->htaccess,
+                         sizeof(entry->htaccess), NULL);
+        }
+        apr_pool_destroy(entry->pool);
+    }
+}
+
+/* Called with the mutex held */
+static void htaccess_entry_unlink(htaccess_entry_t *entry)
+{
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->prev = entry->next = NULL;
+    apr_hash_set(htaccess_cache->entries, entry->key, APR_HASH_KEY_STRING,
+                 NULL);
+    htaccess_cache->count--;
+    htaccess_entry_release(entry);
+}
+
+/* Called with the mutex held */
+static void htaccess_entry_link(htaccess_entry_t *entry)
+{
+    entry->next = htaccess_cache->ring.next;
+    entry->prev = &htaccess_cache->ring;
+    entry->next->prev = entry;
+    htaccess_cache->ring.next = entry;
+}
+
+static apr_status_t htaccess_entry_cleanup(void *data)
+{
+    if (htaccess_cache) {
+        htaccess_cache_lock();
+        htaccess_entry_release(data);
+        htaccess_cache_unlock();
+    }
+    return APR_SUCCESS;
+}
+
+/* Called with the mutex held, and a reference on entry for the request.
+ * Subrequests inherit r->htaccess, so it's released with the main one.
+ */
+static void htaccess_entry_use(request_rec *r, htaccess_entry_t *entry)
+{
+    while (r->main) {
+        r = r->main;
+    }
+    apr_pool_cleanup_register(r->pool, entry, htaccess_entry_cleanup,
+                              apr_pool_cleanup_null);
+}
+
+static int htaccess_finfo_equal(const apr_finfo_t *a, const apr_finfo_t *b)
+{
+    return (a->valid == b->valid
+            && a->filetype == b->filetype
+            && a->mtime == b->mtime
+            && a->ctime == b->ctime
+            && a->size == b->size
+            && (!(a->valid & APR_FINFO_INODE) || a->inode == b->inode)
+            && (!(a->valid & APR_FINFO_DEV) || a->device == b->device));
+}
+
+/* Whether the stat of the access name found (or not) by the entry is
+ * still the same.
+ */
+static int htaccess_entry_valid(request_rec *r, htaccess_entry_t *entry,
+                                const char *d, const char *access_names)
+{
+    apr_finfo_t finfo;
+    apr_status_t rv;
+    int idx;
+
+    if (!entry->htaccess) {
+        return (entry->expiry > apr_time_now());
+    }
+
+    for (idx = 0; access_names[0]; ++idx) {
+        const char *access_name = ap_getword_conf(r->pool, &access_names);
+        const char *filename = ap_make_full_path(r->pool, d, access_name);
+
+        rv = apr_stat(&finfo, filename, HTACCESS_FINFO_WANTED, r->pool);
+        if (idx < entry->access_idx) {
+            /* must still be missing, the errors are left to the parsing */
+            if (!APR_STATUS_IS_ENOENT(rv) && !APR_STATUS_IS_ENOTDIR(rv)) {
+                return 0;
+            }
+            continue;
+        }
+        return ((rv == APR_SUCCESS || rv == APR_INCOMPLETE)
+                && htaccess_finfo_equal(&finfo, &entry->finfo));
+    }
+
+    return 0;
+}
+
+/* Look for the valid entry of key, with a reference for the request */
+static htaccess_entry_t *htaccess_cache_find(request_rec *r, const char *key,
+                                             const char *d,
+                                             const char *access_names)
+{
+    htaccess_entry_t *entry;
+
+    htaccess_cache_lock();
+    entry = apr_hash_get(htaccess_cache->entries, key, APR_HASH_KEY_STRING);
+    if (entry) {
+        entry->refs++;
+    }
+    htaccess_cache_unlock();
+
+    if (entry && !htaccess_entry_valid(r, entry, d, access_names)) {
+        htaccess_cache_lock();
+        htaccess_entry_release(entry);
+        htaccess_cache_unlock();
+        entry = NULL;
+    }
+    if (entry) {
+        htaccess_cache_lock();
+        if (entry->next) {
+            /* most recently used, if still linked */
+            entry->prev->next = entry->next;
+            entry->next->prev = entry->prev;
+            htaccess_entry_link(entry);
+        }
+        htaccess_entry_use(r, entry);
+        htaccess_cache_unlock();
+    }
+
+    return entry;
+}
+
+/* Replace the entry of its key, with a reference for the request */
+static void htaccess_cache_store(request_rec *r, htaccess_entry_t *entry)
+{
+    htaccess_entry_t *old;
+
+    htaccess_cache_lock();
+
+    entry->refs = 2; /* the LRU and this request */
+    htaccess_entry_use(r, entry);
+    if (entry->htaccess) {
+        apr_hash_set(htaccess_cache->confs, &entry->htaccess,
+                     sizeof(entry->htaccess), entry);
+    }
+
+    old = apr_hash_get(htaccess_cache->entries, entry->key,
+                       APR_HASH_KEY_STRING);
+    if (old) {
+        htaccess_entry_unlink(old);
+    }
+    apr_hash_set(htaccess_cache->entries, entry->key, APR_HASH_KEY_STRING,
+                 entry);
+    htaccess_entry_link(entry);
+    htaccess_cache->count++;
+    while (htaccess_cache->count > htaccess_cache->max) {
+        htaccess_entry_unlink(htaccess_cache->ring.prev);
+    }
+
+    htaccess_cache_unlock();
+}
+
+/* Called with the mutex held, an entry unlinked before being linked */
+static htaccess_entry_t *htaccess_entry_create(const char *key)
+{
+    htaccess_entry_t *entry;
+    apr_pool_t *pool;
+
+    apr_pool_create(&pool, htaccess_cache->pool);
+    apr_pool_tag(pool, "htaccess_cache");
+    entry = apr_pcalloc(pool, sizeof(*entry));
+    entry->pool = pool;
+    entry->key = apr_pstrdup(pool, key);
+
+    return entry;
+}
+
+AP_CORE_DECLARE(int) ap_htaccess_cache_hold(ap_conf_vector_t *htaccess,
+                                            apr_pool_t *p)
+{
+    htaccess_entry_t *entry;
+
+    if (!htaccess_cache) {
+        return 0;
+    }
+
+    htaccess_cache_lock();
+    entry = apr_hash_get(htaccess_cache->confs, &htaccess, sizeof(htaccess));
+    if (entry && p) {
+        entry->refs++;
+        apr_pool_cleanup_register(p, entry, htaccess_entry_cleanup,
+                                  apr_pool_cleanup_null);
+    }
+    htaccess_cache_unlock();
+
+    return (entry != NULL);
+}
+
+static apr_status_t htaccess_cache_cleanup(void *dummy)
+{
+    htaccess_cache = NULL;
+    return APR_SUCCESS;
+}
+
+AP_CORE_DECLARE(void) ap_htaccess_cache_child_init(apr_pool_t *pchild,
+                                                   int max,
+                                                   apr_interval_time_t
+                                                       negative_ttl)
+{
+    apr_pool_t *pool;
+
+    if (max <= 0) {
+        return;
+    }
+
+    apr_pool_create(&pool, pchild);
+    apr_pool_tag(pool, "htaccess_cache");
+    htaccess_cache = apr_pcalloc(pool, sizeof(*htaccess_cache));
+    htaccess_cache->pool = pool;
+#if APR_HAS_THREADS
+    apr_thread_mutex_create(&htaccess_cache->mutex, APR_THREAD_MUTEX_DEFAULT,
+                            pool);
+#endif
+    htaccess_cache->entries = apr_hash_make(pool);
+    htaccess_cache->confs = apr_hash_make(pool);
+    htaccess_cache->ring.next = htaccess_cache->ring.prev
+                              = &htaccess_cache->ring;
+    htaccess_cache->max = max;
+    htaccess_cache->negative_ttl = negative_ttl;
+    /* before the entries are destroyed */
+    apr_pool_pre_cleanup_register(pool, NULL, htaccess_cache_cleanup);
+}
+
 AP_CORE_DECLARE(int) ap_parse_htaccess(ap_conf_vector_t **result,
                                        request_rec *r, int override,
                                        int override_opts, apr_table_t *override_list,
@@ -2116,6 +2411,9 @@ AP_CORE_DECLARE(int) ap_parse_htaccess(ap_conf_vector_t **result,
     struct htaccess_result *new;
     ap_conf_vector_t *dc = NULL;
     apr_status_t status;
+    htaccess_entry_t *entry = NULL;
+    apr_pool_t *pool = r->pool;
+    int idx, finfo_ok = 0;
 
     /* firstly, search cache */
     for (cache = r->htaccess; cache != NULL; cache = cache->next) {
@@ -2125,29 +2423,62 @@ AP_CORE_DECLARE(int) ap_parse_htaccess(ap_conf_vector_t **result,
         }
     }
 
+    /* then the files parsed by the previous requests, provided that the
+     * core opens them (other open_htaccess hooks may not use files)
+     */
+    if (htaccess_cache && _hooks.link_open_htaccess
+        && _hooks.link_open_htaccess->nelts == 1) {
+        const char *key = apr_psprintf(r->pool, "%pp:%d:%d:%pp:%s",
+                                       r->server, override, override_opts,
+                                       override_list, d);
+
+        entry = htaccess_cache_find(r, key, d, access_names);
+        if (entry) {
+            dc = entry->htaccess;
+            if (dc) {
+                *result = dc;
+            }
+            goto cache_it;
+        }
+
+        htaccess_cache_lock();
+        entry = htaccess_entry_create(key);
+        htaccess_cache_unlock();
+        pool = entry->pool;
+    }
+
     parms = default_parms;
     parms.override = override;
     parms.override_opts = override_opts;
     parms.override_list = override_list;
-    parms.pool = r->pool;
-    parms.temp_pool = r->pool;
+    parms.pool = pool;
+    parms.temp_pool = pool;
     parms.server = r->server;
-    parms.path = apr_pstrdup(r->pool, d);
+    parms.path = apr_pstrdup(pool, d);
 
     /* loop through the access names and find the first one */
-    while (access_names[0]) {
+    for (idx = 0; access_names[0]; ++idx) {
         const char *access_name = ap_getword_conf(r->pool, &access_names);
 
+        if (entry) {
+            /* before opening it, so that any later change invalidates */
+            status = apr_stat(&entry->finfo,
+                              ap_make_full_path(r->pool, d, access_name),
+                              HTACCESS_FINFO_WANTED, r->pool);
+            finfo_ok = ((status == APR_SUCCESS || status == APR_INCOMPLETE)
+                        && entry->finfo.filetype == APR_REG);
+        }
+
         filename = NULL;
         status = ap_run_open_htaccess(r, d, access_name, &f, &filename);
         if (status == APR_SUCCESS) {
             const char *errmsg;
             ap_directive_t *temptree = NULL;
 
-            dc = ap_create_per_dir_config(r->pool);
+            dc = ap_create_per_dir_config(pool);
 
             parms.config_file = f;
-            errmsg = ap_build_config(&parms, r->pool, r->pool, &temptree);
+            errmsg = ap_build_config(&parms, pool, pool, &temptree);
             if (errmsg == NULL)
                 errmsg = ap_walk_config(temptree, &parms, dc);
 
@@ -2156,6 +2487,11 @@ AP_CORE_DECLARE(int) ap_parse_htaccess(ap_conf_vector_t **result,
             if (errmsg) {
                 ap_log_rerror(APLOG_MARK, APLOG_ALERT, 0, r,
                               "%s: %s", filename, errmsg);
+                if (entry) {
+                    htaccess_cache_lock();
+                    apr_pool_destroy(entry->pool);
+                    htaccess_cache_unlock();
+                }
                 return HTTP_INTERNAL_SERVER_ERROR;
             }
 
@@ -2173,14 +2509,41 @@ AP_CORE_DECLARE(int) ap_parse_htaccess(ap_conf_vector_t **result,
                 apr_table_setn(r->notes, "error-notes",
                                "Server unable to read htaccess file, denying "
                                "access to be safe");
+                if (entry) {
+                    htaccess_cache_lock();
+                    apr_pool_destroy(entry->pool);
+                    htaccess_cache_unlock();
+                }
                 return HTTP_FORBIDDEN;
             }
         }
     }
 
+    if (entry) {
+        if (dc ? finfo_ok : htaccess_cache->negative_ttl > 0) {
+            entry->htaccess = dc;
+            entry->access_idx = idx;
+            entry->expiry = apr_time_now() + htaccess_cache->negative_ttl;
+            htaccess_cache_store(r, entry);
+        }
+        else if (dc) {
+            /* changed while parsed (or not a file), for this request only */
+            htaccess_cache_lock();
+            entry->refs = 1;
+            htaccess_entry_use(r, entry);
+            htaccess_cache_unlock();
+        }
+        else {
+            htaccess_cache_lock();
+            apr_pool_destroy(entry->pool);
+            htaccess_cache_unlock();
+        }
+    }
+
+cache_it:
     /* cache it */
     new = apr_palloc(r->pool, sizeof(struct htaccess_result));
-    new->dir = parms.path;
+    new->dir = apr_pstrdup(r->pool, d);
     new->override = override;
     new->override_opts = override_opts;
     new->htaccess = dc;
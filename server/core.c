@@ -4062,6 +4062,117 @@ static const char *set_http_method(cmd_parms *cmd, void *conf, const char *arg)
     return NULL;
 }
 
+static const char *set_regex_default_options(cmd_parms *cmd, void *dummy,
+                                             const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    int cflags;
+
+    if (err != NULL)
+        return err;
+
+    cflags = ap_regcomp_get_default_cflags();
+    while (*arg) {
+        const char *name = ap_getword_conf(cmd->temp_pool, &arg);
+        int cflag, how = 0;
+
+        if (!strcasecmp(name, "none")) {
+            cflags = 0;
+            continue;
+        }
+        if (*name == '+') {
+            how = 1;
+            ++name;
+        }
+        else if (*name == '-') {
+            how = -1;
+            ++name;
+        }
+
+        cflag = ap_regcomp_default_cflag_by_name(name);
+        if (!cflag) {
+            return apr_psprintf(cmd->pool, "%s: illegal option '%s'",
+                                cmd->cmd->name, name);
+        }
+        if (how > 0) {
+            cflags |= cflag;
+        }
+        else if (how < 0) {
+            cflags &= ~cflag;
+        }
+        else {
+            cflags = cflag;
+        }
+    }
+    ap_regcomp_set_default_cflags(cflags);
+
+    return NULL;
+}
+
+/* WalkCacheSize, for ap_walk_cache_child_init() */
+static int walk_cache_size = 0;
+
+static const char *set_walk_cache_size(cmd_parms *cmd, void *dummy,
+                                       const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err != NULL)
+        return err;
+
+    walk_cache_size = atoi(arg);
+    if (walk_cache_size < 0 || !apr_isdigit(*arg)) {
+        return apr_pstrcat(cmd->pool, cmd->cmd->name,
+                           " must be a number of entries, 0 to disable",
+                           NULL);
+    }
+
+    return NULL;
+}
+
+/* HtaccessCacheSize and HtaccessCacheNegativeTTL, for
+ * ap_htaccess_cache_child_init()
+ */
+static int htaccess_cache_size = 0;
+static apr_interval_time_t htaccess_cache_negative_ttl = 0;
+
+static const char *set_htaccess_cache_size(cmd_parms *cmd, void *dummy,
+                                           const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err != NULL)
+        return err;
+
+    htaccess_cache_size = atoi(arg);
+    if (htaccess_cache_size < 0 || !apr_isdigit(*arg)) {
+        return apr_pstrcat(cmd->pool, cmd->cmd->name,
+                           " must be a number of entries, 0 to disable",
+                           NULL);
+    }
+
+    return NULL;
+}
+
+static const char *set_htaccess_cache_negative_ttl(cmd_parms *cmd,
+                                                   void *dummy,
+                                                   const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err != NULL)
+        return err;
+
+    if (ap_timeout_parameter_parse(arg, &htaccess_cache_negative_ttl, "s")
+            != APR_SUCCESS || htaccess_cache_negative_ttl < 0) {
+        return apr_pstrcat(cmd->pool, cmd->cmd->name,
+                           " must be a duration (seconds by default), "
+                           "0 to disable", NULL);
+    }
+
+    return NULL;
+}
+
 static const char *set_cl_head_zero(cmd_parms *cmd, void *dummy, int arg)
 {
     core_server_config *conf =
@@ -4663,8 +4774,20 @@ AP_INIT_FLAG("MergeTrailers", set_merge_trailers, NULL, RSRC_CONF,
 AP_INIT_ITERATE("HttpProtocol", set_http_protocol, NULL, RSRC_CONF,
               "'min=0.9' (default) or 'min=1.0' to allow/deny HTTP/0.9; "
               "'liberal', 'strict', 'strict,log-only'"),
+AP_INIT_RAW_ARGS("RegexDefaultOptions", set_regex_default_options, NULL,
+                 RSRC_CONF, "default options for regexes, e.g. \"-JIT\""),
 AP_INIT_ITERATE("RegisterHttpMethod", set_http_method, NULL, RSRC_CONF,
                 "Registers non-standard HTTP methods"),
+AP_INIT_TAKE1("WalkCacheSize", set_walk_cache_size, NULL, RSRC_CONF,
+              "Number of directory and location walks of the previous "
+              "requests cached by each child, 0 (default) to disable"),
+AP_INIT_TAKE1("HtaccessCacheSize", set_htaccess_cache_size, NULL, RSRC_CONF,
+              "Number of directories whose .htaccess files are cached "
+              "parsed by each child, 0 (default) to disable"),
+AP_INIT_TAKE1("HtaccessCacheNegativeTTL", set_htaccess_cache_negative_ttl,
+              NULL, RSRC_CONF,
+              "How long the directories without .htaccess files are "
+              "cached, 0 (default) to disable"),
 AP_INIT_FLAG("HttpContentLengthHeadZero", set_cl_head_zero, NULL, OR_OPTIONS,
   "whether to permit Content-Length of 0 responses to HEAD requests"),
 AP_INIT_FLAG("HttpExpectStrict", set_expect_strict, NULL, OR_OPTIONS,
@@ -5031,8 +5154,20 @@ static int core_check_config(apr_pool_t *pconf, apr_pool_t *plog, apr_pool_t *pt
 
 static int core_pre_config(apr_pool_t *pconf, apr_pool_t *plog, apr_pool_t *ptemp)
 {
+    apr_status_t rv;
+
     ap_mutex_init(pconf);
 
+    ap_regcomp_set_default_cflags(AP_REG_DEFAULT);
+    walk_cache_size = 0;
+    htaccess_cache_size = 0;
+    htaccess_cache_negative_ttl = 0;
+    rv = ap_regex_init(pconf);
+    if (rv != APR_SUCCESS) {
+        ap_log_perror(APLOG_MARK, APLOG_WARNING, rv, plog, APLOGNO(03390)
+                      "could not set up the per-thread regex working store");
+    }
+
     if (!saved_server_config_defines)
         init_config_defines(pconf);
     apr_pool_cleanup_register(pconf, NULL, reset_config_defines,
@@ -5336,6 +5471,10 @@ static void core_child_init(apr_pool_t *pchild, server_rec *s)
      */
     proc.pid = getpid();
     apr_random_after_fork(&proc);
+
+    ap_walk_cache_child_init(pchild, walk_cache_size);
+    ap_htaccess_cache_child_init(pchild, htaccess_cache_size,
+                                 htaccess_cache_negative_ttl);
 }
 
 static void core_optional_fn_retrieve(void)
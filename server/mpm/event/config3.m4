@@ -8,8 +8,23 @@ if test "$ac_cv_serf" = yes ; then
 fi
 APACHE_SUBST(MOD_MPM_EVENT_LDADD)
 
-APACHE_MPM_MODULE(event, $enable_mpm_event, event.lo fdqueue.lo,[
+AC_ARG_ENABLE(event-uring, APACHE_HELP_STRING(--disable-event-uring,
+  [Disable io_uring support in the event MPM (AsyncIOUring)]),
+  [event_uring="$enableval"], [event_uring=yes])
+
+APACHE_MPM_MODULE(event, $enable_mpm_event, event.lo fdqueue.lo event_uring.lo,[
     AC_CHECK_FUNCS(pthread_kill)
+    if test "$event_uring" != "no"; then
+        dnl io_uring_submit_and_wait_timeout() is not used, but is new in
+        dnl liburing 2.2, which the poll removal by user_data in
+        dnl event_uring.c requires
+        AC_CHECK_HEADERS(liburing.h, [
+            AC_CHECK_LIB(uring, io_uring_submit_and_wait_timeout, [
+                AC_DEFINE(HAVE_LIBURING, 1, [Define if liburing is available])
+                APR_ADDTO(MOD_MPM_EVENT_LDADD, [-luring])
+            ])
+        ])
+    fi
 ], , [\$(MOD_MPM_EVENT_LDADD)])
 
 APACHE_MPMPATH_FINISH
@@ -92,6 +92,7 @@
 #include "ap_listen.h"
 #include "scoreboard.h"
 #include "fdqueue.h"
+#include "event_uring.h"
 #include "mpm_default.h"
 #include "http_vhost.h"
 #include "unixd.h"
@@ -169,6 +170,8 @@
 static unsigned int worker_factor = DEFAULT_WORKER_FACTOR * WORKER_FACTOR_SCALE;
     /* AsyncRequestWorkerFactor * 16 */
 
+static int use_uring = 0;                   /* AsyncIOUring */
+static int queue_shards = 1;                /* WorkerQueueShards, 0: auto */
 static int threads_per_child = 0;           /* ThreadsPerChild */
 static int ap_daemons_to_start = 0;         /* StartServers */
 static int min_spare_threads = 0;           /* MinSpareThreads */
@@ -209,6 +212,9 @@ struct event_conn_state_t {
     APR_RING_ENTRY(event_conn_state_t) timeout_list;
     /** the time when the entry was queued */
     apr_time_t queue_timestamp;
+    /** the timeout queue it is in, and its expiry tick there */
+    struct timeout_queue *timeout_q;
+    apr_uint64_t timeout_tick;
     /** connection record this struct refers to */
     conn_rec *c;
     /** request record (if any) this struct refers to */
@@ -220,6 +226,15 @@ struct event_conn_state_t {
      * hooks)
      */
     int suspended;
+    /** callback of the suspended handler waiting for its output to be
+     * written or for more input (ap_mpm_register_{output,input}_callback),
+     * and its baton
+     */
+    ap_mpm_callback_fn_t *yield_cbfn;
+    void *yield_baton;
+    /** waiting for input, and polled for it already */
+    unsigned int yield_input:1,
+                 input_polled:1;
     /** memory pool to allocate from */
     apr_pool_t *p;
     /** bucket allocator */
@@ -231,15 +246,39 @@ struct event_conn_state_t {
 };
 APR_RING_HEAD(timeout_head_t, event_conn_state_t);
 
+/*
+ * The timeout queues of a kind share a hierarchical timing wheel, where the
+ * connections are linked in the slot of their expiry tick (TW_TICK, the
+ * listener's maintenance period): insertion and removal are O(1), and the
+ * listener only looks at the slots of the ticks elapsed since its last run,
+ * whatever the number of connections.
+ * Level 0 has a slot per tick for the next TW_SLOTS ticks, the slots of
+ * the next levels cover TW_SLOTS times more ticks each, and their entries
+ * are cascaded down to the lower level when the latter wraps around.
+ */
+#define TW_TICK         apr_time_from_msec(100)
+#define TW_BITS         6
+#define TW_SLOTS        (1 << TW_BITS)
+#define TW_MASK         (TW_SLOTS - 1)
+#define TW_LEVELS       4
+#define TW_MAX_TICKS    ((apr_uint64_t)1 << (TW_BITS * TW_LEVELS))
+#define TW_CACHELINE    64
+
+struct timeout_wheel {
+    struct timeout_head_t slots[TW_LEVELS][TW_SLOTS];
+    apr_uint64_t tick;          /* next tick to expire */
+    apr_time_t tick_time;       /* when it's reached */
+};
+
 struct timeout_queue {
-    struct timeout_head_t head;
+    struct timeout_wheel *wheel;
     int count, *total;
     apr_interval_time_t timeout;
     struct timeout_queue *next;
 };
 /*
- * Several timeout queues that use different timeouts, so that we always can
- * simply append to the end.
+ * Several timeout queues that use different timeouts, each kind sharing a
+ * timing wheel (and a total).
  *   write_completion_q uses vhost's TimeOut
  *   keepalive_q        uses vhost's KeepAliveTimeOut
  *   linger_q           uses MAX_SECS_TO_LINGER
@@ -250,19 +289,80 @@ static struct timeout_queue *write_completion_q,
                             *linger_q,
                             *short_linger_q;
 
+/* Maintenance statistics of the listener thread */
+static apr_uint64_t timeouts_expired;
+static apr_interval_time_t timeouts_usecs;
+
 static apr_pollfd_t *listener_pollfd;
 
+static struct timeout_wheel *tw_create(apr_pool_t *p)
+{
+    struct timeout_wheel *w;
+    int i, j;
+
+    /* Aligned, the wheels being written by all the threads */
+    w = apr_palloc(p, sizeof(*w) + TW_CACHELINE);
+    w = (struct timeout_wheel *)APR_ALIGN((apr_uintptr_t)w, TW_CACHELINE);
+    for (i = 0; i < TW_LEVELS; ++i) {
+        for (j = 0; j < TW_SLOTS; ++j) {
+            APR_RING_INIT(&w->slots[i][j], event_conn_state_t, timeout_list);
+        }
+    }
+    w->tick = 0;
+    w->tick_time = 0;
+    return w;
+}
+
+/* Link the entry in the slot of its expiry tick, relative to the
+ * wheel's current tick.
+ */
+static void tw_place(struct timeout_wheel *w, event_conn_state_t *el)
+{
+    apr_uint64_t expiry = el->timeout_tick, delta;
+    int level;
+
+    if (expiry < w->tick) {
+        /* due, for the next run */
+        expiry = w->tick;
+    }
+    delta = expiry - w->tick;
+    if (delta >= TW_MAX_TICKS) {
+        /* re-placed when cascaded */
+        expiry = w->tick + TW_MAX_TICKS - 1;
+        delta = TW_MAX_TICKS - 1;
+    }
+    for (level = 0; level < TW_LEVELS - 1; ++level) {
+        if (delta < ((apr_uint64_t)1 << (TW_BITS * (level + 1)))) {
+            break;
+        }
+    }
+    APR_RING_INSERT_TAIL(&w->slots[level][(expiry >> (TW_BITS * level))
+                                          & TW_MASK],
+                         el, event_conn_state_t, timeout_list);
+}
+
+static void to_queue_append(struct timeout_queue *q, event_conn_state_t *el)
+{
+    struct timeout_wheel *w = q->wheel;
+    apr_time_t expiry = el->queue_timestamp + q->timeout;
+
+    el->timeout_q = q;
+    if (expiry <= w->tick_time) {
+        el->timeout_tick = w->tick;
+    }
+    else {
+        el->timeout_tick = w->tick + (expiry - w->tick_time) / TW_TICK;
+    }
+    tw_place(w, el);
+    ++*q->total;
+    ++q->count;
+}
+
 /*
  * Macros for accessing struct timeout_queue.
  * For TO_QUEUE_APPEND and TO_QUEUE_REMOVE, timeout_mutex must be held.
  */
-#define TO_QUEUE_APPEND(q, el)                                                \
-    do {                                                                      \
-        APR_RING_INSERT_TAIL(&(q)->head, el, event_conn_state_t,              \
-                             timeout_list);                                   \
-        ++*(q)->total;                                                        \
-        ++(q)->count;                                                         \
-    } while (0)
+#define TO_QUEUE_APPEND(q, el) to_queue_append((q), (el))
 
 #define TO_QUEUE_REMOVE(q, el)                                                \
     do {                                                                      \
@@ -275,7 +375,7 @@ static apr_pollfd_t *listener_pollfd;
     do {                                                                      \
         struct timeout_queue *b = (v);                                        \
         (q) = apr_palloc((p), sizeof *(q));                                   \
-        APR_RING_INIT(&(q)->head, event_conn_state_t, timeout_list);          \
+        (q)->wheel = (b) ? (b)->wheel : tw_create(p);                         \
         (q)->total = (b) ? (b)->total : apr_pcalloc((p), sizeof *(q)->total); \
         (q)->count = 0;                                                       \
         (q)->timeout = (t);                                                   \
@@ -294,6 +394,42 @@ static apr_pollfd_t *listener_pollfd;
  * XXX: cases.
  */
 static apr_pollset_t *event_pollset;
+#if HAVE_LIBURING
+/* Replaces event_pollset with AsyncIOUring on */
+static event_uring_t *event_uring;
+#endif
+
+static APR_INLINE apr_status_t event_pollset_add(const apr_pollfd_t *pfd)
+{
+#if HAVE_LIBURING
+    if (event_uring) {
+        return event_uring_add(event_uring, pfd);
+    }
+#endif
+    return apr_pollset_add(event_pollset, pfd);
+}
+
+static APR_INLINE apr_status_t event_pollset_remove(const apr_pollfd_t *pfd)
+{
+#if HAVE_LIBURING
+    if (event_uring) {
+        return event_uring_remove(event_uring, pfd);
+    }
+#endif
+    return apr_pollset_remove(event_pollset, pfd);
+}
+
+static APR_INLINE apr_status_t event_pollset_poll(apr_interval_time_t timeout,
+                                                  apr_int32_t *num,
+                                                  const apr_pollfd_t **descs)
+{
+#if HAVE_LIBURING
+    if (event_uring) {
+        return event_uring_poll(event_uring, timeout, num, descs);
+    }
+#endif
+    return apr_pollset_poll(event_pollset, timeout, num, descs);
+}
 
 #if HAVE_SERF
 typedef struct {
@@ -444,7 +580,7 @@ static void disable_listensocks(int process_slot)
 {
     int i;
     for (i = 0; i < num_listensocks; i++) {
-        apr_pollset_remove(event_pollset, &listener_pollfd[i]);
+        event_pollset_remove(&listener_pollfd[i]);
     }
     ap_scoreboard_image->parent[process_slot].not_accepting = 1;
 }
@@ -462,7 +598,7 @@ static void enable_listensocks(int process_slot)
                  apr_atomic_read32(&suspended_count),
                  ap_queue_info_get_idlers(worker_queue_info));
     for (i = 0; i < num_listensocks; i++)
-        apr_pollset_add(event_pollset, &listener_pollfd[i]);
+        event_pollset_add(&listener_pollfd[i]);
     /*
      * XXX: This is not yet optimal. If many workers suddenly become available,
      * XXX: the parent may kill some processes off too soon.
@@ -897,7 +1033,7 @@ static int start_lingering_close_common(event_conn_state_t *cs, int in_worker)
             cs->pub.sense == CONN_SENSE_WANT_WRITE ? APR_POLLOUT :
                     APR_POLLIN) | APR_POLLHUP | APR_POLLERR;
     cs->pub.sense = CONN_SENSE_DEFAULT;
-    rv = apr_pollset_add(event_pollset, &cs->pfd);
+    rv = event_pollset_add(&cs->pfd);
     apr_thread_mutex_unlock(timeout_mutex);
     if (rv != APR_SUCCESS && !APR_STATUS_IS_EEXIST(rv)) {
         ap_log_error(APLOG_MARK, APLOG_ERR, rv, ap_server_conf, APLOGNO(03092)
@@ -1144,6 +1280,10 @@ read_request:
     if (cs->pub.state == CONN_STATE_READ_REQUEST_LINE) {
         if (!c->aborted) {
             ap_run_process_connection(c);
+            if (cs->pub.state != CONN_STATE_SUSPENDED) {
+                /* the request did not yield finally */
+                cs->yield_cbfn = NULL;
+            }
 
             /* state will be updated upon return
              * fall thru to either wait for readability/timeout or
@@ -1155,6 +1295,14 @@ read_request:
         }
     }
 
+write_completion:
+    if (cs->pub.state == CONN_STATE_SUSPENDED && cs->yield_cbfn) {
+        /* The handler yielded, write its output (then wait for its input)
+         * asynchronously.
+         */
+        cs->pub.state = CONN_STATE_WRITE_COMPLETION;
+    }
+
     if (cs->pub.state == CONN_STATE_WRITE_COMPLETION) {
         int not_complete_yet;
 
@@ -1162,6 +1310,15 @@ read_request:
 
         not_complete_yet = ap_run_output_pending(c);
 
+        if (not_complete_yet == DECLINED && cs->yield_input
+                && !cs->input_polled && !c->data_in_input_filters
+                && ap_run_input_pending(c) != OK) {
+            /* Nothing to read yet, same as above but for readability */
+            cs->input_polled = 1;
+            cs->pub.sense = CONN_SENSE_WANT_READ;
+            not_complete_yet = OK;
+        }
+
         if (not_complete_yet > OK) {
             cs->pub.state = CONN_STATE_LINGER;
         }
@@ -1178,10 +1335,26 @@ read_request:
                     cs->pub.sense == CONN_SENSE_WANT_READ ? APR_POLLIN :
                             APR_POLLOUT) | APR_POLLHUP | APR_POLLERR;
             cs->pub.sense = CONN_SENSE_DEFAULT;
-            rc = apr_pollset_add(event_pollset, &cs->pfd);
+            rc = event_pollset_add(&cs->pfd);
             apr_thread_mutex_unlock(timeout_mutex);
             return;
         }
+        else if (cs->yield_cbfn) {
+            /* Everything is written (and there is something to read), let
+             * the handler continue; it either finishes the request or
+             * yields again.
+             */
+            ap_mpm_callback_fn_t *cbfn = cs->yield_cbfn;
+
+            cs->yield_cbfn = NULL;
+            cs->yield_input = cs->input_polled = 0;
+            cs->pub.state = CONN_STATE_SUSPENDED;
+            cbfn(cs->yield_baton);
+            if (cs->pub.state != CONN_STATE_SUSPENDED) {
+                cs->yield_cbfn = NULL;
+            }
+            goto write_completion;
+        }
         else if (c->keepalive != AP_CONN_KEEPALIVE || c->aborted ||
             listener_may_exit) {
             cs->pub.state = CONN_STATE_LINGER;
@@ -1216,7 +1389,7 @@ read_request:
 
         /* Add work to pollset. */
         cs->pfd.reqevents = APR_POLLIN;
-        rc = apr_pollset_add(event_pollset, &cs->pfd);
+        rc = event_pollset_add(&cs->pfd);
         apr_thread_mutex_unlock(timeout_mutex);
 
         if (rc != APR_SUCCESS) {
@@ -1246,6 +1419,9 @@ static apr_status_t event_resume_suspended (conn_rec *c) {
     }
     apr_atomic_dec32(&suspended_count);
     c->suspended_baton = NULL;
+    if (cs->pub.state == CONN_STATE_SUSPENDED && cs->yield_cbfn) {
+        cs->pub.state = CONN_STATE_WRITE_COMPLETION;
+    }
 
     apr_thread_mutex_lock(timeout_mutex);
     TO_QUEUE_APPEND(cs->sc->wc_q, cs);
@@ -1253,12 +1429,48 @@ static apr_status_t event_resume_suspended (conn_rec *c) {
             cs->pub.sense == CONN_SENSE_WANT_READ ? APR_POLLIN :
                     APR_POLLOUT) | APR_POLLHUP | APR_POLLERR;
     cs->pub.sense = CONN_SENSE_DEFAULT;
-    apr_pollset_add(event_pollset, &cs->pfd);
+    event_pollset_add(&cs->pfd);
     apr_thread_mutex_unlock(timeout_mutex);
 
     return OK;
 }
 
+/* Continue a suspended handler when its output is written, or when there
+ * is something to read, by the write completion of process_socket().
+ */
+static apr_status_t event_register_yield_callback(conn_rec *c,
+                                                  ap_mpm_callback_fn_t *cbfn,
+                                                  void *baton, int input)
+{
+    event_conn_state_t *cs = ap_get_module_config(c->conn_config,
+                                                  &mpm_event_module);
+
+    if (!cs || c->master || c->clogging_input_filters) {
+        /* not a connection handled by process_socket() */
+        return APR_ENOTIMPL;
+    }
+    cs->yield_cbfn = cbfn;
+    cs->yield_baton = baton;
+    cs->yield_input = input;
+    cs->input_polled = 0;
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t event_register_output_callback(conn_rec *c,
+                                                   ap_mpm_callback_fn_t *cbfn,
+                                                   void *baton)
+{
+    return event_register_yield_callback(c, cbfn, baton, 0);
+}
+
+static apr_status_t event_register_input_callback(conn_rec *c,
+                                                  ap_mpm_callback_fn_t *cbfn,
+                                                  void *baton)
+{
+    return event_register_yield_callback(c, cbfn, baton, 1);
+}
+
 /* conns_this_child has gone to zero or below.  See if the admin coded
    "MaxConnectionsPerChild 0", and keep going in that case.  Doing it this way
    simplifies the hot path in worker_thread */
@@ -1328,23 +1540,21 @@ static apr_status_t s_socket_add(void *user_baton,
                                  apr_pollfd_t *pfd,
                                  void *serf_baton)
 {
-    s_baton_t *s = (s_baton_t*)user_baton;
     /* XXXXX: recycle listener_poll_types */
     listener_poll_type *pt = ap_malloc(sizeof(*pt));
     pt->type = PT_SERF;
     pt->baton = serf_baton;
     pfd->client_data = pt;
-    return apr_pollset_add(s->pollset, pfd);
+    return event_pollset_add(pfd);
 }
 
 static apr_status_t s_socket_remove(void *user_baton,
                                     apr_pollfd_t *pfd,
                                     void *serf_baton)
 {
-    s_baton_t *s = (s_baton_t*)user_baton;
     listener_poll_type *pt = pfd->client_data;
     free(pt);
-    return apr_pollset_remove(s->pollset, pfd);
+    return event_pollset_remove(pfd);
 }
 #endif
 
@@ -1373,7 +1583,7 @@ static apr_status_t init_pollset(apr_pool_t *p)
         pfd->client_data = pt;
 
         apr_socket_opt_set(pfd->desc.s, APR_SO_NONBLOCK, 1);
-        apr_pollset_add(event_pollset, pfd);
+        event_pollset_add(pfd);
 
         lr->accept_func = ap_unixd_accept;
     }
@@ -1556,7 +1766,7 @@ static apr_status_t event_cleanup_poll_callback(void *data)
         apr_pollfd_t *pfd = (apr_pollfd_t *)pfds->elts + i;
         if (pfd->client_data) {
             apr_status_t rc;
-            rc = apr_pollset_remove(event_pollset, pfd);
+            rc = event_pollset_remove(pfd);
             if (rc != APR_SUCCESS && !APR_STATUS_IS_NOTFOUND(rc)) {
                 final_rc = rc;
             }
@@ -1598,7 +1808,7 @@ static apr_status_t event_register_poll_callback_ex(apr_array_header_t *pfds,
     }
     for (i = 0; i < pfds->nelts; i++) {
         apr_pollfd_t *pfd = (apr_pollfd_t *)pfds->elts + i;
-        rc = apr_pollset_add(event_pollset, pfd);
+        rc = event_pollset_add(pfd);
         if (rc != APR_SUCCESS) {
             final_rc = rc;
         }
@@ -1647,7 +1857,7 @@ static void process_lingering_close(event_conn_state_t *cs, const apr_pollfd_t *
     }
 
     apr_thread_mutex_lock(timeout_mutex);
-    rv = apr_pollset_remove(event_pollset, pfd);
+    rv = event_pollset_remove(pfd);
     AP_DEBUG_ASSERT(rv == APR_SUCCESS);
 
     rv = apr_socket_close(csd);
@@ -1662,7 +1872,98 @@ static void process_lingering_close(event_conn_state_t *cs, const apr_pollfd_t *
         ap_queue_interrupt_one(worker_queue);
 }
 
-/* call 'func' for all elements of 'q' with timeout less than 'timeout_time'.
+/* Move the entries of a slot to the trash, removing them from the pollset.
+ * Pre-condition: timeout_mutex must already be locked
+ */
+static int tw_trash(struct timeout_head_t *slot, struct timeout_head_t *trash)
+{
+    event_conn_state_t *cs;
+    apr_status_t rv;
+    int count = 0;
+
+    if (APR_RING_EMPTY(slot, event_conn_state_t, timeout_list)) {
+        return 0;
+    }
+    for (cs = APR_RING_FIRST(slot);
+         cs != APR_RING_SENTINEL(slot, event_conn_state_t, timeout_list);
+         cs = APR_RING_NEXT(cs, timeout_list)) {
+        rv = event_pollset_remove(&cs->pfd);
+        if (rv != APR_SUCCESS && !APR_STATUS_IS_NOTFOUND(rv)) {
+            ap_log_cerror(APLOG_MARK, APLOG_ERR, rv, cs->c, APLOGNO(00473)
+                          "apr_pollset_remove failed");
+        }
+        cs->timeout_q->count--;
+        count++;
+    }
+    APR_RING_CONCAT(trash, slot, event_conn_state_t, timeout_list);
+    return count;
+}
+
+/* Advance the wheel to 'now', trashing the entries of the elapsed ticks.
+ * Pre-condition: timeout_mutex must already be locked
+ */
+static int tw_expire(struct timeout_wheel *w, int nentries, apr_time_t now,
+                     struct timeout_head_t *trash)
+{
+    apr_uint64_t nticks;
+    int total = 0, level;
+
+    if (now < w->tick_time - TW_TICK) {
+        /* The system clock skewed in the past, keep the entries' remaining
+         * time (relative to the wheel) rather than waiting for the clock
+         * to catch up.
+         */
+        w->tick_time = now;
+    }
+    if (now < w->tick_time) {
+        return 0;
+    }
+    nticks = (now - w->tick_time) / TW_TICK + 1;
+
+    if (!nentries || nticks >= TW_MAX_TICKS) {
+        /* Nothing to expire, or everything (forward skew) */
+        if (nentries) {
+            for (level = 0; level < TW_LEVELS; ++level) {
+                int i;
+                for (i = 0; i < TW_SLOTS; ++i) {
+                    total += tw_trash(&w->slots[level][i], trash);
+                }
+            }
+        }
+        w->tick += nticks;
+        w->tick_time += nticks * TW_TICK;
+        return total;
+    }
+
+    while (nticks--) {
+        apr_uint64_t tick = w->tick;
+
+        /* When a level wraps around, cascade the next level's slot */
+        for (level = 1; level < TW_LEVELS; ++level) {
+            struct timeout_head_t *slot;
+            event_conn_state_t *cs;
+
+            if (tick & (((apr_uint64_t)1 << (TW_BITS * level)) - 1)) {
+                break;
+            }
+            slot = &w->slots[level][(tick >> (TW_BITS * level)) & TW_MASK];
+            while (!APR_RING_EMPTY(slot, event_conn_state_t, timeout_list)) {
+                cs = APR_RING_FIRST(slot);
+                APR_RING_REMOVE(cs, timeout_list);
+                tw_place(w, cs);
+            }
+        }
+
+        total += tw_trash(&w->slots[0][tick & TW_MASK], trash);
+        w->tick++;
+        w->tick_time += TW_TICK;
+    }
+
+    return total;
+}
+
+/* call 'func' for all elements of 'q' expiring at 'timeout_time' (all of
+ * them if zero), that is for the elapsed ticks of the kind's wheel.
  * Pre-condition: timeout_mutex must already be locked
  * Post-condition: timeout_mutex will be locked again
  */
@@ -1670,58 +1971,30 @@ static void process_timeout_queue(struct timeout_queue *q,
                                   apr_time_t timeout_time,
                                   int (*func)(event_conn_state_t *))
 {
-    int total = 0, count;
-    event_conn_state_t *first, *cs, *last;
+    struct timeout_wheel *w = q->wheel;
     struct timeout_head_t trash;
-    struct timeout_queue *qp;
-    apr_status_t rv;
-
-    if (!*q->total) {
-        return;
-    }
+    event_conn_state_t *first, *cs;
+    int total = 0, level, i;
 
     APR_RING_INIT(&trash, event_conn_state_t, timeout_list);
-    for (qp = q; qp; qp = qp->next) {
-        count = 0;
-        cs = first = last = APR_RING_FIRST(&qp->head);
-        while (cs != APR_RING_SENTINEL(&qp->head, event_conn_state_t,
-                                       timeout_list)
-               /* Trash the entry if:
-                * - no timeout_time was given (asked for all), or
-                * - it expired (according to the queue timeout), or
-                * - the system clock skewed in the past: no entry should be
-                *   registered above the given timeout_time (~now) + the queue
-                *   timeout, we won't keep any here (eg. for centuries).
-                * Stop otherwise, no following entry will match thanks to the
-                * single timeout per queue (entries are added to the end!).
-                * This allows maintenance in O(1).
-                */
-               && (!timeout_time
-                   || cs->queue_timestamp + qp->timeout < timeout_time
-                   || cs->queue_timestamp > timeout_time + qp->timeout)) {
-            last = cs;
-            rv = apr_pollset_remove(event_pollset, &cs->pfd);
-            if (rv != APR_SUCCESS && !APR_STATUS_IS_NOTFOUND(rv)) {
-                ap_log_cerror(APLOG_MARK, APLOG_ERR, rv, cs->c, APLOGNO(00473)
-                              "apr_pollset_remove failed");
+    if (!timeout_time) {
+        if (*q->total) {
+            for (level = 0; level < TW_LEVELS; ++level) {
+                for (i = 0; i < TW_SLOTS; ++i) {
+                    total += tw_trash(&w->slots[level][i], &trash);
+                }
             }
-            cs = APR_RING_NEXT(cs, timeout_list);
-            count++;
         }
-        if (!count)
-            continue;
-
-        APR_RING_UNSPLICE(first, last, timeout_list);
-        APR_RING_SPLICE_TAIL(&trash, first, last, event_conn_state_t,
-                             timeout_list);
-        qp->count -= count;
-        total += count;
+    }
+    else {
+        total = tw_expire(w, *q->total, timeout_time, &trash);
     }
     if (!total)
         return;
 
     AP_DEBUG_ASSERT(*q->total >= total);
     *q->total -= total;
+    timeouts_expired += total;
     apr_thread_mutex_unlock(timeout_mutex);
     first = APR_RING_FIRST(&trash);
     do {
@@ -1842,7 +2115,7 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
                         int i;
                         for (i = 0; i < te->remove->nelts; i++) {
                             apr_pollfd_t *pfd = (apr_pollfd_t *)te->remove->elts + i;
-                            apr_pollset_remove(event_pollset, pfd);
+                            event_pollset_remove(pfd);
                         }
                     }
                     push_timer2worker(te);
@@ -1859,7 +2132,7 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
         }
         apr_thread_mutex_unlock(g_timer_skiplist_mtx);
 
-        rc = apr_pollset_poll(event_pollset, timeout_interval, &num, &out_pfd);
+        rc = event_pollset_poll(timeout_interval, &num, &out_pfd);
         if (rc != APR_SUCCESS) {
             if (APR_STATUS_IS_EINTR(rc)) {
                 continue;
@@ -1900,7 +2173,7 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
                                &workers_were_busy);
                     apr_thread_mutex_lock(timeout_mutex);
                     TO_QUEUE_REMOVE(remove_from_q, cs);
-                    rc = apr_pollset_remove(event_pollset, &cs->pfd);
+                    rc = event_pollset_remove(&cs->pfd);
                     apr_thread_mutex_unlock(timeout_mutex);
 
                     /*
@@ -2069,7 +2342,7 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
                     /* remove all sockets in my set */
                     for (i = 0; i < baton->pfds->nelts; i++) {
                         apr_pollfd_t *pfd = (apr_pollfd_t *)baton->pfds->elts + i;
-                        apr_pollset_remove(event_pollset, pfd);
+                        event_pollset_remove(pfd);
                         pfd->client_data = NULL;
                     }
 
@@ -2109,22 +2382,28 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
                                       start_lingering_close_nonblocking);
             }
             else {
-                process_timeout_queue(keepalive_q, timeout_time,
+                process_timeout_queue(keepalive_q, now,
                                       start_lingering_close_nonblocking);
             }
             /* Step 2: write completion timeouts */
-            process_timeout_queue(write_completion_q, timeout_time,
+            process_timeout_queue(write_completion_q, now,
                                   start_lingering_close_nonblocking);
             /* Step 3: (normal) lingering close completion timeouts */
-            process_timeout_queue(linger_q, timeout_time, stop_lingering_close);
+            process_timeout_queue(linger_q, now, stop_lingering_close);
             /* Step 4: (short) lingering close completion timeouts */
-            process_timeout_queue(short_linger_q, timeout_time, stop_lingering_close);
+            process_timeout_queue(short_linger_q, now, stop_lingering_close);
 
             ps = ap_get_scoreboard_process(process_slot);
             ps->write_completion = *write_completion_q->total;
             ps->keep_alive = *keepalive_q->total;
+            ps->lingering_normal = *linger_q->total;
+            ps->lingering_short = *short_linger_q->total;
             apr_thread_mutex_unlock(timeout_mutex);
 
+            timeouts_usecs += apr_time_now() - now;
+            ps->timeouts_expired = timeouts_expired;
+            ps->timeouts_usecs = timeouts_usecs;
+
             ps->connections = apr_atomic_read32(&connection_count);
             ps->suspended = apr_atomic_read32(&suspended_count);
             ps->lingering_close = apr_atomic_read32(&lingering_count);
@@ -2234,7 +2513,8 @@ static void *APR_THREAD_FUNC worker_thread(apr_thread_t * thd, void *dummy)
             break;
         }
 
-        rv = ap_queue_pop_something(worker_queue, &csd, &cs, &ptrans, &te);
+        rv = ap_queue_pop_something(worker_queue, thread_slot,
+                                    &csd, &cs, &ptrans, &te);
 
         if (rv != APR_SUCCESS) {
             /* We get APR_EOF during a graceful shutdown once all the
@@ -2340,12 +2620,22 @@ static void *APR_THREAD_FUNC start_threads(apr_thread_t * thd, void *dummy)
     int loops;
     int prev_threads_created;
     int max_recycled_pools = -1;
+    int nshards = queue_shards;
     int good_methods[] = {APR_POLLSET_KQUEUE, APR_POLLSET_PORT, APR_POLLSET_EPOLL};
 
+    if (nshards == 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+        nshards = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        if (nshards < 1) {
+            nshards = 1;
+        }
+    }
+
     /* We must create the fd queues before we start up the listener
      * and worker threads. */
     worker_queue = apr_pcalloc(pchild, sizeof(*worker_queue));
-    rv = ap_queue_init(worker_queue, threads_per_child, pchild);
+    rv = ap_queue_init(worker_queue, threads_per_child, nshards, pchild);
     if (rv != APR_SUCCESS) {
         ap_log_error(APLOG_MARK, APLOG_ALERT, rv, ap_server_conf, APLOGNO(03100)
                      "ap_queue_init() failed");
@@ -2367,6 +2657,13 @@ static void *APR_THREAD_FUNC start_threads(apr_thread_t * thd, void *dummy)
         clean_child_exit(APEXIT_CHILDFATAL);
     }
 
+    /* Start the timing wheels */
+    write_completion_q->wheel->tick_time = keepalive_q->wheel->tick_time =
+        linger_q->wheel->tick_time = short_linger_q->wheel->tick_time =
+            apr_time_now();
+    timeouts_expired = 0;
+    timeouts_usecs = 0;
+
     /* Create the timeout mutex and main pollset before the listener
      * thread starts.
      */
@@ -2379,6 +2676,20 @@ static void *APR_THREAD_FUNC start_threads(apr_thread_t * thd, void *dummy)
     }
 
     /* Create the main pollset */
+#if HAVE_LIBURING
+    if (use_uring) {
+        rv = event_uring_create(&event_uring, threads_per_child*2, pchild);
+        if (rv == APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, ap_server_conf,
+                         APLOGNO(03393) "start_threads: Using io_uring");
+            goto pollset_created;
+        }
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, ap_server_conf,
+                     APLOGNO(03394) "io_uring setup failed, falling back "
+                     "to the default pollset");
+        event_uring = NULL;
+    }
+#endif
     for (i = 0; i < sizeof(good_methods) / sizeof(good_methods[0]); i++) {
         rv = apr_pollset_create_ex(&event_pollset,
                             threads_per_child*2, /* XXX don't we need more, to handle
@@ -2407,6 +2718,9 @@ static void *APR_THREAD_FUNC start_threads(apr_thread_t * thd, void *dummy)
 
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, ap_server_conf, APLOGNO(02471)
                  "start_threads: Using %s", apr_pollset_method_name(event_pollset));
+#if HAVE_LIBURING
+pollset_created:
+#endif
     worker_sockets = apr_pcalloc(pchild, threads_per_child
                                  * sizeof(apr_socket_t *));
 
@@ -3530,6 +3844,8 @@ static int event_pre_config(apr_pool_t * pconf, apr_pool_t * plog,
     max_workers = ap_daemons_limit * threads_per_child;
     had_healthy_child = 0;
     ap_extended_status = 0;
+    use_uring = 0;
+    queue_shards = 1;
 
     return OK;
 }
@@ -3843,6 +4159,10 @@ static void event_hooks(apr_pool_t * p)
     ap_hook_post_read_request(event_post_read_request, NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_mpm_get_name(event_get_name, NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_mpm_resume_suspended(event_resume_suspended, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_mpm_register_output_callback(event_register_output_callback, NULL,
+                                         NULL, APR_HOOK_MIDDLE);
+    ap_hook_mpm_register_input_callback(event_register_input_callback, NULL,
+                                        NULL, APR_HOOK_MIDDLE);
 
     ap_hook_pre_connection(event_pre_connection, NULL, NULL, APR_HOOK_REALLY_FIRST);
     ap_hook_protocol_switch(event_protocol_switch, NULL, NULL, APR_HOOK_REALLY_FIRST);
@@ -3958,6 +4278,45 @@ static const char *set_worker_factor(cmd_parms * cmd, void *dummy,
 }
 
 
+static const char *set_use_uring(cmd_parms *cmd, void *dummy, int flag)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+
+#if HAVE_LIBURING
+    use_uring = flag;
+#else
+    if (flag) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, NULL, APLOGNO(03395)
+                     "AsyncIOUring: io_uring support not available, "
+                     "ignored");
+    }
+#endif
+    return NULL;
+}
+
+static const char *set_queue_shards(cmd_parms *cmd, void *dummy,
+                                    const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+
+    if (!strcasecmp(arg, "auto")) {
+        queue_shards = 0;
+    }
+    else {
+        queue_shards = atoi(arg);
+        if (queue_shards < 1) {
+            return "WorkerQueueShards must be 'auto' or a positive number";
+        }
+    }
+    return NULL;
+}
+
 static const command_rec event_cmds[] = {
     LISTEN_COMMANDS,
     AP_INIT_TAKE1("StartServers", set_daemons_to_start, NULL, RSRC_CONF,
@@ -3980,6 +4339,12 @@ static const command_rec event_cmds[] = {
     AP_INIT_TAKE1("AsyncRequestWorkerFactor", set_worker_factor, NULL, RSRC_CONF,
                   "How many additional connects will be accepted per idle "
                   "worker thread"),
+    AP_INIT_FLAG("AsyncIOUring", set_use_uring, NULL, RSRC_CONF,
+                 "Whether the listener thread uses io_uring instead of the "
+                 "default pollset, if available"),
+    AP_INIT_TAKE1("WorkerQueueShards", set_queue_shards, NULL, RSRC_CONF,
+                  "Number of queues the worker threads are spread over, "
+                  "or 'auto' for one per CPU"),
     AP_GRACEFUL_SHUTDOWN_TIMEOUT_COMMAND,
     {NULL}
 };
@@ -0,0 +1,405 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "event_uring.h"
+
+#if HAVE_LIBURING
+
+#include "apr_portable.h"
+#include "apr_hash.h"
+#include "apr_thread_mutex.h"
+
+#include <poll.h>
+#include <liburing.h>
+
+/*
+ * Each descriptor in the set has a registration, which is the user_data
+ * of its poll requests.  A registration lives until the descriptor is
+ * removed *and* no request of it is in flight anymore, since completions
+ * may still refer to it after event_uring_remove() returned (they are
+ * ignored then).
+ */
+typedef struct uring_reg uring_reg;
+struct uring_reg {
+    const apr_pollfd_t *pfd;
+    uring_reg *next_free;
+    apr_uint32_t gen;           /* last event_uring_poll() returning it */
+    apr_int32_t result;         /* its index in the results then */
+    unsigned int active:1;      /* not removed */
+    unsigned int armed:1;       /* a poll request is in flight */
+    unsigned int delivered:1;   /* in the delivered array */
+};
+
+struct event_uring_t {
+    struct io_uring ring;
+    apr_pool_t *pool;
+    apr_thread_mutex_t *mutex;  /* everything below, and the SQ */
+    apr_hash_t *regs;           /* pfd => reg */
+    uring_reg *free_regs;
+    apr_pollfd_t *results;
+    uring_reg **delivered;      /* by the last poll, to re-arm or free */
+    apr_int32_t ndelivered;
+    apr_uint32_t max_results;
+    apr_uint32_t gen;
+    apr_os_thread_t poller;
+    int have_poller;
+};
+
+static apr_int16_t get_revent(unsigned int event)
+{
+    apr_int16_t rv = 0;
+
+    if (event & POLLIN)
+        rv |= APR_POLLIN;
+    if (event & POLLPRI)
+        rv |= APR_POLLPRI;
+    if (event & POLLOUT)
+        rv |= APR_POLLOUT;
+    if (event & POLLERR)
+        rv |= APR_POLLERR;
+    if (event & POLLHUP)
+        rv |= APR_POLLHUP;
+    if (event & POLLNVAL)
+        rv |= APR_POLLNVAL;
+
+    return rv;
+}
+
+static unsigned int get_event(apr_int16_t event)
+{
+    unsigned int rv = 0;
+
+    if (event & APR_POLLIN)
+        rv |= POLLIN;
+    if (event & APR_POLLPRI)
+        rv |= POLLPRI;
+    if (event & APR_POLLOUT)
+        rv |= POLLOUT;
+    /* POLLERR and POLLHUP are always reported */
+
+    return rv;
+}
+
+static int get_fd(const apr_pollfd_t *pfd)
+{
+    apr_os_sock_t fd;
+
+    if (pfd->desc_type == APR_POLL_SOCKET) {
+        apr_os_sock_get(&fd, pfd->desc.s);
+    }
+    else {
+        apr_os_file_get(&fd, pfd->desc.f);
+    }
+
+    return fd;
+}
+
+static struct io_uring_sqe *get_sqe(event_uring_t *uring)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&uring->ring);
+
+    if (!sqe) {
+        /* SQ full, make room */
+        io_uring_submit(&uring->ring);
+        sqe = io_uring_get_sqe(&uring->ring);
+    }
+
+    return sqe;
+}
+
+/* Called with the mutex held */
+static apr_status_t arm(event_uring_t *uring, uring_reg *reg)
+{
+    struct io_uring_sqe *sqe = get_sqe(uring);
+
+    if (!sqe) {
+        return APR_ENOMEM;
+    }
+    io_uring_prep_poll_add(sqe, get_fd(reg->pfd),
+                           get_event(reg->pfd->reqevents));
+    io_uring_sqe_set_data(sqe, reg);
+    reg->armed = 1;
+
+    return APR_SUCCESS;
+}
+
+/* Called with the mutex held */
+static void release(event_uring_t *uring, uring_reg *reg)
+{
+    if (!reg->active && !reg->armed && !reg->delivered) {
+        reg->next_free = uring->free_regs;
+        uring->free_regs = reg;
+    }
+}
+
+static int is_poller(event_uring_t *uring)
+{
+    return (uring->have_poller
+            && apr_os_thread_equal(uring->poller, apr_os_thread_current()));
+}
+
+static apr_status_t uring_cleanup(void *data)
+{
+    event_uring_t *uring = data;
+
+    io_uring_queue_exit(&uring->ring);
+    return APR_SUCCESS;
+}
+
+apr_status_t event_uring_create(event_uring_t **puring, apr_uint32_t size,
+                                apr_pool_t *p)
+{
+    event_uring_t *uring;
+    struct io_uring_params params;
+    apr_uint32_t entries;
+    apr_status_t rv;
+    int rc;
+
+    *puring = NULL;
+    uring = apr_pcalloc(p, sizeof(*uring));
+    uring->pool = p;
+
+    /* Each descriptor in the set has at most one request in flight, plus
+     * one to cancel it when removed before it completes.
+     */
+    for (entries = 64; entries < size && entries < 4096; entries <<= 1)
+        ;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+    rc = io_uring_queue_init_params(entries, &uring->ring, &params);
+    if (rc < 0) {
+        return APR_FROM_OS_ERROR(-rc);
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG)
+            || !(params.features & IORING_FEAT_NODROP)) {
+        /* Waiting with a timeout must not use the SQ, which is shared
+         * with the worker threads, and completions must not be lost.
+         */
+        io_uring_queue_exit(&uring->ring);
+        return APR_ENOTIMPL;
+    }
+    apr_pool_cleanup_register(p, uring, uring_cleanup,
+                              apr_pool_cleanup_null);
+
+    rv = apr_thread_mutex_create(&uring->mutex, APR_THREAD_MUTEX_DEFAULT, p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    uring->regs = apr_hash_make(p);
+    uring->max_results = params.cq_entries;
+    uring->results = apr_palloc(p, uring->max_results
+                                   * sizeof(apr_pollfd_t));
+    uring->delivered = apr_palloc(p, uring->max_results
+                                     * sizeof(uring_reg *));
+
+    *puring = uring;
+    return APR_SUCCESS;
+}
+
+apr_status_t event_uring_add(event_uring_t *uring, const apr_pollfd_t *pfd)
+{
+    uring_reg *reg;
+    apr_status_t rv;
+
+    apr_thread_mutex_lock(uring->mutex);
+
+    if (apr_hash_get(uring->regs, &pfd, sizeof(pfd))) {
+        apr_thread_mutex_unlock(uring->mutex);
+        return APR_EEXIST;
+    }
+
+    if (uring->free_regs) {
+        reg = uring->free_regs;
+        uring->free_regs = reg->next_free;
+        memset(reg, 0, sizeof(*reg));
+    }
+    else {
+        reg = apr_pcalloc(uring->pool, sizeof(*reg));
+    }
+    reg->pfd = pfd;
+    reg->gen = uring->gen - 1;
+
+    rv = arm(uring, reg);
+    if (rv == APR_SUCCESS) {
+        reg->active = 1;
+        apr_hash_set(uring->regs, &reg->pfd, sizeof(reg->pfd), reg);
+
+        /* The poller submits its own requests with the next wait, others
+         * can't wait for it.
+         */
+        if (!is_poller(uring)) {
+            io_uring_submit(&uring->ring);
+        }
+    }
+    else {
+        release(uring, reg);
+    }
+
+    apr_thread_mutex_unlock(uring->mutex);
+    return rv;
+}
+
+apr_status_t event_uring_remove(event_uring_t *uring,
+                                const apr_pollfd_t *pfd)
+{
+    uring_reg *reg;
+
+    apr_thread_mutex_lock(uring->mutex);
+
+    reg = apr_hash_get(uring->regs, &pfd, sizeof(pfd));
+    if (!reg) {
+        apr_thread_mutex_unlock(uring->mutex);
+        return APR_NOTFOUND;
+    }
+    apr_hash_set(uring->regs, &reg->pfd, sizeof(reg->pfd), NULL);
+    reg->active = 0;
+
+    if (reg->armed) {
+        /* The completion will be ignored, and the registration released
+         * then.  Note that the in flight request holds a reference to the
+         * file, which delays the close (and FIN) of the descriptor until
+         * the cancellation is processed, so others than the poller (who
+         * does with its next wait) submit it right away.
+         */
+        struct io_uring_sqe *sqe = get_sqe(uring);
+        if (sqe) {
+            io_uring_prep_poll_remove(sqe, (__u64)(apr_uintptr_t)reg);
+            io_uring_sqe_set_data(sqe, NULL);
+            if (!is_poller(uring)) {
+                io_uring_submit(&uring->ring);
+            }
+        }
+    }
+    else {
+        release(uring, reg);
+    }
+
+    apr_thread_mutex_unlock(uring->mutex);
+    return APR_SUCCESS;
+}
+
+apr_status_t event_uring_poll(event_uring_t *uring,
+                              apr_interval_time_t timeout,
+                              apr_int32_t *num,
+                              const apr_pollfd_t **descriptors)
+{
+    struct io_uring_cqe *cqe;
+    struct __kernel_timespec ts, *tsp = NULL;
+    apr_int32_t i, nresults = 0;
+    unsigned int head, seen = 0;
+    int rc;
+
+    *num = 0;
+    *descriptors = uring->results;
+
+    apr_thread_mutex_lock(uring->mutex);
+
+    if (!uring->have_poller) {
+        uring->poller = apr_os_thread_current();
+        uring->have_poller = 1;
+    }
+
+    /* Re-arm the descriptors returned by the last poll which are still
+     * in the set (level triggered), release the others.
+     */
+    for (i = 0; i < uring->ndelivered; i++) {
+        uring_reg *reg = uring->delivered[i];
+
+        reg->delivered = 0;
+        if (reg->active && !reg->armed) {
+            if (arm(uring, reg) != APR_SUCCESS) {
+                reg->active = 0;
+                apr_hash_set(uring->regs, &reg->pfd, sizeof(reg->pfd), NULL);
+            }
+        }
+        release(uring, reg);
+    }
+    uring->ndelivered = 0;
+
+    /* Submitting with the wait would save a syscall, but the SQ is shared
+     * with the other threads and the wait can't hold the mutex.  At least
+     * don't enter the kernel when there is nothing to submit.
+     */
+    rc = 0;
+    if (io_uring_sq_ready(&uring->ring)) {
+        rc = io_uring_submit(&uring->ring);
+    }
+    apr_thread_mutex_unlock(uring->mutex);
+    if (rc < 0) {
+        return APR_FROM_OS_ERROR(-rc);
+    }
+
+    if (timeout >= 0) {
+        ts.tv_sec = apr_time_sec(timeout);
+        ts.tv_nsec = apr_time_usec(timeout) * 1000;
+        tsp = &ts;
+    }
+    rc = io_uring_wait_cqe_timeout(&uring->ring, &cqe, tsp);
+    if (rc < 0) {
+        if (rc == -ETIME) {
+            return APR_TIMEUP;
+        }
+        return APR_FROM_OS_ERROR(-rc);
+    }
+
+    apr_thread_mutex_lock(uring->mutex);
+
+    uring->gen++;
+    io_uring_for_each_cqe(&uring->ring, head, cqe) {
+        uring_reg *reg = io_uring_cqe_get_data(cqe);
+        apr_int16_t rtnevents;
+
+        seen++;
+        if (!reg) {
+            /* completion of a removal */
+            continue;
+        }
+        reg->armed = 0;
+
+        if (!reg->active) {
+            release(uring, reg);
+            continue;
+        }
+
+        if (cqe->res >= 0) {
+            rtnevents = get_revent(cqe->res);
+        }
+        else {
+            rtnevents = APR_POLLERR;
+        }
+        if (reg->gen == uring->gen) {
+            uring->results[reg->result].rtnevents |= rtnevents;
+            continue;
+        }
+        reg->gen = uring->gen;
+        reg->result = nresults;
+        uring->results[nresults] = *reg->pfd;
+        uring->results[nresults].rtnevents = rtnevents;
+        nresults++;
+
+        reg->delivered = 1;
+        uring->delivered[uring->ndelivered++] = reg;
+    }
+    io_uring_cq_advance(&uring->ring, seen);
+
+    apr_thread_mutex_unlock(uring->mutex);
+
+    *num = nresults;
+    return nresults ? APR_SUCCESS : APR_TIMEUP;
+}
+
+#endif /* HAVE_LIBURING */
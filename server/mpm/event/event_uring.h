@@ -0,0 +1,60 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file  event/event_uring.h
+ * @brief io_uring based pollset for the listener thread
+ *
+ * A replacement for the APR_POLLSET_THREADSAFE | APR_POLLSET_NOCOPY
+ * pollset of the event MPM, with the same semantics (level triggered
+ * descriptors which stay in the set until they are removed), where the
+ * descriptors are watched with one shot poll requests on an io_uring:
+ * - the requests queued by the listener thread (removals, and re-arming
+ *   the descriptors it got events for) are submitted in a single batch
+ *   before the wait for the next events, rather than one epoll_ctl() each
+ *   (the submission and the wait are still two io_uring_enter() calls,
+ *   since the wait can't hold the lock on the SQ shared with the workers),
+ * - a descriptor which got an event and is removed before the next wait
+ *   (e.g. a keep-alive connection handed to a worker) costs nothing more.
+ *
+ * @addtogroup APACHE_MPM_EVENT
+ * @{
+ */
+
+#ifndef EVENT_URING_H
+#define EVENT_URING_H
+
+#include "httpd.h"
+#include "apr_poll.h"
+
+#if HAVE_LIBURING
+
+typedef struct event_uring_t event_uring_t;
+
+apr_status_t event_uring_create(event_uring_t **puring, apr_uint32_t size,
+                                apr_pool_t *p);
+apr_status_t event_uring_add(event_uring_t *uring, const apr_pollfd_t *pfd);
+apr_status_t event_uring_remove(event_uring_t *uring,
+                                const apr_pollfd_t *pfd);
+apr_status_t event_uring_poll(event_uring_t *uring,
+                              apr_interval_time_t timeout,
+                              apr_int32_t *num,
+                              const apr_pollfd_t **descriptors);
+
+#endif /* HAVE_LIBURING */
+
+#endif /* EVENT_URING_H */
+/** @} */
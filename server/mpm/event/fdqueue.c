@@ -303,16 +303,16 @@ apr_status_t ap_queue_info_term(fd_queue_info_t * queue_info)
 }
 
 /**
- * Detects when the fd_queue_t is full. This utility function is expected
- * to be called from within critical sections, and is not threadsafe.
+ * Detects when the fd_queue_shard_t is full. This utility function is
+ * expected to be called from within critical sections, and is not threadsafe.
  */
-#define ap_queue_full(queue) ((queue)->nelts == (queue)->bounds)
+#define ap_queue_full(shard) ((shard)->nelts == (shard)->bounds)
 
 /**
- * Detects when the fd_queue_t is empty. This utility function is expected
- * to be called from within critical sections, and is not threadsafe.
+ * Detects when the fd_queue_shard_t is empty. This utility function is
+ * expected to be called from within critical sections, and is not threadsafe.
  */
-#define ap_queue_empty(queue) ((queue)->nelts == 0 && APR_RING_EMPTY(&queue->timers ,timer_event_t, link))
+#define ap_queue_empty(shard) ((shard)->npending == 0)
 
 /**
  * Callback routine that is called to destroy this
@@ -321,12 +321,15 @@ apr_status_t ap_queue_info_term(fd_queue_info_t * queue_info)
 static apr_status_t ap_queue_destroy(void *data)
 {
     fd_queue_t *queue = data;
+    unsigned int i;
 
     /* Ignore errors here, we can't do anything about them anyway.
      * XXX: We should at least try to signal an error here, it is
      * indicative of a programmer error. -aaron */
-    apr_thread_cond_destroy(queue->not_empty);
-    apr_thread_mutex_destroy(queue->one_big_mutex);
+    for (i = 0; i < queue->nshards; ++i) {
+        apr_thread_cond_destroy(queue->shards[i]->not_empty);
+        apr_thread_mutex_destroy(queue->shards[i]->mutex);
+    }
 
     return APR_SUCCESS;
 }
@@ -335,31 +338,58 @@ static apr_status_t ap_queue_destroy(void *data)
  * Initialize the fd_queue_t.
  */
 apr_status_t ap_queue_init(fd_queue_t * queue, int queue_capacity,
-                           apr_pool_t * a)
+                           int nshards, apr_pool_t * a)
 {
-    int i;
+    int i, j;
     apr_status_t rv;
 
-    if ((rv = apr_thread_mutex_create(&queue->one_big_mutex,
-                                      APR_THREAD_MUTEX_DEFAULT,
-                                      a)) != APR_SUCCESS) {
-        return rv;
+    if (nshards < 1) {
+        nshards = 1;
     }
-    if ((rv = apr_thread_cond_create(&queue->not_empty, a)) != APR_SUCCESS) {
-        return rv;
+    if (nshards > queue_capacity) {
+        nshards = queue_capacity;
     }
 
-    APR_RING_INIT(&queue->timers, timer_event_t, link);
+    queue->shards = apr_palloc(a, nshards * sizeof(fd_queue_shard_t *));
+    queue->nshards = nshards;
+    queue->next = 0;
+    queue->terminated = 0;
 
-    queue->data = apr_palloc(a, queue_capacity * sizeof(fd_queue_elem_t));
-    queue->bounds = queue_capacity;
-    queue->nelts = 0;
-    queue->in = 0;
-    queue->out = 0;
+    for (i = 0; i < nshards; ++i) {
+        fd_queue_shard_t *shard;
+
+        /* Each shard is on its own cache line(s), so that the workers of
+         * different shards don't share anything but the listener's pushes.
+         */
+        shard = apr_pcalloc(a, APR_ALIGN(sizeof(*shard), FDQUEUE_CACHELINE)
+                               + FDQUEUE_CACHELINE);
+        shard = (fd_queue_shard_t *)APR_ALIGN((apr_uintptr_t)shard,
+                                              FDQUEUE_CACHELINE);
+
+        if ((rv = apr_thread_mutex_create(&shard->mutex,
+                                          APR_THREAD_MUTEX_DEFAULT,
+                                          a)) != APR_SUCCESS) {
+            return rv;
+        }
+        if ((rv = apr_thread_cond_create(&shard->not_empty,
+                                         a)) != APR_SUCCESS) {
+            return rv;
+        }
 
-    /* Set all the sockets in the queue to NULL */
-    for (i = 0; i < queue_capacity; ++i)
-        queue->data[i].sd = NULL;
+        APR_RING_INIT(&shard->timers, timer_event_t, link);
+
+        /* Any shard may have to hold all the queued sockets, when the
+         * listener can't find idle workers elsewhere.
+         */
+        shard->data = apr_palloc(a, queue_capacity * sizeof(fd_queue_elem_t));
+        shard->bounds = queue_capacity;
+
+        /* Set all the sockets in the queue to NULL */
+        for (j = 0; j < queue_capacity; ++j)
+            shard->data[j].sd = NULL;
+
+        queue->shards[i] = shard;
+    }
 
     apr_pool_cleanup_register(a, queue, ap_queue_destroy,
                               apr_pool_cleanup_null);
@@ -367,6 +397,68 @@ apr_status_t ap_queue_init(fd_queue_t * queue, int queue_capacity,
     return APR_SUCCESS;
 }
 
+/**
+ * Choose the shard to push to: the first one (round-robin) having more
+ * waiting workers than pending entries, or the next one if none has.
+ * The counters are read without locking, this is only a hint.
+ */
+static fd_queue_shard_t *queue_pick_shard(fd_queue_t *queue)
+{
+    unsigned int i, start;
+
+    if (queue->nshards == 1) {
+        return queue->shards[0];
+    }
+
+    start = apr_atomic_inc32(&queue->next) % queue->nshards;
+    for (i = 0; i < queue->nshards; ++i) {
+        fd_queue_shard_t *shard = queue->shards[(start + i) % queue->nshards];
+        if (apr_atomic_read32(&shard->waiters) > shard->npending) {
+            return shard;
+        }
+    }
+    return queue->shards[start];
+}
+
+/**
+ * Called after pushing to a shard which has not enough waiting workers
+ * for its pending entries: wake up a worker waiting on another shard (if
+ * any), which will then steal from the others before blocking again.
+ */
+static apr_status_t queue_kick(fd_queue_t *queue, fd_queue_shard_t *from)
+{
+    unsigned int i;
+    apr_status_t rv;
+
+    for (i = 0; i < queue->nshards; ++i) {
+        fd_queue_shard_t *shard = queue->shards[i];
+        /* Not a plain read: the pusher's update of the pending entries
+         * must be visible before the waiters are looked at, as the
+         * waiters raise their count before looking at the entries.
+         */
+        if (shard == from
+                || apr_atomic_add32(&shard->waiters, 0) <= shard->npending
+                                                           + shard->kicks) {
+            continue;
+        }
+
+        if ((rv = apr_thread_mutex_lock(shard->mutex)) != APR_SUCCESS) {
+            return rv;
+        }
+        if (apr_atomic_read32(&shard->waiters) > shard->npending
+                                                 + shard->kicks) {
+            shard->kicks++;
+            apr_thread_cond_signal(shard->not_empty);
+            return apr_thread_mutex_unlock(shard->mutex);
+        }
+        if ((rv = apr_thread_mutex_unlock(shard->mutex)) != APR_SUCCESS) {
+            return rv;
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
 /**
  * Push a new socket onto the queue.
  *
@@ -376,136 +468,280 @@ apr_status_t ap_queue_init(fd_queue_t * queue, int queue_capacity,
 apr_status_t ap_queue_push(fd_queue_t * queue, apr_socket_t * sd,
                            event_conn_state_t * ecs, apr_pool_t * p)
 {
+    fd_queue_shard_t *shard = queue_pick_shard(queue);
     fd_queue_elem_t *elem;
+    int kick;
     apr_status_t rv;
 
-    if ((rv = apr_thread_mutex_lock(queue->one_big_mutex)) != APR_SUCCESS) {
+    if ((rv = apr_thread_mutex_lock(shard->mutex)) != APR_SUCCESS) {
         return rv;
     }
 
     AP_DEBUG_ASSERT(!queue->terminated);
-    AP_DEBUG_ASSERT(!ap_queue_full(queue));
+    AP_DEBUG_ASSERT(!ap_queue_full(shard));
 
-    elem = &queue->data[queue->in];
-    queue->in++;
-    if (queue->in >= queue->bounds)
-        queue->in -= queue->bounds;
+    elem = &shard->data[shard->in];
+    shard->in++;
+    if (shard->in >= shard->bounds)
+        shard->in -= shard->bounds;
     elem->sd = sd;
     elem->ecs = ecs;
     elem->p = p;
-    queue->nelts++;
+    shard->nelts++;
+    shard->npending++;
 
-    apr_thread_cond_signal(queue->not_empty);
+    apr_thread_cond_signal(shard->not_empty);
+    /* The waiters already kicked are going to the other shards */
+    kick = (apr_atomic_read32(&shard->waiters) < shard->npending
+                                                 + shard->kicks);
 
-    if ((rv = apr_thread_mutex_unlock(queue->one_big_mutex)) != APR_SUCCESS) {
+    if ((rv = apr_thread_mutex_unlock(shard->mutex)) != APR_SUCCESS) {
         return rv;
     }
 
+    if (kick && queue->nshards > 1) {
+        return queue_kick(queue, shard);
+    }
+
     return APR_SUCCESS;
 }
 
 apr_status_t ap_queue_push_timer(fd_queue_t * queue, timer_event_t *te)
 {
+    fd_queue_shard_t *shard = queue_pick_shard(queue);
+    int kick;
     apr_status_t rv;
 
-    if ((rv = apr_thread_mutex_lock(queue->one_big_mutex)) != APR_SUCCESS) {
+    if ((rv = apr_thread_mutex_lock(shard->mutex)) != APR_SUCCESS) {
         return rv;
     }
 
     AP_DEBUG_ASSERT(!queue->terminated);
 
-    APR_RING_INSERT_TAIL(&queue->timers, te, timer_event_t, link);
+    APR_RING_INSERT_TAIL(&shard->timers, te, timer_event_t, link);
+    shard->npending++;
 
-    apr_thread_cond_signal(queue->not_empty);
+    apr_thread_cond_signal(shard->not_empty);
+    /* The waiters already kicked are going to the other shards */
+    kick = (apr_atomic_read32(&shard->waiters) < shard->npending
+                                                 + shard->kicks);
 
-    if ((rv = apr_thread_mutex_unlock(queue->one_big_mutex)) != APR_SUCCESS) {
+    if ((rv = apr_thread_mutex_unlock(shard->mutex)) != APR_SUCCESS) {
         return rv;
     }
 
+    if (kick && queue->nshards > 1) {
+        return queue_kick(queue, shard);
+    }
+
     return APR_SUCCESS;
 }
 
+/**
+ * Take the next entry (timers first) of a non-empty shard, with its
+ * mutex held.
+ */
+static void queue_take(fd_queue_shard_t *shard, apr_socket_t ** sd,
+                       event_conn_state_t ** ecs, apr_pool_t ** p,
+                       timer_event_t ** te_out)
+{
+    fd_queue_elem_t *elem;
+
+    *te_out = NULL;
+
+    if (!APR_RING_EMPTY(&shard->timers, timer_event_t, link)) {
+        *te_out = APR_RING_FIRST(&shard->timers);
+        APR_RING_REMOVE(*te_out, link);
+    }
+    else {
+        elem = &shard->data[shard->out];
+        shard->out++;
+        if (shard->out >= shard->bounds)
+            shard->out -= shard->bounds;
+        shard->nelts--;
+        *sd = elem->sd;
+        *ecs = elem->ecs;
+        *p = elem->p;
+#ifdef AP_DEBUG
+        elem->sd = NULL;
+        elem->p = NULL;
+#endif /* AP_DEBUG */
+    }
+    shard->npending--;
+}
+
+/**
+ * Try to take an entry from the shards other than 'own', starting with
+ * the next one.  Returns APR_EAGAIN if they are all empty.
+ */
+static apr_status_t queue_steal(fd_queue_t *queue, unsigned int own,
+                                apr_socket_t ** sd,
+                                event_conn_state_t ** ecs, apr_pool_t ** p,
+                                timer_event_t ** te_out)
+{
+    unsigned int i;
+    apr_status_t rv;
+
+    for (i = 1; i < queue->nshards; ++i) {
+        fd_queue_shard_t *shard = queue->shards[(own + i) % queue->nshards];
+
+        /* Unlocked peek first, most of the shards are empty most of
+         * the time.
+         */
+        if (!shard->npending) {
+            continue;
+        }
+        if ((rv = apr_thread_mutex_lock(shard->mutex)) != APR_SUCCESS) {
+            return rv;
+        }
+        if (!ap_queue_empty(shard)) {
+            queue_take(shard, sd, ecs, p, te_out);
+            return apr_thread_mutex_unlock(shard->mutex);
+        }
+        if ((rv = apr_thread_mutex_unlock(shard->mutex)) != APR_SUCCESS) {
+            return rv;
+        }
+    }
+
+    return APR_EAGAIN;
+}
+
 /**
  * Retrieves the next available socket from the queue. If there are no
  * sockets available, it will block until one becomes available.
  * Once retrieved, the socket is placed into the address specified by
  * 'sd'.
+ *
+ * The worker pops from its own shard (given by 'slot'), and when it's
+ * empty steals from the other shards before blocking.  The number of
+ * waiting workers of the shard is raised *before* looking at the others,
+ * so that either the worker finds what the listener pushed concurrently,
+ * or the listener sees it waiting and wakes it up (queue_kick()).  A
+ * worker kicked for another shard's entry which ends up with one of its
+ * own shard passes the kick on.
  */
-apr_status_t ap_queue_pop_something(fd_queue_t * queue, apr_socket_t ** sd,
+apr_status_t ap_queue_pop_something(fd_queue_t * queue, unsigned int slot,
+                                    apr_socket_t ** sd,
                                     event_conn_state_t ** ecs, apr_pool_t ** p,
                                     timer_event_t ** te_out)
 {
-    fd_queue_elem_t *elem;
+    unsigned int own = slot % queue->nshards;
+    fd_queue_shard_t *shard = queue->shards[own];
+    int kicked = 0;
     apr_status_t rv;
 
-    if ((rv = apr_thread_mutex_lock(queue->one_big_mutex)) != APR_SUCCESS) {
+    if ((rv = apr_thread_mutex_lock(shard->mutex)) != APR_SUCCESS) {
         return rv;
     }
 
-    /* Keep waiting until we wake up and find that the queue is not empty. */
-    if (ap_queue_empty(queue)) {
-        if (!queue->terminated) {
-            apr_thread_cond_wait(queue->not_empty, queue->one_big_mutex);
+    for (;;) {
+        if (!ap_queue_empty(shard)) {
+            queue_take(shard, sd, ecs, p, te_out);
+            if ((rv = apr_thread_mutex_unlock(shard->mutex)) != APR_SUCCESS
+                    || !kicked) {
+                return rv;
+            }
+            /* the entry we were kicked for is still waiting elsewhere */
+            return queue_kick(queue, shard);
         }
-        /* If we wake up and it's still empty, then we were interrupted */
-        if (ap_queue_empty(queue)) {
-            rv = apr_thread_mutex_unlock(queue->one_big_mutex);
-            if (rv != APR_SUCCESS) {
+
+        apr_atomic_inc32(&shard->waiters);
+
+        if (queue->nshards > 1) {
+            if ((rv = apr_thread_mutex_unlock(shard->mutex)) != APR_SUCCESS) {
+                apr_atomic_dec32(&shard->waiters);
                 return rv;
             }
-            if (queue->terminated) {
-                return APR_EOF; /* no more elements ever again */
+            rv = queue_steal(queue, own, sd, ecs, p, te_out);
+            if (rv != APR_EAGAIN) {
+                apr_atomic_dec32(&shard->waiters);
+                return rv;
             }
-            else {
-                return APR_EINTR;
+            if ((rv = apr_thread_mutex_lock(shard->mutex)) != APR_SUCCESS) {
+                apr_atomic_dec32(&shard->waiters);
+                return rv;
             }
         }
-    }
 
-    *te_out = NULL;
+        /* The other shards are drained before terminating too, their
+         * workers may have exited already.
+         */
+        if (ap_queue_empty(shard) && queue->terminated) {
+            apr_atomic_dec32(&shard->waiters);
+            rv = apr_thread_mutex_unlock(shard->mutex);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+            return APR_EOF; /* no more elements ever again */
+        }
 
-    if (!APR_RING_EMPTY(&queue->timers, timer_event_t, link)) {
-        *te_out = APR_RING_FIRST(&queue->timers);
-        APR_RING_REMOVE(*te_out, link);
-    }
-    else {
-        elem = &queue->data[queue->out];
-        queue->out++;
-        if (queue->out >= queue->bounds)
-            queue->out -= queue->bounds;
-        queue->nelts--;
-        *sd = elem->sd;
-        *ecs = elem->ecs;
-        *p = elem->p;
-#ifdef AP_DEBUG
-        elem->sd = NULL;
-        elem->p = NULL;
-#endif /* AP_DEBUG */
-    }
+        /* Keep waiting until we wake up and find that the queue is not
+         * empty, or we are asked to look at the other shards.
+         */
+        if (ap_queue_empty(shard) && !shard->kicks) {
+            apr_thread_cond_wait(shard->not_empty, shard->mutex);
+        }
+        apr_atomic_dec32(&shard->waiters);
+        if (shard->kicks) {
+            shard->kicks--;
+            kicked = 1;
+            continue;
+        }
 
-    rv = apr_thread_mutex_unlock(queue->one_big_mutex);
-    return rv;
+        /* If we wake up and it's still empty, then we were interrupted */
+        if (ap_queue_empty(shard) && !queue->terminated) {
+            rv = apr_thread_mutex_unlock(shard->mutex);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+            return APR_EINTR;
+        }
+    }
 }
 
 static apr_status_t queue_interrupt(fd_queue_t *queue, int all, int term)
 {
+    unsigned int i, first, n;
     apr_status_t rv;
 
-    if ((rv = apr_thread_mutex_lock(queue->one_big_mutex)) != APR_SUCCESS) {
-        return rv;
-    }
-    /* we must hold one_big_mutex when setting this... otherwise,
+    /* we must take the shards' mutex after setting this... otherwise,
      * we could end up setting it and waking everybody up just after a
      * would-be popper checks it but right before they block
      */
     if (term) {
         queue->terminated = 1;
     }
-    if (all)
-        apr_thread_cond_broadcast(queue->not_empty);
-    else
-        apr_thread_cond_signal(queue->not_empty);
-    return apr_thread_mutex_unlock(queue->one_big_mutex);
+    if (all) {
+        first = 0;
+        n = queue->nshards;
+    }
+    else {
+        /* wake up a worker of a shard having some waiting */
+        first = apr_atomic_inc32(&queue->next) % queue->nshards;
+        for (i = 0; i < queue->nshards; ++i) {
+            unsigned int k = (first + i) % queue->nshards;
+            if (apr_atomic_read32(&queue->shards[k]->waiters)) {
+                first = k;
+                break;
+            }
+        }
+        n = 1;
+    }
+    for (i = 0; i < n; ++i) {
+        fd_queue_shard_t *shard = queue->shards[(first + i) % queue->nshards];
+
+        if ((rv = apr_thread_mutex_lock(shard->mutex)) != APR_SUCCESS) {
+            return rv;
+        }
+        if (all)
+            apr_thread_cond_broadcast(shard->not_empty);
+        else
+            apr_thread_cond_signal(shard->not_empty);
+        if ((rv = apr_thread_mutex_unlock(shard->mutex)) != APR_SUCCESS) {
+            return rv;
+        }
+    }
+    return APR_SUCCESS;
 }
 
 apr_status_t ap_queue_interrupt_all(fd_queue_t * queue)
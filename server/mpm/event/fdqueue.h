@@ -74,7 +74,14 @@ struct timer_event_t
     apr_array_header_t *remove;
 };
 
-struct fd_queue_t
+#ifndef FDQUEUE_CACHELINE
+#define FDQUEUE_CACHELINE 64
+#endif
+
+/* A FIFO of sockets and timers, with its own mutex and condition, which
+ * the workers assigned to it pop from (and the others steal from).
+ */
+struct fd_queue_shard_t
 {
     APR_RING_HEAD(timers_t, timer_event_t) timers;
     fd_queue_elem_t *data;
@@ -82,9 +89,20 @@ struct fd_queue_t
     unsigned int bounds;
     unsigned int in;
     unsigned int out;
-    apr_thread_mutex_t *one_big_mutex;
+    unsigned int npending;      /* nelts + number of timers */
+    unsigned int kicks;         /* wake-ups to steal from other shards */
+    apr_uint32_t waiters;       /* workers blocked (or about to) in pop */
+    apr_thread_mutex_t *mutex;
     apr_thread_cond_t *not_empty;
-    int terminated;
+};
+typedef struct fd_queue_shard_t fd_queue_shard_t;
+
+struct fd_queue_t
+{
+    fd_queue_shard_t **shards;
+    unsigned int nshards;
+    apr_uint32_t next;          /* round-robin cursor of the pushes */
+    volatile int terminated;
 };
 typedef struct fd_queue_t fd_queue_t;
 
@@ -93,11 +111,12 @@ void ap_push_pool(fd_queue_info_t * queue_info,
                                     apr_pool_t * pool_to_recycle);
 
 apr_status_t ap_queue_init(fd_queue_t * queue, int queue_capacity,
-                           apr_pool_t * a);
+                           int nshards, apr_pool_t * a);
 apr_status_t ap_queue_push(fd_queue_t * queue, apr_socket_t * sd,
                            event_conn_state_t * ecs, apr_pool_t * p);
 apr_status_t ap_queue_push_timer(fd_queue_t *queue, timer_event_t *te);
-apr_status_t ap_queue_pop_something(fd_queue_t * queue, apr_socket_t ** sd,
+apr_status_t ap_queue_pop_something(fd_queue_t * queue, unsigned int slot,
+                                    apr_socket_t ** sd,
                                     event_conn_state_t ** ecs, apr_pool_t ** p,
                                     timer_event_t ** te);
 apr_status_t ap_queue_interrupt_all(fd_queue_t * queue);
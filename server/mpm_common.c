@@ -73,6 +73,8 @@
     APR_HOOK_LINK(mpm_unregister_poll_callback) \
     APR_HOOK_LINK(mpm_get_name) \
     APR_HOOK_LINK(mpm_resume_suspended) \
+    APR_HOOK_LINK(mpm_register_output_callback) \
+    APR_HOOK_LINK(mpm_register_input_callback) \
     APR_HOOK_LINK(end_generation) \
     APR_HOOK_LINK(child_status) \
     APR_HOOK_LINK(output_pending) \
@@ -110,6 +112,12 @@ AP_IMPLEMENT_HOOK_RUN_FIRST(apr_status_t, mpm_register_timed_callback,
 AP_IMPLEMENT_HOOK_RUN_FIRST(apr_status_t, mpm_resume_suspended,
                             (conn_rec *c),
                             (c), APR_ENOTIMPL)
+AP_IMPLEMENT_HOOK_RUN_FIRST(apr_status_t, mpm_register_output_callback,
+                            (conn_rec *c, ap_mpm_callback_fn_t *cbfn, void *baton),
+                            (c, cbfn, baton), APR_ENOTIMPL)
+AP_IMPLEMENT_HOOK_RUN_FIRST(apr_status_t, mpm_register_input_callback,
+                            (conn_rec *c, ap_mpm_callback_fn_t *cbfn, void *baton),
+                            (c, cbfn, baton), APR_ENOTIMPL)
 AP_IMPLEMENT_HOOK_RUN_FIRST(apr_status_t, mpm_register_poll_callback,
                             (apr_array_header_t *pds, ap_mpm_callback_fn_t *cbfn, void *baton),
                             (pds, cbfn, baton), APR_ENOTIMPL)
@@ -562,6 +570,18 @@ AP_DECLARE(apr_status_t) ap_mpm_resume_suspended(conn_rec *c)
     return ap_run_mpm_resume_suspended(c);
 }
 
+AP_DECLARE(apr_status_t) ap_mpm_register_output_callback(conn_rec *c,
+        ap_mpm_callback_fn_t *cbfn, void *baton)
+{
+    return ap_run_mpm_register_output_callback(c, cbfn, baton);
+}
+
+AP_DECLARE(apr_status_t) ap_mpm_register_input_callback(conn_rec *c,
+        ap_mpm_callback_fn_t *cbfn, void *baton)
+{
+    return ap_run_mpm_register_input_callback(c, cbfn, baton);
+}
+
 AP_DECLARE(apr_status_t) ap_mpm_register_timed_callback(apr_time_t t,
         ap_mpm_callback_fn_t *cbfn, void *baton)
 {
@@ -48,6 +48,7 @@
 #include "util_charset.h"
 #include "util_ebcdic.h"
 #include "scoreboard.h"
+#include "util_time.h"
 
 #if APR_HAVE_STDARG_H
 #include <stdarg.h>
@@ -1900,7 +1901,7 @@ AP_DECLARE(void) ap_set_last_modified(request_rec *r)
         apr_time_t mod_time = ap_rationalize_mtime(r, r->mtime);
         char *datestr = apr_palloc(r->pool, APR_RFC822_DATE_LEN);
 
-        apr_rfc822_date(datestr, mod_time);
+        ap_recent_rfc822_date(datestr, mod_time);
         apr_table_setn(r->headers_out, "Last-Modified", datestr);
     }
 }
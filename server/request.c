@@ -28,6 +28,10 @@
 #include "apr_strings.h"
 #include "apr_file_io.h"
 #include "apr_fnmatch.h"
+#include "apr_hash.h"
+#if APR_HAS_THREADS
+#include "apr_thread_mutex.h"
+#endif
 
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
@@ -46,6 +50,7 @@
 #include "util_script.h"
 #include "ap_expr.h"
 #include "mod_request.h"
+#include "scoreboard.h"
 
 #include "mod_core.h"
 #include "mod_auth.h"
@@ -435,6 +440,468 @@ static walk_cache_t *prep_walk_cache(apr_size_t t, request_rec *r)
     return cache;
 }
 
+/* The caches above live as long as the request, so each new request merges
+ * the same <Directory > and <Location > sections again.  With WalkCacheSize,
+ * each child also keeps the walked lists of its recent walks in an LRU, by
+ * kind of walk, vhost and path, with the merges allocated from the entry's
+ * own pool.  A fresh walk cache is seeded with the walked list of its path,
+ * so that each section matching in sequence reuses the merge rather than
+ * redoing it.  The matching itself, the stats and the .htaccess lookups are
+ * still done, so the result is always the one of a full walk; an entry is
+ * replaced when its walk doesn't match the same sections anymore.  The
+ * .htaccess parsed by the request are part of the walked list only when
+ * they come from the HtaccessCacheSize cache (the same configuration as
+ * long as the file doesn't change), and held by the entry then.
+ *
+ * The final merges onto r->per_dir_config are cached with the entry too,
+ * when the base is the vhost's defaults or the result of another entry used
+ * by the request (e.g. the directory walk for the second location walk).
+ *
+ * Entries are referenced by the LRU, the requests using their merges and
+ * the entries using their results as a base, and freed with the last one.
+ */
+#define WALK_RESULTS_MAX 4
+
+typedef struct walk_entry_t walk_entry_t;
+
+typedef struct walk_result_t {
+    ap_conf_vector_t *base;      /* per_dir_config merged onto */
+    ap_conf_vector_t *result;    /* ... and the result */
+    walk_entry_t *base_entry;    /* the entry owning base, if any */
+} walk_result_t;
+
+struct walk_entry_t {
+    walk_entry_t *prev, *next;   /* LRU ring, most recently used first */
+    apr_pool_t *pool;            /* of the entry and its merges */
+    const char *key;
+    apr_array_header_t *walked;  /* The list of walk_walked_t results */
+    int partial;                 /* walked stops before an uncached
+                                  * .htaccess */
+    int refs;
+    int nresults;
+    walk_result_t results[WALK_RESULTS_MAX];
+};
+
+typedef struct {
+    apr_pool_t *pool;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;   /* everything, and the entries' pools */
+#endif
+    apr_hash_t *entries;
+    walk_entry_t ring;
+    int count;
+    int max;
+} walk_lru_t;
+
+static walk_lru_t *walk_lru = NULL;
+
+/* The entries used by a request (and its internal redirects) */
+typedef struct walk_used_t {
+    walk_entry_t *entry;
+    struct walk_used_t *next;
+} walk_used_t;
+
+#define WALK_USED_KEY "ap_walk_cache_used"
+
+/* The entry (if any) and key of a walk */
+typedef struct walk_seed_t {
+    const char *key;
+    walk_entry_t *entry;
+} walk_seed_t;
+
+static APR_INLINE void walk_lru_lock(void)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(walk_lru->mutex);
+#endif
+}
+
+static APR_INLINE void walk_lru_unlock(void)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(walk_lru->mutex);
+#endif
+}
+
+/* Called with the mutex held */
+static void walk_entry_release(walk_entry_t *entry)
+{
+    if (--entry->refs == 0) {
+        int i;
+
+        for (i = 0; i < entry->nresults; ++i) {
+            if (entry->results[i].base_entry) {
+                walk_entry_release(entry->results[i].base_entry);
+            }
+        }
+        apr_pool_destroy(entry->pool);
+    }
+}
+
+/* Called with the mutex held */
+static void walk_entry_link(walk_entry_t *entry)
+{
+    entry->next = walk_lru->ring.next;
+    entry->prev = &walk_lru->ring;
+    entry->next->prev = entry;
+    walk_lru->ring.next = entry;
+}
+
+/* Called with the mutex held */
+static void walk_entry_unlink(walk_entry_t *entry)
+{
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    apr_hash_set(walk_lru->entries, entry->key, APR_HASH_KEY_STRING, NULL);
+    walk_lru->count--;
+    walk_entry_release(entry);
+}
+
+static apr_status_t walk_used_cleanup(void *data)
+{
+    walk_used_t *used;
+
+    if (!walk_lru) {
+        /* the child is exiting, the entries are gone already */
+        return APR_SUCCESS;
+    }
+
+    walk_lru_lock();
+    for (used = data; used; used = used->next) {
+        walk_entry_release(used->entry);
+    }
+    walk_lru_unlock();
+
+    return APR_SUCCESS;
+}
+
+/* Called with the mutex held, and a reference on entry for r */
+static void walk_entry_use(request_rec *r, walk_entry_t *entry)
+{
+    walk_used_t *used, *first;
+    void *data;
+
+    apr_pool_userdata_get(&data, WALK_USED_KEY, r->pool);
+    first = data;
+
+    used = apr_palloc(r->pool, sizeof(*used));
+    used->entry = entry;
+    if (first) {
+        /* after the head, which the cleanup was registered with */
+        used->next = first->next;
+        first->next = used;
+    }
+    else {
+        used->next = NULL;
+        apr_pool_userdata_setn(used, WALK_USED_KEY, walk_used_cleanup,
+                               r->pool);
+    }
+}
+
+/* Whether the request uses entry already */
+static int walk_entry_used(request_rec *r, walk_entry_t *entry)
+{
+    walk_used_t *used;
+    void *data;
+
+    apr_pool_userdata_get(&data, WALK_USED_KEY, r->pool);
+    for (used = data; used; used = used->next) {
+        if (used->entry == entry) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Called with the mutex held.  Whether base is stable, i.e. the vhost's
+ * defaults or the result of an entry used by the request (returned then).
+ */
+static int walk_base_stable(request_rec *r, ap_conf_vector_t *base,
+                            walk_entry_t **base_entry)
+{
+    walk_used_t *used;
+    void *data;
+    int i;
+
+    *base_entry = NULL;
+    if (base == r->server->lookup_defaults) {
+        return 1;
+    }
+    apr_pool_userdata_get(&data, WALK_USED_KEY, r->pool);
+    for (used = data; used; used = used->next) {
+        for (i = 0; i < used->entry->nresults; ++i) {
+            if (used->entry->results[i].result == base) {
+                *base_entry = used->entry;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Called with the mutex held */
+static ap_conf_vector_t *walk_entry_result(request_rec *r,
+                                           walk_entry_t *entry,
+                                           ap_conf_vector_t *base)
+{
+    walk_result_t *res;
+    walk_entry_t *base_entry;
+    int i;
+
+    for (i = 0; i < entry->nresults; ++i) {
+        if (entry->results[i].base == base) {
+            return entry->results[i].result;
+        }
+    }
+    if (entry->partial || entry->nresults == WALK_RESULTS_MAX
+        || !walk_base_stable(r, base, &base_entry)) {
+        return NULL;
+    }
+
+    res = &entry->results[entry->nresults++];
+    res->base = base;
+    res->base_entry = base_entry;
+    if (base_entry) {
+        base_entry->refs++;
+    }
+    if (entry->walked->nelts) {
+        res->result = ap_merge_per_dir_configs(entry->pool, base,
+                            ((walk_walked_t *)entry->walked->elts)
+                                            [entry->walked->nelts - 1].merged);
+    }
+    else {
+        res->result = base;
+    }
+    return res->result;
+}
+
+static void walk_cache_count(request_rec *r, int hit)
+{
+    worker_score *ws;
+
+    if (!ap_extended_status
+        || !(ws = ap_get_scoreboard_worker(r->connection->sbh))) {
+        return;
+    }
+    if (hit) {
+        ws->walk_cache_hits++;
+    }
+    else {
+        ws->walk_cache_misses++;
+    }
+}
+
+/* Find the entry of the walk's vhost and path, and seed the walk cache with
+ * its walked list if it's a fresh one.
+ */
+static void walk_cache_seed(request_rec *r, walk_cache_t *cache,
+                            apr_size_t t, const char *path,
+                            walk_seed_t *seed)
+{
+    walk_entry_t *entry;
+
+    seed->key = NULL;
+    seed->entry = NULL;
+    if (!walk_lru) {
+        return;
+    }
+
+    seed->key = apr_psprintf(r->pool, "%" APR_SIZE_T_FMT ":%pp:%s",
+                             t, r->server, path);
+
+    walk_lru_lock();
+    entry = apr_hash_get(walk_lru->entries, seed->key, APR_HASH_KEY_STRING);
+    if (entry) {
+        /* most recently used */
+        entry->prev->next = entry->next;
+        entry->next->prev = entry->prev;
+        walk_entry_link(entry);
+
+        if (!walk_entry_used(r, entry)) {
+            entry->refs++;
+            walk_entry_use(r, entry);
+        }
+    }
+    walk_lru_unlock();
+
+    if (entry) {
+        if (!cache->cached && !cache->walked->nelts) {
+            apr_array_cat(cache->walked, entry->walked);
+        }
+        seed->entry = entry;
+    }
+}
+
+/* Whether the dir_conf is one of the sections (configuration lifetime) or
+ * a cached .htaccess, then held until p is cleared if not NULL.  Other
+ * .htaccess live in the request's pool.
+ */
+static int walk_matched_stable(ap_conf_vector_t **sec_ent, int num_sec,
+                               ap_conf_vector_t *matched, apr_pool_t *p)
+{
+    int sec_idx;
+
+    for (sec_idx = 0; sec_idx < num_sec; ++sec_idx) {
+        if (sec_ent[sec_idx] == matched) {
+            return 1;
+        }
+    }
+    return ap_htaccess_cache_hold(matched, p);
+}
+
+/* Once the walk is done (cache->walked holding its result), reuse the final
+ * merge onto r->per_dir_config from the walk's entry, or replace the entry
+ * if it was not the same walk.  Returns whether r->per_dir_config was set.
+ */
+static int walk_cache_store(request_rec *r, walk_cache_t *cache,
+                            walk_seed_t *seed,
+                            ap_conf_vector_t **sec_ent, int num_sec)
+{
+    walk_walked_t *walked = (walk_walked_t *)cache->walked->elts;
+    int nelts = cache->walked->nelts;
+    walk_entry_t *entry = seed->entry;
+    ap_conf_vector_t *result;
+    apr_pool_t *pool;
+    int i;
+
+    if (entry) {
+        walk_walked_t *cached = (walk_walked_t *)entry->walked->elts;
+        int cached_nelts = entry->walked->nelts;
+        int in_sync = (nelts >= cached_nelts);
+
+        /* The walk matched the sections of the entry in sequence (whether
+         * or not it started from its merges, e.g. in a subrequest), then
+         * found the same .htaccess or nothing more.
+         */
+        for (i = 0; in_sync && i < cached_nelts; ++i) {
+            in_sync = (walked[i].matched == cached[i].matched);
+        }
+        if (in_sync && entry->partial) {
+            in_sync = (nelts > cached_nelts
+                       && !walk_matched_stable(sec_ent, num_sec,
+                                               walked[cached_nelts].matched,
+                                               NULL));
+        }
+        else if (in_sync) {
+            in_sync = (nelts == cached_nelts);
+        }
+
+        walk_cache_count(r, in_sync);
+        if (in_sync) {
+            walk_lru_lock();
+            result = walk_entry_result(r, entry, r->per_dir_config);
+            walk_lru_unlock();
+            if (result) {
+                r->per_dir_config = result;
+                return 1;
+            }
+            return 0;
+        }
+    }
+    else {
+        walk_cache_count(r, 0);
+    }
+
+    walk_lru_lock();
+    apr_pool_create(&pool, walk_lru->pool);
+    walk_lru_unlock();
+    apr_pool_tag(pool, "walk_cache");
+
+    /* The entry is private until linked, so the merges into its pool need
+     * no lock.
+     */
+    entry = apr_pcalloc(pool, sizeof(*entry));
+    entry->pool = pool;
+    entry->key = apr_pstrdup(pool, seed->key);
+    entry->walked = apr_array_make(pool, nelts ? nelts : 1,
+                                   sizeof(walk_walked_t));
+    for (i = 0; i < nelts; ++i) {
+        walk_walked_t *last_walk;
+
+        if (!walk_matched_stable(sec_ent, num_sec, walked[i].matched,
+                                 pool)) {
+            entry->partial = 1;
+            break;
+        }
+        last_walk = (walk_walked_t *)apr_array_push(entry->walked);
+        last_walk->matched = walked[i].matched;
+        if (i) {
+            last_walk->merged = ap_merge_per_dir_configs(pool,
+                                                         last_walk[-1].merged,
+                                                         walked[i].matched);
+        }
+        else {
+            last_walk->merged = walked[i].matched;
+        }
+    }
+
+    walk_lru_lock();
+
+    if (entry->partial && !entry->walked->nelts) {
+        /* nothing to reuse */
+        apr_pool_destroy(pool);
+        walk_lru_unlock();
+        return 0;
+    }
+
+    entry->refs = 1; /* this request */
+    walk_entry_use(r, entry);
+    result = walk_entry_result(r, entry, r->per_dir_config);
+
+    if (seed->entry
+        && apr_hash_get(walk_lru->entries, entry->key,
+                        APR_HASH_KEY_STRING) == seed->entry) {
+        walk_entry_unlink(seed->entry);
+    }
+    if (!apr_hash_get(walk_lru->entries, entry->key, APR_HASH_KEY_STRING)) {
+        entry->refs++; /* the LRU */
+        apr_hash_set(walk_lru->entries, entry->key, APR_HASH_KEY_STRING,
+                     entry);
+        walk_entry_link(entry);
+        walk_lru->count++;
+        while (walk_lru->count > walk_lru->max) {
+            walk_entry_unlink(walk_lru->ring.prev);
+        }
+    }
+    /* else stored by another thread meanwhile, ours is for this request */
+
+    walk_lru_unlock();
+
+    if (result) {
+        r->per_dir_config = result;
+        return 1;
+    }
+    return 0;
+}
+
+static apr_status_t walk_lru_cleanup(void *dummy)
+{
+    walk_lru = NULL;
+    return APR_SUCCESS;
+}
+
+AP_DECLARE(void) ap_walk_cache_child_init(apr_pool_t *pchild, int max)
+{
+    apr_pool_t *pool;
+
+    if (max <= 0) {
+        return;
+    }
+
+    apr_pool_create(&pool, pchild);
+    apr_pool_tag(pool, "walk_cache");
+    walk_lru = apr_pcalloc(pool, sizeof(*walk_lru));
+    walk_lru->pool = pool;
+#if APR_HAS_THREADS
+    apr_thread_mutex_create(&walk_lru->mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+#endif
+    walk_lru->entries = apr_hash_make(pool);
+    walk_lru->ring.next = walk_lru->ring.prev = &walk_lru->ring;
+    walk_lru->max = max;
+    apr_pool_cleanup_register(pool, NULL, walk_lru_cleanup,
+                              apr_pool_cleanup_null);
+}
+
 /*****************************************************************
  *
  * Getting and checking directory configuration.  Also checks the
@@ -601,6 +1068,7 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
     ap_conf_vector_t **sec_ent = (ap_conf_vector_t **) sconf->sec_dir->elts;
     int num_sec = sconf->sec_dir->nelts;
     walk_cache_t *cache;
+    walk_seed_t seed;
     char *entry_dir;
     apr_status_t rv;
     int cached;
@@ -680,6 +1148,7 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
     else if (r->filename[strlen(r->filename) - 1] != '/') {
         entry_dir = apr_pstrcat(r->pool, r->filename, "/", NULL);
     }
+    walk_cache_seed(r, cache, AP_NOTE_DIRECTORY_WALK, entry_dir, &seed);
 
     /* If we have a file already matches the path of r->filename,
      * and the vhost's list of directory sections hasn't changed,
@@ -1372,7 +1841,10 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
     /* Merge our cache->dir_conf_merged construct with the r->per_dir_configs,
      * and note the end result to (potentially) skip this step next time.
      */
-    if (now_merged) {
+    if (seed.key && walk_cache_store(r, cache, &seed, sec_ent, num_sec)) {
+        /* r->per_dir_config is the one of the previous requests */
+    }
+    else if (now_merged) {
         r->per_dir_config = ap_merge_per_dir_configs(r->pool,
                                                      r->per_dir_config,
                                                      now_merged);
@@ -1391,6 +1863,7 @@ AP_DECLARE(int) ap_location_walk(request_rec *r)
     ap_conf_vector_t **sec_ent = (ap_conf_vector_t **)sconf->sec_url->elts;
     int num_sec = sconf->sec_url->nelts;
     walk_cache_t *cache;
+    walk_seed_t seed;
     const char *entry_uri;
     int cached;
 
@@ -1418,6 +1891,7 @@ AP_DECLARE(int) ap_location_walk(request_rec *r)
         ap_no2slash(uri);
         entry_uri = uri;
     }
+    walk_cache_seed(r, cache, AP_NOTE_LOCATION_WALK, entry_uri, &seed);
 
     /* If we have an cache->cached location that matches r->uri,
      * and the vhost's list of locations hasn't changed, we can skip
@@ -1575,7 +2049,10 @@ AP_DECLARE(int) ap_location_walk(request_rec *r)
     /* Merge our cache->dir_conf_merged construct with the r->per_dir_configs,
      * and note the end result to (potentially) skip this step next time.
      */
-    if (now_merged) {
+    if (seed.key && walk_cache_store(r, cache, &seed, sec_ent, num_sec)) {
+        /* r->per_dir_config is the one of the previous requests */
+    }
+    else if (now_merged) {
         r->per_dir_config = ap_merge_per_dir_configs(r->pool,
                                                      r->per_dir_config,
                                                      now_merged);
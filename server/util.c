@@ -2182,6 +2182,74 @@ AP_DECLARE(apr_size_t) ap_escape_errorlog_item(char *dest, const char *source,
     return (d - (unsigned char *)dest);
 }
 
+AP_DECLARE(apr_size_t) ap_escape_logitem_buffer(char *dest, const char *source,
+                                                apr_size_t buflen)
+{
+    unsigned char *d, *ep;
+    const unsigned char *s;
+
+    if (!source || !buflen) { /* be safe */
+        return 0;
+    }
+
+    d = (unsigned char *)dest;
+    s = (const unsigned char *)source;
+    ep = d + buflen - 1;
+
+    for (; d < ep && *s; ++s) {
+        if (TEST_CHAR(*s, T_ESCAPE_LOGITEM)) {
+            switch(*s) {
+            case '\b':
+            case '\n':
+            case '\r':
+            case '\t':
+            case '\v':
+            case '\\':
+            case '"':
+                if (d + 2 > ep) {
+                    ep = d; /* break the for loop as well */
+                    break;
+                }
+                *d++ = '\\';
+                switch(*s) {
+                case '\b':
+                    *d++ = 'b';
+                    break;
+                case '\n':
+                    *d++ = 'n';
+                    break;
+                case '\r':
+                    *d++ = 'r';
+                    break;
+                case '\t':
+                    *d++ = 't';
+                    break;
+                case '\v':
+                    *d++ = 'v';
+                    break;
+                default:
+                    *d++ = *s;
+                }
+                break;
+            default:
+                if (d + 4 > ep) {
+                    ep = d; /* break the for loop as well */
+                    break;
+                }
+                *d++ = '\\';
+                c2x(*s, 'x', d);
+                d += 3;
+            }
+        }
+        else {
+            *d++ = *s;
+        }
+    }
+    *d = '\0';
+
+    return (d - (unsigned char *)dest);
+}
+
 AP_DECLARE(void) ap_bin2hex(const void *src, apr_size_t srclen, char *dest)
 {
     const unsigned char *in = src;
@@ -46,6 +46,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "httpd.h"
 #include "apr_strings.h"
 #include "apr_tables.h"
+#include "apr_thread_proc.h"
 #include "pcre.h"
 
 /* PCRE_DUPNAMES is only present since version 6.7 of PCRE */
@@ -60,6 +61,41 @@ POSSIBILITY OF SUCH DAMAGE.
 #define POSIX_MALLOC_THRESHOLD (10)
 #endif
 
+/* JIT stack sizes, PCRE uses 32K of the machine stack without one */
+#ifndef AP_PCRE_JIT_STACK_MIN
+#define AP_PCRE_JIT_STACK_MIN (32 * 1024)
+#endif
+#ifndef AP_PCRE_JIT_STACK_MAX
+#define AP_PCRE_JIT_STACK_MAX (512 * 1024)
+#endif
+
+#if defined(PCRE_STUDY_JIT_COMPILE) && defined(PCRE_CONFIG_JIT)
+#define HAVE_PCRE_JIT 1
+#endif
+
+/* What ap_regex_t.re_pcre points to */
+typedef struct {
+    pcre *re;
+    pcre_extra *extra;          /* from pcre_study(), may be NULL */
+} ap_pcre_t;
+
+/* Working store of ap_regexec(), reused by each thread */
+typedef struct {
+    int *ovector;
+    apr_size_t ovector_size;    /* in ints */
+#ifdef HAVE_PCRE_JIT
+    pcre_jit_stack *jit_stack;
+#endif
+} match_data_t;
+
+static int default_cflags = AP_REG_DEFAULT;
+
+#if APR_HAS_THREADS
+static apr_threadkey_t *match_data_key;
+#else
+static match_data_t *match_data;
+#endif
+
 /* Table of error strings corresponding to POSIX error codes; must be
  * kept in synch with include/ap_regex.h's AP_REG_E* definitions.
  */
@@ -112,13 +148,162 @@ AP_DECLARE(apr_size_t) ap_regerror(int errcode, const ap_regex_t *preg,
 
 
 
+AP_DECLARE(int) ap_regcomp_get_default_cflags(void)
+{
+    return default_cflags;
+}
+
+AP_DECLARE(void) ap_regcomp_set_default_cflags(int cflags)
+{
+    default_cflags = cflags;
+}
+
+AP_DECLARE(int) ap_regcomp_default_cflag_by_name(const char *name)
+{
+    if (!strcasecmp(name, "JIT")) {
+        return AP_REG_JIT;
+    }
+    return 0;
+}
+
+
+
+
+/*************************************************
+ *        Per-thread match working store         *
+ *************************************************/
+
+static void match_data_free(void *data)
+{
+    match_data_t *md = data;
+
+    if (md) {
+#ifdef HAVE_PCRE_JIT
+        if (md->jit_stack) {
+            pcre_jit_stack_free(md->jit_stack);
+        }
+#endif
+        free(md->ovector);
+        free(md);
+    }
+}
+
+#if APR_HAS_THREADS
+static apr_status_t match_data_cleanup(void *dummy)
+{
+    apr_threadkey_private_delete(match_data_key);
+    match_data_key = NULL;
+    return APR_SUCCESS;
+}
+#else
+static apr_status_t match_data_cleanup(void *dummy)
+{
+    match_data_free(match_data);
+    match_data = NULL;
+    return APR_SUCCESS;
+}
+#endif
+
+AP_DECLARE(apr_status_t) ap_regex_init(apr_pool_t *p)
+{
+#if APR_HAS_THREADS
+    apr_status_t rv;
+
+    if (match_data_key) {
+        return APR_SUCCESS;
+    }
+    rv = apr_threadkey_private_create(&match_data_key, match_data_free, p);
+    if (rv != APR_SUCCESS) {
+        match_data_key = NULL;
+        return rv;
+    }
+#endif
+    apr_pool_cleanup_register(p, NULL, match_data_cleanup,
+                              apr_pool_cleanup_null);
+    return APR_SUCCESS;
+}
+
+/* Returns NULL if ap_regex_init() wasn't called or we are out of memory,
+ * callers then fall back to their own working store.
+ */
+static match_data_t *get_match_data(void)
+{
+    match_data_t *md = NULL;
+
+#if APR_HAS_THREADS
+    if (!match_data_key) {
+        return NULL;
+    }
+    if (apr_threadkey_private_get((void **)&md, match_data_key) != APR_SUCCESS) {
+        return NULL;
+    }
+    if (!md) {
+        md = calloc(1, sizeof(*md));
+        if (md && apr_threadkey_private_set(md, match_data_key) != APR_SUCCESS) {
+            free(md);
+            md = NULL;
+        }
+    }
+#else
+    if (!match_data) {
+        match_data = calloc(1, sizeof(*match_data));
+    }
+    md = match_data;
+#endif
+
+    return md;
+}
+
+static int *get_match_ovector(match_data_t *md, apr_size_t size)
+{
+    if (md->ovector_size < size) {
+        int *ovector = realloc(md->ovector, size * sizeof(int));
+        if (ovector == NULL) {
+            return NULL;
+        }
+        md->ovector = ovector;
+        md->ovector_size = size;
+    }
+    return md->ovector;
+}
+
+#ifdef HAVE_PCRE_JIT
+static pcre_jit_stack *get_jit_stack(void *dummy)
+{
+    match_data_t *md = get_match_data();
+
+    if (md && !md->jit_stack) {
+        md->jit_stack = pcre_jit_stack_alloc(AP_PCRE_JIT_STACK_MIN,
+                                             AP_PCRE_JIT_STACK_MAX);
+    }
+    /* NULL makes PCRE use (a smaller stack on) the machine stack */
+    return md ? md->jit_stack : NULL;
+}
+#endif
+
+
+
+
 /*************************************************
  *           Free store held by a regex          *
  *************************************************/
 
 AP_DECLARE(void) ap_regfree(ap_regex_t *preg)
 {
-    (pcre_free)(preg->re_pcre);
+    ap_pcre_t *rx = preg->re_pcre;
+
+    if (rx) {
+        if (rx->extra) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+            pcre_free_study(rx->extra);
+#else
+            (pcre_free)(rx->extra);
+#endif
+        }
+        (pcre_free)(rx->re);
+        free(rx);
+        preg->re_pcre = NULL;
+    }
 }
 
 
@@ -143,6 +328,11 @@ AP_DECLARE(int) ap_regcomp(ap_regex_t * preg, const char *pattern, int cflags)
     int erroffset;
     int errcode = 0;
     int options = PCRE_DUPNAMES;
+    int study_options = 0;
+    ap_pcre_t *rx;
+    pcre *re;
+
+    cflags |= default_cflags;
 
     if ((cflags & AP_REG_ICASE) != 0)
         options |= PCRE_CASELESS;
@@ -151,11 +341,11 @@ AP_DECLARE(int) ap_regcomp(ap_regex_t * preg, const char *pattern, int cflags)
     if ((cflags & AP_REG_DOTALL) != 0)
         options |= PCRE_DOTALL;
 
-    preg->re_pcre =
-        pcre_compile2(pattern, options, &errcode, &errorptr, &erroffset, NULL);
+    preg->re_pcre = NULL;
+    re = pcre_compile2(pattern, options, &errcode, &errorptr, &erroffset, NULL);
     preg->re_erroffset = erroffset;
 
-    if (preg->re_pcre == NULL) {
+    if (re == NULL) {
         /*
          * There doesn't seem to be constants defined for compile time error
          * codes. 21 is "failed to get memory" according to pcreapi(3).
@@ -165,8 +355,34 @@ AP_DECLARE(int) ap_regcomp(ap_regex_t * preg, const char *pattern, int cflags)
         return AP_REG_INVARG;
     }
 
-    pcre_fullinfo((const pcre *)preg->re_pcre, NULL,
-                   PCRE_INFO_CAPTURECOUNT, &(preg->re_nsub));
+    rx = malloc(sizeof(*rx));
+    if (rx == NULL) {
+        (pcre_free)(re);
+        return AP_REG_ESPACE;
+    }
+    rx->re = re;
+
+#ifdef HAVE_PCRE_JIT
+    if ((cflags & AP_REG_JIT) != 0) {
+        int jit = 0;
+        if (pcre_config(PCRE_CONFIG_JIT, &jit) == 0 && jit) {
+            study_options |= PCRE_STUDY_JIT_COMPILE;
+        }
+    }
+#endif
+
+    /* Studying is done once, and a failure (or nothing to learn) just
+     * leaves us with the interpreter and no start-of-match optimizations.
+     */
+    rx->extra = pcre_study(re, study_options, &errorptr);
+#ifdef HAVE_PCRE_JIT
+    if (rx->extra && (rx->extra->flags & PCRE_EXTRA_EXECUTABLE_JIT)) {
+        pcre_assign_jit_stack(rx->extra, get_jit_stack, NULL);
+    }
+#endif
+    preg->re_pcre = rx;
+
+    pcre_fullinfo(re, rx->extra, PCRE_INFO_CAPTURECOUNT, &(preg->re_nsub));
     return 0;
 }
 
@@ -178,11 +394,16 @@ AP_DECLARE(int) ap_regcomp(ap_regex_t * preg, const char *pattern, int cflags)
  *************************************************/
 
 /* Unfortunately, PCRE requires 3 ints of working space for each captured
- * substring, so we have to get and release working store instead of just using
- * the POSIX structures as was done in earlier releases when PCRE needed only 2
- * ints. However, if the number of possible capturing brackets is small, use a
- * block of store on the stack, to reduce the use of malloc/free. The threshold
- * is in a macro that can be changed at configure time.
+ * substring, so we have to get working store instead of just using the POSIX
+ * structures as was done in earlier releases when PCRE needed only 2 ints.
+ * If the number of possible capturing brackets is small, use a block of store
+ * on the stack, otherwise the one of this thread set up by ap_regex_init(),
+ * and only get and release it when there is none. The threshold is in a macro
+ * that can be changed at configure time.
+ *
+ * The working store always has room for all the capturing brackets of the
+ * regex, even if fewer are asked for, so that PCRE doesn't have to allocate
+ * its own to handle back references.
  */
 AP_DECLARE(int) ap_regexec(const ap_regex_t *preg, const char *string,
                            apr_size_t nmatch, ap_regmatch_t *pmatch,
@@ -196,11 +417,13 @@ AP_DECLARE(int) ap_regexec_len(const ap_regex_t *preg, const char *buff,
                                apr_size_t len, apr_size_t nmatch,
                                ap_regmatch_t *pmatch, int eflags)
 {
+    const ap_pcre_t *rx = preg->re_pcre;
     int rc;
     int options = 0;
     int *ovector = NULL;
     int small_ovector[POSIX_MALLOC_THRESHOLD * 3];
     int allocated_ovector = 0;
+    apr_size_t ncaptures = nmatch;
 
     if ((eflags & AP_REG_NOTBOL) != 0)
         options |= PCRE_NOTBOL;
@@ -209,26 +432,44 @@ AP_DECLARE(int) ap_regexec_len(const ap_regex_t *preg, const char *buff,
 
     ((ap_regex_t *)preg)->re_erroffset = (apr_size_t)(-1);    /* Only has meaning after compile */
 
-    if (nmatch > 0) {
-        if (nmatch <= POSIX_MALLOC_THRESHOLD) {
-            ovector = &(small_ovector[0]);
-        }
-        else {
-            ovector = (int *)malloc(sizeof(int) * nmatch * 3);
+    if (ncaptures < (apr_size_t)preg->re_nsub + 1)
+        ncaptures = preg->re_nsub + 1;
+
+    if (ncaptures <= POSIX_MALLOC_THRESHOLD) {
+        ovector = &(small_ovector[0]);
+    }
+    else {
+        match_data_t *md = get_match_data();
+        if (md)
+            ovector = get_match_ovector(md, ncaptures * 3);
+        if (ovector == NULL) {
+            ovector = (int *)malloc(sizeof(int) * ncaptures * 3);
             if (ovector == NULL)
                 return AP_REG_ESPACE;
             allocated_ovector = 1;
         }
     }
 
-    rc = pcre_exec((const pcre *)preg->re_pcre, NULL, buff, (int)len,
-                   0, options, ovector, nmatch * 3);
+    rc = pcre_exec(rx->re, rx->extra, buff, (int)len,
+                   0, options, ovector, ncaptures * 3);
+
+#ifdef HAVE_PCRE_JIT
+    if (rc == PCRE_ERROR_JIT_STACKLIMIT) {
+        /* The interpreter isn't bound by the JIT stack, retry with it */
+        pcre_extra nojit = *rx->extra;
+        nojit.flags &= ~PCRE_EXTRA_EXECUTABLE_JIT;
+        rc = pcre_exec(rx->re, &nojit, buff, (int)len,
+                       0, options, ovector, ncaptures * 3);
+    }
+#endif
 
     if (rc == 0)
-        rc = nmatch;            /* All captured slots were filled in */
+        rc = ncaptures;         /* All captured slots were filled in */
 
     if (rc >= 0) {
         apr_size_t i;
+        if ((apr_size_t)rc > nmatch)
+            rc = nmatch;
         for (i = 0; i < (apr_size_t)rc; i++) {
             pmatch[i].rm_so = ovector[i * 2];
             pmatch[i].rm_eo = ovector[i * 2 + 1];
@@ -278,17 +519,15 @@ AP_DECLARE(int) ap_regname(const ap_regex_t *preg,
                            apr_array_header_t *names, const char *prefix,
                            int upper)
 {
+    const ap_pcre_t *rx = preg->re_pcre;
     int namecount;
     int nameentrysize;
     int i;
     char *nametable;
 
-    pcre_fullinfo((const pcre *)preg->re_pcre, NULL,
-                       PCRE_INFO_NAMECOUNT, &namecount);
-    pcre_fullinfo((const pcre *)preg->re_pcre, NULL,
-                       PCRE_INFO_NAMEENTRYSIZE, &nameentrysize);
-    pcre_fullinfo((const pcre *)preg->re_pcre, NULL,
-                       PCRE_INFO_NAMETABLE, &nametable);
+    pcre_fullinfo(rx->re, rx->extra, PCRE_INFO_NAMECOUNT, &namecount);
+    pcre_fullinfo(rx->re, rx->extra, PCRE_INFO_NAMEENTRYSIZE, &nameentrysize);
+    pcre_fullinfo(rx->re, rx->extra, PCRE_INFO_NAMETABLE, &nametable);
 
     for (i = 0; i < namecount; i++) {
         const char *offset = nametable + i * nameentrysize;
@@ -16,6 +16,7 @@
 
 #include "util_time.h"
 #include "apr_env.h"
+#include "apr_atomic.h"
 
 
 
@@ -52,6 +53,30 @@ static struct exploded_time_cache_element exploded_cache_localtime[TIME_CACHE_SI
 static struct exploded_time_cache_element exploded_cache_gmt[TIME_CACHE_SIZE];
 
 
+/* Cache for the formatted strings of recent timestamps
+ */
+
+struct formatted_time_cache_element {
+    apr_uint32_t seq;       /* odd while the element is being updated */
+    apr_int64_t t;
+    char clf[AP_CLF_DATE_LEN];
+    char ctime[APR_CTIME_LEN];
+    char compact[AP_CTIME_COMPACT_LEN];
+    char rfc822[APR_RFC822_DATE_LEN];
+};
+
+static struct formatted_time_cache_element formatted_cache[TIME_CACHE_SIZE];
+
+/* Orders the reads of the sequence number and of the element it guards */
+#if defined(__ATOMIC_ACQUIRE)
+#define formatted_cache_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#else
+static apr_uint32_t formatted_cache_fence;
+#define formatted_cache_rmb() \
+    ((void)apr_atomic_cas32(&formatted_cache_fence, 0, 0))
+#endif
+
+
 static apr_status_t cached_explode(apr_time_exp_t *xt, apr_time_t t,
                                    struct exploded_time_cache_element *cache,
                                    int use_gmt)
@@ -155,54 +180,19 @@ AP_DECLARE(apr_status_t) ap_explode_recent_gmt(apr_time_exp_t * tm,
     return cached_explode(tm, t, exploded_cache_gmt, 1);
 }
 
-AP_DECLARE(apr_status_t) ap_recent_ctime(char *date_str, apr_time_t t)
+static void format_ctime(char *date_str, const apr_time_exp_t *xt, int option)
 {
-    int len = APR_CTIME_LEN;
-    return ap_recent_ctime_ex(date_str, t, AP_CTIME_OPTION_NONE, &len);
-}
-
-AP_DECLARE(apr_status_t) ap_recent_ctime_ex(char *date_str, apr_time_t t,
-                                            int option, int *len)
-{
-    /* ### This code is a clone of apr_ctime(), except that it
-     * uses ap_explode_recent_localtime() instead of apr_time_exp_lt().
-     */
-    apr_time_exp_t xt;
     const char *s;
     int real_year;
-    int needed;
-
-
-    /* Calculate the needed buffer length */
-    if (option & AP_CTIME_OPTION_COMPACT)
-        needed = AP_CTIME_COMPACT_LEN;
-    else
-        needed = APR_CTIME_LEN;
-
-    if (option & AP_CTIME_OPTION_USEC) {
-        needed += AP_CTIME_USEC_LENGTH;
-    }
-
-    /* Check the provided buffer length */
-    if (len && *len >= needed) {
-        *len = needed;
-    }
-    else {
-        if (len != NULL) {
-            *len = 0;
-        }
-        return APR_ENOMEM;
-    }
 
     /* example without options: "Wed Jun 30 21:49:08 1993" */
     /*                           123456789012345678901234  */
     /* example for compact format: "1993-06-30 21:49:08" */
     /*                              1234567890123456789  */
 
-    ap_explode_recent_localtime(&xt, t);
-    real_year = 1900 + xt.tm_year;
+    real_year = 1900 + xt->tm_year;
     if (option & AP_CTIME_OPTION_COMPACT) {
-        int real_month = xt.tm_mon + 1;
+        int real_month = xt->tm_mon + 1;
         *date_str++ = real_year / 1000 + '0';
         *date_str++ = real_year % 1000 / 100 + '0';
         *date_str++ = real_year % 100 / 10 + '0';
@@ -213,31 +203,31 @@ AP_DECLARE(apr_status_t) ap_recent_ctime_ex(char *date_str, apr_time_t t,
         *date_str++ = '-';
     }
     else {
-        s = &apr_day_snames[xt.tm_wday][0];
+        s = &apr_day_snames[xt->tm_wday][0];
         *date_str++ = *s++;
         *date_str++ = *s++;
         *date_str++ = *s++;
         *date_str++ = ' ';
-        s = &apr_month_snames[xt.tm_mon][0];
+        s = &apr_month_snames[xt->tm_mon][0];
         *date_str++ = *s++;
         *date_str++ = *s++;
         *date_str++ = *s++;
         *date_str++ = ' ';
     }
-    *date_str++ = xt.tm_mday / 10 + '0';
-    *date_str++ = xt.tm_mday % 10 + '0';
+    *date_str++ = xt->tm_mday / 10 + '0';
+    *date_str++ = xt->tm_mday % 10 + '0';
     *date_str++ = ' ';
-    *date_str++ = xt.tm_hour / 10 + '0';
-    *date_str++ = xt.tm_hour % 10 + '0';
+    *date_str++ = xt->tm_hour / 10 + '0';
+    *date_str++ = xt->tm_hour % 10 + '0';
     *date_str++ = ':';
-    *date_str++ = xt.tm_min / 10 + '0';
-    *date_str++ = xt.tm_min % 10 + '0';
+    *date_str++ = xt->tm_min / 10 + '0';
+    *date_str++ = xt->tm_min % 10 + '0';
     *date_str++ = ':';
-    *date_str++ = xt.tm_sec / 10 + '0';
-    *date_str++ = xt.tm_sec % 10 + '0';
+    *date_str++ = xt->tm_sec / 10 + '0';
+    *date_str++ = xt->tm_sec % 10 + '0';
     if (option & AP_CTIME_OPTION_USEC) {
         int div;
-        int usec = (int)xt.tm_usec;
+        int usec = (int)xt->tm_usec;
         *date_str++ = '.';
         for (div=100000; div>0; div=div/10) {
             *date_str++ = usec / div + '0';
@@ -252,58 +242,293 @@ AP_DECLARE(apr_status_t) ap_recent_ctime_ex(char *date_str, apr_time_t t,
         *date_str++ = real_year % 10 + '0';
     }
     *date_str++ = 0;
-
-    return APR_SUCCESS;
 }
 
-AP_DECLARE(apr_status_t) ap_recent_rfc822_date(char *date_str, apr_time_t t)
+static void format_rfc822(char *date_str, const apr_time_exp_t *xt)
 {
-    /* ### This code is a clone of apr_rfc822_date(), except that it
-     * uses ap_explode_recent_gmt() instead of apr_time_exp_gmt().
-     */
-    apr_time_exp_t xt;
+    /* ### This code is a clone of apr_rfc822_date() */
     const char *s;
     int real_year;
 
-    ap_explode_recent_gmt(&xt, t);
-
     /* example: "Sat, 08 Jan 2000 18:31:41 GMT" */
     /*           12345678901234567890123456789  */
 
-    s = &apr_day_snames[xt.tm_wday][0];
+    s = &apr_day_snames[xt->tm_wday][0];
     *date_str++ = *s++;
     *date_str++ = *s++;
     *date_str++ = *s++;
     *date_str++ = ',';
     *date_str++ = ' ';
-    *date_str++ = xt.tm_mday / 10 + '0';
-    *date_str++ = xt.tm_mday % 10 + '0';
+    *date_str++ = xt->tm_mday / 10 + '0';
+    *date_str++ = xt->tm_mday % 10 + '0';
     *date_str++ = ' ';
-    s = &apr_month_snames[xt.tm_mon][0];
+    s = &apr_month_snames[xt->tm_mon][0];
     *date_str++ = *s++;
     *date_str++ = *s++;
     *date_str++ = *s++;
     *date_str++ = ' ';
-    real_year = 1900 + xt.tm_year;
+    real_year = 1900 + xt->tm_year;
     /* This routine isn't y10k ready. */
     *date_str++ = real_year / 1000 + '0';
     *date_str++ = real_year % 1000 / 100 + '0';
     *date_str++ = real_year % 100 / 10 + '0';
     *date_str++ = real_year % 10 + '0';
     *date_str++ = ' ';
-    *date_str++ = xt.tm_hour / 10 + '0';
-    *date_str++ = xt.tm_hour % 10 + '0';
+    *date_str++ = xt->tm_hour / 10 + '0';
+    *date_str++ = xt->tm_hour % 10 + '0';
     *date_str++ = ':';
-    *date_str++ = xt.tm_min / 10 + '0';
-    *date_str++ = xt.tm_min % 10 + '0';
+    *date_str++ = xt->tm_min / 10 + '0';
+    *date_str++ = xt->tm_min % 10 + '0';
     *date_str++ = ':';
-    *date_str++ = xt.tm_sec / 10 + '0';
-    *date_str++ = xt.tm_sec % 10 + '0';
+    *date_str++ = xt->tm_sec / 10 + '0';
+    *date_str++ = xt->tm_sec % 10 + '0';
     *date_str++ = ' ';
     *date_str++ = 'G';
     *date_str++ = 'M';
     *date_str++ = 'T';
     *date_str++ = 0;
+}
+
+static void format_clf(char *date_str, const apr_time_exp_t *xt)
+{
+    const char *s;
+    int real_year, timz;
+
+    /* example: "[08/Jan/2000:18:31:41 +0100]" */
+    /*           1234567890123456789012345678  */
+
+    *date_str++ = '[';
+    *date_str++ = xt->tm_mday / 10 + '0';
+    *date_str++ = xt->tm_mday % 10 + '0';
+    *date_str++ = '/';
+    s = &apr_month_snames[xt->tm_mon][0];
+    *date_str++ = *s++;
+    *date_str++ = *s++;
+    *date_str++ = *s++;
+    *date_str++ = '/';
+    real_year = 1900 + xt->tm_year;
+    *date_str++ = real_year / 1000 + '0';
+    *date_str++ = real_year % 1000 / 100 + '0';
+    *date_str++ = real_year % 100 / 10 + '0';
+    *date_str++ = real_year % 10 + '0';
+    *date_str++ = ':';
+    *date_str++ = xt->tm_hour / 10 + '0';
+    *date_str++ = xt->tm_hour % 10 + '0';
+    *date_str++ = ':';
+    *date_str++ = xt->tm_min / 10 + '0';
+    *date_str++ = xt->tm_min % 10 + '0';
+    *date_str++ = ':';
+    *date_str++ = xt->tm_sec / 10 + '0';
+    *date_str++ = xt->tm_sec % 10 + '0';
+    *date_str++ = ' ';
+    timz = xt->tm_gmtoff;
+    if (timz < 0) {
+        timz = -timz;
+        *date_str++ = '-';
+    }
+    else {
+        *date_str++ = '+';
+    }
+    timz /= 60;
+    *date_str++ = timz / 600 % 10 + '0';
+    *date_str++ = timz / 60 % 10 + '0';
+    *date_str++ = timz % 60 / 10 + '0';
+    *date_str++ = timz % 10 + '0';
+    *date_str++ = ']';
+    *date_str++ = 0;
+}
+
+static void format_time_cache_element(
+                    struct formatted_time_cache_element *element,
+                    apr_time_t t)
+{
+    apr_time_exp_t xt;
+
+    ap_explode_recent_localtime(&xt, t);
+    format_clf(element->clf, &xt);
+    format_ctime(element->ctime, &xt, AP_CTIME_OPTION_NONE);
+    format_ctime(element->compact, &xt, AP_CTIME_OPTION_COMPACT);
+
+    ap_explode_recent_gmt(&xt, t);
+    format_rfc822(element->rfc822, &xt);
+}
+
+#define FORMAT_CLF      0
+#define FORMAT_CTIME    1
+#define FORMAT_COMPACT  2
+#define FORMAT_RFC822   3
+
+static void copy_formatted(char *date_str,
+                           const struct formatted_time_cache_element *element,
+                           int format)
+{
+    switch (format) {
+    case FORMAT_CLF:
+        memcpy(date_str, element->clf, AP_CLF_DATE_LEN);
+        break;
+    case FORMAT_CTIME:
+        memcpy(date_str, element->ctime, APR_CTIME_LEN);
+        break;
+    case FORMAT_COMPACT:
+        memcpy(date_str, element->compact, AP_CTIME_COMPACT_LEN);
+        break;
+    default:
+        memcpy(date_str, element->rfc822, APR_RFC822_DATE_LEN);
+        break;
+    }
+}
+
+/* Format a time that is not among the recent seconds, e.g. a Last-Modified,
+ * in the one format needed, rather than filling a cache element with all
+ * of them that would not be used again.
+ */
+static void format_uncached(char *date_str, apr_time_t t, int format)
+{
+    apr_time_exp_t xt;
+
+    if (format == FORMAT_RFC822) {
+        apr_rfc822_date(date_str, t);
+        return;
+    }
+    apr_time_exp_lt(&xt, t);
+    switch (format) {
+    case FORMAT_CLF:
+        format_clf(date_str, &xt);
+        break;
+    case FORMAT_CTIME:
+        format_ctime(date_str, &xt, AP_CTIME_OPTION_NONE);
+        break;
+    default:
+        format_ctime(date_str, &xt, AP_CTIME_OPTION_COMPACT);
+        break;
+    }
+}
+
+/* Like cached_explode(), for the formatted strings: the element of the
+ * current second is formatted once, by the first thread to need it, and
+ * then copied by the others. Only the recent seconds go through the cache,
+ * older (or future) times are formatted directly.  Rather than the
+ * snapshot check above, the element is guarded by a sequence number which
+ * the writer makes odd while it updates the element, and which readers
+ * check is the same (and even) before and after they copy it; otherwise
+ * they format the time themselves.
+ */
+static void cached_format(char *date_str, apr_time_t t, int format)
+{
+    apr_int64_t seconds = apr_time_sec(t);
+    struct formatted_time_cache_element *cache_element =
+        &(formatted_cache[seconds & TIME_CACHE_MASK]);
+    struct formatted_time_cache_element fresh;
+    apr_int64_t now = apr_time_sec(apr_time_now());
+    apr_uint32_t seq;
+
+    if (seconds > now || seconds + AP_TIME_RECENT_THRESHOLD < now) {
+        format_uncached(date_str, t, format);
+        return;
+    }
+
+    seq = apr_atomic_read32(&cache_element->seq);
+    formatted_cache_rmb();
+    if (!(seq & 1) && cache_element->t == seconds) {
+        copy_formatted(date_str, cache_element, format);
+        formatted_cache_rmb();
+        if (apr_atomic_read32(&cache_element->seq) == seq) {
+            return;
+        }
+    }
+
+    format_time_cache_element(&fresh, t);
+    copy_formatted(date_str, &fresh, format);
+
+    /* Only a newer second replaces the element, and only one writer
+     * does it at a time.
+     */
+    if (!(seq & 1) && cache_element->t < seconds
+            && apr_atomic_cas32(&cache_element->seq, seq + 1, seq) == seq) {
+        cache_element->t = seconds;
+        memcpy(cache_element->clf, fresh.clf, sizeof(fresh.clf));
+        memcpy(cache_element->ctime, fresh.ctime, sizeof(fresh.ctime));
+        memcpy(cache_element->compact, fresh.compact,
+               sizeof(fresh.compact));
+        memcpy(cache_element->rfc822, fresh.rfc822, sizeof(fresh.rfc822));
+        apr_atomic_inc32(&cache_element->seq);
+    }
+}
+
+AP_DECLARE(apr_status_t) ap_recent_ctime(char *date_str, apr_time_t t)
+{
+    int len = APR_CTIME_LEN;
+    return ap_recent_ctime_ex(date_str, t, AP_CTIME_OPTION_NONE, &len);
+}
+
+AP_DECLARE(apr_status_t) ap_recent_ctime_ex(char *date_str, apr_time_t t,
+                                            int option, int *len)
+{
+    int needed;
+
+
+    /* Calculate the needed buffer length */
+    if (option & AP_CTIME_OPTION_COMPACT)
+        needed = AP_CTIME_COMPACT_LEN;
+    else
+        needed = APR_CTIME_LEN;
+
+    if (option & AP_CTIME_OPTION_USEC) {
+        needed += AP_CTIME_USEC_LENGTH;
+    }
+
+    /* Check the provided buffer length */
+    if (len && *len >= needed) {
+        *len = needed;
+    }
+    else {
+        if (len != NULL) {
+            *len = 0;
+        }
+        return APR_ENOMEM;
+    }
+
+    if (option & AP_CTIME_OPTION_COMPACT) {
+        cached_format(date_str, t, FORMAT_COMPACT);
+        if (option & AP_CTIME_OPTION_USEC) {
+            /* append to "1993-06-30 21:49:08" */
+            date_str += AP_CTIME_COMPACT_LEN - 1;
+        }
+    }
+    else {
+        cached_format(date_str, t, FORMAT_CTIME);
+        if (option & AP_CTIME_OPTION_USEC) {
+            /* insert before the year of "Wed Jun 30 21:49:08 1993" */
+            memmove(date_str + APR_CTIME_LEN - 6 + AP_CTIME_USEC_LENGTH,
+                    date_str + APR_CTIME_LEN - 6, 6);
+            date_str += APR_CTIME_LEN - 6;
+        }
+    }
+    if (option & AP_CTIME_OPTION_USEC) {
+        int div;
+        int usec = (int)apr_time_usec(t);
+        *date_str++ = '.';
+        for (div=100000; div>0; div=div/10) {
+            *date_str++ = usec / div + '0';
+            usec = usec % div;
+        }
+        if (option & AP_CTIME_OPTION_COMPACT) {
+            *date_str = 0;
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+AP_DECLARE(apr_status_t) ap_recent_rfc822_date(char *date_str, apr_time_t t)
+{
+    cached_format(date_str, t, FORMAT_RFC822);
+    return APR_SUCCESS;
+}
+
+AP_DECLARE(apr_status_t) ap_recent_clf_date(char *date_str, apr_time_t t)
+{
+    cached_format(date_str, t, FORMAT_CLF);
     return APR_SUCCESS;
 }
 
@@ -23,6 +23,7 @@
 #include "apr.h"
 #include "apr_strings.h"
 #include "apr_lib.h"
+#include "apr_hash.h"
 
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
@@ -52,11 +53,41 @@
  * lists of name-vhosts.
  */
 typedef struct name_chain name_chain;
+typedef struct name_index name_index;
 struct name_chain {
     name_chain *next;
     server_addr_rec *sar;       /* the record causing it to be in
                                  * this chain (needed for port comparisons) */
     server_rec *server;         /* the server to use on a match */
+    name_index *index;          /* only set on the head of long chains */
+};
+
+/* An entry of the name_chain, with its position in the chain so that the
+ * first match in chain order can be found across the tables below.
+ */
+typedef struct {
+    int pos;
+    name_chain *nc;
+} name_cand;
+
+typedef struct {
+    const char *pattern;
+    name_cand cand;
+} wild_cand;
+
+/* Index of the ServerName/ServerAlias of the name-vhosts sharing an
+ * address, so that check_hostalias() doesn't have to walk the whole
+ * name_chain.  The hashes map lowercased names to arrays of name_cand,
+ * in chain order.
+ */
+struct name_index {
+    int nentries;               /* length of the name_chain */
+    name_chain **entries;       /* the name_chain by position */
+    apr_hash_t *exact;          /* ServerName and plain ServerAlias */
+    apr_hash_t *suffix;         /* "*suffix" wildcard aliases, by suffix */
+    apr_array_header_t *suffix_lens; /* distinct suffix lengths, int */
+    apr_array_header_t *wild;   /* other wildcard aliases, wild_cand */
+    apr_hash_t *virthost;       /* the addresses from <VirtualHost> */
 };
 
 /* meta-list of ip addresses.  Each server_rec can be in possibly multiple
@@ -75,6 +106,12 @@ struct ipaddr_chain {
                                  * NVH'es names */
 };
 
+/* Name-vhost chains at least this long get a name_index.
+ */
+#ifndef VHOST_NAME_INDEX_MIN
+#define VHOST_NAME_INDEX_MIN 8
+#endif
+
 /* This defines the size of the hash table used for hashing ip addresses
  * of virtual hosts.  It must be a power of two.
  */
@@ -373,6 +410,7 @@ static name_chain *new_name_chain(apr_pool_t *p,
     new->server = s;
     new->sar = sar;
     new->next = NULL;
+    new->index = NULL;
     return new;
 }
 
@@ -431,6 +469,218 @@ static ipaddr_chain *find_default_server(apr_port_t port)
 #define IS_IN6_ANYADDR(ad) (0)
 #endif
 
+#define NAME_PORT_MATCHES(sar, port) \
+    ((sar)->host_port == 0 || (sar)->host_port == (port))
+
+static void name_index_add(apr_pool_t *p, apr_hash_t *h, const char *name,
+                           int pos, name_chain *nc)
+{
+    apr_array_header_t *cands;
+    name_cand *cand;
+    char *key;
+
+    key = apr_pstrdup(p, name);
+    ap_str_tolower(key);
+
+    cands = apr_hash_get(h, key, APR_HASH_KEY_STRING);
+    if (!cands) {
+        cands = apr_array_make(p, 1, sizeof(name_cand));
+        apr_hash_set(h, key, APR_HASH_KEY_STRING, cands);
+    }
+    else if (APR_ARRAY_IDX(cands, cands->nelts - 1, name_cand).pos == pos) {
+        /* same name given twice for this server */
+        return;
+    }
+
+    cand = apr_array_push(cands);
+    cand->pos = pos;
+    cand->nc = nc;
+}
+
+static void name_index_add_wild(apr_pool_t *p, name_index *ix,
+                                const char *name, int pos, name_chain *nc)
+{
+    const char *suffix = name;
+    wild_cand *wc;
+    int i, len;
+
+    /* "*foo" is a case-insensitive suffix match of "foo" (which may be
+     * empty), anything else is left to ap_strcasecmp_match()
+     */
+    while (*suffix == '*') {
+        ++suffix;
+    }
+    if (suffix != name && !ap_strchr_c(suffix, '*')
+        && !ap_strchr_c(suffix, '?')) {
+        name_index_add(p, ix->suffix, suffix, pos, nc);
+
+        len = strlen(suffix);
+        for (i = 0; i < ix->suffix_lens->nelts; ++i) {
+            if (APR_ARRAY_IDX(ix->suffix_lens, i, int) == len) {
+                return;
+            }
+        }
+        APR_ARRAY_PUSH(ix->suffix_lens, int) = len;
+        return;
+    }
+
+    wc = apr_array_push(ix->wild);
+    wc->pattern = name;
+    wc->cand.pos = pos;
+    wc->cand.nc = nc;
+}
+
+static name_index *make_name_index(apr_pool_t *p, name_chain *names)
+{
+    name_index *ix;
+    name_chain *nc;
+    int n, pos, i;
+
+    for (n = 0, nc = names; nc; nc = nc->next) {
+        ++n;
+    }
+    if (n < VHOST_NAME_INDEX_MIN) {
+        return NULL;
+    }
+
+    ix = apr_palloc(p, sizeof(*ix));
+    ix->nentries = n;
+    ix->entries = apr_palloc(p, n * sizeof(name_chain *));
+    ix->exact = apr_hash_make(p);
+    ix->suffix = apr_hash_make(p);
+    ix->suffix_lens = apr_array_make(p, 2, sizeof(int));
+    ix->wild = apr_array_make(p, 2, sizeof(wild_cand));
+    ix->virthost = apr_hash_make(p);
+
+    for (pos = 0, nc = names; nc; nc = nc->next, ++pos) {
+        server_rec *s = nc->server;
+        char **name;
+
+        ix->entries[pos] = nc;
+        name_index_add(p, ix->virthost, nc->sar->virthost, pos, nc);
+        name_index_add(p, ix->exact, s->server_hostname, pos, nc);
+        if (s->names) {
+            name = (char **)s->names->elts;
+            for (i = 0; i < s->names->nelts; ++i) {
+                if (name[i]) {
+                    name_index_add(p, ix->exact, name[i], pos, nc);
+                }
+            }
+        }
+        if (s->wild_names) {
+            name = (char **)s->wild_names->elts;
+            for (i = 0; i < s->wild_names->nelts; ++i) {
+                if (name[i]) {
+                    name_index_add_wild(p, ix, name[i], pos, nc);
+                }
+            }
+        }
+    }
+
+    return ix;
+}
+
+/* position of the first candidate for key (before 'best') on this port */
+static int name_index_first(apr_hash_t *h, const char *key, apr_ssize_t klen,
+                            apr_port_t port, int best)
+{
+    apr_array_header_t *cands = apr_hash_get(h, key, klen);
+
+    if (cands) {
+        name_cand *cand = (name_cand *)cands->elts;
+        int i;
+
+        for (i = 0; i < cands->nelts && cand[i].pos < best; ++i) {
+            if (NAME_PORT_MATCHES(cand[i].nc->sar, port)) {
+                return cand[i].pos;
+            }
+        }
+    }
+    return best;
+}
+
+/* Same result as the name_chain walk in check_hostalias(): the first
+ * server of the chain whose ServerName/ServerAlias matches host, else
+ * (unless names_only) the first one whose VirtualHost address matches
+ * it, else NULL.
+ */
+static server_rec *name_index_lookup(const name_index *ix, const char *host,
+                                     apr_port_t port, int names_only,
+                                     apr_pool_t *p)
+{
+    apr_size_t len = strlen(host);
+    int best = ix->nentries;
+    int i;
+
+    for (i = 0; host[i]; ++i) {
+        if (apr_isupper(host[i])) {
+            char *lower = apr_pstrmemdup(p, host, len);
+            ap_str_tolower(lower);
+            host = lower;
+            break;
+        }
+    }
+
+    best = name_index_first(ix->exact, host, len, port, best);
+    for (i = 0; i < ix->suffix_lens->nelts; ++i) {
+        apr_size_t slen = APR_ARRAY_IDX(ix->suffix_lens, i, int);
+        if (slen <= len) {
+            best = name_index_first(ix->suffix, host + len - slen, slen,
+                                    port, best);
+        }
+    }
+    for (i = 0; i < ix->wild->nelts; ++i) {
+        wild_cand *wc = &APR_ARRAY_IDX(ix->wild, i, wild_cand);
+        if (wc->cand.pos >= best) {
+            break;
+        }
+        if (NAME_PORT_MATCHES(wc->cand.nc->sar, port)
+            && !ap_strcasecmp_match(host, wc->pattern)) {
+            best = wc->cand.pos;
+            break;
+        }
+    }
+    if (best < ix->nentries) {
+        return ix->entries[best]->server;
+    }
+    if (names_only) {
+        return NULL;
+    }
+
+    best = name_index_first(ix->virthost, host, len, port, best);
+    if (best < ix->nentries) {
+        return ix->entries[best]->server;
+    }
+
+    return NULL;
+}
+
+static void dump_name_index(apr_file_t *f, const name_index *ix)
+{
+    apr_hash_t *tables[3];
+    int i, longest = 0;
+
+    tables[0] = ix->exact;
+    tables[1] = ix->suffix;
+    tables[2] = ix->virthost;
+    for (i = 0; i < 3; ++i) {
+        apr_hash_index_t *hi;
+        for (hi = apr_hash_first(NULL, tables[i]); hi; hi = apr_hash_next(hi)) {
+            apr_array_header_t *cands = apr_hash_this_val(hi);
+            if (cands->nelts > longest) {
+                longest = cands->nelts;
+            }
+        }
+    }
+
+    apr_file_printf(f, "%8s name index: %d entries, %u names, %u suffixes "
+                    "(%d lengths), %d other wild aliases, %u addresses, "
+                    "at most %d servers per key\n", "", ix->nentries,
+                    apr_hash_count(ix->exact), apr_hash_count(ix->suffix),
+                    ix->suffix_lens->nelts, ix->wild->nelts,
+                    apr_hash_count(ix->virthost), longest);
+}
+
 static void dump_a_vhost(apr_file_t *f, ipaddr_chain *ic)
 {
     name_chain *nc;
@@ -459,6 +709,9 @@ static void dump_a_vhost(apr_file_t *f, ipaddr_chain *ic)
                     "%8s default server %s (%s:%u)\n",
                     buf, "", ic->server->server_hostname,
                     ic->server->defn_name, ic->server->defn_line_number);
+    if (ic->names->index) {
+        dump_name_index(f, ic->names->index);
+    }
     for (nc = ic->names; nc; nc = nc->next) {
         if (nc->sar->host_port) {
             apr_file_printf(f, "%8s port %u ", "", nc->sar->host_port);
@@ -551,6 +804,25 @@ static void add_name_vhost_config(apr_pool_t *p, server_rec *main_s,
    }
 }
 
+static void index_name_vhosts(apr_pool_t *p)
+{
+    ipaddr_chain *ic;
+    int i;
+
+    for (i = 0; i < IPHASH_TABLE_SIZE; ++i) {
+        for (ic = iphash_table[i]; ic; ic = ic->next) {
+            if (ic->names) {
+                ic->names->index = make_name_index(p, ic->names);
+            }
+        }
+    }
+    for (ic = default_list; ic; ic = ic->next) {
+        if (ic->names) {
+            ic->names->index = make_name_index(p, ic->names);
+        }
+    }
+}
+
 /* compile the tables and such we need to do the run-time vhost lookups */
 AP_DECLARE(void) ap_fini_vhost_config(apr_pool_t *p, server_rec *main_s)
 {
@@ -667,6 +939,9 @@ AP_DECLARE(void) ap_fini_vhost_config(apr_pool_t *p, server_rec *main_s)
         }
     }
 
+    /* now that all the names are known, index the long name-vhost chains */
+    index_name_vhosts(p);
+
 #ifdef IPHASH_STATISTICS
     dump_iphash_statistics(main_s);
 #endif
@@ -1008,6 +1283,15 @@ static void check_hostalias(request_rec *r)
 
     port = r->connection->local_addr->port;
 
+    src = r->connection->vhost_lookup_data;
+    if (src->index) {
+        s = name_index_lookup(src->index, host, port, 0, r->pool);
+        if (s) {
+            goto found;
+        }
+        return;
+    }
+
     /* Recall that the name_chain is a list of server_addr_recs, some of
      * whose ports may not match.  Also each server may appear more than
      * once in the chain -- specifically, it will appear once for each
@@ -1242,6 +1526,48 @@ AP_DECLARE(int) ap_vhost_iterate_given_conn(conn_rec *conn,
     return rv;
 }
 
+AP_DECLARE(server_rec *) ap_vhost_find_given_conn(conn_rec *conn,
+                                                  const char *host)
+{
+    server_rec *s;
+    server_rec *last_s;
+    name_chain *src;
+    apr_port_t port;
+
+    src = conn->vhost_lookup_data;
+    if (!src) {
+        return matches_aliases(conn->base_server, host) ? conn->base_server
+                                                        : NULL;
+    }
+
+    port = conn->local_addr->port;
+    if (src->index) {
+        return name_index_lookup(src->index, host, port, 1, conn->pool);
+    }
+
+    last_s = NULL;
+    for (; src; src = src->next) {
+        server_addr_rec *sar;
+
+        sar = src->sar;
+        if (sar->host_port != 0 && port != sar->host_port) {
+            continue;
+        }
+
+        s = src->server;
+        if (s == last_s) {
+            continue;
+        }
+        last_s = s;
+
+        if (matches_aliases(s, host)) {
+            return s;
+        }
+    }
+
+    return NULL;
+}
+
 /* Called for a new connection which has a known local_addr.  Note that the
  * new connection is assumed to have conn->server == main server.
  */
@@ -0,0 +1,34 @@
+#
+# Licensed to the Apache Software Foundation (ASF) under one or more
+# contributor license agreements.  See the NOTICE file distributed with
+# this work for additional information regarding copyright ownership.
+# The ASF licenses this file to You under the Apache License, Version 2.0
+# (the "License"); you may not use this file except in compliance with
+# the License.  You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Functions of the time-*.sh scripts, which source this file. They measure
+# the CPU time used by a running httpd whose pidfile is $PIDFILE, from /proc
+# (Linux only).
+#
+
+# user+system time of the parent and the children, in clock ticks
+cpu_ticks() {
+    PARENT=`cat $PIDFILE`
+    for pid in $PARENT `pgrep -P $PARENT` ; do
+        cut -d' ' -f14,15 /proc/$pid/stat 2>/dev/null
+    done | awk '{ t += $1 + $2 } END { print t }'
+}
+
+# usec_per start end count: usec of CPU per operation, from the clock ticks
+# at the start and the end of count operations
+usec_per() {
+    expr \( $2 - $1 \) \* 1000000 / `getconf CLK_TCK` / $3
+}
@@ -0,0 +1,171 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+time-fdqueue.c drives the worker queue of the event MPM
+(server/mpm/event/fdqueue.c) in isolation, the way the listener and
+worker threads do: a single "listener" thread waits for an idle worker
+(ap_queue_info_wait_for_idler) and pushes a (fake) socket, the workers
+mark themselves idle (ap_queue_info_set_idle) and pop.
+
+argv[1] is the #pushes per run, 1000000 by default, argv[2] the number
+of worker threads, 512 by default (ThreadsPerChild), and argv[3] the
+amount of "work" (loop iterations) per popped entry, 0 by default.  Each
+run uses 1, 2, 4, 8, 16 then 32 shards (WorkerQueueShards), and prints
+the pushes per second and how often the listener had to block.
+
+compile with (from a configured source tree):
+
+gcc -o time-fdqueue -Wall -O2 -I../include -I../os/unix \
+    -I../server/mpm/event \
+    `apr-1-config --cflags --cppflags --includes` \
+    time-fdqueue.c ../server/mpm/event/fdqueue.c \
+    `apr-1-config --link-ld --libs`
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+
+#include "fdqueue.h"
+
+static fd_queue_t *queue;
+static fd_queue_info_t *queue_info;
+static volatile int work_sink;
+static int work;
+
+typedef struct {
+    unsigned int slot;
+    unsigned long popped;
+} worker_t;
+
+static void *APR_THREAD_FUNC worker(apr_thread_t *thd, void *data)
+{
+    worker_t *w = data;
+
+    for (;;) {
+        apr_socket_t *sd = NULL;
+        event_conn_state_t *ecs;
+        apr_pool_t *p;
+        timer_event_t *te;
+        apr_status_t rv;
+        int i;
+
+        if (ap_queue_info_set_idle(queue_info, NULL) != APR_SUCCESS) {
+            break;
+        }
+        do {
+            rv = ap_queue_pop_something(queue, w->slot, &sd, &ecs, &p, &te);
+        } while (APR_STATUS_IS_EINTR(rv));
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        for (i = 0; i < work; i++) {
+            work_sink += i;
+        }
+        w->popped++;
+    }
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void run(apr_pool_t *pool, int nshards, int nthreads,
+                unsigned long iterations)
+{
+    apr_pool_t *p;
+    apr_thread_t **threads;
+    worker_t *workers;
+    unsigned long i, blocked = 0, popped = 0;
+    apr_time_t start, end;
+    apr_status_t rv;
+    int t;
+
+    apr_pool_create(&p, pool);
+    queue = apr_pcalloc(p, sizeof(*queue));
+    ap_queue_init(queue, nthreads, nshards, p);
+    ap_queue_info_create(&queue_info, p, nthreads, -1);
+
+    threads = apr_pcalloc(p, nthreads * sizeof(*threads));
+    workers = apr_pcalloc(p, nthreads * sizeof(*workers));
+    for (t = 0; t < nthreads; t++) {
+        workers[t].slot = t;
+        apr_thread_create(&threads[t], NULL, worker, &workers[t], p);
+    }
+
+    start = apr_time_now();
+    for (i = 0; i < iterations; i++) {
+        int had_to_block = 0;
+
+        ap_queue_info_wait_for_idler(queue_info, &had_to_block);
+        blocked += had_to_block;
+        ap_queue_push(queue, (apr_socket_t *)&queue, NULL, NULL);
+    }
+    ap_queue_term(queue);
+    ap_queue_info_term(queue_info);
+    for (t = 0; t < nthreads; t++) {
+        apr_thread_join(&rv, threads[t]);
+        popped += workers[t].popped;
+    }
+    end = apr_time_now();
+
+    printf("%2d shard(s): %9.0f pushes/s, %5.2f%% blocked%s\n",
+           queue->nshards,
+           (double)iterations * APR_USEC_PER_SEC / (end - start + 1),
+           100.0 * blocked / iterations,
+           popped == iterations ? "" : " (LOST ENTRIES)");
+
+    apr_pool_destroy(p);
+}
+
+int main(int argc, const char *const *argv)
+{
+    static const int shards[] = { 1, 2, 4, 8, 16, 32 };
+    unsigned long iterations = 1000000;
+    int nthreads = 512;
+    apr_pool_t *pool;
+    int i;
+
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+
+    if (argc > 1) {
+        iterations = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        nthreads = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        work = atoi(argv[3]);
+    }
+
+    printf("%lu pushes, %d workers, %d work\n", iterations, nthreads, work);
+    for (i = 0; i < sizeof(shards) / sizeof(shards[0]); i++) {
+        if (shards[i] > nthreads) {
+            break;
+        }
+        run(pool, shards[i], nthreads, iterations);
+    }
+
+    apr_pool_destroy(pool);
+    apr_terminate();
+    return 0;
+}
@@ -0,0 +1,85 @@
+#!/bin/sh
+#
+# Licensed to the Apache Software Foundation (ASF) under one or more
+# contributor license agreements.  See the NOTICE file distributed with
+# this work for additional information regarding copyright ownership.
+# The ASF licenses this file to You under the Apache License, Version 2.0
+# (the "License"); you may not use this file except in compliance with
+# the License.  You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# This script measures the CPU time used by a running httpd per HTTP/2
+# stream (see time-common.sh), for:
+# - GET requests, with h2load,
+# - POST requests without content-length, with nghttp --no-content-length,
+#   whose bodies mod_http2 used to convert to HTTP/1 chunks and back.
+# Run it against the same server with "H2SerializeHeaders on" to compare
+# with the HTTP/1 serialization of the requests and responses.
+#
+# Syntax: time-h2.sh [-n streams] [-c clients] [-m max-concurrent]
+#                    [-b body-file] [-p pidfile] URL
+#
+H2LOAD=${H2LOAD:-h2load}
+NGHTTP=${NGHTTP:-nghttp}
+PIDFILE=${PIDFILE:-logs/httpd.pid}
+STREAMS=100000
+CLIENTS=10
+CONCURRENT=10
+BODY=
+
+args=`getopt n:c:m:b:p: $*`
+if [ $? != 0 ] ; then
+    echo "Syntax: $0 [-n streams] [-c clients] [-m max-concurrent] [-b body-file] [-p pidfile] URL"
+    exit 1
+fi
+set -- $args
+for i
+do
+    case "$i"
+    in
+        -n) STREAMS=$2; shift; shift;;
+        -c) CLIENTS=$2; shift; shift;;
+        -m) CONCURRENT=$2; shift; shift;;
+        -b) BODY=$2; shift; shift;;
+        -p) PIDFILE=$2; shift; shift;;
+        --) shift; break;;
+    esac
+done
+URL=$1
+if [ -z "$URL" -o ! -r "$PIDFILE" ] ; then
+    echo "$0: no URL given or no pidfile $PIDFILE"
+    exit 1
+fi
+if [ -z "$BODY" ] ; then
+    BODY=`mktemp`
+    trap "rm -f $BODY" 0
+    dd if=/dev/zero of=$BODY bs=1024 count=16 2>/dev/null
+fi
+
+. `dirname $0`/time-common.sh
+
+report() {
+    echo "$1: $STREAMS streams, `usec_per $2 $3 $STREAMS` usec CPU per stream"
+}
+
+start=`cpu_ticks`
+$H2LOAD -n $STREAMS -c $CLIENTS -m $CONCURRENT "$URL" >/dev/null || exit 1
+report "GET" $start `cpu_ticks`
+
+# one connection per client, each requesting the URL STREAMS/CLIENTS times
+start=`cpu_ticks`
+i=0
+while [ $i -lt $CLIENTS ] ; do
+    $NGHTTP -n -m `expr $STREAMS / $CLIENTS` -d $BODY --no-content-length \
+        "$URL" >/dev/null &
+    i=`expr $i + 1`
+done
+wait
+report "POST `wc -c < $BODY` bytes, no content-length" $start `cpu_ticks`
@@ -0,0 +1,180 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+time-proxy-worker.c compares the lookup of the worker matching a URL, as
+done by ap_proxy_get_worker(), between the linear scan of the worker names
+(longest prefix, on a lowercased copy of the URL) and the name trie that
+mod_proxy builds at post_config (modules/proxy/proxy_trie.c).
+
+argv[1] is the #iterations (lookups) per run, 1000000 by default. Each
+run uses 10, 1000 then 10000 workers named like
+"http://backendN.example.com:8080/appN", and looks up URLs below them,
+plus some which don't match any worker.
+
+compile with:
+
+gcc -o time-proxy-worker -Wall -O2 -I../modules/proxy \
+    `apr-1-config --cflags --cppflags --includes` \
+    time-proxy-worker.c ../modules/proxy/proxy_trie.c \
+    `apr-1-config --link-ld --libs`
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_lib.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+
+#include "proxy_trie.h"
+
+#define NUM_URLS 1024
+
+/* what ap_proxy_get_worker() did for every request */
+static int scan_lookup(apr_pool_t *p, const char **names, int nnames,
+                       const char *url)
+{
+    int url_length = strlen(url);
+    char *url_copy = apr_pstrmemdup(p, url, url_length);
+    const char *c = strchr(strchr(url, ':') + 3, '/');
+    int min_match, max_match = 0, max_pos = -1, i;
+
+    if (c) {
+        char *pathstart = url_copy + (c - url);
+        *pathstart = '\0';
+        for (i = 0; url_copy[i]; i++) {
+            url_copy[i] = apr_tolower(url_copy[i]);
+        }
+        min_match = strlen(url_copy);
+        *pathstart = '/';
+    }
+    else {
+        for (i = 0; url_copy[i]; i++) {
+            url_copy[i] = apr_tolower(url_copy[i]);
+        }
+        min_match = url_length;
+    }
+
+    for (i = 0; i < nnames; i++) {
+        int len = strlen(names[i]);
+        if (len <= url_length && len >= min_match && len > max_match
+            && strncmp(url_copy, names[i], len) == 0) {
+            max_pos = i;
+            max_match = len;
+        }
+    }
+
+    return max_pos;
+}
+
+static int trie_lookup(const proxy_trie_t *trie, const char *url)
+{
+    const char *c = strchr(strchr(url, ':') + 3, '/');
+    apr_size_t min_match = c ? (apr_size_t)(c - url) : strlen(url);
+    apr_size_t len;
+    int pos = proxy_trie_longest_prefix(trie, url, min_match, &len);
+
+    return (pos >= 0 && len >= min_match) ? pos : -1;
+}
+
+static void run(apr_pool_t *pool, int nworkers, long iterations)
+{
+    apr_pool_t *p, *rp;
+    const char **names, **urls;
+    proxy_trie_t *trie;
+    apr_time_t start, scan_time, trie_time;
+    long n, found = 0;
+    int i;
+
+    apr_pool_create(&p, pool);
+    apr_pool_create(&rp, p);
+
+    names = apr_palloc(p, nworkers * sizeof(*names));
+    trie = proxy_trie_make(p);
+    for (i = 0; i < nworkers; i++) {
+        names[i] = apr_psprintf(p, "http://backend%d.example.com:8080/app%d",
+                                i % 97, i);
+        proxy_trie_insert(trie, names[i], i);
+    }
+
+    urls = apr_palloc(p, NUM_URLS * sizeof(*urls));
+    for (i = 0; i < NUM_URLS; i++) {
+        int w = rand() % nworkers;
+        if (i % 8 == 0) {
+            urls[i] = apr_psprintf(p, "http://unknown%d.example.com/app%d", i, w);
+        }
+        else {
+            urls[i] = apr_psprintf(p, "http://Backend%d.Example.com:8080/"
+                                   "app%d/some/path/%d.html", w % 97, w, i);
+        }
+        if (scan_lookup(rp, names, nworkers, urls[i]) != trie_lookup(trie, urls[i])) {
+            fprintf(stderr, "mismatch for %s\n", urls[i]);
+            exit(1);
+        }
+    }
+
+    start = apr_time_now();
+    for (n = 0; n < iterations; n++) {
+        found += scan_lookup(rp, names, nworkers, urls[n % NUM_URLS]) >= 0;
+        if (n % NUM_URLS == 0) {
+            apr_pool_clear(rp); /* like r->pool */
+        }
+    }
+    scan_time = apr_time_now() - start;
+
+    start = apr_time_now();
+    for (n = 0; n < iterations; n++) {
+        found -= trie_lookup(trie, urls[n % NUM_URLS]) >= 0;
+    }
+    trie_time = apr_time_now() - start;
+
+    printf("%6d workers: scan %10.1f ns/lookup, trie %8.1f ns/lookup%s\n",
+           nworkers, (double)scan_time * 1000 / iterations,
+           (double)trie_time * 1000 / iterations,
+           found ? " (results differ!)" : "");
+
+    apr_pool_destroy(p);
+}
+
+int main(int argc, const char * const argv[])
+{
+    apr_pool_t *pool;
+    long iterations = 1000000;
+
+    if (argc > 1) {
+        iterations = atol(argv[1]);
+    }
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+
+    run(pool, 10, iterations);
+    run(pool, 1000, iterations / 10);
+    run(pool, 10000, iterations / 100);
+
+    apr_pool_destroy(pool);
+    apr_terminate();
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+#!/bin/sh
+#
+# Licensed to the Apache Software Foundation (ASF) under one or more
+# contributor license agreements.  See the NOTICE file distributed with
+# this work for additional information regarding copyright ownership.
+# The ASF licenses this file to You under the Apache License, Version 2.0
+# (the "License"); you may not use this file except in compliance with
+# the License.  You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# This script compares the CPU time used per request for a rewrite-heavy
+# configuration by httpd builds from before and after a change (like the
+# PCRE JIT and the match data reuse of ap_regex).
+#
+# Each apachectl given is started in turn, after the previous one was
+# stopped, with the configuration written to the given include file, which
+# the configurations of all the builds must Include at server level, e.g.
+#     Include /tmp/time-regex.conf
+# along with the same Listen and PidFile. The configuration has -r
+# RewriteRules that do not match the requested URL, then one that does,
+# and a LocationMatch, SetEnvIf and Header with regexes, so that each
+# request runs about -r + 4 regexes. mod_rewrite, mod_setenvif and
+# mod_headers need to be loaded. The URL's path should be /time-regex/...
+# With -o, the configuration also has "RegexDefaultOptions options" (e.g.
+# -o -JIT), which the builds from before the change do not know.
+#
+# Syntax: time-regex.sh [-n requests] [-c concurrency] [-r rules]
+#                       [-o regex-options] [-p pidfile]
+#                       include-file URL apachectl...
+#
+AB=${AB:-ab}
+PIDFILE=${PIDFILE:-logs/httpd.pid}
+REQUESTS=100000
+CONCURRENCY=10
+RULES=100
+OPTIONS=
+
+args=`getopt n:c:r:o:p: $*`
+if [ $? != 0 ] ; then
+    echo "Syntax: $0 [-n requests] [-c concurrency] [-r rules] [-o regex-options] [-p pidfile] include-file URL apachectl..."
+    exit 1
+fi
+set -- $args
+for i
+do
+    case "$i"
+    in
+        -n) REQUESTS=$2; shift; shift;;
+        -c) CONCURRENCY=$2; shift; shift;;
+        -r) RULES=$2; shift; shift;;
+        -o) OPTIONS=$2; shift; shift;;
+        -p) PIDFILE=$2; shift; shift;;
+        --) shift; break;;
+    esac
+done
+CONF=$1
+URL=$2
+if [ -z "$CONF" -o -z "$URL" -o -z "$3" ] ; then
+    echo "$0: no include file, URL or apachectl given"
+    exit 1
+fi
+shift; shift
+
+. `dirname $0`/time-common.sh
+
+write_conf() {
+    if [ -n "$OPTIONS" ] ; then
+        echo "RegexDefaultOptions $OPTIONS"
+    fi
+    echo "RewriteEngine on"
+    i=0
+    while [ $i -lt $RULES ] ; do
+        echo "RewriteRule \"^/app$i/([a-z]+)/(\\d+)(?:/(.*))?\$\" /index.html?c=\$1&id=\$2 [L]"
+        i=`expr $i + 1`
+    done
+    echo "RewriteRule \"^/time-regex/([^/]+)/?(.*)\$\" /\$1 [L]"
+    echo "<LocationMatch \"^/(?<sect>[a-z]+)(?:\\.html)?\$\">"
+    echo "    SetEnvIf User-Agent \"(?i)(bot|crawl|spider|ApacheBench)\" is_bot"
+    echo "    Header set X-Section \"%{MATCH_SECT}e\""
+    echo "</LocationMatch>"
+}
+
+write_conf > $CONF
+for APACHECTL
+do
+    $APACHECTL -k start || exit 1
+    sleep 2
+    $AB -q -n 1000 -c $CONCURRENCY "$URL" >/dev/null || exit 1
+    start=`cpu_ticks`
+    $AB -q -n $REQUESTS -c $CONCURRENCY "$URL" >/dev/null || exit 1
+    end=`cpu_ticks`
+    echo "$APACHECTL, $RULES rules: $REQUESTS requests, `usec_per $start $end $REQUESTS` usec CPU per request"
+    $APACHECTL -k stop
+    sleep 2
+done
@@ -0,0 +1,240 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+time-shmcb.c measures the store and retrieve operations of the "shmcb"
+shared object cache (modules/cache/mod_socache_shmcb.c), whose source is
+included here with stubs for the few httpd functions it calls.
+
+argv[1] is the #operations per run, 1000000 by default, and argv[2] the
+largest cache size in MB, 64 by default.  Each run uses a cache of 1MB,
+then 4 times larger up to that size, and ids of 16, 32 then 64 bytes
+(SSL session ids are 32) with 150 bytes of data.  The cache is filled
+before the stores are timed, so that they also account for the entries
+scrolled out, then the retrieves look up the ids stored last (mostly
+hits, the ones scrolled out are misses).
+
+compile with (from a configured source tree):
+
+gcc -o time-shmcb -Wall -O2 -I../include -I../os/unix \
+    -I../modules/generators -I../modules/cache \
+    `apr-1-config --cflags --cppflags --includes` \
+    `apu-1-config --includes` \
+    time-shmcb.c \
+    `apr-1-config --link-ld --libs`
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* no debug logging calls */
+#define APLOG_MAX_LOGLEVEL APLOG_ERR
+
+#include "mod_socache_shmcb.c"
+
+#define DATA_LEN 150
+
+AP_DECLARE(void) ap_log_error_(const char *file, int line, int module_index,
+                               int level, apr_status_t status,
+                               const server_rec *s, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+}
+
+AP_DECLARE(void) ap_log_perror_(const char *file, int line, int module_index,
+                                int level, apr_status_t status, apr_pool_t *p,
+                                const char *fmt, ...)
+{
+}
+
+AP_DECLARE(void) ap_log_rerror_(const char *file, int line, int module_index,
+                                int level, apr_status_t status,
+                                const request_rec *r, const char *fmt, ...)
+{
+}
+
+AP_DECLARE(char *) ap_runtime_dir_relative(apr_pool_t *p, const char *fname)
+{
+    return apr_pstrdup(p, fname);
+}
+
+AP_DECLARE(int) ap_rwrite(const void *buf, int nbyte, request_rec *r)
+{
+    return nbyte;
+}
+
+AP_DECLARE_NONSTD(int) ap_rprintf(request_rec *r, const char *fmt, ...)
+{
+    return 0;
+}
+
+AP_DECLARE(apr_status_t) ap_register_provider(apr_pool_t *pool,
+                                              const char *provider_group,
+                                              const char *provider_name,
+                                              const char *provider_version,
+                                              const void *provider)
+{
+    return APR_SUCCESS;
+}
+
+AP_DECLARE(void) ap_hook_pre_config(ap_HOOK_pre_config_t *pf,
+                                    const char * const *aszPre,
+                                    const char * const *aszSucc, int nOrder)
+{
+}
+
+AP_DECLARE(void) ap_hook_child_init(ap_HOOK_child_init_t *pf,
+                                    const char * const *aszPre,
+                                    const char * const *aszSucc, int nOrder)
+{
+}
+
+AP_DECLARE(apr_status_t) ap_mutex_register(apr_pool_t *pconf,
+                                           const char *type,
+                                           const char *default_dir,
+                                           apr_lockmech_e default_mech,
+                                           apr_int32_t options)
+{
+    return APR_SUCCESS;
+}
+
+AP_DECLARE(apr_status_t) ap_global_mutex_create(apr_global_mutex_t **mutex,
+                                                const char **name,
+                                                const char *type,
+                                                const char *instance_id,
+                                                server_rec *server,
+                                                apr_pool_t *pool,
+                                                apr_int32_t options)
+{
+    return APR_ENOTIMPL;
+}
+
+static void make_id(unsigned char *id, unsigned int idlen, apr_uint64_t n)
+{
+    unsigned int i;
+
+    /* like random session ids, the first byte selects the subcache */
+    for (i = 0; i < idlen; i++) {
+        n = n * APR_UINT64_C(6364136223846793005)
+              + APR_UINT64_C(1442695040888963407);
+        id[i] = (unsigned char)(n >> 56);
+    }
+}
+
+static void run(apr_pool_t *pool, apr_size_t size, unsigned int idlen,
+                unsigned long iterations)
+{
+    const ap_socache_provider_t *provider = &socache_shmcb;
+    struct ap_socache_hints hints;
+    ap_socache_instance_t *instance;
+    server_rec *s;
+    apr_pool_t *p;
+    unsigned char id[64], data[DATA_LEN], dest[DATA_LEN];
+    unsigned long i, entries, stored, hits = 0;
+    apr_time_t start, mid, end, expiry;
+    const char *err;
+
+    apr_pool_create(&p, pool);
+    s = apr_pcalloc(p, sizeof(*s));
+    memset(data, 'x', sizeof(data));
+
+    err = provider->create(&instance,
+                           apr_psprintf(p, "time-shmcb(%" APR_SIZE_T_FMT ")",
+                                        size),
+                           p, p);
+    if (err) {
+        fprintf(stderr, "create: %s\n", err);
+        exit(1);
+    }
+    hints.avg_id_len = idlen;
+    hints.avg_obj_size = DATA_LEN;
+    hints.expiry_interval = 0;
+    if (provider->init(instance, "time-shmcb", &hints, s, p) != APR_SUCCESS) {
+        fprintf(stderr, "init failed\n");
+        exit(1);
+    }
+    expiry = apr_time_now() + apr_time_from_sec(3600);
+
+    /* fill it */
+    entries = instance->header->subcache_num * instance->header->index_num;
+    for (stored = 0; stored < entries; stored++) {
+        make_id(id, idlen, stored);
+        provider->store(instance, s, id, idlen, expiry, data, DATA_LEN, p);
+    }
+
+    start = apr_time_now();
+    for (i = 0; i < iterations; i++) {
+        make_id(id, idlen, stored + i);
+        provider->store(instance, s, id, idlen, expiry, data, DATA_LEN, p);
+    }
+    stored += iterations;
+    mid = apr_time_now();
+    for (i = 0; i < iterations; i++) {
+        unsigned int destlen = sizeof(dest);
+
+        make_id(id, idlen, stored - 1 - (i % entries));
+        if (provider->retrieve(instance, s, id, idlen, dest, &destlen,
+                               p) == APR_SUCCESS) {
+            hits++;
+        }
+    }
+    end = apr_time_now();
+
+    printf("%4" APR_SIZE_T_FMT "MB, id %2u, %8lu entries: "
+           "%9.0f stores/s, %9.0f retrieves/s (%5.2f%% hits)\n",
+           size >> 20, idlen, entries,
+           (double)iterations * APR_USEC_PER_SEC / (mid - start + 1),
+           (double)iterations * APR_USEC_PER_SEC / (end - mid + 1),
+           100.0 * hits / iterations);
+
+    provider->destroy(instance, s);
+    apr_pool_destroy(p);
+}
+
+int main(int argc, const char *const *argv)
+{
+    static const unsigned int idlens[] = { 16, 32, 64 };
+    unsigned long iterations = 1000000;
+    apr_size_t size, max_size = 64;
+    apr_pool_t *pool;
+    int i;
+
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+
+    if (argc > 1) {
+        iterations = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        max_size = strtoul(argv[2], NULL, 10);
+    }
+
+    for (size = 1; size <= max_size; size *= 4) {
+        for (i = 0; i < sizeof(idlens) / sizeof(idlens[0]); i++) {
+            run(pool, size << 20, idlens[i], iterations);
+        }
+    }
+
+    apr_pool_destroy(pool);
+    apr_terminate();
+    return 0;
+}